@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+#include "nx-v4l2-stats.h"
+#include "nx-v4l2-3a.h"
+
+#ifndef V4L2_CID_ANALOGUE_GAIN
+#define V4L2_CID_ANALOGUE_GAIN	(V4L2_CID_IMAGE_SOURCE_CLASS_BASE + 3)
+#endif
+
+#define MAX_3A_CTRLS		4
+
+/* a control write which is held back until the sequence is reached */
+struct pending_ctrls {
+	bool valid;
+	uint32_t sequence;
+	int count;
+	struct v4l2_ext_control ctrls[MAX_3A_CTRLS];
+};
+
+struct nx_v4l2_3a {
+	struct nx_v4l2_3a_config cfg;
+	nx_v4l2_3a_writer writer;
+	void *priv;
+	int fd;
+	struct nx_v4l2_3a_state state;
+	uint32_t settled;
+	uint32_t ae_stable;
+	uint32_t awb_stable;
+	/* 0 for exposure, 1 for gain and white balance */
+	struct pending_ctrls pending[2];
+};
+
+static int32_t clamp32(double v, int32_t min, int32_t max)
+{
+	if (v < min)
+		return min;
+	if (v > max)
+		return max;
+	return (int32_t)(v + 0.5);
+}
+
+static int write_subdev(void *priv, struct v4l2_ext_control *ctrls,
+			int count)
+{
+	struct nx_v4l2_3a *aaa = priv;
+
+	if (nx_v4l2_set_ext_ctrls(aaa->fd, nx_sensor_subdev, ctrls, count))
+		return -errno;
+
+	return 0;
+}
+
+void nx_v4l2_3a_default_config(struct nx_v4l2_3a_config *cfg)
+{
+	bzero(cfg, sizeof(*cfg));
+	cfg->target = 118;
+	cfg->tolerance = 4;
+	cfg->damping = 50;
+	cfg->converge_frames = 3;
+	cfg->exposure_min = 1;
+	cfg->exposure_max = 1125;
+	cfg->gain_min = 16;
+	cfg->gain_max = 256;
+	cfg->gain_unit = 16;
+	cfg->wb_min = 128;
+	cfg->wb_max = 1024;
+	cfg->wb_unit = 256;
+	cfg->exposure_delay = 2;
+	cfg->gain_delay = 1;
+	cfg->awb = true;
+}
+
+struct nx_v4l2_3a *nx_v4l2_3a_create(int fd,
+				     const struct nx_v4l2_3a_config *cfg)
+{
+	struct nx_v4l2_3a *aaa;
+	int value;
+
+	if (cfg->exposure_min <= 0 || cfg->exposure_min > cfg->exposure_max ||
+	    cfg->gain_unit <= 0 || cfg->gain_min > cfg->gain_max ||
+	    cfg->wb_unit <= 0 || cfg->wb_min > cfg->wb_max ||
+	    !cfg->damping || cfg->damping > 100 ||
+	    cfg->exposure_delay < 0 || cfg->gain_delay < 0) {
+		fprintf(stderr, "%s: invalid config\n", __func__);
+		return NULL;
+	}
+
+	aaa = calloc(1, sizeof(*aaa));
+	if (!aaa)
+		return NULL;
+
+	aaa->cfg = *cfg;
+	aaa->fd = fd;
+	aaa->writer = write_subdev;
+	aaa->priv = aaa;
+
+	aaa->state.exposure = clamp32(cfg->exposure_max / 4,
+				      cfg->exposure_min, cfg->exposure_max);
+	aaa->state.gain = clamp32(cfg->gain_unit, cfg->gain_min,
+				  cfg->gain_max);
+	aaa->state.red = clamp32(cfg->wb_unit, cfg->wb_min, cfg->wb_max);
+	aaa->state.blue = aaa->state.red;
+
+	/* start from what the sensor has now */
+	if (fd >= 0) {
+		if (!nx_v4l2_get_ctrl(fd, nx_sensor_subdev, V4L2_CID_EXPOSURE,
+				      &value))
+			aaa->state.exposure = value;
+		if (!nx_v4l2_get_ctrl(fd, nx_sensor_subdev,
+				      V4L2_CID_ANALOGUE_GAIN, &value))
+			aaa->state.gain = value;
+		if (cfg->awb &&
+		    !nx_v4l2_get_ctrl(fd, nx_sensor_subdev,
+				      V4L2_CID_RED_BALANCE, &value))
+			aaa->state.red = value;
+		if (cfg->awb &&
+		    !nx_v4l2_get_ctrl(fd, nx_sensor_subdev,
+				      V4L2_CID_BLUE_BALANCE, &value))
+			aaa->state.blue = value;
+	}
+
+	return aaa;
+}
+
+void nx_v4l2_3a_destroy(struct nx_v4l2_3a *aaa)
+{
+	free(aaa);
+}
+
+void nx_v4l2_3a_set_writer(struct nx_v4l2_3a *aaa, nx_v4l2_3a_writer writer,
+			   void *priv)
+{
+	aaa->writer = writer ? writer : write_subdev;
+	aaa->priv = writer ? priv : aaa;
+}
+
+void nx_v4l2_3a_get_state(struct nx_v4l2_3a *aaa,
+			  struct nx_v4l2_3a_state *state)
+{
+	*state = aaa->state;
+}
+
+static void add_ctrl(struct pending_ctrls *p, uint32_t id, int32_t value)
+{
+	p->ctrls[p->count].id = id;
+	p->ctrls[p->count].value = value;
+	p->count++;
+}
+
+/* returns true if exposure or gain is changed */
+static bool update_ae(struct nx_v4l2_3a *aaa,
+		      const struct nx_v4l2_stats *stats)
+{
+	const struct nx_v4l2_3a_config *cfg = &aaa->cfg;
+	struct nx_v4l2_3a_state *st = &aaa->state;
+	uint32_t err = abs((int)stats->mean - (int)cfg->target);
+	double total, target, ratio;
+	int32_t exposure, gain;
+
+	st->mean = stats->mean;
+
+	if (st->ae_converged && err <= 2 * cfg->tolerance)
+		return false;
+	st->ae_converged = false;
+
+	if (err <= cfg->tolerance) {
+		if (++aaa->ae_stable >= cfg->converge_frames)
+			st->ae_converged = true;
+		return false;
+	}
+	aaa->ae_stable = 0;
+
+	/* a clipped histogram hides how far off we are, limit the step */
+	if (stats->mean == 0)
+		ratio = 4.0;
+	else
+		ratio = (double)cfg->target / stats->mean;
+	if (ratio > 4.0)
+		ratio = 4.0;
+	if (ratio < 0.25)
+		ratio = 0.25;
+	if (stats->samples && stats->over > stats->samples / 4 &&
+	    ratio > 0.5)
+		ratio = 0.5;
+
+	total = (double)st->exposure * st->gain / cfg->gain_unit;
+	target = total * ratio;
+	total += (target - total) * cfg->damping / 100;
+
+	exposure = clamp32(total, cfg->exposure_min, cfg->exposure_max);
+	gain = clamp32(total / exposure * cfg->gain_unit, cfg->gain_min,
+		       cfg->gain_max);
+	if (exposure == st->exposure && gain == st->gain) {
+		/* damping asked for less than a step, still take one */
+		if (stats->mean < cfg->target) {
+			if (exposure < cfg->exposure_max)
+				exposure++;
+			else if (gain < cfg->gain_max)
+				gain++;
+			else
+				return false;
+		} else {
+			if (gain > cfg->gain_min)
+				gain--;
+			else if (exposure > cfg->exposure_min)
+				exposure--;
+			else
+				return false;
+		}
+	}
+
+	st->exposure = exposure;
+	st->gain = gain;
+	return true;
+}
+
+/* returns true if white balance is changed */
+static bool update_awb(struct nx_v4l2_3a *aaa,
+		       const struct nx_v4l2_stats *stats)
+{
+	const struct nx_v4l2_3a_config *cfg = &aaa->cfg;
+	struct nx_v4l2_3a_state *st = &aaa->state;
+	double y = 0, u = 0, v = 0, r, g, b;
+	uint32_t i, n = 0, cells = stats->grid_cols * stats->grid_rows;
+	double err;
+	int32_t red, blue;
+
+	/* gray world over the well exposed cells */
+	for (i = 0; i < cells; i++) {
+		if (stats->y[i] < 32 || stats->y[i] > 220)
+			continue;
+		y += stats->y[i];
+		u += stats->u[i];
+		v += stats->v[i];
+		n++;
+	}
+	if (!n)
+		return false;
+
+	y = y / n - 16;
+	u = u / n - 128;
+	v = v / n - 128;
+	err = u * u > v * v ? (u < 0 ? -u : u) : (v < 0 ? -v : v);
+
+	if (st->awb_converged && err <= 4)
+		return false;
+	st->awb_converged = false;
+
+	if (err <= 2) {
+		if (++aaa->awb_stable >= cfg->converge_frames)
+			st->awb_converged = true;
+		return false;
+	}
+	aaa->awb_stable = 0;
+
+	r = 1.164 * y + 1.596 * v;
+	g = 1.164 * y - 0.392 * u - 0.813 * v;
+	b = 1.164 * y + 2.017 * u;
+	if (r <= 0 || g <= 0 || b <= 0)
+		return false;
+
+	red = clamp32(st->red + (st->red * g / r - st->red) *
+		      cfg->damping / 100, cfg->wb_min, cfg->wb_max);
+	blue = clamp32(st->blue + (st->blue * g / b - st->blue) *
+		       cfg->damping / 100, cfg->wb_min, cfg->wb_max);
+	if (red == st->red && blue == st->blue)
+		return false;
+
+	st->red = red;
+	st->blue = blue;
+	return true;
+}
+
+static int flush_pending(struct nx_v4l2_3a *aaa, uint32_t sequence)
+{
+	struct v4l2_ext_control ctrls[2 * MAX_3A_CTRLS];
+	int count = 0;
+	int i, j;
+
+	for (i = 0; i < 2; i++) {
+		struct pending_ctrls *p = &aaa->pending[i];
+
+		if (!p->valid || (int32_t)(sequence - p->sequence) < 0)
+			continue;
+		for (j = 0; j < p->count; j++)
+			ctrls[count++] = p->ctrls[j];
+		p->valid = false;
+	}
+
+	return count ? aaa->writer(aaa->priv, ctrls, count) : 0;
+}
+
+int nx_v4l2_3a_process(struct nx_v4l2_3a *aaa,
+		       const struct nx_v4l2_stats *stats, uint32_t sequence)
+{
+	const struct nx_v4l2_3a_config *cfg = &aaa->cfg;
+	struct nx_v4l2_3a_state *st = &aaa->state;
+	struct pending_ctrls *exp = &aaa->pending[0];
+	struct pending_ctrls *gain = &aaa->pending[1];
+	int max_delay = cfg->exposure_delay > cfg->gain_delay ?
+			cfg->exposure_delay : cfg->gain_delay;
+	bool ae, awb = false;
+
+	/* the frame was taken before the last update took effect */
+	if ((int32_t)(sequence - aaa->settled) < 0 ||
+	    exp->valid || gain->valid)
+		return flush_pending(aaa, sequence);
+
+	ae = update_ae(aaa, stats);
+	if (cfg->awb)
+		awb = update_awb(aaa, stats);
+	if (!ae && !awb)
+		return 0;
+
+	/* hold back the faster control so that both land on one frame */
+	exp->count = 0;
+	gain->count = 0;
+	if (ae) {
+		add_ctrl(exp, V4L2_CID_EXPOSURE, st->exposure);
+		exp->sequence = sequence + max_delay - cfg->exposure_delay;
+		exp->valid = true;
+		add_ctrl(gain, V4L2_CID_ANALOGUE_GAIN, st->gain);
+	}
+	if (awb) {
+		add_ctrl(gain, V4L2_CID_RED_BALANCE, st->red);
+		add_ctrl(gain, V4L2_CID_BLUE_BALANCE, st->blue);
+	}
+	gain->sequence = sequence + max_delay - cfg->gain_delay;
+	gain->valid = true;
+	aaa->settled = sequence + max_delay;
+
+	return flush_pending(aaa, sequence);
+}
+
+/****************************************************************
+ * simulated sensor
+ *
+ * renders a small NV12 gradient whose brightness follows the latched
+ * exposure, gain and white balance, controls are latched after the delays
+ * of the config like a real sensor.
+ */
+#define SIM_WIDTH		64
+#define SIM_HEIGHT		48
+#define SIM_QUEUE		16
+
+struct sim_write {
+	uint32_t sequence;
+	uint32_t id;
+	int32_t value;
+};
+
+struct nx_v4l2_3a_sim {
+	struct nx_v4l2_3a_config cfg;
+	uint32_t sequence;
+	uint32_t level;
+	uint32_t scene_red;
+	uint32_t scene_blue;
+	int32_t exposure;
+	int32_t gain;
+	int32_t red;
+	int32_t blue;
+	int queued;
+	struct sim_write queue[SIM_QUEUE];
+	uint8_t image[SIM_WIDTH * SIM_HEIGHT * 3 / 2];
+};
+
+struct nx_v4l2_3a_sim *nx_v4l2_3a_sim_create(
+				const struct nx_v4l2_3a_config *cfg)
+{
+	struct nx_v4l2_3a_sim *sim = calloc(1, sizeof(*sim));
+
+	if (!sim)
+		return NULL;
+
+	sim->cfg = *cfg;
+	sim->exposure = clamp32(cfg->exposure_max / 4, cfg->exposure_min,
+				cfg->exposure_max);
+	sim->gain = clamp32(cfg->gain_unit, cfg->gain_min, cfg->gain_max);
+	sim->red = cfg->wb_unit;
+	sim->blue = cfg->wb_unit;
+	nx_v4l2_3a_sim_set_scene(sim, 200, cfg->wb_unit, cfg->wb_unit);
+
+	return sim;
+}
+
+void nx_v4l2_3a_sim_destroy(struct nx_v4l2_3a_sim *sim)
+{
+	free(sim);
+}
+
+/*
+ * level is the luma of a white patch with 1000 lines at 1x, red and blue
+ * tint the scene in wb_unit
+ */
+void nx_v4l2_3a_sim_set_scene(struct nx_v4l2_3a_sim *sim, uint32_t level,
+			      uint32_t red, uint32_t blue)
+{
+	sim->level = level;
+	sim->scene_red = red;
+	sim->scene_blue = blue;
+}
+
+int nx_v4l2_3a_sim_write(void *priv, struct v4l2_ext_control *ctrls,
+			 int count)
+{
+	struct nx_v4l2_3a_sim *sim = priv;
+	int delay;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (sim->queued == SIM_QUEUE)
+			return -EBUSY;
+
+		switch (ctrls[i].id) {
+		case V4L2_CID_EXPOSURE:
+			delay = sim->cfg.exposure_delay;
+			break;
+		case V4L2_CID_ANALOGUE_GAIN:
+		case V4L2_CID_RED_BALANCE:
+		case V4L2_CID_BLUE_BALANCE:
+			delay = sim->cfg.gain_delay;
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		sim->queue[sim->queued].sequence = sim->sequence + delay;
+		sim->queue[sim->queued].id = ctrls[i].id;
+		sim->queue[sim->queued].value = ctrls[i].value;
+		sim->queued++;
+	}
+
+	return 0;
+}
+
+static void sim_latch(struct nx_v4l2_3a_sim *sim)
+{
+	struct sim_write *w;
+	int i = 0;
+
+	while (i < sim->queued) {
+		w = &sim->queue[i];
+		if ((int32_t)(sim->sequence - w->sequence) < 0) {
+			i++;
+			continue;
+		}
+
+		if (w->id == V4L2_CID_EXPOSURE)
+			sim->exposure = w->value;
+		else if (w->id == V4L2_CID_ANALOGUE_GAIN)
+			sim->gain = w->value;
+		else if (w->id == V4L2_CID_RED_BALANCE)
+			sim->red = w->value;
+		else
+			sim->blue = w->value;
+
+		memmove(w, w + 1, (--sim->queued - i) * sizeof(*w));
+	}
+}
+
+static uint8_t sim_clip(double v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)(v + 0.5);
+}
+
+static void sim_render(struct nx_v4l2_3a_sim *sim)
+{
+	const struct nx_v4l2_3a_config *cfg = &sim->cfg;
+	double unit = cfg->wb_unit;
+	double k = (double)sim->level * sim->exposure / 1000 * sim->gain /
+		   cfg->gain_unit;
+	double kr = k * sim->scene_red / unit * sim->red / unit;
+	double kb = k * sim->scene_blue / unit * sim->blue / unit;
+	uint8_t *luma = sim->image;
+	uint8_t *uv = sim->image + SIM_WIDTH * SIM_HEIGHT;
+	double refl, r, g, b;
+	int x, y;
+
+	for (y = 0; y < SIM_HEIGHT; y++) {
+		for (x = 0; x < SIM_WIDTH; x++) {
+			refl = 0.1 + 0.8 * x / (SIM_WIDTH - 1);
+			r = sim_clip(kr * refl);
+			g = sim_clip(k * refl);
+			b = sim_clip(kb * refl);
+
+			luma[y * SIM_WIDTH + x] = sim_clip(16 +
+				(65.481 * r + 128.553 * g + 24.966 * b) / 255);
+			if ((x & 1) || (y & 1))
+				continue;
+			uv[(y / 2) * SIM_WIDTH + x] = sim_clip(128 +
+				(-37.797 * r - 74.203 * g + 112.0 * b) / 255);
+			uv[(y / 2) * SIM_WIDTH + x + 1] = sim_clip(128 +
+				(112.0 * r - 93.786 * g - 18.214 * b) / 255);
+		}
+	}
+}
+
+int nx_v4l2_3a_sim_frame(struct nx_v4l2_3a_sim *sim,
+			 struct nx_v4l2_stats *stats, uint32_t *sequence)
+{
+	struct nx_v4l2_stats_config scfg;
+	struct nx_v4l2_image img;
+
+	sim->sequence++;
+	sim_latch(sim);
+	sim_render(sim);
+
+	nx_v4l2_stats_default_config(&scfg);
+	scfg.step_x = 1;
+	scfg.step_y = 1;
+	nx_v4l2_image_setup(&img, V4L2_PIX_FMT_NV12, SIM_WIDTH, SIM_HEIGHT,
+			    sim->image);
+	*sequence = sim->sequence;
+
+	return nx_v4l2_stats_compute(&img, &scfg, stats);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_3A_H
+#define _NX_V4L2_3A_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Software auto exposure and auto white balance.
+ *
+ * nx_v4l2_3a_process() is called with the statistics of every captured
+ * frame(see nx-v4l2-stats.h). Exposure and analogue gain are computed in
+ * the total exposure domain and moved by damping percent of the error per
+ * update, white balance uses the gray world assumption on the grid means.
+ *
+ * Sensors latch exposure exposure_delay frames and gain gain_delay frames
+ * after the write, so the gain and white balance write is held back until
+ * both land on the same frame, and frames captured before the new settings
+ * took effect are not used for the next update. All controls of one frame
+ * are written with one VIDIOC_S_EXT_CTRLS to the nx_sensor_subdev.
+ *
+ * The writer can be replaced, nx_v4l2_3a_sim_write() with a simulated
+ * sensor from nx_v4l2_3a_sim_create() runs the loop without hardware.
+ */
+
+struct nx_v4l2_3a_config {
+	uint32_t target;		/* mean luma */
+	uint32_t tolerance;
+	uint32_t damping;		/* percent, 1 ~ 100 */
+	uint32_t converge_frames;
+	int32_t exposure_min;
+	int32_t exposure_max;
+	int32_t gain_min;
+	int32_t gain_max;
+	int32_t gain_unit;		/* gain value of 1x */
+	int32_t wb_min;
+	int32_t wb_max;
+	int32_t wb_unit;		/* white balance value of 1x */
+	int exposure_delay;		/* frames */
+	int gain_delay;			/* frames */
+	bool awb;
+};
+
+struct nx_v4l2_3a_state {
+	int32_t exposure;
+	int32_t gain;
+	int32_t red;
+	int32_t blue;
+	uint32_t mean;
+	bool ae_converged;
+	bool awb_converged;
+};
+
+typedef int (*nx_v4l2_3a_writer)(void *priv, struct v4l2_ext_control *ctrls,
+				 int count);
+
+struct nx_v4l2_3a;
+
+void nx_v4l2_3a_default_config(struct nx_v4l2_3a_config *cfg);
+struct nx_v4l2_3a *nx_v4l2_3a_create(int fd,
+				     const struct nx_v4l2_3a_config *cfg);
+void nx_v4l2_3a_destroy(struct nx_v4l2_3a *aaa);
+void nx_v4l2_3a_set_writer(struct nx_v4l2_3a *aaa, nx_v4l2_3a_writer writer,
+			   void *priv);
+int nx_v4l2_3a_process(struct nx_v4l2_3a *aaa,
+		       const struct nx_v4l2_stats *stats, uint32_t sequence);
+void nx_v4l2_3a_get_state(struct nx_v4l2_3a *aaa,
+			  struct nx_v4l2_3a_state *state);
+
+/* simulated sensor */
+struct nx_v4l2_3a_sim;
+
+struct nx_v4l2_3a_sim *nx_v4l2_3a_sim_create(
+				const struct nx_v4l2_3a_config *cfg);
+void nx_v4l2_3a_sim_destroy(struct nx_v4l2_3a_sim *sim);
+void nx_v4l2_3a_sim_set_scene(struct nx_v4l2_3a_sim *sim, uint32_t level,
+			      uint32_t red, uint32_t blue);
+int nx_v4l2_3a_sim_write(void *priv, struct v4l2_ext_control *ctrls,
+			 int count);
+int nx_v4l2_3a_sim_frame(struct nx_v4l2_3a_sim *sim,
+			 struct nx_v4l2_stats *stats, uint32_t *sequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-bringup.h"
+
+#define BRINGUP_MAX_THREADS	8
+
+struct bringup_ctx {
+	struct nx_v4l2_bringup_module *modules;
+	int count;
+	int next;
+	int timeout_ms;
+	struct timespec start;
+};
+
+static uint32_t lap_us(struct timespec *t)
+{
+	struct timespec now;
+	uint32_t us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - t->tv_sec) * 1000000 +
+	     (now.tv_nsec - t->tv_nsec) / 1000;
+	*t = now;
+
+	return us;
+}
+
+static bool is_video(int type)
+{
+	return type == nx_clipper_video || type == nx_decimator_video;
+}
+
+static int bringup_format(struct nx_v4l2_bringup_module *m,
+			  const struct nx_v4l2_bringup_format *f)
+{
+	int fd;
+	int ret;
+
+	if (f->type == m->video_type) {
+		if (m->memory == V4L2_MEMORY_MMAP)
+			return nx_v4l2_set_format_mmap(m->fd, f->type,
+						       f->width, f->height,
+						       f->format);
+		return nx_v4l2_set_format(m->fd, f->type, f->width, f->height,
+					  f->format);
+	}
+
+	fd = nx_v4l2_open_device(f->type, m->module);
+	if (fd < 0)
+		return fd;
+
+	ret = nx_v4l2_set_format(fd, f->type, f->width, f->height, f->format);
+	close(fd);
+
+	return ret;
+}
+
+static int bringup_first_frame(struct nx_v4l2_bringup_module *m,
+			       int timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	pfd.fd = nx_v4l2_stream_get_fd(m->stream);
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret < 0)
+		return -errno;
+	if (ret == 0)
+		return -ETIMEDOUT;
+
+	bzero(&m->first_frame, sizeof(m->first_frame));
+	ret = nx_v4l2_stream_dqbuf(m->stream, &m->first_frame);
+	if (ret)
+		return ret;
+
+	m->has_first_frame = true;
+	return 0;
+}
+
+static int bringup_module(struct bringup_ctx *ctx,
+			  struct nx_v4l2_bringup_module *m)
+{
+	struct nx_v4l2_bringup_timing *t = &m->timing;
+	const struct nx_v4l2_bringup_link *l;
+	struct timespec lap;
+	int ret;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &lap);
+
+	m->fd = nx_v4l2_open_device(m->video_type, m->module);
+	if (m->fd < 0)
+		return m->fd;
+	t->open_us = lap_us(&lap);
+
+	for (i = 0; i < m->link_num; i++) {
+		l = &m->links[i];
+		ret = nx_v4l2_link(true, m->module, l->src_type, l->src_pad,
+				   l->sink_type, l->sink_pad);
+		if (ret) {
+			fprintf(stderr, "%s: failed to link %d -> %d of module %d\n",
+				__func__, l->src_type, l->sink_type,
+				m->module);
+			return ret;
+		}
+	}
+	t->link_us = lap_us(&lap);
+
+	for (i = 0; i < m->format_num; i++) {
+		ret = bringup_format(m, &m->formats[i]);
+		if (ret) {
+			fprintf(stderr, "%s: failed to set format of type %d of module %d\n",
+				__func__, m->formats[i].type, m->module);
+			return ret;
+		}
+	}
+	t->format_us = lap_us(&lap);
+
+	m->stream = nx_v4l2_stream_create(m->fd, m->video_type, m->memory,
+					  m->count);
+	if (!m->stream)
+		return -ENOMEM;
+	t->alloc_us = lap_us(&lap);
+
+	if (m->memory != V4L2_MEMORY_MMAP)
+		goto done;
+
+	ret = nx_v4l2_stream_start(m->stream);
+	if (ret)
+		return ret;
+	t->streamon_us = lap_us(&lap);
+
+	if (ctx->timeout_ms) {
+		ret = bringup_first_frame(m, ctx->timeout_ms);
+		if (ret) {
+			fprintf(stderr, "%s: no frame from module %d(%d)\n",
+				__func__, m->module, ret);
+			return ret;
+		}
+		t->first_frame_us = lap_us(&lap);
+	}
+
+done:
+	lap = ctx->start;
+	t->total_us = lap_us(&lap);
+	return 0;
+}
+
+static void *bringup_worker(void *arg)
+{
+	struct bringup_ctx *ctx = arg;
+	struct nx_v4l2_bringup_module *m;
+	int i;
+
+	for (;;) {
+		i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+		if (i >= ctx->count)
+			break;
+
+		m = &ctx->modules[i];
+		m->result = bringup_module(ctx, m);
+	}
+
+	return NULL;
+}
+
+int nx_v4l2_bringup(struct nx_v4l2_bringup_module *modules, int count,
+		    int threads, int first_frame_timeout_ms,
+		    struct nx_v4l2_bringup_report *report)
+{
+	pthread_t tids[BRINGUP_MAX_THREADS];
+	struct bringup_ctx ctx;
+	struct timespec lap;
+	int started = 0;
+	int ret = 0;
+	int i;
+
+	bzero(report, sizeof(*report));
+	for (i = 0; i < count; i++) {
+		if (!is_video(modules[i].video_type) ||
+		    modules[i].link_num > NX_V4L2_BRINGUP_MAX_LINKS ||
+		    modules[i].format_num > NX_V4L2_BRINGUP_MAX_FORMATS)
+			return -EINVAL;
+		modules[i].fd = -1;
+		modules[i].stream = NULL;
+		modules[i].has_first_frame = false;
+		bzero(&modules[i].timing, sizeof(modules[i].timing));
+	}
+
+	bzero(&ctx, sizeof(ctx));
+	ctx.modules = modules;
+	ctx.count = count;
+	ctx.timeout_ms = first_frame_timeout_ms;
+	clock_gettime(CLOCK_MONOTONIC, &ctx.start);
+	lap = ctx.start;
+
+	/* every worker only reads the cache after this */
+	nx_v4l2_enumerate();
+	report->enumerate_us = lap_us(&lap);
+
+	if (threads > count)
+		threads = count;
+	if (threads > BRINGUP_MAX_THREADS)
+		threads = BRINGUP_MAX_THREADS;
+
+	/* the caller's thread is a worker too */
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&tids[started], NULL, bringup_worker, &ctx))
+			break;
+		started++;
+	}
+	bringup_worker(&ctx);
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	for (i = 0; i < count; i++) {
+		if (modules[i].result) {
+			report->failed++;
+			if (!ret)
+				ret = modules[i].result;
+		}
+	}
+	lap = ctx.start;
+	report->total_us = lap_us(&lap);
+
+	return ret;
+}
+
+void nx_v4l2_bringup_release(struct nx_v4l2_bringup_module *modules,
+			     int count)
+{
+	struct nx_v4l2_bringup_module *m;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		m = &modules[i];
+		/* destroying the stream stops it and frees its buffers */
+		nx_v4l2_stream_destroy(m->stream);
+		m->stream = NULL;
+		m->has_first_frame = false;
+		if (m->fd >= 0)
+			close(m->fd);
+		m->fd = -1;
+	}
+}
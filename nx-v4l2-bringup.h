@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_BRINGUP_H
+#define _NX_V4L2_BRINGUP_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parallel pipeline bring-up.
+ *
+ * nx_v4l2_bringup() enumerates the devices once, then sets up the given
+ * modules concurrently on a pool of threads workers. Every module opens
+ * its video node, enables its links, programs its formats in the given
+ * order, allocates its buffers, streams on and waits for the first frame.
+ * The first frame is kept in first_frame and owned by the caller, who
+ * queues it back with nx_v4l2_stream_qbuf().
+ *
+ * Dmabuf streams need buffers from the caller, their bring-up stops after
+ * the allocation and the caller starts them after
+ * nx_v4l2_stream_set_buffer().
+ */
+
+#define NX_V4L2_BRINGUP_MAX_LINKS	4
+#define NX_V4L2_BRINGUP_MAX_FORMATS	4
+
+struct nx_v4l2_bringup_link {
+	int src_type;
+	int src_pad;
+	int sink_type;
+	int sink_pad;
+};
+
+struct nx_v4l2_bringup_format {
+	int type;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;	/* media bus code or pixel format */
+};
+
+/* time spent in each phase in microseconds */
+struct nx_v4l2_bringup_timing {
+	uint32_t open_us;
+	uint32_t link_us;
+	uint32_t format_us;
+	uint32_t alloc_us;
+	uint32_t streamon_us;
+	uint32_t first_frame_us;
+	uint32_t total_us;		/* since nx_v4l2_bringup() was called */
+};
+
+struct nx_v4l2_bringup_module {
+	int module;
+	int video_type;
+	uint32_t memory;
+	int count;
+	int link_num;
+	struct nx_v4l2_bringup_link links[NX_V4L2_BRINGUP_MAX_LINKS];
+	int format_num;
+	struct nx_v4l2_bringup_format formats[NX_V4L2_BRINGUP_MAX_FORMATS];
+
+	/* results */
+	int result;
+	int fd;
+	struct nx_v4l2_stream *stream;
+	bool has_first_frame;
+	struct nx_v4l2_frame first_frame;
+	struct nx_v4l2_bringup_timing timing;
+};
+
+struct nx_v4l2_bringup_report {
+	uint32_t enumerate_us;
+	uint32_t total_us;
+	int failed;
+};
+
+int nx_v4l2_bringup(struct nx_v4l2_bringup_module *modules, int count,
+		    int threads, int first_frame_timeout_ms,
+		    struct nx_v4l2_bringup_report *report);
+void nx_v4l2_bringup_release(struct nx_v4l2_bringup_module *modules,
+			     int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
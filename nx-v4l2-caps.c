@@ -0,0 +1,624 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#include <linux/videodev2.h>
+#include <linux/v4l2-subdev.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-caps.h"
+
+#define MAX_DIMENSION	65535
+
+struct caps_node {
+	struct caps_node *next;
+	dev_t rdev;
+	struct nx_v4l2_caps caps;
+};
+
+static struct caps_node *caps_list;
+static pthread_mutex_t caps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool is_subdev(int type)
+{
+	switch (type) {
+	case nx_sensor_subdev:
+	case nx_clipper_subdev:
+	case nx_decimator_subdev:
+	case nx_csi_subdev:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static struct nx_v4l2_caps_entry *add_entry(struct nx_v4l2_caps *caps,
+					    uint32_t code)
+{
+	struct nx_v4l2_caps_entry *e;
+
+	e = realloc(caps->entries, (caps->count + 1) * sizeof(*e));
+	if (!e)
+		return NULL;
+
+	caps->entries = e;
+	e = &caps->entries[caps->count++];
+	bzero(e, sizeof(*e));
+	e->code = code;
+	e->min_width = 1;
+	e->max_width = MAX_DIMENSION;
+	e->step_width = 1;
+	e->min_height = 1;
+	e->max_height = MAX_DIMENSION;
+	e->step_height = 1;
+
+	return e;
+}
+
+static void set_size(struct nx_v4l2_caps_entry *e, uint32_t min_w,
+		     uint32_t max_w, uint32_t step_w, uint32_t min_h,
+		     uint32_t max_h, uint32_t step_h)
+{
+	e->min_width = min_w;
+	e->max_width = max_w;
+	e->step_width = step_w ? step_w : 1;
+	e->min_height = min_h;
+	e->max_height = max_h;
+	e->step_height = step_h ? step_h : 1;
+}
+
+static void enum_subdev_intervals(int fd, struct nx_v4l2_caps_entry *e)
+{
+	struct v4l2_subdev_frame_interval_enum fie;
+
+	while (e->interval_num < NX_V4L2_CAPS_MAX_INTERVALS) {
+		bzero(&fie, sizeof(fie));
+		fie.index = e->interval_num;
+		fie.pad = 0;
+		fie.code = e->code;
+		fie.width = e->max_width;
+		fie.height = e->max_height;
+		fie.which = V4L2_SUBDEV_FORMAT_ACTIVE;
+		if (ioctl(fd, VIDIOC_SUBDEV_ENUM_FRAME_INTERVAL, &fie))
+			break;
+		e->intervals[e->interval_num++] = fie.interval;
+	}
+}
+
+static int enum_subdev(int fd, struct nx_v4l2_caps *caps)
+{
+	struct v4l2_subdev_mbus_code_enum ce;
+	struct v4l2_subdev_frame_size_enum fse;
+	struct nx_v4l2_caps_entry *e;
+	uint32_t i, j;
+
+	for (i = 0; ; i++) {
+		bzero(&ce, sizeof(ce));
+		ce.pad = 0;
+		ce.index = i;
+		ce.which = V4L2_SUBDEV_FORMAT_ACTIVE;
+		if (ioctl(fd, VIDIOC_SUBDEV_ENUM_MBUS_CODE, &ce))
+			break;
+
+		for (j = 0; ; j++) {
+			bzero(&fse, sizeof(fse));
+			fse.pad = 0;
+			fse.index = j;
+			fse.code = ce.code;
+			fse.which = V4L2_SUBDEV_FORMAT_ACTIVE;
+			if (ioctl(fd, VIDIOC_SUBDEV_ENUM_FRAME_SIZE, &fse)) {
+				/* code without size enumeration, any size */
+				if (j == 0 && !add_entry(caps, ce.code))
+					return -ENOMEM;
+				break;
+			}
+
+			e = add_entry(caps, ce.code);
+			if (!e)
+				return -ENOMEM;
+			set_size(e, fse.min_width, fse.max_width, 1,
+				 fse.min_height, fse.max_height, 1);
+			enum_subdev_intervals(fd, e);
+		}
+	}
+
+	caps->any = i == 0;
+	return 0;
+}
+
+static void enum_video_intervals(int fd, struct nx_v4l2_caps_entry *e)
+{
+	struct v4l2_frmivalenum fie;
+
+	while (e->interval_num < NX_V4L2_CAPS_MAX_INTERVALS) {
+		bzero(&fie, sizeof(fie));
+		fie.index = e->interval_num;
+		fie.pixel_format = e->code;
+		fie.width = e->max_width;
+		fie.height = e->max_height;
+		if (ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &fie))
+			break;
+
+		if (fie.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+			e->interval_stepwise = true;
+			e->intervals[0] = fie.stepwise.min;
+			e->intervals[1] = fie.stepwise.max;
+			e->interval_num = 2;
+			break;
+		}
+		e->intervals[e->interval_num++] = fie.discrete;
+	}
+}
+
+/* the buffer type the node enumerates, single planar for mmap only nodes */
+static uint32_t video_buf_type(int fd, int type)
+{
+	struct v4l2_fmtdesc desc;
+	bool capture = type == nx_clipper_video || type == nx_decimator_video;
+
+	bzero(&desc, sizeof(desc));
+	desc.type = capture ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE :
+			      V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	if (!ioctl(fd, VIDIOC_ENUM_FMT, &desc))
+		return desc.type;
+
+	return capture ? V4L2_BUF_TYPE_VIDEO_CAPTURE :
+			 V4L2_BUF_TYPE_VIDEO_OUTPUT;
+}
+
+static int enum_video(int fd, struct nx_v4l2_caps *caps)
+{
+	struct v4l2_fmtdesc desc;
+	struct v4l2_frmsizeenum fse;
+	struct nx_v4l2_caps_entry *e;
+	uint32_t buf_type = video_buf_type(fd, caps->type);
+	uint32_t i, j;
+
+	for (i = 0; ; i++) {
+		bzero(&desc, sizeof(desc));
+		desc.index = i;
+		desc.type = buf_type;
+		if (ioctl(fd, VIDIOC_ENUM_FMT, &desc))
+			break;
+
+		for (j = 0; ; j++) {
+			bzero(&fse, sizeof(fse));
+			fse.index = j;
+			fse.pixel_format = desc.pixelformat;
+			if (ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &fse)) {
+				if (j == 0 && !add_entry(caps, desc.pixelformat))
+					return -ENOMEM;
+				break;
+			}
+
+			e = add_entry(caps, desc.pixelformat);
+			if (!e)
+				return -ENOMEM;
+
+			if (fse.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+				set_size(e, fse.discrete.width,
+					 fse.discrete.width, 1,
+					 fse.discrete.height,
+					 fse.discrete.height, 1);
+			} else {
+				set_size(e, fse.stepwise.min_width,
+					 fse.stepwise.max_width,
+					 fse.stepwise.step_width,
+					 fse.stepwise.min_height,
+					 fse.stepwise.max_height,
+					 fse.stepwise.step_height);
+			}
+			enum_video_intervals(fd, e);
+
+			if (fse.type != V4L2_FRMSIZE_TYPE_DISCRETE)
+				break;
+		}
+	}
+
+	caps->any = i == 0;
+	return 0;
+}
+
+static int copy_caps(const struct nx_v4l2_caps *src, struct nx_v4l2_caps *dst)
+{
+	*dst = *src;
+	dst->entries = NULL;
+	if (!src->count)
+		return 0;
+
+	dst->entries = malloc(src->count * sizeof(*src->entries));
+	if (!dst->entries)
+		return -ENOMEM;
+	memcpy(dst->entries, src->entries, src->count * sizeof(*src->entries));
+
+	return 0;
+}
+
+int nx_v4l2_caps_get(int fd, int type, struct nx_v4l2_caps *caps)
+{
+	struct caps_node *node;
+	struct stat st;
+	int ret;
+
+	bzero(caps, sizeof(*caps));
+	if (fstat(fd, &st))
+		return -errno;
+
+	pthread_mutex_lock(&caps_lock);
+	for (node = caps_list; node; node = node->next) {
+		if (node->rdev == st.st_rdev && node->caps.type == type) {
+			ret = copy_caps(&node->caps, caps);
+			pthread_mutex_unlock(&caps_lock);
+			return ret;
+		}
+	}
+
+	node = calloc(1, sizeof(*node));
+	if (!node) {
+		pthread_mutex_unlock(&caps_lock);
+		return -ENOMEM;
+	}
+
+	node->rdev = st.st_rdev;
+	node->caps.type = type;
+	if (is_subdev(type))
+		ret = enum_subdev(fd, &node->caps);
+	else
+		ret = enum_video(fd, &node->caps);
+	if (ret) {
+		fprintf(stderr, "%s: failed to enumerate type %d\n", __func__,
+			type);
+		free(node->caps.entries);
+		free(node);
+		pthread_mutex_unlock(&caps_lock);
+		return ret;
+	}
+
+	node->next = caps_list;
+	caps_list = node;
+	ret = copy_caps(&node->caps, caps);
+	pthread_mutex_unlock(&caps_lock);
+
+	return ret;
+}
+
+void nx_v4l2_caps_release(struct nx_v4l2_caps *caps)
+{
+	free(caps->entries);
+	caps->entries = NULL;
+	caps->count = 0;
+}
+
+void nx_v4l2_caps_invalidate(int fd)
+{
+	struct caps_node **p, *node;
+	struct stat st;
+
+	if (fstat(fd, &st))
+		return;
+
+	pthread_mutex_lock(&caps_lock);
+	p = &caps_list;
+	while (*p) {
+		node = *p;
+		if (node->rdev == st.st_rdev) {
+			*p = node->next;
+			free(node->caps.entries);
+			free(node);
+		} else {
+			p = &node->next;
+		}
+	}
+	pthread_mutex_unlock(&caps_lock);
+}
+
+void nx_v4l2_caps_cleanup(void)
+{
+	struct caps_node *node;
+
+	pthread_mutex_lock(&caps_lock);
+	while (caps_list) {
+		node = caps_list;
+		caps_list = node->next;
+		free(node->caps.entries);
+		free(node);
+	}
+	pthread_mutex_unlock(&caps_lock);
+}
+
+static bool entry_fits(const struct nx_v4l2_caps_entry *e, uint32_t width,
+		       uint32_t height)
+{
+	return width >= e->min_width && width <= e->max_width &&
+	       height >= e->min_height && height <= e->max_height &&
+	       (width - e->min_width) % e->step_width == 0 &&
+	       (height - e->min_height) % e->step_height == 0;
+}
+
+bool nx_v4l2_caps_supports(const struct nx_v4l2_caps *caps, uint32_t code,
+			   uint32_t width, uint32_t height)
+{
+	int i;
+
+	if (caps->any)
+		return true;
+
+	for (i = 0; i < caps->count; i++)
+		if (caps->entries[i].code == code &&
+		    entry_fits(&caps->entries[i], width, height))
+			return true;
+
+	return false;
+}
+
+/****************************************************************
+ * negotiation
+ */
+#define COST_SIZE_DEFICIT	(1ULL << 50)
+#define COST_FPS_DEFICIT	(1ULL << 40)
+
+/* nearest size inside the range which is not smaller than the request */
+static uint32_t fit_range(uint32_t v, uint32_t min, uint32_t max,
+			  uint32_t step)
+{
+	if (v <= min)
+		return min;
+	if (v >= max)
+		return max;
+
+	v = min + (v - min + step - 1) / step * step;
+	return v > max ? max : v;
+}
+
+static uint64_t pick_interval(const struct nx_v4l2_caps_entry *e,
+			      uint32_t fps, struct v4l2_fract *interval)
+{
+	uint64_t best = UINT64_MAX, cost;
+	double f, want = fps;
+	int i;
+
+	bzero(interval, sizeof(*interval));
+	if (!e->interval_num)
+		return 0;
+
+	if (e->interval_stepwise) {
+		/* a zero numerator is a broken driver, leave the rate alone */
+		if (!e->intervals[0].numerator || !e->intervals[1].numerator)
+			return 0;
+
+		/* intervals[0] is the fastest */
+		f = (double)e->intervals[0].denominator /
+		    e->intervals[0].numerator;
+		if (!fps || f <= want) {
+			*interval = e->intervals[0];
+			return fps ? (uint64_t)((want - f) * 1000) *
+				     COST_FPS_DEFICIT / 1000 : 0;
+		}
+
+		/* slower than the slowest step */
+		f = (double)e->intervals[1].denominator /
+		    e->intervals[1].numerator;
+		if (f > want) {
+			*interval = e->intervals[1];
+			return (uint64_t)((f - want) * 1000);
+		}
+
+		interval->numerator = 1;
+		interval->denominator = fps;
+		return 0;
+	}
+
+	for (i = 0; i < e->interval_num; i++) {
+		if (!e->intervals[i].numerator)
+			continue;
+		f = (double)e->intervals[i].denominator /
+		    e->intervals[i].numerator;
+		if (!fps)
+			cost = (uint64_t)(1000000 / f);
+		else if (f >= want)
+			cost = (uint64_t)((f - want) * 1000);
+		else
+			cost = COST_FPS_DEFICIT +
+			       (uint64_t)((want - f) * 1000);
+		if (cost < best) {
+			best = cost;
+			*interval = e->intervals[i];
+		}
+	}
+
+	return best == UINT64_MAX ? 0 : best;
+}
+
+static uint64_t size_cost(uint32_t w, uint32_t h, uint32_t rw, uint32_t rh)
+{
+	if (w < rw || h < rh)
+		return COST_SIZE_DEFICIT +
+		       (uint64_t)(w < rw ? rw - w : 0) * rh +
+		       (uint64_t)(h < rh ? rh - h : 0) * rw;
+
+	return (uint64_t)w * h - (uint64_t)rw * rh;
+}
+
+/* check the candidate against the rest of the chain */
+static bool chain_accepts(const struct nx_v4l2_caps *caps, const int *types,
+			  int count, int first, uint32_t code, uint32_t w,
+			  uint32_t h, uint32_t *pixelformat)
+{
+	const struct nx_v4l2_caps *c;
+	int i, j;
+
+	for (i = first + 1; i < count; i++) {
+		c = &caps[i];
+		if (is_subdev(types[i])) {
+			if (!nx_v4l2_caps_supports(c, code, w, h))
+				return false;
+			continue;
+		}
+
+		/* video node, choose its pixel format */
+		if (c->any)
+			continue;
+		if (*pixelformat) {
+			if (!nx_v4l2_caps_supports(c, *pixelformat, w, h))
+				return false;
+			continue;
+		}
+		for (j = 0; j < c->count; j++) {
+			if (entry_fits(&c->entries[j], w, h)) {
+				*pixelformat = c->entries[j].code;
+				break;
+			}
+		}
+		if (j == c->count)
+			return false;
+	}
+
+	return true;
+}
+
+int nx_v4l2_negotiate(const int *fds, const int *types, int count,
+		      uint32_t width, uint32_t height, uint32_t fps,
+		      uint32_t pixelformat, struct nx_v4l2_negotiation *result)
+{
+	struct nx_v4l2_caps caps[nx_v4l2_max];
+	const struct nx_v4l2_caps_entry *e;
+	struct v4l2_fract interval;
+	uint64_t best = UINT64_MAX, cost;
+	uint32_t cand_w[2], cand_h[2], pf;
+	int first, i, k;
+	int ret = 0;
+
+	if (count <= 0 || count > nx_v4l2_max)
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		ret = nx_v4l2_caps_get(fds[i], types[i], &caps[i]);
+		if (ret) {
+			count = i;
+			goto out;
+		}
+	}
+
+	/* candidates come from the most upstream element which knows them */
+	for (first = 0; first < count; first++)
+		if (!caps[first].any && is_subdev(types[first]))
+			break;
+	if (first == count) {
+		fprintf(stderr, "%s: no element enumerates formats\n",
+			__func__);
+		ret = -ENOTSUP;
+		goto out;
+	}
+
+	for (i = 0; i < caps[first].count; i++) {
+		e = &caps[first].entries[i];
+
+		cand_w[0] = fit_range(width, e->min_width, e->max_width,
+				      e->step_width);
+		cand_h[0] = fit_range(height, e->min_height, e->max_height,
+				      e->step_height);
+		cand_w[1] = e->max_width;
+		cand_h[1] = e->max_height;
+
+		for (k = 0; k < 2; k++) {
+			pf = pixelformat;
+			if (!chain_accepts(caps, types, count, first, e->code,
+					   cand_w[k], cand_h[k], &pf))
+				continue;
+
+			cost = size_cost(cand_w[k], cand_h[k], width, height) +
+			       pick_interval(e, fps, &interval);
+			if (cost >= best)
+				continue;
+
+			best = cost;
+			result->code = e->code;
+			result->pixelformat = pf;
+			result->width = cand_w[k];
+			result->height = cand_h[k];
+			result->interval = interval;
+		}
+	}
+
+	if (best == UINT64_MAX) {
+		fprintf(stderr, "%s: no common format for %ux%u\n", __func__,
+			width, height);
+		ret = -EINVAL;
+	}
+
+out:
+	for (i = 0; i < count; i++)
+		nx_v4l2_caps_release(&caps[i]);
+
+	return ret;
+}
+
+int nx_v4l2_negotiate_apply(const int *fds, const int *types, int count,
+			    const struct nx_v4l2_negotiation *result)
+{
+	struct v4l2_subdev_frame_interval fi;
+	bool interval_set = false;
+	uint32_t format;
+	int ret;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		format = is_subdev(types[i]) ? result->code :
+			 result->pixelformat;
+		if (!format)
+			continue;
+
+		ret = nx_v4l2_set_format(fds[i], types[i], result->width,
+					 result->height, format);
+		if (ret) {
+			fprintf(stderr, "%s: failed to set format of type %d\n",
+				__func__, types[i]);
+			return ret;
+		}
+
+		if (interval_set || !is_subdev(types[i]) ||
+		    !result->interval.denominator)
+			continue;
+
+		/* the most upstream subdev owns the frame rate */
+		bzero(&fi, sizeof(fi));
+		fi.pad = 0;
+		fi.interval = result->interval;
+		if (ioctl(fds[i], VIDIOC_SUBDEV_S_FRAME_INTERVAL, &fi) &&
+		    errno != ENOTTY)
+			fprintf(stderr, "%s: failed to set frame interval\n",
+				__func__);
+		interval_set = true;
+	}
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_CAPS_H
+#define _NX_V4L2_CAPS_H
+
+#include "nx-v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Format capability discovery and negotiation.
+ *
+ * nx_v4l2_caps_get() enumerates the media bus codes of a subdev(pad 0) or
+ * the pixel formats of a video node with their frame sizes and intervals.
+ * The result is cached per device node, so every open fd of the same node
+ * shares it until nx_v4l2_caps_invalidate() or nx_v4l2_caps_cleanup(). The
+ * caller gets its own copy of the entries, which stays valid across an
+ * invalidate and is freed with nx_v4l2_caps_release().
+ *
+ * nx_v4l2_negotiate() walks the chain given in pipeline order(sensor, csi,
+ * clipper subdev, clipper video) and picks the code, size and interval
+ * which every element supports and which is nearest to the request, the
+ * smallest size not below the requested one wins. Elements which don't
+ * implement the enumeration ioctls accept anything.
+ */
+
+#define NX_V4L2_CAPS_MAX_INTERVALS	8
+
+struct nx_v4l2_caps_entry {
+	uint32_t code;		/* media bus code or pixel format */
+	uint32_t min_width;
+	uint32_t max_width;
+	uint32_t step_width;
+	uint32_t min_height;
+	uint32_t max_height;
+	uint32_t step_height;
+	int interval_num;
+	bool interval_stepwise;	/* intervals[0] is min, [1] is max */
+	struct v4l2_fract intervals[NX_V4L2_CAPS_MAX_INTERVALS];
+};
+
+struct nx_v4l2_caps {
+	int type;
+	bool any;		/* enumeration isn't supported */
+	int count;
+	struct nx_v4l2_caps_entry *entries;
+};
+
+struct nx_v4l2_negotiation {
+	uint32_t code;
+	uint32_t pixelformat;
+	uint32_t width;
+	uint32_t height;
+	struct v4l2_fract interval;
+};
+
+int nx_v4l2_caps_get(int fd, int type, struct nx_v4l2_caps *caps);
+void nx_v4l2_caps_release(struct nx_v4l2_caps *caps);
+void nx_v4l2_caps_invalidate(int fd);
+void nx_v4l2_caps_cleanup(void);
+bool nx_v4l2_caps_supports(const struct nx_v4l2_caps *caps, uint32_t code,
+			   uint32_t width, uint32_t height);
+
+int nx_v4l2_negotiate(const int *fds, const int *types, int count,
+		      uint32_t width, uint32_t height, uint32_t fps,
+		      uint32_t pixelformat, struct nx_v4l2_negotiation *result);
+int nx_v4l2_negotiate_apply(const int *fds, const int *types, int count,
+			    const struct nx_v4l2_negotiation *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <poll.h>
+#include <sys/epoll.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-m2m.h"
+#include "nx-v4l2-chain.h"
+
+#define MAX_RESULTS	VIDEO_MAX_FRAME
+
+struct nx_v4l2_chain {
+	struct nx_v4l2_stream *source;
+	struct nx_v4l2_m2m *stages[NX_V4L2_CHAIN_MAX_STAGES];
+	int stage_num;
+	int epoll_fd;
+
+	/* frame waiting to enter stage i */
+	bool waiting[NX_V4L2_CHAIN_MAX_STAGES];
+	struct nx_v4l2_frame pending[NX_V4L2_CHAIN_MAX_STAGES];
+
+	/* results of the last stage */
+	struct nx_v4l2_frame results[MAX_RESULTS];
+	int result_head;
+	int result_count;
+
+	struct nx_v4l2_chain_stats stats;
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int watch(struct nx_v4l2_chain *chain, int fd)
+{
+	struct epoll_event ev;
+
+	bzero(&ev, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return epoll_ctl(chain->epoll_fd, EPOLL_CTL_ADD, fd, &ev) ? -errno : 0;
+}
+
+struct nx_v4l2_chain *nx_v4l2_chain_create(struct nx_v4l2_stream *source,
+					   struct nx_v4l2_m2m **stages,
+					   int count)
+{
+	struct nx_v4l2_chain *chain;
+	int fd;
+	int i;
+
+	if (count <= 0 || count > NX_V4L2_CHAIN_MAX_STAGES)
+		return NULL;
+
+	chain = calloc(1, sizeof(*chain));
+	if (!chain)
+		return NULL;
+
+	chain->source = source;
+	chain->stage_num = count;
+	for (i = 0; i < count; i++)
+		chain->stages[i] = stages[i];
+
+	chain->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (chain->epoll_fd < 0)
+		goto fail;
+
+	fd = nx_v4l2_stream_get_fd(source);
+	if (fd < 0 || watch(chain, fd))
+		goto fail;
+	for (i = 0; i < count; i++)
+		if (watch(chain, nx_v4l2_m2m_get_fd(stages[i])))
+			goto fail;
+
+	return chain;
+
+fail:
+	fprintf(stderr, "%s: failed to watch the stages\n", __func__);
+	nx_v4l2_chain_destroy(chain);
+	return NULL;
+}
+
+/* give a frame back to whoever produced it */
+static void put_input(struct nx_v4l2_chain *chain, int stage,
+		      struct nx_v4l2_frame *frame)
+{
+	if (stage == 0)
+		nx_v4l2_stream_qbuf(chain->source, frame);
+	else
+		nx_v4l2_m2m_release(chain->stages[stage - 1], frame);
+}
+
+void nx_v4l2_chain_destroy(struct nx_v4l2_chain *chain)
+{
+	int i;
+
+	if (!chain)
+		return;
+
+	for (i = 0; i < chain->stage_num; i++)
+		if (chain->waiting[i])
+			put_input(chain, i, &chain->pending[i]);
+
+	if (chain->epoll_fd >= 0)
+		close(chain->epoll_fd);
+	free(chain);
+}
+
+int nx_v4l2_chain_get_fd(struct nx_v4l2_chain *chain)
+{
+	return chain->epoll_fd;
+}
+
+/* submit a frame, a frame the stage rejects goes back to its producer */
+static int submit(struct nx_v4l2_chain *chain, int stage,
+		  struct nx_v4l2_frame *frame)
+{
+	struct nx_v4l2_chain_stage_stats *stats = &chain->stats.stages[stage];
+	int ret;
+
+	ret = nx_v4l2_m2m_submit(chain->stages[stage], frame);
+	if (!ret) {
+		stats->submitted++;
+	} else if (ret != -EAGAIN) {
+		put_input(chain, stage, frame);
+		stats->failed++;
+	}
+
+	return ret;
+}
+
+/* submit or park a frame for stage, an older waiting frame is dropped */
+static int feed(struct nx_v4l2_chain *chain, int stage,
+		struct nx_v4l2_frame *frame)
+{
+	struct nx_v4l2_chain_stage_stats *stats = &chain->stats.stages[stage];
+	int ret;
+
+	if (!chain->waiting[stage]) {
+		ret = submit(chain, stage, frame);
+		if (ret != -EAGAIN)
+			return ret;
+	}
+
+	if (chain->waiting[stage]) {
+		put_input(chain, stage, &chain->pending[stage]);
+		stats->dropped++;
+	}
+	chain->pending[stage] = *frame;
+	chain->waiting[stage] = true;
+
+	return 0;
+}
+
+static void push_result(struct nx_v4l2_chain *chain,
+			struct nx_v4l2_frame *frame)
+{
+	uint64_t ts = (uint64_t)frame->timestamp.tv_sec * 1000000 +
+		frame->timestamp.tv_usec;
+	uint64_t now = now_us();
+
+	if (chain->result_count == MAX_RESULTS) {
+		nx_v4l2_m2m_release(chain->stages[chain->stage_num - 1],
+				    frame);
+		return;
+	}
+
+	chain->results[(chain->result_head + chain->result_count) %
+		       MAX_RESULTS] = *frame;
+	chain->result_count++;
+	chain->stats.completed++;
+
+	if (ts && ts <= now) {
+		chain->stats.latency_us = now - ts;
+		if (chain->stats.latency_us > chain->stats.latency_max_us)
+			chain->stats.latency_max_us = chain->stats.latency_us;
+	}
+}
+
+/*
+ * video nodes are usually opened blocking, a dequeue only happens when a
+ * frame is ready so that it never waits for the camera
+ */
+static bool source_ready(struct nx_v4l2_chain *chain)
+{
+	struct pollfd pfd;
+
+	pfd.fd = nx_v4l2_stream_get_fd(chain->source);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+/* returns the first error of a stage, the other stages keep going */
+static int pump(struct nx_v4l2_chain *chain)
+{
+	struct nx_v4l2_frame frame;
+	int err = 0;
+	int ret;
+	int i;
+
+	/* consumed inputs first, that frees the camera and stage buffers */
+	for (i = chain->stage_num - 1; i >= 0; i--)
+		while (!nx_v4l2_m2m_reclaim(chain->stages[i], &frame))
+			put_input(chain, i, &frame);
+
+	for (i = 0; i < chain->stage_num; i++) {
+		if (!chain->waiting[i])
+			continue;
+		ret = submit(chain, i, &chain->pending[i]);
+		if (ret == -EAGAIN)
+			continue;
+		chain->waiting[i] = false;
+		if (ret && !err)
+			err = ret;
+	}
+
+	while (source_ready(chain) &&
+	       !nx_v4l2_stream_dqbuf(chain->source, &frame)) {
+		chain->stats.captured++;
+		ret = feed(chain, 0, &frame);
+		if (ret && !err)
+			err = ret;
+	}
+
+	for (i = 0; i < chain->stage_num; i++) {
+		while (!nx_v4l2_m2m_dequeue(chain->stages[i], &frame)) {
+			if (i == chain->stage_num - 1) {
+				push_result(chain, &frame);
+				continue;
+			}
+			ret = feed(chain, i + 1, &frame);
+			if (ret && !err)
+				err = ret;
+		}
+	}
+
+	return err;
+}
+
+int nx_v4l2_chain_process(struct nx_v4l2_chain *chain, int timeout_ms)
+{
+	struct epoll_event events[NX_V4L2_CHAIN_MAX_STAGES + 1];
+	int ret;
+
+	ret = epoll_wait(chain->epoll_fd, events,
+			 NX_V4L2_CHAIN_MAX_STAGES + 1,
+			 chain->result_count ? 0 : timeout_ms);
+	if (ret < 0 && errno != EINTR)
+		return -errno;
+
+	ret = pump(chain);
+	if (ret)
+		return ret;
+
+	return chain->result_count;
+}
+
+int nx_v4l2_chain_read(struct nx_v4l2_chain *chain,
+		       struct nx_v4l2_frame *frame)
+{
+	if (!chain->result_count)
+		return -EAGAIN;
+
+	*frame = chain->results[chain->result_head];
+	chain->result_head = (chain->result_head + 1) % MAX_RESULTS;
+	chain->result_count--;
+
+	return 0;
+}
+
+int nx_v4l2_chain_release(struct nx_v4l2_chain *chain,
+			  struct nx_v4l2_frame *frame)
+{
+	return nx_v4l2_m2m_release(chain->stages[chain->stage_num - 1], frame);
+}
+
+void nx_v4l2_chain_get_stats(struct nx_v4l2_chain *chain,
+			     struct nx_v4l2_chain_stats *stats)
+{
+	*stats = chain->stats;
+}
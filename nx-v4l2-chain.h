@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_CHAIN_H
+#define _NX_V4L2_CHAIN_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-m2m.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Capture to memory to memory pipeline.
+ *
+ * Frames of a stream go through a chain of m2m sessions(see nx-v4l2-m2m.h),
+ * the result of one stage is submitted to the next one as dmabuf when the
+ * stage exports its buffers. Every stage keeps its own depth of jobs in
+ * flight, so all of them work at the same time on different frames.
+ *
+ * A camera buffer is queued back as soon as the first stage reclaims it,
+ * the result buffer of a stage as soon as the next stage did, not when the
+ * whole chain finished. A stage which is full holds one waiting frame, a
+ * newer frame replaces it and the older one is dropped, so the camera
+ * never runs out of buffers and the latency stays bounded. Only a full
+ * stage makes a frame wait, a frame the stage can't take at all is given
+ * back at once and nx_v4l2_chain_process() reports the error.
+ *
+ * nx_v4l2_chain_process() does all the work without blocking longer than
+ * timeout_ms, results of the last stage are taken with nx_v4l2_chain_read()
+ * and given back with nx_v4l2_chain_release(). The chain does not own the
+ * stream and the stages, the stream must be started by the caller.
+ */
+
+#define NX_V4L2_CHAIN_MAX_STAGES	4
+
+struct nx_v4l2_chain_stage_stats {
+	uint64_t submitted;
+	uint64_t dropped;		/* replaced while waiting */
+	uint64_t failed;		/* rejected by the stage */
+};
+
+struct nx_v4l2_chain_stats {
+	uint64_t captured;
+	uint64_t completed;
+	uint32_t latency_us;		/* capture to the last stage */
+	uint32_t latency_max_us;
+	struct nx_v4l2_chain_stage_stats stages[NX_V4L2_CHAIN_MAX_STAGES];
+};
+
+struct nx_v4l2_chain;
+
+struct nx_v4l2_chain *nx_v4l2_chain_create(struct nx_v4l2_stream *source,
+					   struct nx_v4l2_m2m **stages,
+					   int count);
+void nx_v4l2_chain_destroy(struct nx_v4l2_chain *chain);
+int nx_v4l2_chain_get_fd(struct nx_v4l2_chain *chain);
+/*
+ * returns the number of results ready to read, or the error of a stage
+ * which rejected a frame, the frame is given back and the chain goes on
+ */
+int nx_v4l2_chain_process(struct nx_v4l2_chain *chain, int timeout_ms);
+int nx_v4l2_chain_read(struct nx_v4l2_chain *chain,
+		       struct nx_v4l2_frame *frame);
+int nx_v4l2_chain_release(struct nx_v4l2_chain *chain,
+			  struct nx_v4l2_frame *frame);
+void nx_v4l2_chain_get_stats(struct nx_v4l2_chain *chain,
+			     struct nx_v4l2_chain_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
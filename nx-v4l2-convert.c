@@ -0,0 +1,966 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+
+#include <linux/videodev2.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+
+/*
+ * Fixed point yuv -> rgb in 6 fractional bits, everything fits in signed
+ * 16bit lanes. Luma gain is applied with a rounding high multiply in Q15
+ * (mulhrs/vqrdmulh) to keep its precision. Only the blue channel can
+ * overflow and there a saturated result clamps to 255 just like the exact
+ * one does.
+ */
+struct yuv_coeffs {
+	int16_t yg;
+	int16_t vr;
+	int16_t ug;
+	int16_t vg;
+	int16_t ub;
+};
+
+static const struct yuv_coeffs coeffs[] = {
+	[NX_V4L2_COLOR_BT601] = { 19077, 102, 25, 52, 129 },
+	[NX_V4L2_COLOR_BT709] = { 19077, 115, 14, 34, 135 },
+};
+
+struct convert_ops {
+	int simd;
+	void (*uv_split)(const uint8_t *uv, uint8_t *u, uint8_t *v, int n);
+	void (*uv_merge)(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+			 int n);
+	void (*packed_to_nv12)(const uint8_t *s0, const uint8_t *s1,
+			       uint8_t *y0, uint8_t *y1, uint8_t *uv, int w,
+			       int yoff);
+	void (*nv12_to_rgb)(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+			    int w, const struct yuv_coeffs *c, int bpp);
+};
+
+/****************************************************************
+ * scalar reference
+ */
+static inline uint8_t clamp_u8(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static void uv_split_c(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		u[i] = uv[2 * i];
+		v[i] = uv[2 * i + 1];
+	}
+}
+
+static void uv_merge_c(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+		       int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		uv[2 * i] = u[i];
+		uv[2 * i + 1] = v[i];
+	}
+}
+
+/* yoff is 0 for YUYV and 1 for UYVY, s1 may be equal to s0 */
+static void packed_to_nv12_c(const uint8_t *s0, const uint8_t *s1,
+			     uint8_t *y0, uint8_t *y1, uint8_t *uv, int w,
+			     int yoff)
+{
+	int coff = 1 - yoff;
+	int i;
+
+	for (i = 0; i < w; i++) {
+		y0[i] = s0[2 * i + yoff];
+		if (y1)
+			y1[i] = s1[2 * i + yoff];
+	}
+
+	for (i = 0; i < (w + 1) / 2; i++) {
+		uv[2 * i] = (s0[4 * i + coff] + s1[4 * i + coff] + 1) >> 1;
+		uv[2 * i + 1] = (s0[4 * i + 2 + coff] +
+				 s1[4 * i + 2 + coff] + 1) >> 1;
+	}
+}
+
+static void nv12_to_rgb_c(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+			  int w, const struct yuv_coeffs *c, int bpp)
+{
+	int i;
+
+	for (i = 0; i < w; i++) {
+		int y1 = ((y[i] - 16) * 128 * c->yg + 0x4000) >> 15;
+		int u = uv[(i & ~1)] - 128;
+		int v = uv[(i & ~1) + 1] - 128;
+
+		dst[0] = clamp_u8((y1 + c->vr * v + 32) >> 6);
+		dst[1] = clamp_u8((y1 - c->ug * u - c->vg * v + 32) >> 6);
+		dst[2] = clamp_u8((y1 + c->ub * u + 32) >> 6);
+		if (bpp == 4)
+			dst[3] = 0xff;
+		dst += bpp;
+	}
+}
+
+static const struct convert_ops scalar_ops = {
+	.simd = NX_V4L2_SIMD_SCALAR,
+	.uv_split = uv_split_c,
+	.uv_merge = uv_merge_c,
+	.packed_to_nv12 = packed_to_nv12_c,
+	.nv12_to_rgb = nv12_to_rgb_c,
+};
+
+#ifdef HAVE_X86_SIMD
+/****************************************************************
+ * SSSE3
+ */
+__attribute__((target("ssse3")))
+static void uv_split_sse(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+
+		_mm_storeu_si128((__m128i *)(u + i),
+				 _mm_packus_epi16(_mm_and_si128(a, mask),
+						  _mm_and_si128(b, mask)));
+		_mm_storeu_si128((__m128i *)(v + i),
+				 _mm_packus_epi16(_mm_srli_epi16(a, 8),
+						  _mm_srli_epi16(b, 8)));
+	}
+
+	uv_split_c(uv + 2 * i, u + i, v + i, n - i);
+}
+
+__attribute__((target("ssse3")))
+static void uv_merge_sse(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+			 int n)
+{
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(u + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(v + i));
+
+		_mm_storeu_si128((__m128i *)(uv + 2 * i),
+				 _mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128((__m128i *)(uv + 2 * i + 16),
+				 _mm_unpackhi_epi8(a, b));
+	}
+
+	uv_merge_c(u + i, v + i, uv + 2 * i, n - i);
+}
+
+__attribute__((target("ssse3")))
+static void packed_to_nv12_sse(const uint8_t *s0, const uint8_t *s1,
+			       uint8_t *y0, uint8_t *y1, uint8_t *uv, int w,
+			       int yoff)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	__m128i a0, b0, a1, b1, ya0, yb0, ya1, yb1, ca0, cb0, ca1, cb1;
+	int i;
+
+	for (i = 0; i + 16 <= w; i += 16) {
+		a0 = _mm_loadu_si128((const __m128i *)(s0 + 2 * i));
+		b0 = _mm_loadu_si128((const __m128i *)(s0 + 2 * i + 16));
+		a1 = _mm_loadu_si128((const __m128i *)(s1 + 2 * i));
+		b1 = _mm_loadu_si128((const __m128i *)(s1 + 2 * i + 16));
+
+		if (yoff) {
+			ya0 = _mm_srli_epi16(a0, 8);
+			yb0 = _mm_srli_epi16(b0, 8);
+			ya1 = _mm_srli_epi16(a1, 8);
+			yb1 = _mm_srli_epi16(b1, 8);
+			ca0 = _mm_and_si128(a0, mask);
+			cb0 = _mm_and_si128(b0, mask);
+			ca1 = _mm_and_si128(a1, mask);
+			cb1 = _mm_and_si128(b1, mask);
+		} else {
+			ya0 = _mm_and_si128(a0, mask);
+			yb0 = _mm_and_si128(b0, mask);
+			ya1 = _mm_and_si128(a1, mask);
+			yb1 = _mm_and_si128(b1, mask);
+			ca0 = _mm_srli_epi16(a0, 8);
+			cb0 = _mm_srli_epi16(b0, 8);
+			ca1 = _mm_srli_epi16(a1, 8);
+			cb1 = _mm_srli_epi16(b1, 8);
+		}
+
+		_mm_storeu_si128((__m128i *)(y0 + i),
+				 _mm_packus_epi16(ya0, yb0));
+		if (y1)
+			_mm_storeu_si128((__m128i *)(y1 + i),
+					 _mm_packus_epi16(ya1, yb1));
+		_mm_storeu_si128((__m128i *)(uv + i),
+				 _mm_avg_epu8(_mm_packus_epi16(ca0, cb0),
+					      _mm_packus_epi16(ca1, cb1)));
+	}
+
+	packed_to_nv12_c(s0 + 2 * i, s1 + 2 * i, y0 + i, y1 ? y1 + i : NULL,
+			 uv + i, w - i, yoff);
+}
+
+/* store 8 pixels from the low 8 bytes of r, g and b */
+__attribute__((target("ssse3")))
+static inline void store_rgb8_sse(uint8_t *dst, __m128i r, __m128i g,
+				  __m128i b, int bpp)
+{
+	const __m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10,
+					   12, 13, 14, -1, -1, -1, -1);
+	__m128i rg = _mm_unpacklo_epi8(r, g);
+	__m128i ba = _mm_unpacklo_epi8(b, _mm_set1_epi8((char)0xff));
+	__m128i p0 = _mm_unpacklo_epi16(rg, ba);
+	__m128i p1 = _mm_unpackhi_epi16(rg, ba);
+	int32_t tail;
+
+	if (bpp == 4) {
+		_mm_storeu_si128((__m128i *)dst, p0);
+		_mm_storeu_si128((__m128i *)(dst + 16), p1);
+		return;
+	}
+
+	p0 = _mm_shuffle_epi8(p0, shuf);
+	p1 = _mm_shuffle_epi8(p1, shuf);
+	_mm_storel_epi64((__m128i *)dst, p0);
+	tail = _mm_cvtsi128_si32(_mm_srli_si128(p0, 8));
+	memcpy(dst + 8, &tail, 4);
+	_mm_storel_epi64((__m128i *)(dst + 12), p1);
+	tail = _mm_cvtsi128_si32(_mm_srli_si128(p1, 8));
+	memcpy(dst + 20, &tail, 4);
+}
+
+/* y, u and v are 8 signed 16bit values with chroma already duplicated */
+__attribute__((target("ssse3")))
+static inline void yuv_to_rgb16_sse(__m128i y, __m128i u, __m128i v,
+				    const struct yuv_coeffs *c, __m128i *r,
+				    __m128i *g, __m128i *b)
+{
+	const __m128i round = _mm_set1_epi16(32);
+	__m128i y1 = _mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), 7);
+
+	y1 = _mm_mulhrs_epi16(y1, _mm_set1_epi16(c->yg));
+
+	u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+	v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+	*r = _mm_adds_epi16(y1, _mm_mullo_epi16(v, _mm_set1_epi16(c->vr)));
+	*g = _mm_subs_epi16(y1, _mm_mullo_epi16(u, _mm_set1_epi16(c->ug)));
+	*g = _mm_subs_epi16(*g, _mm_mullo_epi16(v, _mm_set1_epi16(c->vg)));
+	*b = _mm_adds_epi16(y1, _mm_mullo_epi16(u, _mm_set1_epi16(c->ub)));
+
+	*r = _mm_srai_epi16(_mm_adds_epi16(*r, round), 6);
+	*g = _mm_srai_epi16(_mm_adds_epi16(*g, round), 6);
+	*b = _mm_srai_epi16(_mm_adds_epi16(*b, round), 6);
+}
+
+__attribute__((target("ssse3")))
+static void nv12_to_rgb_sse(const uint8_t *y, const uint8_t *uv,
+			    uint8_t *dst, int w, const struct yuv_coeffs *c,
+			    int bpp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo16 = _mm_set1_epi32(0xffff);
+	__m128i y16, uv16, u16, v16, r, g, b;
+	int i;
+
+	for (i = 0; i + 8 <= w; i += 8) {
+		y16 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)(y + i)), zero);
+		uv16 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)(uv + i)), zero);
+		u16 = _mm_and_si128(uv16, lo16);
+		u16 = _mm_or_si128(u16, _mm_slli_epi32(u16, 16));
+		v16 = _mm_srli_epi32(uv16, 16);
+		v16 = _mm_or_si128(v16, _mm_slli_epi32(v16, 16));
+
+		yuv_to_rgb16_sse(y16, u16, v16, c, &r, &g, &b);
+		store_rgb8_sse(dst + i * bpp, _mm_packus_epi16(r, r),
+			       _mm_packus_epi16(g, g), _mm_packus_epi16(b, b),
+			       bpp);
+	}
+
+	nv12_to_rgb_c(y + i, uv + i, dst + i * bpp, w - i, c, bpp);
+}
+
+static const struct convert_ops sse_ops = {
+	.simd = NX_V4L2_SIMD_SSE,
+	.uv_split = uv_split_sse,
+	.uv_merge = uv_merge_sse,
+	.packed_to_nv12 = packed_to_nv12_sse,
+	.nv12_to_rgb = nv12_to_rgb_sse,
+};
+
+/****************************************************************
+ * AVX2
+ */
+__attribute__((target("avx2")))
+static void uv_split_avx2(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	__m256i a, b, pu, pv;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		a = _mm256_loadu_si256((const __m256i *)(uv + 2 * i));
+		b = _mm256_loadu_si256((const __m256i *)(uv + 2 * i + 32));
+		pu = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+					 _mm256_and_si256(b, mask));
+		pv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+					 _mm256_srli_epi16(b, 8));
+		/* packus works per 128bit lane */
+		_mm256_storeu_si256((__m256i *)(u + i),
+				    _mm256_permute4x64_epi64(pu, 0xd8));
+		_mm256_storeu_si256((__m256i *)(v + i),
+				    _mm256_permute4x64_epi64(pv, 0xd8));
+	}
+
+	uv_split_sse(uv + 2 * i, u + i, v + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void uv_merge_avx2(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+			  int n)
+{
+	__m256i a, b, lo, hi;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		a = _mm256_loadu_si256((const __m256i *)(u + i));
+		b = _mm256_loadu_si256((const __m256i *)(v + i));
+		lo = _mm256_unpacklo_epi8(a, b);
+		hi = _mm256_unpackhi_epi8(a, b);
+		_mm256_storeu_si256((__m256i *)(uv + 2 * i),
+				    _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(uv + 2 * i + 32),
+				    _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	uv_merge_sse(u + i, v + i, uv + 2 * i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void packed_to_nv12_avx2(const uint8_t *s0, const uint8_t *s1,
+				uint8_t *y0, uint8_t *y1, uint8_t *uv, int w,
+				int yoff)
+{
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	__m256i a0, b0, a1, b1, ya0, yb0, ya1, yb1, ca0, cb0, ca1, cb1, c;
+	int i;
+
+	for (i = 0; i + 32 <= w; i += 32) {
+		a0 = _mm256_loadu_si256((const __m256i *)(s0 + 2 * i));
+		b0 = _mm256_loadu_si256((const __m256i *)(s0 + 2 * i + 32));
+		a1 = _mm256_loadu_si256((const __m256i *)(s1 + 2 * i));
+		b1 = _mm256_loadu_si256((const __m256i *)(s1 + 2 * i + 32));
+
+		if (yoff) {
+			ya0 = _mm256_srli_epi16(a0, 8);
+			yb0 = _mm256_srli_epi16(b0, 8);
+			ya1 = _mm256_srli_epi16(a1, 8);
+			yb1 = _mm256_srli_epi16(b1, 8);
+			ca0 = _mm256_and_si256(a0, mask);
+			cb0 = _mm256_and_si256(b0, mask);
+			ca1 = _mm256_and_si256(a1, mask);
+			cb1 = _mm256_and_si256(b1, mask);
+		} else {
+			ya0 = _mm256_and_si256(a0, mask);
+			yb0 = _mm256_and_si256(b0, mask);
+			ya1 = _mm256_and_si256(a1, mask);
+			yb1 = _mm256_and_si256(b1, mask);
+			ca0 = _mm256_srli_epi16(a0, 8);
+			cb0 = _mm256_srli_epi16(b0, 8);
+			ca1 = _mm256_srli_epi16(a1, 8);
+			cb1 = _mm256_srli_epi16(b1, 8);
+		}
+
+		_mm256_storeu_si256((__m256i *)(y0 + i),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(ya0, yb0), 0xd8));
+		if (y1)
+			_mm256_storeu_si256((__m256i *)(y1 + i),
+				_mm256_permute4x64_epi64(
+					_mm256_packus_epi16(ya1, yb1), 0xd8));
+		c = _mm256_avg_epu8(_mm256_packus_epi16(ca0, cb0),
+				    _mm256_packus_epi16(ca1, cb1));
+		_mm256_storeu_si256((__m256i *)(uv + i),
+				    _mm256_permute4x64_epi64(c, 0xd8));
+	}
+
+	packed_to_nv12_sse(s0 + 2 * i, s1 + 2 * i, y0 + i, y1 ? y1 + i : NULL,
+			   uv + i, w - i, yoff);
+}
+
+__attribute__((target("avx2")))
+static void nv12_to_rgb_avx2(const uint8_t *y, const uint8_t *uv,
+			     uint8_t *dst, int w, const struct yuv_coeffs *c,
+			     int bpp)
+{
+	const __m256i lo16 = _mm256_set1_epi32(0xffff);
+	const __m256i round = _mm256_set1_epi16(32);
+	const __m256i yg = _mm256_set1_epi16(c->yg);
+	const __m256i vr = _mm256_set1_epi16(c->vr);
+	const __m256i ug = _mm256_set1_epi16(c->ug);
+	const __m256i vg = _mm256_set1_epi16(c->vg);
+	const __m256i ub = _mm256_set1_epi16(c->ub);
+	__m256i y1, uv16, u16, v16, r, g, b;
+	__m128i r8, g8, b8;
+	int i;
+
+	for (i = 0; i + 16 <= w; i += 16) {
+		y1 = _mm256_cvtepu8_epi16(
+			_mm_loadu_si128((const __m128i *)(y + i)));
+		uv16 = _mm256_cvtepu8_epi16(
+			_mm_loadu_si128((const __m128i *)(uv + i)));
+		u16 = _mm256_and_si256(uv16, lo16);
+		u16 = _mm256_or_si256(u16, _mm256_slli_epi32(u16, 16));
+		v16 = _mm256_srli_epi32(uv16, 16);
+		v16 = _mm256_or_si256(v16, _mm256_slli_epi32(v16, 16));
+
+		y1 = _mm256_slli_epi16(
+			_mm256_sub_epi16(y1, _mm256_set1_epi16(16)), 7);
+		y1 = _mm256_mulhrs_epi16(y1, yg);
+		u16 = _mm256_sub_epi16(u16, _mm256_set1_epi16(128));
+		v16 = _mm256_sub_epi16(v16, _mm256_set1_epi16(128));
+
+		r = _mm256_adds_epi16(y1, _mm256_mullo_epi16(v16, vr));
+		g = _mm256_subs_epi16(y1, _mm256_mullo_epi16(u16, ug));
+		g = _mm256_subs_epi16(g, _mm256_mullo_epi16(v16, vg));
+		b = _mm256_adds_epi16(y1, _mm256_mullo_epi16(u16, ub));
+		r = _mm256_srai_epi16(_mm256_adds_epi16(r, round), 6);
+		g = _mm256_srai_epi16(_mm256_adds_epi16(g, round), 6);
+		b = _mm256_srai_epi16(_mm256_adds_epi16(b, round), 6);
+
+		r8 = _mm_packus_epi16(_mm256_castsi256_si128(r),
+				      _mm256_extracti128_si256(r, 1));
+		g8 = _mm_packus_epi16(_mm256_castsi256_si128(g),
+				      _mm256_extracti128_si256(g, 1));
+		b8 = _mm_packus_epi16(_mm256_castsi256_si128(b),
+				      _mm256_extracti128_si256(b, 1));
+		store_rgb8_sse(dst + i * bpp, r8, g8, b8, bpp);
+		store_rgb8_sse(dst + (i + 8) * bpp, _mm_srli_si128(r8, 8),
+			       _mm_srli_si128(g8, 8), _mm_srli_si128(b8, 8),
+			       bpp);
+	}
+
+	nv12_to_rgb_sse(y + i, uv + i, dst + i * bpp, w - i, c, bpp);
+}
+
+static const struct convert_ops avx2_ops = {
+	.simd = NX_V4L2_SIMD_AVX2,
+	.uv_split = uv_split_avx2,
+	.uv_merge = uv_merge_avx2,
+	.packed_to_nv12 = packed_to_nv12_avx2,
+	.nv12_to_rgb = nv12_to_rgb_avx2,
+};
+#endif /* HAVE_X86_SIMD */
+
+#ifdef HAVE_NEON
+/****************************************************************
+ * NEON
+ */
+static void uv_split_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+	uint8x16x2_t p;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		p = vld2q_u8(uv + 2 * i);
+		vst1q_u8(u + i, p.val[0]);
+		vst1q_u8(v + i, p.val[1]);
+	}
+
+	uv_split_c(uv + 2 * i, u + i, v + i, n - i);
+}
+
+static void uv_merge_neon(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+			  int n)
+{
+	uint8x16x2_t p;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		p.val[0] = vld1q_u8(u + i);
+		p.val[1] = vld1q_u8(v + i);
+		vst2q_u8(uv + 2 * i, p);
+	}
+
+	uv_merge_c(u + i, v + i, uv + 2 * i, n - i);
+}
+
+static void packed_to_nv12_neon(const uint8_t *s0, const uint8_t *s1,
+				uint8_t *y0, uint8_t *y1, uint8_t *uv, int w,
+				int yoff)
+{
+	uint8x16x2_t p0, p1;
+	int i;
+
+	for (i = 0; i + 16 <= w; i += 16) {
+		p0 = vld2q_u8(s0 + 2 * i);
+		p1 = vld2q_u8(s1 + 2 * i);
+		vst1q_u8(y0 + i, p0.val[yoff]);
+		if (y1)
+			vst1q_u8(y1 + i, p1.val[yoff]);
+		vst1q_u8(uv + i, vrhaddq_u8(p0.val[1 - yoff],
+					    p1.val[1 - yoff]));
+	}
+
+	packed_to_nv12_c(s0 + 2 * i, s1 + 2 * i, y0 + i, y1 ? y1 + i : NULL,
+			 uv + i, w - i, yoff);
+}
+
+static inline void yuv_to_rgb8_neon(uint8x8_t y8, uint8x8_t u8, uint8x8_t v8,
+				    const struct yuv_coeffs *c, uint8x8_t *r8,
+				    uint8x8_t *g8, uint8x8_t *b8)
+{
+	int16x8_t y1, u, v, r, g, b;
+
+	y1 = vreinterpretq_s16_u16(vsubl_u8(y8, vdup_n_u8(16)));
+	y1 = vqrdmulhq_n_s16(vshlq_n_s16(y1, 7), c->yg);
+	u = vreinterpretq_s16_u16(vsubl_u8(u8, vdup_n_u8(128)));
+	v = vreinterpretq_s16_u16(vsubl_u8(v8, vdup_n_u8(128)));
+
+	r = vqaddq_s16(y1, vmulq_n_s16(v, c->vr));
+	g = vqsubq_s16(y1, vmulq_n_s16(u, c->ug));
+	g = vqsubq_s16(g, vmulq_n_s16(v, c->vg));
+	b = vqaddq_s16(y1, vmulq_n_s16(u, c->ub));
+
+	*r8 = vqrshrun_n_s16(r, 6);
+	*g8 = vqrshrun_n_s16(g, 6);
+	*b8 = vqrshrun_n_s16(b, 6);
+}
+
+static void nv12_to_rgb_neon(const uint8_t *y, const uint8_t *uv,
+			     uint8_t *dst, int w, const struct yuv_coeffs *c,
+			     int bpp)
+{
+	uint8x16_t y16;
+	uint8x8x2_t cuv, du, dv;
+	uint8x8_t r0, g0, b0, r1, g1, b1;
+	uint8x16x3_t rgb;
+	uint8x16x4_t rgba;
+	int i;
+
+	for (i = 0; i + 16 <= w; i += 16) {
+		y16 = vld1q_u8(y + i);
+		cuv = vld2_u8(uv + i);
+		du = vzip_u8(cuv.val[0], cuv.val[0]);
+		dv = vzip_u8(cuv.val[1], cuv.val[1]);
+
+		yuv_to_rgb8_neon(vget_low_u8(y16), du.val[0], dv.val[0], c,
+				 &r0, &g0, &b0);
+		yuv_to_rgb8_neon(vget_high_u8(y16), du.val[1], dv.val[1], c,
+				 &r1, &g1, &b1);
+
+		if (bpp == 4) {
+			rgba.val[0] = vcombine_u8(r0, r1);
+			rgba.val[1] = vcombine_u8(g0, g1);
+			rgba.val[2] = vcombine_u8(b0, b1);
+			rgba.val[3] = vdupq_n_u8(0xff);
+			vst4q_u8(dst + i * 4, rgba);
+		} else {
+			rgb.val[0] = vcombine_u8(r0, r1);
+			rgb.val[1] = vcombine_u8(g0, g1);
+			rgb.val[2] = vcombine_u8(b0, b1);
+			vst3q_u8(dst + i * 3, rgb);
+		}
+	}
+
+	nv12_to_rgb_c(y + i, uv + i, dst + i * bpp, w - i, c, bpp);
+}
+
+static const struct convert_ops neon_ops = {
+	.simd = NX_V4L2_SIMD_NEON,
+	.uv_split = uv_split_neon,
+	.uv_merge = uv_merge_neon,
+	.packed_to_nv12 = packed_to_nv12_neon,
+	.nv12_to_rgb = nv12_to_rgb_neon,
+};
+#endif /* HAVE_NEON */
+
+/****************************************************************
+ * dispatch
+ */
+static const struct convert_ops *get_simd_ops(int simd)
+{
+	switch (simd) {
+	case NX_V4L2_SIMD_SCALAR:
+		return &scalar_ops;
+#ifdef HAVE_X86_SIMD
+	case NX_V4L2_SIMD_SSE:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3") ? &sse_ops : NULL;
+	case NX_V4L2_SIMD_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? &avx2_ops : NULL;
+#endif
+#ifdef HAVE_NEON
+	case NX_V4L2_SIMD_NEON:
+		return &neon_ops;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static const struct convert_ops *select_ops(void)
+{
+	static const int order[] = {
+		NX_V4L2_SIMD_NEON,
+		NX_V4L2_SIMD_AVX2,
+		NX_V4L2_SIMD_SSE,
+		NX_V4L2_SIMD_SCALAR,
+	};
+	const struct convert_ops *ops;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+		ops = get_simd_ops(order[i]);
+		if (ops)
+			return ops;
+	}
+
+	return &scalar_ops;
+}
+
+static const struct convert_ops *_convert_ops;
+
+static const struct convert_ops *get_ops(void)
+{
+	const struct convert_ops *ops;
+
+	ops = __atomic_load_n(&_convert_ops, __ATOMIC_ACQUIRE);
+	if (!ops) {
+		ops = select_ops();
+		__atomic_store_n(&_convert_ops, ops, __ATOMIC_RELEASE);
+	}
+
+	return ops;
+}
+
+int nx_v4l2_convert_set_simd(int simd)
+{
+	const struct convert_ops *ops;
+
+	ops = simd == NX_V4L2_SIMD_AUTO ? select_ops() : get_simd_ops(simd);
+	if (!ops)
+		return -ENOTSUP;
+
+	__atomic_store_n(&_convert_ops, ops, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int nx_v4l2_convert_get_simd(void)
+{
+	return get_ops()->simd;
+}
+
+/****************************************************************
+ * image layout
+ */
+static uint32_t base_format(uint32_t format)
+{
+	switch (format) {
+	case V4L2_PIX_FMT_NV12M:
+		return V4L2_PIX_FMT_NV12;
+	case V4L2_PIX_FMT_YUV420M:
+		return V4L2_PIX_FMT_YUV420;
+	default:
+		return format;
+	}
+}
+
+/* returns number of image planes and default stride of the first one */
+static int get_plane_info(uint32_t format, uint32_t width, uint32_t *stride)
+{
+	switch (base_format(format)) {
+	case V4L2_PIX_FMT_NV12:
+		*stride = width;
+		return 2;
+	case V4L2_PIX_FMT_YUV420:
+		*stride = width;
+		return 3;
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_UYVY:
+		*stride = ((width + 1) & ~1) * 2;
+		return 1;
+	case V4L2_PIX_FMT_RGB24:
+		*stride = width * 3;
+		return 1;
+	case V4L2_PIX_FMT_RGBA32:
+		*stride = width * 4;
+		return 1;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* an interleaved UV row holds a pair for every started pair of pixels */
+static uint32_t nv12_uv_stride(uint32_t stride, uint32_t width)
+{
+	uint32_t uv = ((width + 1) / 2) * 2;
+
+	return stride > uv ? stride : uv;
+}
+
+/* fill chroma planes which follow the luma plane in the same buffer */
+static void fill_chroma_planes(struct nx_v4l2_image *img, bool half_stride)
+{
+	uint32_t ch = (img->height + 1) / 2;
+	uint32_t cw = (img->width + 1) / 2;
+
+	img->data[1] = img->data[0] + img->strides[0] * img->height;
+	if (img->plane_num == 2) {
+		img->strides[1] = nv12_uv_stride(img->strides[0], img->width);
+		return;
+	}
+
+	img->strides[1] = half_stride ? img->strides[0] / 2 : cw;
+	img->strides[2] = img->strides[1];
+	img->data[2] = img->data[1] + img->strides[1] * ch;
+}
+
+int nx_v4l2_image_from_frame(struct nx_v4l2_image *img,
+			     const struct nx_v4l2_format_info *fmt,
+			     const struct nx_v4l2_frame *frame)
+{
+	uint32_t stride;
+	int planes;
+	int i;
+
+	planes = get_plane_info(fmt->format, fmt->width, &stride);
+	if (planes < 0)
+		return planes;
+
+	bzero(img, sizeof(*img));
+	img->format = base_format(fmt->format);
+	img->width = fmt->width;
+	img->height = fmt->height;
+	img->plane_num = planes;
+
+	if (frame->plane_num >= planes) {
+		for (i = 0; i < planes; i++) {
+			if (!frame->virt[i])
+				return -EINVAL;
+			img->data[i] = frame->virt[i];
+			img->strides[i] = fmt->strides[i];
+		}
+		if (!img->strides[0])
+			img->strides[0] = stride;
+		if (planes == 2 && !img->strides[1])
+			img->strides[1] = nv12_uv_stride(img->strides[0],
+							 img->width);
+		for (i = 1; i < planes && planes == 3; i++)
+			if (!img->strides[i])
+				img->strides[i] = (img->width + 1) / 2;
+		return 0;
+	}
+
+	/* all planes are contiguous in the first buffer plane */
+	if (!frame->virt[0])
+		return -EINVAL;
+
+	img->data[0] = frame->virt[0];
+	img->strides[0] = fmt->strides[0] ? fmt->strides[0] : stride;
+	if (planes > 1)
+		fill_chroma_planes(img, fmt->strides[0] != 0);
+
+	return 0;
+}
+
+size_t nx_v4l2_image_setup(struct nx_v4l2_image *img, uint32_t format,
+			   uint32_t width, uint32_t height, void *buf)
+{
+	struct nx_v4l2_image tmp;
+	uint32_t stride;
+	int planes;
+
+	planes = get_plane_info(format, width, &stride);
+	if (planes < 0)
+		return 0;
+
+	if (!img)
+		img = &tmp;
+
+	bzero(img, sizeof(*img));
+	img->format = base_format(format);
+	img->width = width;
+	img->height = height;
+	img->plane_num = planes;
+	img->data[0] = buf;
+	img->strides[0] = stride;
+	if (planes == 1)
+		return (size_t)stride * height;
+
+	fill_chroma_planes(img, false);
+	return (size_t)(img->data[planes - 1] - img->data[0]) +
+		(size_t)img->strides[planes - 1] * ((height + 1) / 2);
+}
+
+/****************************************************************
+ * conversions
+ */
+static void copy_plane(const uint8_t *src, uint32_t src_stride, uint8_t *dst,
+		       uint32_t dst_stride, uint32_t width, uint32_t height)
+{
+	uint32_t y;
+
+	if (src_stride == dst_stride && src_stride == width) {
+		memcpy(dst, src, (size_t)width * height);
+		return;
+	}
+
+	for (y = 0; y < height; y++)
+		memcpy(dst + y * dst_stride, src + y * src_stride, width);
+}
+
+static void nv12_to_i420(const struct convert_ops *ops,
+			 const struct nx_v4l2_image *src,
+			 struct nx_v4l2_image *dst)
+{
+	uint32_t cw = (src->width + 1) / 2;
+	uint32_t ch = (src->height + 1) / 2;
+	uint32_t y;
+
+	copy_plane(src->data[0], src->strides[0], dst->data[0],
+		   dst->strides[0], src->width, src->height);
+	for (y = 0; y < ch; y++)
+		ops->uv_split(src->data[1] + y * src->strides[1],
+			      dst->data[1] + y * dst->strides[1],
+			      dst->data[2] + y * dst->strides[2], cw);
+}
+
+static void i420_to_nv12(const struct convert_ops *ops,
+			 const struct nx_v4l2_image *src,
+			 struct nx_v4l2_image *dst)
+{
+	uint32_t cw = (src->width + 1) / 2;
+	uint32_t ch = (src->height + 1) / 2;
+	uint32_t y;
+
+	copy_plane(src->data[0], src->strides[0], dst->data[0],
+		   dst->strides[0], src->width, src->height);
+	for (y = 0; y < ch; y++)
+		ops->uv_merge(src->data[1] + y * src->strides[1],
+			      src->data[2] + y * src->strides[2],
+			      dst->data[1] + y * dst->strides[1], cw);
+}
+
+static void packed_to_nv12(const struct convert_ops *ops,
+			   const struct nx_v4l2_image *src,
+			   struct nx_v4l2_image *dst, int yoff)
+{
+	const uint8_t *s0, *s1;
+	uint8_t *y1;
+	uint32_t y;
+
+	for (y = 0; y < src->height; y += 2) {
+		s0 = src->data[0] + y * src->strides[0];
+		if (y + 1 < src->height) {
+			s1 = s0 + src->strides[0];
+			y1 = dst->data[0] + (y + 1) * dst->strides[0];
+		} else {
+			s1 = s0;
+			y1 = NULL;
+		}
+
+		ops->packed_to_nv12(s0, s1, dst->data[0] + y * dst->strides[0],
+				    y1, dst->data[1] + y / 2 * dst->strides[1],
+				    src->width, yoff);
+	}
+}
+
+static void nv12_to_rgb(const struct convert_ops *ops,
+			const struct nx_v4l2_image *src,
+			struct nx_v4l2_image *dst, const struct yuv_coeffs *c,
+			int bpp)
+{
+	uint32_t y;
+
+	for (y = 0; y < src->height; y++)
+		ops->nv12_to_rgb(src->data[0] + y * src->strides[0],
+				 src->data[1] + y / 2 * src->strides[1],
+				 dst->data[0] + y * dst->strides[0],
+				 src->width, c, bpp);
+}
+
+int nx_v4l2_convert(const struct nx_v4l2_image *src,
+		    struct nx_v4l2_image *dst, int color)
+{
+	const struct convert_ops *ops = get_ops();
+	uint32_t sf = base_format(src->format);
+	uint32_t df = base_format(dst->format);
+
+	if (src->width != dst->width || src->height != dst->height) {
+		fprintf(stderr, "%s: size mismatch %ux%u -> %ux%u\n",
+			__func__, src->width, src->height, dst->width,
+			dst->height);
+		return -EINVAL;
+	}
+
+	if (color != NX_V4L2_COLOR_BT601 && color != NX_V4L2_COLOR_BT709)
+		return -EINVAL;
+
+	if (sf == V4L2_PIX_FMT_NV12 && df == V4L2_PIX_FMT_YUV420) {
+		nv12_to_i420(ops, src, dst);
+	} else if (sf == V4L2_PIX_FMT_YUV420 && df == V4L2_PIX_FMT_NV12) {
+		i420_to_nv12(ops, src, dst);
+	} else if (sf == V4L2_PIX_FMT_YUYV && df == V4L2_PIX_FMT_NV12) {
+		packed_to_nv12(ops, src, dst, 0);
+	} else if (sf == V4L2_PIX_FMT_UYVY && df == V4L2_PIX_FMT_NV12) {
+		packed_to_nv12(ops, src, dst, 1);
+	} else if (sf == V4L2_PIX_FMT_NV12 && df == V4L2_PIX_FMT_RGB24) {
+		nv12_to_rgb(ops, src, dst, &coeffs[color], 3);
+	} else if (sf == V4L2_PIX_FMT_NV12 && df == V4L2_PIX_FMT_RGBA32) {
+		nv12_to_rgb(ops, src, dst, &coeffs[color], 4);
+	} else {
+		fprintf(stderr, "%s: unsupported conversion 0x%x -> 0x%x\n",
+			__func__, src->format, dst->format);
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
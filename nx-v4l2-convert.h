@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_CONVERT_H
+#define _NX_V4L2_CONVERT_H
+
+#include <stddef.h>
+
+#include "nx-v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pixel format conversion.
+ *
+ * supported conversions
+ *  NV12(M)          -> YUV420(M)
+ *  YUV420(M)        -> NV12(M)
+ *  YUYV, UYVY       -> NV12(M)
+ *  NV12(M)          -> RGB24, RGBA32
+ *
+ * YUV <-> RGB uses limited range BT.601 or BT.709 coefficients.
+ * Kernels are selected at runtime among NEON, AVX2, SSE and the scalar
+ * reference, every kernel gives bit exact results with the reference.
+ */
+
+#ifndef V4L2_PIX_FMT_RGBA32
+#define V4L2_PIX_FMT_RGBA32	v4l2_fourcc('A', 'B', '2', '4')
+#endif
+
+enum {
+	NX_V4L2_COLOR_BT601 = 0,
+	NX_V4L2_COLOR_BT709,
+};
+
+enum {
+	NX_V4L2_SIMD_AUTO = 0,
+	NX_V4L2_SIMD_SCALAR,
+	NX_V4L2_SIMD_SSE,
+	NX_V4L2_SIMD_AVX2,
+	NX_V4L2_SIMD_NEON,
+};
+
+struct nx_v4l2_image {
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	int plane_num;
+	uint8_t *data[NX_V4L2_MAX_PLANES];
+	uint32_t strides[NX_V4L2_MAX_PLANES];
+};
+
+int nx_v4l2_image_from_frame(struct nx_v4l2_image *img,
+			     const struct nx_v4l2_format_info *fmt,
+			     const struct nx_v4l2_frame *frame);
+size_t nx_v4l2_image_setup(struct nx_v4l2_image *img, uint32_t format,
+			   uint32_t width, uint32_t height, void *buf);
+
+int nx_v4l2_convert(const struct nx_v4l2_image *src,
+		    struct nx_v4l2_image *dst, int color);
+
+int nx_v4l2_convert_set_simd(int simd);
+int nx_v4l2_convert_get_simd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include <sys/eventfd.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-fanout.h"
+
+struct fanout_slot {
+	int refs;
+	struct nx_v4l2_frame frame;
+};
+
+struct nx_v4l2_fanout_ref {
+	struct nx_v4l2_fanout_consumer *consumer;
+	struct fanout_slot *slot;
+};
+
+struct nx_v4l2_fanout_consumer {
+	struct nx_v4l2_fanout *fanout;
+	int event_fd;
+	int max_held;
+	bool drop_oldest;
+	int held;		/* pending and acquired */
+	int head;
+	int count;		/* pending */
+	int pending[VIDEO_MAX_FRAME];
+	uint32_t delivered;
+	uint32_t dropped;
+	struct nx_v4l2_fanout_ref refs[VIDEO_MAX_FRAME];
+};
+
+struct nx_v4l2_fanout {
+	struct nx_v4l2_stream *stream;
+	pthread_mutex_t lock;
+	pthread_mutex_t qbuf_lock;
+	int consumer_num;
+	struct nx_v4l2_fanout_consumer *consumers[NX_V4L2_FANOUT_MAX_CONSUMERS];
+	struct fanout_slot slots[VIDEO_MAX_FRAME];
+};
+
+static int slot_put(struct nx_v4l2_fanout *fanout, struct fanout_slot *slot)
+{
+	int ret;
+
+	if (__atomic_sub_fetch(&slot->refs, 1, __ATOMIC_ACQ_REL))
+		return 0;
+
+	pthread_mutex_lock(&fanout->qbuf_lock);
+	ret = nx_v4l2_stream_qbuf(fanout->stream, &slot->frame);
+	pthread_mutex_unlock(&fanout->qbuf_lock);
+	if (ret)
+		fprintf(stderr, "%s: failed to queue buffer %d\n", __func__,
+			slot->frame.index);
+
+	return ret;
+}
+
+static void consumer_signal(struct nx_v4l2_fanout_consumer *c)
+{
+	uint64_t v = 1;
+
+	if (write(c->event_fd, &v, sizeof(v)) < 0)
+		fprintf(stderr, "%s: failed to signal event\n", __func__);
+}
+
+static void consumer_clear(struct nx_v4l2_fanout_consumer *c)
+{
+	uint64_t v;
+
+	if (read(c->event_fd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+		fprintf(stderr, "%s: failed to clear event\n", __func__);
+}
+
+struct nx_v4l2_fanout *nx_v4l2_fanout_create(struct nx_v4l2_stream *stream)
+{
+	struct nx_v4l2_fanout *fanout;
+
+	fanout = calloc(1, sizeof(*fanout));
+	if (!fanout)
+		return NULL;
+
+	fanout->stream = stream;
+	pthread_mutex_init(&fanout->lock, NULL);
+	pthread_mutex_init(&fanout->qbuf_lock, NULL);
+
+	return fanout;
+}
+
+void nx_v4l2_fanout_destroy(struct nx_v4l2_fanout *fanout)
+{
+	if (!fanout)
+		return;
+
+	while (fanout->consumer_num) {
+		if (nx_v4l2_fanout_detach(fanout->consumers[0]))
+			break;
+	}
+
+	pthread_mutex_destroy(&fanout->qbuf_lock);
+	pthread_mutex_destroy(&fanout->lock);
+	free(fanout);
+}
+
+int nx_v4l2_fanout_dispatch(struct nx_v4l2_fanout *fanout)
+{
+	struct fanout_slot *drops[NX_V4L2_FANOUT_MAX_CONSUMERS];
+	struct nx_v4l2_fanout_consumer *c;
+	struct nx_v4l2_frame frame;
+	struct fanout_slot *slot;
+	int drop_num = 0;
+	int delivered = 0;
+	int ret;
+	int i;
+
+	bzero(&frame, sizeof(frame));
+	ret = nx_v4l2_stream_dqbuf(fanout->stream, &frame);
+	if (ret)
+		return ret;
+
+	if (frame.index < 0 || frame.index >= VIDEO_MAX_FRAME)
+		return -EINVAL;
+
+	slot = &fanout->slots[frame.index];
+	slot->frame = frame;
+	/* dispatcher reference, keeps the slot until every consumer has it */
+	__atomic_store_n(&slot->refs, 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&fanout->lock);
+	for (i = 0; i < fanout->consumer_num; i++) {
+		c = fanout->consumers[i];
+		if (c->held >= c->max_held) {
+			c->dropped++;
+			if (!c->drop_oldest || !c->count)
+				continue;
+			drops[drop_num++] = &fanout->slots[c->pending[c->head]];
+			c->head = (c->head + 1) % VIDEO_MAX_FRAME;
+			c->count--;
+			c->held--;
+		}
+
+		__atomic_add_fetch(&slot->refs, 1, __ATOMIC_RELAXED);
+		c->refs[frame.index].slot = slot;
+		c->pending[(c->head + c->count) % VIDEO_MAX_FRAME] =
+			frame.index;
+		if (!c->count++)
+			consumer_signal(c);
+		c->held++;
+		c->delivered++;
+		delivered++;
+	}
+	pthread_mutex_unlock(&fanout->lock);
+
+	for (i = 0; i < drop_num; i++)
+		slot_put(fanout, drops[i]);
+
+	ret = slot_put(fanout, slot);
+	if (ret)
+		return ret;
+
+	return delivered;
+}
+
+struct nx_v4l2_fanout_consumer *nx_v4l2_fanout_attach(
+				struct nx_v4l2_fanout *fanout, int max_held,
+				bool drop_oldest)
+{
+	struct nx_v4l2_fanout_consumer *c;
+	int i;
+
+	if (max_held <= 0 || max_held > VIDEO_MAX_FRAME)
+		return NULL;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	c->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (c->event_fd < 0) {
+		fprintf(stderr, "%s: failed to create eventfd\n", __func__);
+		free(c);
+		return NULL;
+	}
+
+	c->fanout = fanout;
+	c->max_held = max_held;
+	c->drop_oldest = drop_oldest;
+	for (i = 0; i < VIDEO_MAX_FRAME; i++)
+		c->refs[i].consumer = c;
+
+	pthread_mutex_lock(&fanout->lock);
+	if (fanout->consumer_num >= NX_V4L2_FANOUT_MAX_CONSUMERS) {
+		pthread_mutex_unlock(&fanout->lock);
+		close(c->event_fd);
+		free(c);
+		return NULL;
+	}
+	fanout->consumers[fanout->consumer_num++] = c;
+	pthread_mutex_unlock(&fanout->lock);
+
+	return c;
+}
+
+int nx_v4l2_fanout_detach(struct nx_v4l2_fanout_consumer *consumer)
+{
+	struct nx_v4l2_fanout *fanout = consumer->fanout;
+	struct fanout_slot *drops[VIDEO_MAX_FRAME];
+	int drop_num = 0;
+	int i;
+
+	pthread_mutex_lock(&fanout->lock);
+	if (consumer->held > consumer->count) {
+		pthread_mutex_unlock(&fanout->lock);
+		fprintf(stderr, "%s: %d frames are not put\n", __func__,
+			consumer->held - consumer->count);
+		return -EBUSY;
+	}
+
+	for (i = 0; i < fanout->consumer_num; i++) {
+		if (fanout->consumers[i] == consumer) {
+			fanout->consumers[i] =
+				fanout->consumers[--fanout->consumer_num];
+			break;
+		}
+	}
+
+	while (consumer->count) {
+		drops[drop_num++] =
+			&fanout->slots[consumer->pending[consumer->head]];
+		consumer->head = (consumer->head + 1) % VIDEO_MAX_FRAME;
+		consumer->count--;
+	}
+	pthread_mutex_unlock(&fanout->lock);
+
+	for (i = 0; i < drop_num; i++)
+		slot_put(fanout, drops[i]);
+
+	close(consumer->event_fd);
+	free(consumer);
+
+	return 0;
+}
+
+int nx_v4l2_fanout_get_fd(struct nx_v4l2_fanout_consumer *consumer)
+{
+	return consumer->event_fd;
+}
+
+int nx_v4l2_fanout_acquire(struct nx_v4l2_fanout_consumer *consumer,
+			   struct nx_v4l2_fanout_ref **ref)
+{
+	struct nx_v4l2_fanout *fanout = consumer->fanout;
+	int index;
+
+	pthread_mutex_lock(&fanout->lock);
+	if (!consumer->count) {
+		pthread_mutex_unlock(&fanout->lock);
+		return -EAGAIN;
+	}
+
+	index = consumer->pending[consumer->head];
+	consumer->head = (consumer->head + 1) % VIDEO_MAX_FRAME;
+	if (!--consumer->count)
+		consumer_clear(consumer);
+	*ref = &consumer->refs[index];
+	pthread_mutex_unlock(&fanout->lock);
+
+	return 0;
+}
+
+const struct nx_v4l2_frame *nx_v4l2_fanout_frame(
+				const struct nx_v4l2_fanout_ref *ref)
+{
+	return &ref->slot->frame;
+}
+
+int nx_v4l2_fanout_put(struct nx_v4l2_fanout_ref *ref)
+{
+	struct nx_v4l2_fanout_consumer *c = ref->consumer;
+	struct nx_v4l2_fanout *fanout = c->fanout;
+	struct fanout_slot *slot = ref->slot;
+
+	pthread_mutex_lock(&fanout->lock);
+	c->held--;
+	pthread_mutex_unlock(&fanout->lock);
+
+	return slot_put(fanout, slot);
+}
+
+void nx_v4l2_fanout_get_stats(struct nx_v4l2_fanout_consumer *consumer,
+			      struct nx_v4l2_fanout_stats *stats)
+{
+	struct nx_v4l2_fanout *fanout = consumer->fanout;
+
+	pthread_mutex_lock(&fanout->lock);
+	stats->delivered = consumer->delivered;
+	stats->dropped = consumer->dropped;
+	stats->held = consumer->held;
+	pthread_mutex_unlock(&fanout->lock);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_FANOUT_H
+#define _NX_V4L2_FANOUT_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Zero-copy distribution of stream frames to several consumers.
+ *
+ * nx_v4l2_fanout_dispatch() dequeues a frame from the stream and hands a
+ * reference to every attached consumer, the buffer is queued back to the
+ * stream when the last reference is put. A consumer polls the fd given by
+ * nx_v4l2_fanout_get_fd() and takes its frames with
+ * nx_v4l2_fanout_acquire().
+ *
+ * Every consumer holds at most max_held frames(pending plus acquired), a
+ * frame which would exceed the limit is dropped for that consumer only. If
+ * drop_oldest is set the oldest pending frame is dropped instead, so the
+ * consumer always sees the latest frame(display).
+ *
+ * dispatch may run concurrently with acquire and put from other threads,
+ * the stream must allow dqbuf and qbuf of different buffers at the same
+ * time(v4l2 video node sources do).
+ */
+
+#define NX_V4L2_FANOUT_MAX_CONSUMERS	8
+
+struct nx_v4l2_fanout;
+struct nx_v4l2_fanout_consumer;
+struct nx_v4l2_fanout_ref;
+
+struct nx_v4l2_fanout_stats {
+	uint32_t delivered;
+	uint32_t dropped;
+	int held;
+};
+
+struct nx_v4l2_fanout *nx_v4l2_fanout_create(struct nx_v4l2_stream *stream);
+void nx_v4l2_fanout_destroy(struct nx_v4l2_fanout *fanout);
+int nx_v4l2_fanout_dispatch(struct nx_v4l2_fanout *fanout);
+
+struct nx_v4l2_fanout_consumer *nx_v4l2_fanout_attach(
+				struct nx_v4l2_fanout *fanout, int max_held,
+				bool drop_oldest);
+int nx_v4l2_fanout_detach(struct nx_v4l2_fanout_consumer *consumer);
+int nx_v4l2_fanout_get_fd(struct nx_v4l2_fanout_consumer *consumer);
+int nx_v4l2_fanout_acquire(struct nx_v4l2_fanout_consumer *consumer,
+			   struct nx_v4l2_fanout_ref **ref);
+const struct nx_v4l2_frame *nx_v4l2_fanout_frame(
+				const struct nx_v4l2_fanout_ref *ref);
+int nx_v4l2_fanout_put(struct nx_v4l2_fanout_ref *ref);
+void nx_v4l2_fanout_get_stats(struct nx_v4l2_fanout_consumer *consumer,
+			      struct nx_v4l2_fanout_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include <sys/ioctl.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+#include "nx-v4l2-layout.h"
+
+#define ALIGN(v, a)	(((v) + (a) - 1) / (a) * (a))
+#define DIV_ROUND_UP(v, d)	(((v) + (d) - 1) / (d))
+
+static const struct nx_v4l2_pixfmt pixfmts[] = {
+	/* format		planes buffers hsub vsub cpp */
+	{ V4L2_PIX_FMT_NV12,	2, 1, 2, 2, { 1, 2 } },
+	{ V4L2_PIX_FMT_NV21,	2, 1, 2, 2, { 1, 2 } },
+	{ V4L2_PIX_FMT_NV16,	2, 1, 2, 1, { 1, 2 } },
+	{ V4L2_PIX_FMT_NV61,	2, 1, 2, 1, { 1, 2 } },
+	{ V4L2_PIX_FMT_NV12M,	2, 2, 2, 2, { 1, 2 } },
+	{ V4L2_PIX_FMT_NV21M,	2, 2, 2, 2, { 1, 2 } },
+	{ V4L2_PIX_FMT_NV16M,	2, 2, 2, 1, { 1, 2 } },
+	{ V4L2_PIX_FMT_NV61M,	2, 2, 2, 1, { 1, 2 } },
+	{ V4L2_PIX_FMT_YUV420,	3, 1, 2, 2, { 1, 1, 1 } },
+	{ V4L2_PIX_FMT_YVU420,	3, 1, 2, 2, { 1, 1, 1 } },
+	{ V4L2_PIX_FMT_YUV422P,	3, 1, 2, 1, { 1, 1, 1 } },
+	{ V4L2_PIX_FMT_YUV420M,	3, 3, 2, 2, { 1, 1, 1 } },
+	{ V4L2_PIX_FMT_YVU420M,	3, 3, 2, 2, { 1, 1, 1 } },
+	{ V4L2_PIX_FMT_YUV422M,	3, 3, 2, 1, { 1, 1, 1 } },
+	{ V4L2_PIX_FMT_YUYV,	1, 1, 2, 1, { 2 } },
+	{ V4L2_PIX_FMT_YVYU,	1, 1, 2, 1, { 2 } },
+	{ V4L2_PIX_FMT_UYVY,	1, 1, 2, 1, { 2 } },
+	{ V4L2_PIX_FMT_VYUY,	1, 1, 2, 1, { 2 } },
+	{ V4L2_PIX_FMT_GREY,	1, 1, 1, 1, { 1 } },
+	{ V4L2_PIX_FMT_RGB565,	1, 1, 1, 1, { 2 } },
+	{ V4L2_PIX_FMT_RGB24,	1, 1, 1, 1, { 3 } },
+	{ V4L2_PIX_FMT_BGR24,	1, 1, 1, 1, { 3 } },
+	{ V4L2_PIX_FMT_RGBA32,	1, 1, 1, 1, { 4 } },
+	{ V4L2_PIX_FMT_XRGB32,	1, 1, 1, 1, { 4 } },
+};
+
+const struct nx_v4l2_pixfmt *nx_v4l2_pixfmt_find(uint32_t format)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(pixfmts) / sizeof(pixfmts[0]); i++)
+		if (pixfmts[i].format == format)
+			return &pixfmts[i];
+
+	return NULL;
+}
+
+/* lay out the planes from the luma stride and height */
+static void fill_layout(struct nx_v4l2_layout *layout,
+			const struct nx_v4l2_pixfmt *pf, uint32_t stride,
+			uint32_t height, uint32_t stride_align)
+{
+	struct nx_v4l2_plane_layout *p;
+	uint32_t calign = stride_align / pf->hsub;
+	int i;
+
+	if (!calign)
+		calign = 1;
+
+	bzero(layout->planes, sizeof(layout->planes));
+	bzero(layout->buffer_sizes, sizeof(layout->buffer_sizes));
+	layout->plane_num = pf->planes;
+	layout->buffer_num = pf->buffers;
+
+	for (i = 0; i < pf->planes; i++) {
+		p = &layout->planes[i];
+		if (i == 0) {
+			p->stride = stride;
+			p->height = height;
+		} else {
+			p->stride = pf->planes == 2 ? stride :
+				    ALIGN(DIV_ROUND_UP(stride, pf->hsub),
+					  calign);
+			p->height = (height + pf->vsub - 1) / pf->vsub;
+		}
+		p->size = p->stride * p->height;
+		p->buffer = pf->buffers == 1 ? 0 : i;
+		p->offset = layout->buffer_sizes[p->buffer];
+		layout->buffer_sizes[p->buffer] += p->size;
+	}
+}
+
+int nx_v4l2_layout_calc(uint32_t format, uint32_t width, uint32_t height,
+			uint32_t stride_align, uint32_t height_align,
+			struct nx_v4l2_layout *layout)
+{
+	const struct nx_v4l2_pixfmt *pf = nx_v4l2_pixfmt_find(format);
+	uint32_t stride;
+
+	if (!pf || !width || !height) {
+		fprintf(stderr, "%s: unsupported format 0x%x %ux%u\n",
+			__func__, format, width, height);
+		return -EINVAL;
+	}
+
+	if (!stride_align)
+		stride_align = 1;
+	if (!height_align)
+		height_align = 1;
+
+	layout->format = format;
+	layout->width = width;
+	layout->height = height;
+
+	/* packed 4:2:2 lines hold whole pixel pairs */
+	if (pf->planes == 1 && pf->hsub > 1)
+		width = ALIGN(width, pf->hsub);
+	stride = ALIGN(width * pf->cpp[0], stride_align);
+	fill_layout(layout, pf, stride, ALIGN(height, height_align),
+		    stride_align);
+
+	return 0;
+}
+
+int nx_v4l2_layout_reconcile(struct nx_v4l2_layout *layout,
+			     const struct v4l2_format *fmt)
+{
+	const struct nx_v4l2_pixfmt *pf;
+	struct nx_v4l2_layout min;
+	uint32_t stride, sizes[NX_V4L2_MAX_PLANES];
+	uint32_t strides[NX_V4L2_MAX_PLANES];
+	int num, i;
+
+	bzero(strides, sizeof(strides));
+	bzero(sizes, sizeof(sizes));
+	if (V4L2_TYPE_IS_MULTIPLANAR(fmt->type)) {
+		layout->format = fmt->fmt.pix_mp.pixelformat;
+		layout->width = fmt->fmt.pix_mp.width;
+		layout->height = fmt->fmt.pix_mp.height;
+		num = fmt->fmt.pix_mp.num_planes;
+		for (i = 0; i < num && i < NX_V4L2_MAX_PLANES; i++) {
+			strides[i] = fmt->fmt.pix_mp.plane_fmt[i].bytesperline;
+			sizes[i] = fmt->fmt.pix_mp.plane_fmt[i].sizeimage;
+		}
+	} else {
+		layout->format = fmt->fmt.pix.pixelformat;
+		layout->width = fmt->fmt.pix.width;
+		layout->height = fmt->fmt.pix.height;
+		num = 1;
+		strides[0] = fmt->fmt.pix.bytesperline;
+		sizes[0] = fmt->fmt.pix.sizeimage;
+	}
+
+	pf = nx_v4l2_pixfmt_find(layout->format);
+	if (!pf || num != pf->buffers) {
+		fprintf(stderr, "%s: unknown layout of 0x%x, %d planes\n",
+			__func__, layout->format, num);
+		return -EINVAL;
+	}
+
+	/* smallest layout the format needs */
+	nx_v4l2_layout_calc(layout->format, layout->width, layout->height,
+			    1, 1, &min);
+	if (strides[0] && strides[0] < min.planes[0].stride) {
+		fprintf(stderr, "%s: bytesperline %u is too small\n",
+			__func__, strides[0]);
+		return -EINVAL;
+	}
+
+	stride = strides[0] ? strides[0] : layout->planes[0].stride;
+	if (!stride)
+		stride = min.planes[0].stride;
+
+	/* keep the aligned height only if the driver's sizes hold it */
+	fill_layout(layout, pf, stride,
+		    ALIGN(layout->height, NX_V4L2_HEIGHT_ALIGN),
+		    NX_V4L2_STRIDE_ALIGN);
+	for (i = 0; i < num; i++) {
+		if (sizes[i] && sizes[i] < layout->buffer_sizes[i]) {
+			fill_layout(layout, pf, stride, layout->height,
+				    NX_V4L2_STRIDE_ALIGN);
+			break;
+		}
+	}
+
+	/* drivers report their own chroma strides for separate buffers */
+	for (i = 1; i < num && pf->buffers > 1; i++) {
+		if (!strides[i])
+			continue;
+		if (strides[i] < min.planes[i].stride) {
+			fprintf(stderr, "%s: plane %d bytesperline %u is too small\n",
+				__func__, i, strides[i]);
+			return -EINVAL;
+		}
+		layout->planes[i].stride = strides[i];
+		layout->planes[i].size = strides[i] * layout->planes[i].height;
+		layout->buffer_sizes[i] = layout->planes[i].size;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (sizes[i] && sizes[i] < layout->buffer_sizes[i]) {
+			fprintf(stderr, "%s: plane %d sizeimage %u < %u\n",
+				__func__, i, sizes[i],
+				layout->buffer_sizes[i]);
+			return -EINVAL;
+		}
+		if (sizes[i])
+			layout->buffer_sizes[i] = sizes[i];
+	}
+
+	return 0;
+}
+
+int nx_v4l2_layout_query(int fd, int type, bool try_fmt,
+			 struct nx_v4l2_layout *layout)
+{
+	struct v4l2_format v4l2_fmt;
+	unsigned long req = try_fmt ? VIDIOC_TRY_FMT : VIDIOC_G_FMT;
+	bool capture;
+	int ret;
+
+	switch (type) {
+	case nx_sensor_subdev:
+	case nx_clipper_subdev:
+	case nx_decimator_subdev:
+	case nx_csi_subdev:
+		return -EINVAL;
+	}
+	/* same mapping as the buffer calls of nx-v4l2.c */
+	capture = type == nx_clipper_video || type == nx_decimator_video;
+
+	if (try_fmt) {
+		ret = nx_v4l2_layout_calc(layout->format, layout->width,
+					  layout->height, NX_V4L2_STRIDE_ALIGN,
+					  NX_V4L2_HEIGHT_ALIGN, layout);
+		if (ret)
+			return ret;
+	} else {
+		bzero(layout, sizeof(*layout));
+	}
+
+	bzero(&v4l2_fmt, sizeof(v4l2_fmt));
+	v4l2_fmt.type = capture ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE :
+				  V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	v4l2_fmt.fmt.pix_mp.pixelformat = layout->format;
+	v4l2_fmt.fmt.pix_mp.width = layout->width;
+	v4l2_fmt.fmt.pix_mp.height = layout->height;
+	v4l2_fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
+	ret = ioctl(fd, req, &v4l2_fmt);
+	if (ret && errno == EINVAL) {
+		/* single planar node, used with mmap */
+		bzero(&v4l2_fmt, sizeof(v4l2_fmt));
+		v4l2_fmt.type = capture ? V4L2_BUF_TYPE_VIDEO_CAPTURE :
+					  V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		v4l2_fmt.fmt.pix.pixelformat = layout->format;
+		v4l2_fmt.fmt.pix.width = layout->width;
+		v4l2_fmt.fmt.pix.height = layout->height;
+		v4l2_fmt.fmt.pix.field = V4L2_FIELD_ANY;
+		ret = ioctl(fd, req, &v4l2_fmt);
+	}
+	if (ret)
+		return ret;
+
+	return nx_v4l2_layout_reconcile(layout, &v4l2_fmt);
+}
+
+int nx_v4l2_layout_from_format_info(const struct nx_v4l2_format_info *info,
+				    struct nx_v4l2_layout *layout)
+{
+	struct v4l2_format v4l2_fmt;
+	int i;
+
+	if (info->plane_num < 1 || info->plane_num > NX_V4L2_MAX_PLANES)
+		return -EINVAL;
+
+	bzero(&v4l2_fmt, sizeof(v4l2_fmt));
+	v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	v4l2_fmt.fmt.pix_mp.pixelformat = info->format;
+	v4l2_fmt.fmt.pix_mp.width = info->width;
+	v4l2_fmt.fmt.pix_mp.height = info->height;
+	v4l2_fmt.fmt.pix_mp.num_planes = info->plane_num;
+	for (i = 0; i < info->plane_num; i++) {
+		v4l2_fmt.fmt.pix_mp.plane_fmt[i].bytesperline = info->strides[i];
+		v4l2_fmt.fmt.pix_mp.plane_fmt[i].sizeimage = info->sizes[i];
+	}
+
+	return nx_v4l2_layout_reconcile(layout, &v4l2_fmt);
+}
+
+void nx_v4l2_layout_to_format_info(const struct nx_v4l2_layout *layout,
+				   struct nx_v4l2_format_info *info)
+{
+	int i;
+
+	bzero(info, sizeof(*info));
+	info->format = layout->format;
+	info->width = layout->width;
+	info->height = layout->height;
+	info->plane_num = layout->buffer_num;
+	for (i = 0; i < layout->plane_num; i++) {
+		const struct nx_v4l2_plane_layout *p = &layout->planes[i];
+
+		if (p->buffer == i || i == 0)
+			info->strides[p->buffer] = p->stride;
+	}
+	for (i = 0; i < layout->buffer_num; i++)
+		info->sizes[i] = layout->buffer_sizes[i];
+}
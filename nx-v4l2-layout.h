@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_LAYOUT_H
+#define _NX_V4L2_LAYOUT_H
+
+#include "nx-v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pixel format table and plane layout.
+ *
+ * nx_v4l2_layout_calc() gives the stride, height, offset and size of every
+ * color plane and the size of every buffer(memory plane) for a format.
+ * Luma strides are aligned to stride_align bytes, chroma strides of planar
+ * formats to stride_align / hsub(the luma stride divided by hsub rounds
+ * up), and plane heights to height_align lines.
+ * The defaults match the Nexell video input hardware.
+ *
+ * nx_v4l2_layout_reconcile() takes bytesperline and sizeimage reported by
+ * VIDIOC_G_FMT/TRY_FMT, they win over the table when they are large
+ * enough, and the table fills in the planes the driver doesn't report.
+ */
+
+#define NX_V4L2_STRIDE_ALIGN	32
+#define NX_V4L2_HEIGHT_ALIGN	16
+
+struct nx_v4l2_pixfmt {
+	uint32_t format;
+	uint8_t planes;			/* color planes */
+	uint8_t buffers;		/* memory planes */
+	uint8_t hsub;
+	uint8_t vsub;
+	uint8_t cpp[NX_V4L2_MAX_PLANES];	/* bytes per sample */
+};
+
+struct nx_v4l2_plane_layout {
+	int buffer;
+	uint32_t offset;
+	uint32_t stride;
+	uint32_t height;
+	uint32_t size;
+};
+
+struct nx_v4l2_layout {
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	int plane_num;
+	int buffer_num;
+	struct nx_v4l2_plane_layout planes[NX_V4L2_MAX_PLANES];
+	uint32_t buffer_sizes[NX_V4L2_MAX_PLANES];
+};
+
+const struct nx_v4l2_pixfmt *nx_v4l2_pixfmt_find(uint32_t format);
+
+int nx_v4l2_layout_calc(uint32_t format, uint32_t width, uint32_t height,
+			uint32_t stride_align, uint32_t height_align,
+			struct nx_v4l2_layout *layout);
+int nx_v4l2_layout_reconcile(struct nx_v4l2_layout *layout,
+			     const struct v4l2_format *fmt);
+int nx_v4l2_layout_query(int fd, int type, bool try_fmt,
+			 struct nx_v4l2_layout *layout);
+int nx_v4l2_layout_from_format_info(const struct nx_v4l2_format_info *info,
+				    struct nx_v4l2_layout *layout);
+void nx_v4l2_layout_to_format_info(const struct nx_v4l2_layout *layout,
+				   struct nx_v4l2_format_info *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
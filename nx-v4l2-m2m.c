@@ -0,0 +1,969 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-layout.h"
+#include "nx-v4l2-m2m.h"
+
+#define MAX_BUFS	VIDEO_MAX_FRAME
+#define MAX_VIDEO_NODES	64
+
+struct m2m_queue {
+	struct nx_v4l2_format_info fmt;
+	uint32_t buf_type;
+	uint32_t memory;
+	int count;
+	bool queued[MAX_BUFS];
+	int fds[MAX_BUFS][NX_V4L2_MAX_PLANES];
+	void *virt[MAX_BUFS][NX_V4L2_MAX_PLANES];
+	uint32_t lengths[MAX_BUFS][NX_V4L2_MAX_PLANES];
+};
+
+struct m2m_job {
+	uint32_t sequence;
+	struct timeval timestamp;
+	uint64_t submit_us;
+};
+
+/* dqbuf returns 1 for a buffer the device flagged as broken */
+struct m2m_ops {
+	int (*qbuf)(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+		    const struct nx_v4l2_frame *frame);
+	int (*dqbuf)(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+		     struct nx_v4l2_frame *frame);
+	void (*release)(struct nx_v4l2_m2m *m2m);
+};
+
+struct nx_v4l2_m2m {
+	const struct m2m_ops *ops;
+	int fd;
+	int epoll_fd;
+	bool mplane;
+	int depth;
+	struct m2m_queue out;
+	struct m2m_queue cap;
+	struct nx_v4l2_frame sources[MAX_BUFS];
+	struct m2m_job jobs[MAX_BUFS];
+	int job_head;
+	int job_count;
+	struct nx_v4l2_m2m_stats stats;
+	void *priv;
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool is_output(struct nx_v4l2_m2m *m2m, struct m2m_queue *q)
+{
+	return q == &m2m->out;
+}
+
+/****************************************************************
+ * v4l2 device
+ */
+static int v4l2_qbuf(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+		     const struct nx_v4l2_frame *frame)
+{
+	struct v4l2_buffer buf;
+	struct v4l2_plane planes[NX_V4L2_MAX_PLANES];
+	bool dmabuf = q->memory == V4L2_MEMORY_DMABUF;
+	int i;
+
+	bzero(&buf, sizeof(buf));
+	bzero(planes, sizeof(planes));
+	buf.type = q->buf_type;
+	buf.memory = q->memory;
+	buf.index = frame->index;
+	if (is_output(m2m, q)) {
+		buf.field = V4L2_FIELD_NONE;
+		buf.timestamp = frame->timestamp;
+	}
+
+	if (m2m->mplane) {
+		buf.m.planes = planes;
+		buf.length = q->fmt.plane_num;
+		for (i = 0; i < q->fmt.plane_num; i++) {
+			planes[i].bytesused = frame->bytesused[i];
+			if (dmabuf) {
+				planes[i].m.fd = frame->fds[i];
+				planes[i].length = frame->sizes[i];
+			}
+		}
+	} else {
+		buf.bytesused = frame->bytesused[0];
+		if (dmabuf) {
+			buf.m.fd = frame->fds[0];
+			buf.length = frame->sizes[0];
+		}
+	}
+
+	return ioctl(m2m->fd, VIDIOC_QBUF, &buf) ? -errno : 0;
+}
+
+static int v4l2_dqbuf(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+		      struct nx_v4l2_frame *frame)
+{
+	struct v4l2_buffer buf;
+	struct v4l2_plane planes[NX_V4L2_MAX_PLANES];
+	int i;
+
+	bzero(&buf, sizeof(buf));
+	bzero(planes, sizeof(planes));
+	buf.type = q->buf_type;
+	buf.memory = q->memory;
+	if (m2m->mplane) {
+		buf.m.planes = planes;
+		buf.length = q->fmt.plane_num;
+	}
+
+	if (ioctl(m2m->fd, VIDIOC_DQBUF, &buf))
+		return -errno;
+
+	if (buf.index >= (uint32_t)q->count)
+		return -EINVAL;
+
+	frame->index = buf.index;
+	frame->plane_num = q->fmt.plane_num;
+	for (i = 0; i < q->fmt.plane_num; i++)
+		frame->bytesused[i] = m2m->mplane ? planes[i].bytesused :
+			buf.bytesused;
+	frame->sequence = buf.sequence;
+	frame->timestamp = buf.timestamp;
+
+	return buf.flags & V4L2_BUF_FLAG_ERROR ? 1 : 0;
+}
+
+static void v4l2_unmap(struct m2m_queue *q)
+{
+	int i, j;
+
+	for (i = 0; i < q->count; i++) {
+		for (j = 0; j < q->fmt.plane_num; j++) {
+			if (q->virt[i][j])
+				munmap(q->virt[i][j], q->lengths[i][j]);
+			if (q->fds[i][j] >= 0)
+				close(q->fds[i][j]);
+			q->virt[i][j] = NULL;
+			q->fds[i][j] = -1;
+		}
+	}
+}
+
+static void v4l2_release(struct nx_v4l2_m2m *m2m)
+{
+	struct v4l2_requestbuffers req;
+	struct m2m_queue *qs[2] = { &m2m->out, &m2m->cap };
+	uint32_t type;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		type = qs[i]->buf_type;
+		ioctl(m2m->fd, VIDIOC_STREAMOFF, &type);
+		v4l2_unmap(qs[i]);
+		if (!qs[i]->count)
+			continue;
+
+		bzero(&req, sizeof(req));
+		req.type = qs[i]->buf_type;
+		req.memory = qs[i]->memory;
+		ioctl(m2m->fd, VIDIOC_REQBUFS, &req);
+	}
+}
+
+static const struct m2m_ops v4l2_ops = {
+	.qbuf = v4l2_qbuf,
+	.dqbuf = v4l2_dqbuf,
+	.release = v4l2_release,
+};
+
+static int v4l2_set_format(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+			   uint32_t w, uint32_t h, uint32_t format)
+{
+	struct nx_v4l2_format_info *fmt = &q->fmt;
+	struct v4l2_format v4l2_fmt;
+	int i;
+
+	bzero(&v4l2_fmt, sizeof(v4l2_fmt));
+	v4l2_fmt.type = q->buf_type;
+	if (m2m->mplane) {
+		v4l2_fmt.fmt.pix_mp.width = w;
+		v4l2_fmt.fmt.pix_mp.height = h;
+		v4l2_fmt.fmt.pix_mp.pixelformat = format;
+		v4l2_fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+	} else {
+		v4l2_fmt.fmt.pix.width = w;
+		v4l2_fmt.fmt.pix.height = h;
+		v4l2_fmt.fmt.pix.pixelformat = format;
+		v4l2_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	}
+
+	if (ioctl(m2m->fd, VIDIOC_S_FMT, &v4l2_fmt))
+		return -errno;
+
+	if (!m2m->mplane) {
+		fmt->format = v4l2_fmt.fmt.pix.pixelformat;
+		fmt->width = v4l2_fmt.fmt.pix.width;
+		fmt->height = v4l2_fmt.fmt.pix.height;
+		fmt->plane_num = 1;
+		fmt->strides[0] = v4l2_fmt.fmt.pix.bytesperline;
+		fmt->sizes[0] = v4l2_fmt.fmt.pix.sizeimage;
+		return 0;
+	}
+
+	fmt->format = v4l2_fmt.fmt.pix_mp.pixelformat;
+	fmt->width = v4l2_fmt.fmt.pix_mp.width;
+	fmt->height = v4l2_fmt.fmt.pix_mp.height;
+	fmt->plane_num = v4l2_fmt.fmt.pix_mp.num_planes;
+	if (fmt->plane_num < 1 || fmt->plane_num > NX_V4L2_MAX_PLANES)
+		return -EINVAL;
+	for (i = 0; i < fmt->plane_num; i++) {
+		fmt->strides[i] = v4l2_fmt.fmt.pix_mp.plane_fmt[i].bytesperline;
+		fmt->sizes[i] = v4l2_fmt.fmt.pix_mp.plane_fmt[i].sizeimage;
+	}
+
+	return 0;
+}
+
+static int v4l2_map_buffer(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+			   int index)
+{
+	struct v4l2_buffer buf;
+	struct v4l2_plane planes[NX_V4L2_MAX_PLANES];
+	struct v4l2_exportbuffer expbuf;
+	uint32_t offset;
+	void *virt;
+	int i;
+
+	bzero(&buf, sizeof(buf));
+	bzero(planes, sizeof(planes));
+	buf.type = q->buf_type;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = index;
+	if (m2m->mplane) {
+		buf.m.planes = planes;
+		buf.length = q->fmt.plane_num;
+	}
+
+	if (ioctl(m2m->fd, VIDIOC_QUERYBUF, &buf))
+		return -errno;
+
+	for (i = 0; i < q->fmt.plane_num; i++) {
+		q->lengths[index][i] = m2m->mplane ? planes[i].length :
+			buf.length;
+		offset = m2m->mplane ? planes[i].m.mem_offset : buf.m.offset;
+		virt = mmap(NULL, q->lengths[index][i],
+			    PROT_READ | PROT_WRITE, MAP_SHARED, m2m->fd,
+			    offset);
+		if (virt == MAP_FAILED)
+			return -errno;
+		q->virt[index][i] = virt;
+
+		/* results are passed on as dmabuf when the driver exports */
+		if (is_output(m2m, q))
+			continue;
+		bzero(&expbuf, sizeof(expbuf));
+		expbuf.type = q->buf_type;
+		expbuf.index = index;
+		expbuf.plane = i;
+		expbuf.flags = O_RDWR | O_CLOEXEC;
+		if (!ioctl(m2m->fd, VIDIOC_EXPBUF, &expbuf))
+			q->fds[index][i] = expbuf.fd;
+	}
+
+	return 0;
+}
+
+static int v4l2_setup_queue(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+			    int count)
+{
+	struct v4l2_requestbuffers req;
+	int ret;
+	int i;
+
+	bzero(&req, sizeof(req));
+	req.count = count;
+	req.type = q->buf_type;
+	req.memory = q->memory;
+	if (ioctl(m2m->fd, VIDIOC_REQBUFS, &req))
+		return -errno;
+
+	if (!req.count || req.count > MAX_BUFS)
+		return -ENOMEM;
+	q->count = req.count;
+
+	if (q->memory != V4L2_MEMORY_MMAP)
+		return 0;
+
+	for (i = 0; i < q->count; i++) {
+		ret = v4l2_map_buffer(m2m, q, i);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int nx_v4l2_m2m_open(const char *driver)
+{
+	struct v4l2_capability cap;
+	char path[32];
+	uint32_t caps;
+	int fd;
+	int i;
+
+	for (i = 0; i < MAX_VIDEO_NODES; i++) {
+		snprintf(path, sizeof(path), "/dev/video%d", i);
+		fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		bzero(&cap, sizeof(cap));
+		if (!ioctl(fd, VIDIOC_QUERYCAP, &cap)) {
+			caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ?
+				cap.device_caps : cap.capabilities;
+			if ((caps & (V4L2_CAP_VIDEO_M2M |
+				     V4L2_CAP_VIDEO_M2M_MPLANE)) &&
+			    (!driver ||
+			     !strcmp((const char *)cap.driver, driver)))
+				return fd;
+		}
+		close(fd);
+	}
+
+	return -ENODEV;
+}
+
+/****************************************************************
+ * session
+ */
+static struct nx_v4l2_m2m *m2m_alloc(const struct nx_v4l2_m2m_config *cfg)
+{
+	struct nx_v4l2_m2m *m2m;
+
+	if (cfg->depth <= 0 || cfg->out_count <= 0 ||
+	    cfg->out_count > MAX_BUFS || cfg->cap_count <= 0 ||
+	    cfg->cap_count > MAX_BUFS ||
+	    (cfg->out_memory != V4L2_MEMORY_DMABUF &&
+	     cfg->out_memory != V4L2_MEMORY_MMAP))
+		return NULL;
+
+	m2m = calloc(1, sizeof(*m2m));
+	if (!m2m)
+		return NULL;
+
+	m2m->fd = -1;
+	m2m->out.memory = cfg->out_memory;
+	m2m->cap.memory = V4L2_MEMORY_MMAP;
+	memset(m2m->out.fds, -1, sizeof(m2m->out.fds));
+	memset(m2m->cap.fds, -1, sizeof(m2m->cap.fds));
+	m2m->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (m2m->epoll_fd < 0) {
+		free(m2m);
+		return NULL;
+	}
+
+	return m2m;
+}
+
+static int m2m_watch(struct nx_v4l2_m2m *m2m, int fd, uint32_t events)
+{
+	struct epoll_event ev;
+
+	bzero(&ev, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	return epoll_ctl(m2m->epoll_fd, EPOLL_CTL_ADD, fd, &ev) ? -errno : 0;
+}
+
+/* queue all capture buffers and clamp the depth to the queues */
+static int m2m_prepare(struct nx_v4l2_m2m *m2m,
+		       const struct nx_v4l2_m2m_config *cfg)
+{
+	struct nx_v4l2_frame frame;
+	int ret;
+	int i;
+
+	bzero(&frame, sizeof(frame));
+	for (i = 0; i < m2m->cap.count; i++) {
+		frame.index = i;
+		ret = m2m->ops->qbuf(m2m, &m2m->cap, &frame);
+		if (ret)
+			return ret;
+		m2m->cap.queued[i] = true;
+	}
+
+	m2m->depth = cfg->depth;
+	if (m2m->depth > m2m->out.count)
+		m2m->depth = m2m->out.count;
+	if (m2m->depth > m2m->cap.count)
+		m2m->depth = m2m->cap.count;
+
+	return 0;
+}
+
+struct nx_v4l2_m2m *nx_v4l2_m2m_create(int fd,
+				       const struct nx_v4l2_m2m_config *cfg)
+{
+	struct nx_v4l2_m2m *m2m;
+	struct v4l2_capability cap;
+	uint32_t caps;
+	uint32_t type;
+	int flags;
+	int ret;
+
+	m2m = m2m_alloc(cfg);
+	if (!m2m)
+		return NULL;
+
+	m2m->ops = &v4l2_ops;
+	m2m->fd = fd;
+
+	bzero(&cap, sizeof(cap));
+	if (ioctl(fd, VIDIOC_QUERYCAP, &cap)) {
+		ret = -errno;
+		goto fail;
+	}
+	caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ?
+		cap.device_caps : cap.capabilities;
+	if (caps & V4L2_CAP_VIDEO_M2M_MPLANE) {
+		m2m->mplane = true;
+		m2m->out.buf_type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+		m2m->cap.buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	} else if (caps & V4L2_CAP_VIDEO_M2M) {
+		m2m->out.buf_type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		m2m->cap.buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	} else {
+		ret = -ENODEV;
+		goto fail;
+	}
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+		ret = -errno;
+		goto fail;
+	}
+
+	/* codecs derive the capture format from the output one */
+	ret = v4l2_set_format(m2m, &m2m->out, cfg->out_width,
+			      cfg->out_height, cfg->out_format);
+	if (!ret)
+		ret = v4l2_set_format(m2m, &m2m->cap, cfg->cap_width,
+				      cfg->cap_height, cfg->cap_format);
+	if (ret) {
+		fprintf(stderr, "%s: failed to set formats(%d)\n", __func__,
+			ret);
+		goto fail;
+	}
+
+	ret = v4l2_setup_queue(m2m, &m2m->out, cfg->out_count);
+	if (!ret)
+		ret = v4l2_setup_queue(m2m, &m2m->cap, cfg->cap_count);
+	if (ret) {
+		fprintf(stderr, "%s: failed to allocate buffers(%d)\n",
+			__func__, ret);
+		goto fail;
+	}
+
+	ret = m2m_prepare(m2m, cfg);
+	if (ret)
+		goto fail;
+
+	type = m2m->out.buf_type;
+	if (ioctl(fd, VIDIOC_STREAMON, &type)) {
+		ret = -errno;
+		goto fail;
+	}
+	type = m2m->cap.buf_type;
+	if (ioctl(fd, VIDIOC_STREAMON, &type)) {
+		ret = -errno;
+		goto fail;
+	}
+
+	ret = m2m_watch(m2m, fd, EPOLLIN | EPOLLOUT);
+	if (ret)
+		goto fail;
+
+	return m2m;
+
+fail:
+	fprintf(stderr, "%s: failed(%d)\n", __func__, ret);
+	nx_v4l2_m2m_destroy(m2m);
+	return NULL;
+}
+
+void nx_v4l2_m2m_destroy(struct nx_v4l2_m2m *m2m)
+{
+	if (!m2m)
+		return;
+
+	m2m->ops->release(m2m);
+	close(m2m->epoll_fd);
+	free(m2m->priv);
+	free(m2m);
+}
+
+const struct nx_v4l2_format_info *nx_v4l2_m2m_get_format(
+				struct nx_v4l2_m2m *m2m, bool capture)
+{
+	return capture ? &m2m->cap.fmt : &m2m->out.fmt;
+}
+
+int nx_v4l2_m2m_get_fd(struct nx_v4l2_m2m *m2m)
+{
+	return m2m->epoll_fd;
+}
+
+int nx_v4l2_m2m_submit(struct nx_v4l2_m2m *m2m,
+		       const struct nx_v4l2_frame *src)
+{
+	struct m2m_queue *q = &m2m->out;
+	struct nx_v4l2_frame frame;
+	struct m2m_job *job;
+	uint32_t len;
+	int index;
+	int ret;
+	int i;
+
+	if (m2m->job_count >= m2m->depth)
+		return -EAGAIN;
+
+	for (index = 0; index < q->count; index++)
+		if (!q->queued[index])
+			break;
+	if (index == q->count)
+		return -EAGAIN;
+
+	if (q->memory == V4L2_MEMORY_DMABUF &&
+	    src->plane_num != q->fmt.plane_num)
+		return -EINVAL;
+
+	frame = *src;
+	frame.index = index;
+	for (i = 0; i < q->fmt.plane_num; i++) {
+		len = src->bytesused[i] ? src->bytesused[i] : src->sizes[i];
+		if (q->memory == V4L2_MEMORY_MMAP) {
+			/* planes of the source are copied in device order */
+			if (i >= src->plane_num || !src->virt[i])
+				return -EINVAL;
+			if (len > q->lengths[index][i])
+				len = q->lengths[index][i];
+			memcpy(q->virt[index][i], src->virt[i], len);
+		}
+		frame.bytesused[i] = len;
+	}
+
+	ret = m2m->ops->qbuf(m2m, q, &frame);
+	if (ret)
+		return ret;
+
+	q->queued[index] = true;
+	m2m->sources[index] = *src;
+
+	job = &m2m->jobs[(m2m->job_head + m2m->job_count) % MAX_BUFS];
+	job->sequence = src->sequence;
+	job->timestamp = src->timestamp;
+	job->submit_us = now_us();
+	m2m->job_count++;
+	m2m->stats.submitted++;
+
+	return 0;
+}
+
+int nx_v4l2_m2m_reclaim(struct nx_v4l2_m2m *m2m, struct nx_v4l2_frame *src)
+{
+	struct nx_v4l2_frame frame;
+	int ret;
+
+	ret = m2m->ops->dqbuf(m2m, &m2m->out, &frame);
+	if (ret < 0)
+		return ret;
+
+	m2m->out.queued[frame.index] = false;
+	*src = m2m->sources[frame.index];
+
+	return 0;
+}
+
+int nx_v4l2_m2m_dequeue(struct nx_v4l2_m2m *m2m,
+			struct nx_v4l2_frame *result)
+{
+	struct m2m_queue *q = &m2m->cap;
+	struct nx_v4l2_frame frame;
+	struct m2m_job *job;
+	uint64_t latency;
+	int index;
+	int ret;
+	int i;
+
+	ret = m2m->ops->dqbuf(m2m, q, &frame);
+	if (ret < 0)
+		return ret;
+	if (ret)
+		m2m->stats.errors++;
+
+	index = frame.index;
+	q->queued[index] = false;
+
+	bzero(result, sizeof(*result));
+	result->index = index;
+	result->memory = q->fds[index][0] >= 0 ?
+		V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
+	result->plane_num = q->fmt.plane_num;
+	for (i = 0; i < q->fmt.plane_num; i++) {
+		result->fds[i] = q->fds[index][i];
+		result->virt[i] = q->virt[index][i];
+		result->sizes[i] = q->lengths[index][i];
+		result->bytesused[i] = frame.bytesused[i];
+	}
+
+	if (m2m->job_count) {
+		job = &m2m->jobs[m2m->job_head];
+		m2m->job_head = (m2m->job_head + 1) % MAX_BUFS;
+		m2m->job_count--;
+
+		result->sequence = job->sequence;
+		result->timestamp = job->timestamp;
+		latency = now_us() - job->submit_us;
+		m2m->stats.latency_us = latency;
+		if (latency > m2m->stats.latency_max_us)
+			m2m->stats.latency_max_us = latency;
+	}
+	m2m->stats.completed++;
+
+	return 0;
+}
+
+int nx_v4l2_m2m_release(struct nx_v4l2_m2m *m2m,
+			struct nx_v4l2_frame *result)
+{
+	struct m2m_queue *q = &m2m->cap;
+	int ret;
+
+	if (result->index < 0 || result->index >= q->count ||
+	    q->queued[result->index])
+		return -EINVAL;
+
+	ret = m2m->ops->qbuf(m2m, q, result);
+	if (ret)
+		return ret;
+	q->queued[result->index] = true;
+
+	return 0;
+}
+
+void nx_v4l2_m2m_get_stats(struct nx_v4l2_m2m *m2m,
+			   struct nx_v4l2_m2m_stats *stats)
+{
+	*stats = m2m->stats;
+	stats->in_flight = m2m->job_count;
+}
+
+/****************************************************************
+ * simulated device with memfd buffers
+ */
+struct sim_fifo {
+	int index[MAX_BUFS];
+	int head;
+	int count;
+};
+
+struct sim_device {
+	uint32_t process_us;
+	int timer_fd;
+	int event_fd;
+	bool signaled;
+	bool busy;
+	uint64_t done_us;	/* end of the job in process */
+	uint32_t sequence;
+	struct sim_fifo out_queued;
+	struct sim_fifo cap_queued;
+	struct sim_fifo out_done;
+	struct sim_fifo cap_done;
+	struct nx_v4l2_frame out_frames[MAX_BUFS];
+	struct nx_v4l2_frame cap_frames[MAX_BUFS];
+};
+
+static void fifo_push(struct sim_fifo *f, int index)
+{
+	f->index[(f->head + f->count) % MAX_BUFS] = index;
+	f->count++;
+}
+
+static int fifo_pop(struct sim_fifo *f)
+{
+	int index = f->index[f->head];
+
+	f->head = (f->head + 1) % MAX_BUFS;
+	f->count--;
+	return index;
+}
+
+static void sim_convert(struct nx_v4l2_m2m *m2m, struct sim_device *sim,
+			int out, int cap)
+{
+	const struct nx_v4l2_frame *src = &sim->out_frames[out];
+	struct nx_v4l2_frame *dst = &sim->cap_frames[cap];
+	uint8_t value;
+	void *virt;
+	int i;
+
+	/* every plane is filled with the first byte of its source plane */
+	for (i = 0; i < m2m->cap.fmt.plane_num; i++) {
+		virt = NULL;
+		if (i < m2m->out.fmt.plane_num)
+			virt = m2m->out.memory == V4L2_MEMORY_MMAP ?
+				m2m->out.virt[out][i] : src->virt[i];
+		value = virt ? *(uint8_t *)virt : sim->sequence & 0xff;
+		memset(m2m->cap.virt[cap][i], value, m2m->cap.fmt.sizes[i]);
+		dst->bytesused[i] = m2m->cap.fmt.sizes[i];
+	}
+	dst->index = cap;
+	dst->plane_num = m2m->cap.fmt.plane_num;
+	dst->sequence = sim->sequence++;
+	dst->timestamp = src->timestamp;
+}
+
+static void sim_process(struct nx_v4l2_m2m *m2m)
+{
+	struct sim_device *sim = m2m->priv;
+	struct itimerspec its;
+	uint64_t expirations;
+	uint64_t now = now_us();
+	uint64_t value = 1;
+	uint64_t wait;
+	int out, cap;
+
+	if (read(sim->timer_fd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		return;
+
+	while (true) {
+		if (!sim->busy) {
+			if (!sim->out_queued.count || !sim->cap_queued.count)
+				break;
+			/* jobs run back to back like on the hardware */
+			sim->busy = true;
+			if (sim->done_us < now)
+				sim->done_us = now;
+			sim->done_us += sim->process_us;
+		}
+
+		if (sim->done_us > now)
+			break;
+
+		out = fifo_pop(&sim->out_queued);
+		cap = fifo_pop(&sim->cap_queued);
+		sim_convert(m2m, sim, out, cap);
+		fifo_push(&sim->out_done, out);
+		fifo_push(&sim->cap_done, cap);
+		sim->busy = false;
+	}
+
+	bzero(&its, sizeof(its));
+	if (sim->busy) {
+		wait = sim->done_us - now;
+		its.it_value.tv_sec = wait / 1000000;
+		its.it_value.tv_nsec = (wait % 1000000) * 1000;
+	}
+	timerfd_settime(sim->timer_fd, 0, &its, NULL);
+
+	/* the event stays readable while something can be dequeued */
+	if (sim->out_done.count || sim->cap_done.count) {
+		if (!sim->signaled &&
+		    write(sim->event_fd, &value, sizeof(value)) > 0)
+			sim->signaled = true;
+	} else if (sim->signaled) {
+		if (read(sim->event_fd, &value, sizeof(value)) > 0)
+			sim->signaled = false;
+	}
+}
+
+static int sim_qbuf(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+		    const struct nx_v4l2_frame *frame)
+{
+	struct sim_device *sim = m2m->priv;
+
+	if (is_output(m2m, q)) {
+		sim->out_frames[frame->index] = *frame;
+		fifo_push(&sim->out_queued, frame->index);
+	} else {
+		fifo_push(&sim->cap_queued, frame->index);
+	}
+	sim_process(m2m);
+
+	return 0;
+}
+
+static int sim_dqbuf(struct nx_v4l2_m2m *m2m, struct m2m_queue *q,
+		     struct nx_v4l2_frame *frame)
+{
+	struct sim_device *sim = m2m->priv;
+	struct sim_fifo *done;
+	int index;
+
+	sim_process(m2m);
+
+	done = is_output(m2m, q) ? &sim->out_done : &sim->cap_done;
+	if (!done->count)
+		return -EAGAIN;
+
+	index = fifo_pop(done);
+	*frame = is_output(m2m, q) ? sim->out_frames[index] :
+		sim->cap_frames[index];
+	sim_process(m2m);
+
+	return 0;
+}
+
+static void sim_release(struct nx_v4l2_m2m *m2m)
+{
+	struct sim_device *sim = m2m->priv;
+
+	v4l2_unmap(&m2m->out);
+	v4l2_unmap(&m2m->cap);
+	if (!sim)
+		return;
+	if (sim->timer_fd >= 0)
+		close(sim->timer_fd);
+	if (sim->event_fd >= 0)
+		close(sim->event_fd);
+}
+
+static const struct m2m_ops sim_ops = {
+	.qbuf = sim_qbuf,
+	.dqbuf = sim_dqbuf,
+	.release = sim_release,
+};
+
+static int sim_alloc_queue(struct m2m_queue *q, uint32_t format,
+			   uint32_t width, uint32_t height, int count)
+{
+	struct nx_v4l2_layout layout;
+	void *virt;
+	int fd;
+	int i, j;
+
+	if (nx_v4l2_layout_calc(format, width, height, NX_V4L2_STRIDE_ALIGN,
+				1, &layout))
+		return -EINVAL;
+	nx_v4l2_layout_to_format_info(&layout, &q->fmt);
+
+	q->count = count;
+	if (q->memory != V4L2_MEMORY_MMAP)
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < q->fmt.plane_num; j++) {
+			fd = memfd_create("nx-v4l2-m2m", MFD_CLOEXEC);
+			if (fd < 0)
+				return -errno;
+			q->fds[i][j] = fd;
+			q->lengths[i][j] = q->fmt.sizes[j];
+			if (ftruncate(fd, q->fmt.sizes[j]))
+				return -errno;
+			virt = mmap(NULL, q->fmt.sizes[j],
+				    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (virt == MAP_FAILED)
+				return -errno;
+			q->virt[i][j] = virt;
+		}
+	}
+
+	return 0;
+}
+
+struct nx_v4l2_m2m *nx_v4l2_m2m_sim_create(
+				const struct nx_v4l2_m2m_config *cfg,
+				uint32_t process_us)
+{
+	struct nx_v4l2_m2m *m2m;
+	struct sim_device *sim;
+	int ret;
+
+	m2m = m2m_alloc(cfg);
+	if (!m2m)
+		return NULL;
+
+	m2m->ops = &sim_ops;
+	sim = calloc(1, sizeof(*sim));
+	if (!sim) {
+		m2m->ops->release(m2m);
+		close(m2m->epoll_fd);
+		free(m2m);
+		return NULL;
+	}
+	m2m->priv = sim;
+	sim->process_us = process_us;
+	sim->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				       TFD_NONBLOCK | TFD_CLOEXEC);
+	sim->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (sim->timer_fd < 0 || sim->event_fd < 0) {
+		ret = -errno;
+		goto fail;
+	}
+
+	ret = sim_alloc_queue(&m2m->out, cfg->out_format, cfg->out_width,
+			      cfg->out_height, cfg->out_count);
+	if (!ret)
+		ret = sim_alloc_queue(&m2m->cap, cfg->cap_format,
+				      cfg->cap_width, cfg->cap_height,
+				      cfg->cap_count);
+	if (!ret)
+		ret = m2m_prepare(m2m, cfg);
+	if (!ret)
+		ret = m2m_watch(m2m, sim->timer_fd, EPOLLIN);
+	if (!ret)
+		ret = m2m_watch(m2m, sim->event_fd, EPOLLIN);
+	if (ret)
+		goto fail;
+
+	return m2m;
+
+fail:
+	fprintf(stderr, "%s: failed(%d)\n", __func__, ret);
+	nx_v4l2_m2m_destroy(m2m);
+	return NULL;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_M2M_H
+#define _NX_V4L2_M2M_H
+
+#include "nx-v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memory to memory session.
+ *
+ * A scaler, converter or codec node has an OUTPUT queue which takes the
+ * source frames and a CAPTURE queue which returns the results, both on one
+ * fd. The session sets the formats of both queues, allocates mmap capture
+ * buffers(exported as dmabuf when the driver can) and keeps up to depth
+ * jobs in flight.
+ *
+ * nx_v4l2_m2m_submit() queues a source frame, with V4L2_MEMORY_DMABUF its
+ * fds go to the device without a copy and the frame is handed back by
+ * nx_v4l2_m2m_reclaim() once the device consumed it, so a camera buffer can
+ * be queued again before the result is ready. nx_v4l2_m2m_dequeue() returns
+ * the results in submit order with the sequence and timestamp of their
+ * source, nx_v4l2_m2m_release() gives the result buffer back. None of them
+ * blocks, they return -EAGAIN instead; the fd from nx_v4l2_m2m_get_fd()
+ * becomes readable when one of them may succeed.
+ *
+ * One result per source is assumed, which holds for scalers, converters and
+ * intra codecs. nx_v4l2_m2m_sim_create() simulates a device which needs
+ * process_us for a job.
+ */
+
+struct nx_v4l2_m2m_config {
+	/* OUTPUT queue, the source frames */
+	uint32_t out_format;
+	uint32_t out_width;
+	uint32_t out_height;
+	uint32_t out_memory;		/* DMABUF, or MMAP to copy sources */
+	int out_count;
+	/* CAPTURE queue, the results */
+	uint32_t cap_format;
+	uint32_t cap_width;
+	uint32_t cap_height;
+	int cap_count;
+	int depth;			/* jobs in flight */
+};
+
+struct nx_v4l2_m2m_stats {
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t errors;		/* results flagged by the driver */
+	uint32_t in_flight;
+	uint32_t latency_us;		/* submit to dequeue, last job */
+	uint32_t latency_max_us;
+};
+
+struct nx_v4l2_m2m;
+
+/* fd of the first m2m video node of driver, any when driver is NULL */
+int nx_v4l2_m2m_open(const char *driver);
+struct nx_v4l2_m2m *nx_v4l2_m2m_create(int fd,
+				       const struct nx_v4l2_m2m_config *cfg);
+struct nx_v4l2_m2m *nx_v4l2_m2m_sim_create(
+				const struct nx_v4l2_m2m_config *cfg,
+				uint32_t process_us);
+void nx_v4l2_m2m_destroy(struct nx_v4l2_m2m *m2m);
+
+const struct nx_v4l2_format_info *nx_v4l2_m2m_get_format(
+				struct nx_v4l2_m2m *m2m, bool capture);
+int nx_v4l2_m2m_get_fd(struct nx_v4l2_m2m *m2m);
+int nx_v4l2_m2m_submit(struct nx_v4l2_m2m *m2m,
+		       const struct nx_v4l2_frame *src);
+int nx_v4l2_m2m_reclaim(struct nx_v4l2_m2m *m2m, struct nx_v4l2_frame *src);
+int nx_v4l2_m2m_dequeue(struct nx_v4l2_m2m *m2m,
+			struct nx_v4l2_frame *result);
+int nx_v4l2_m2m_release(struct nx_v4l2_m2m *m2m,
+			struct nx_v4l2_frame *result);
+void nx_v4l2_m2m_get_stats(struct nx_v4l2_m2m *m2m,
+			   struct nx_v4l2_m2m_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/mman.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-metrics.h"
+
+#define METRICS_DIR	"/dev/shm/"
+
+struct nx_v4l2_metrics {
+	char path[128];
+	size_t size;
+	pthread_mutex_t lock;
+	struct nx_v4l2_metrics_header *header;
+	struct nx_v4l2_metric *entries;
+};
+
+struct nx_v4l2_metrics *nx_v4l2_metrics_create(const char *name,
+					       int capacity)
+{
+	struct nx_v4l2_metrics *metrics;
+	struct nx_v4l2_metrics_header *h;
+	void *base;
+	int fd;
+
+	if (capacity <= 0)
+		return NULL;
+
+	metrics = calloc(1, sizeof(*metrics));
+	if (!metrics)
+		return NULL;
+
+	if (name)
+		snprintf(metrics->path, sizeof(metrics->path), "%s%s%s",
+			 METRICS_DIR, NX_V4L2_METRICS_PREFIX, name);
+	else
+		snprintf(metrics->path, sizeof(metrics->path), "%s%s%d",
+			 METRICS_DIR, NX_V4L2_METRICS_PREFIX, getpid());
+
+	metrics->size = sizeof(*h) + sizeof(struct nx_v4l2_metric) * capacity;
+	fd = open(metrics->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "%s: failed to create %s\n", __func__,
+			metrics->path);
+		free(metrics);
+		return NULL;
+	}
+
+	if (ftruncate(fd, metrics->size)) {
+		close(fd);
+		goto fail;
+	}
+
+	base = mmap(NULL, metrics->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		goto fail;
+
+	h = base;
+	h->version = NX_V4L2_METRICS_VERSION;
+	h->header_size = sizeof(*h);
+	h->entry_size = sizeof(struct nx_v4l2_metric);
+	h->capacity = capacity;
+	h->pid = getpid();
+	/* readers check the magic last */
+	__atomic_store_n(&h->magic, NX_V4L2_METRICS_MAGIC, __ATOMIC_RELEASE);
+
+	metrics->header = h;
+	metrics->entries = (struct nx_v4l2_metric *)(h + 1);
+	pthread_mutex_init(&metrics->lock, NULL);
+
+	return metrics;
+
+fail:
+	unlink(metrics->path);
+	free(metrics);
+	return NULL;
+}
+
+void nx_v4l2_metrics_destroy(struct nx_v4l2_metrics *metrics)
+{
+	if (!metrics)
+		return;
+
+	unlink(metrics->path);
+	munmap(metrics->header, metrics->size);
+	pthread_mutex_destroy(&metrics->lock);
+	free(metrics);
+}
+
+struct nx_v4l2_metric *nx_v4l2_metrics_add(struct nx_v4l2_metrics *metrics,
+					   int kind, const char *name,
+					   const char *labels, uint16_t scale)
+{
+	struct nx_v4l2_metrics_header *h = metrics->header;
+	struct nx_v4l2_metric *m;
+
+	pthread_mutex_lock(&metrics->lock);
+	if (h->count >= h->capacity) {
+		pthread_mutex_unlock(&metrics->lock);
+		fprintf(stderr, "%s: no room for %s\n", __func__, name);
+		return NULL;
+	}
+
+	m = &metrics->entries[h->count];
+	m->kind = kind;
+	m->scale = scale ? scale : 1;
+	snprintf(m->name, sizeof(m->name), "%s", name);
+	snprintf(m->labels, sizeof(m->labels), "%s", labels ? labels : "");
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&metrics->lock);
+
+	return m;
+}
+
+int nx_v4l2_metrics_read(const struct nx_v4l2_metrics_header *header,
+			 struct nx_v4l2_metric *entries, int max)
+{
+	const struct nx_v4l2_metric *table;
+	const struct nx_v4l2_metric *m;
+	uint32_t count;
+	uint32_t s1, s2;
+	int64_t v;
+	uint32_t i;
+	int retries;
+
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) !=
+	    NX_V4L2_METRICS_MAGIC ||
+	    header->version != NX_V4L2_METRICS_VERSION ||
+	    header->entry_size != sizeof(struct nx_v4l2_metric))
+		return -EINVAL;
+
+	table = (const struct nx_v4l2_metric *)
+		((const uint8_t *)header + header->header_size);
+	count = __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+	if (count > header->capacity)
+		return -EINVAL;
+	if (count > (uint32_t)max)
+		count = max;
+
+	for (i = 0; i < count; i++) {
+		m = &table[i];
+		retries = NX_V4L2_METRICS_READ_RETRIES;
+		do {
+			if (!retries--)
+				return -EAGAIN;
+			s1 = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+			v = __atomic_load_n(&m->value, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			s2 = __atomic_load_n(&m->seq, __ATOMIC_RELAXED);
+		} while ((s1 & 1) || s1 != s2);
+
+		entries[i] = *m;
+		entries[i].value = v;
+		entries[i].seq = s1;
+	}
+
+	return count;
+}
+
+int nx_v4l2_stream_metrics_init(struct nx_v4l2_stream_metrics *sm,
+				struct nx_v4l2_metrics *metrics,
+				const char *stream_name)
+{
+	char labels[NX_V4L2_METRICS_LABELS_LEN];
+
+	bzero(sm, sizeof(*sm));
+	snprintf(labels, sizeof(labels), "stream=\"%s\"", stream_name);
+
+	sm->frames = nx_v4l2_metrics_add(metrics, NX_V4L2_METRIC_COUNTER,
+					 "nx_v4l2_frames_total", labels, 1);
+	sm->drops = nx_v4l2_metrics_add(metrics, NX_V4L2_METRIC_COUNTER,
+					"nx_v4l2_dropped_frames_total",
+					labels, 1);
+	sm->fps = nx_v4l2_metrics_add(metrics, NX_V4L2_METRIC_GAUGE,
+				      "nx_v4l2_fps", labels, 1000);
+	sm->queued = nx_v4l2_metrics_add(metrics, NX_V4L2_METRIC_GAUGE,
+					 "nx_v4l2_queued_buffers", labels, 1);
+	sm->latency_us = nx_v4l2_metrics_add(metrics, NX_V4L2_METRIC_GAUGE,
+					     "nx_v4l2_dequeue_latency_us",
+					     labels, 1);
+	sm->latency_sum_us = nx_v4l2_metrics_add(metrics,
+					NX_V4L2_METRIC_COUNTER,
+					"nx_v4l2_dequeue_latency_us_sum",
+					labels, 1);
+	sm->errors = nx_v4l2_metrics_add(metrics, NX_V4L2_METRIC_COUNTER,
+					 "nx_v4l2_ioctl_errors_total",
+					 labels, 1);
+	sm->pinned_bytes = nx_v4l2_metrics_add(metrics, NX_V4L2_METRIC_GAUGE,
+					       "nx_v4l2_pinned_bytes",
+					       labels, 1);
+
+	if (!sm->frames || !sm->drops || !sm->fps || !sm->queued ||
+	    !sm->latency_us || !sm->latency_sum_us || !sm->errors ||
+	    !sm->pinned_bytes)
+		return -ENOSPC;
+
+	return 0;
+}
+
+void nx_v4l2_stream_metrics_frame(struct nx_v4l2_stream_metrics *sm,
+				  const struct nx_v4l2_frame *frame)
+{
+	struct timespec now;
+	uint64_t now_us, ts_us;
+	int32_t gap;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_us = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+	ts_us = (uint64_t)frame->timestamp.tv_sec * 1000000 +
+		frame->timestamp.tv_usec;
+
+	nx_v4l2_metric_add(sm->frames, 1);
+
+	gap = frame->sequence - sm->next_seq;
+	if (sm->seen && gap > 0)
+		nx_v4l2_metric_add(sm->drops, gap);
+	sm->next_seq = frame->sequence + 1;
+
+	if (ts_us && ts_us <= now_us) {
+		nx_v4l2_metric_set(sm->latency_us, now_us - ts_us);
+		nx_v4l2_metric_add(sm->latency_sum_us, now_us - ts_us);
+	}
+
+	/* timestamps per frame, a gap of n frames spans n + 1 intervals */
+	if (sm->seen && ts_us > sm->last_us && gap >= 0) {
+		uint64_t interval = (ts_us - sm->last_us) / (gap + 1);
+
+		sm->interval_us = sm->interval_us ?
+			(sm->interval_us * 7 + interval) / 8 : interval;
+		if (sm->interval_us)
+			nx_v4l2_metric_set(sm->fps, 1000000000ULL /
+					   sm->interval_us);
+	}
+	sm->last_us = ts_us;
+	sm->seen = true;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_METRICS_H
+#define _NX_V4L2_METRICS_H
+
+#include "nx-v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runtime metrics in shared memory.
+ *
+ * A registry is a file in /dev/shm(NX_V4L2_METRICS_PREFIX plus a name,
+ * the pid by default) holding a header and a fixed table of counters and
+ * gauges, external readers(tools/nx-v4l2-metrics) map it read only and
+ * never talk to the capture process.
+ *
+ * Every entry is protected by its own seqlock: the writer makes seq odd,
+ * stores the value and makes seq even again, a reader retries while seq
+ * is odd or changed. Writers take the odd seq with a compare and swap, so
+ * a metric may be updated from several threads(a stream counts errors
+ * from both its dqbuf and qbuf callers) without syscalls. Entries are
+ * only appended, count is published after the entry is complete.
+ *
+ * nx_v4l2_metrics_read() gives up with -EAGAIN when an entry stays locked
+ * for NX_V4L2_METRICS_READ_RETRIES reads, e.g. a writer preempted inside
+ * its update.
+ */
+
+#define NX_V4L2_METRICS_PREFIX		"nx-v4l2-metrics."
+#define NX_V4L2_METRICS_MAGIC		0x544d584e	/* NXMT */
+#define NX_V4L2_METRICS_VERSION		1
+#define NX_V4L2_METRICS_NAME_LEN	48
+#define NX_V4L2_METRICS_LABELS_LEN	64
+#define NX_V4L2_METRICS_READ_RETRIES	1000
+
+enum {
+	NX_V4L2_METRIC_COUNTER,
+	NX_V4L2_METRIC_GAUGE,
+};
+
+struct nx_v4l2_metrics_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t entry_size;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t pid;
+	uint32_t reserved;
+};
+
+struct nx_v4l2_metric {
+	uint32_t seq;
+	uint16_t kind;
+	uint16_t scale;			/* value / scale is the real value */
+	int64_t value;
+	char name[NX_V4L2_METRICS_NAME_LEN];
+	char labels[NX_V4L2_METRICS_LABELS_LEN];	/* a="x",b="y" */
+};
+
+struct nx_v4l2_metrics;
+
+struct nx_v4l2_metrics *nx_v4l2_metrics_create(const char *name,
+					       int capacity);
+void nx_v4l2_metrics_destroy(struct nx_v4l2_metrics *metrics);
+struct nx_v4l2_metric *nx_v4l2_metrics_add(struct nx_v4l2_metrics *metrics,
+					   int kind, const char *name,
+					   const char *labels, uint16_t scale);
+
+/*
+ * reader side, returns the number of entries copied to entries or -EAGAIN
+ * when an entry could not be read consistently
+ */
+int nx_v4l2_metrics_read(const struct nx_v4l2_metrics_header *header,
+			 struct nx_v4l2_metric *entries, int max);
+
+/* makes seq odd, returns the even seq it replaced */
+static inline uint32_t nx_v4l2_metric_lock(struct nx_v4l2_metric *m)
+{
+	uint32_t seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&m->seq, __ATOMIC_RELAXED);
+		if (!(seq & 1) &&
+		    __atomic_compare_exchange_n(&m->seq, &seq, seq + 1, true,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			break;
+	}
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return seq;
+}
+
+static inline void nx_v4l2_metric_set(struct nx_v4l2_metric *m, int64_t v)
+{
+	uint32_t seq = nx_v4l2_metric_lock(m);
+
+	__atomic_store_n(&m->value, v, __ATOMIC_RELAXED);
+	__atomic_store_n(&m->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static inline void nx_v4l2_metric_add(struct nx_v4l2_metric *m, int64_t v)
+{
+	uint32_t seq = nx_v4l2_metric_lock(m);
+	int64_t old = __atomic_load_n(&m->value, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&m->value, old + v, __ATOMIC_RELAXED);
+	__atomic_store_n(&m->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Metrics of a stream, see nx_v4l2_stream_set_metrics().
+ * fps is kept in thousandths, latency is from the frame timestamp to the
+ * return of the dequeue.
+ */
+struct nx_v4l2_stream_metrics {
+	struct nx_v4l2_metric *frames;
+	struct nx_v4l2_metric *drops;
+	struct nx_v4l2_metric *fps;
+	struct nx_v4l2_metric *queued;
+	struct nx_v4l2_metric *latency_us;
+	struct nx_v4l2_metric *latency_sum_us;
+	struct nx_v4l2_metric *errors;
+	struct nx_v4l2_metric *pinned_bytes;
+
+	/* writer state */
+	bool seen;
+	uint32_t next_seq;
+	uint64_t last_us;
+	uint64_t interval_us;		/* smoothed */
+};
+
+int nx_v4l2_stream_metrics_init(struct nx_v4l2_stream_metrics *sm,
+				struct nx_v4l2_metrics *metrics,
+				const char *stream_name);
+void nx_v4l2_stream_metrics_frame(struct nx_v4l2_stream_metrics *sm,
+				  const struct nx_v4l2_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+#include "nx-v4l2-layout.h"
+#include "nx-v4l2-mm.h"
+
+struct mm_slot {
+	bool in_flight;
+	int export_fd;		/* exported mmap buffer */
+	struct nx_v4l2_frame frame;
+};
+
+struct nx_v4l2_mm_bridge {
+	int fd;
+	int type;
+	struct nx_v4l2_format_info fmt;
+	int buf_count;
+	pthread_mutex_t lock;
+	struct mm_slot slots[VIDEO_MAX_FRAME];
+};
+
+MMPixelFormatType nx_v4l2_mm_pixel_format(uint32_t format)
+{
+	switch (format) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV12M:
+		return MM_PIXEL_FORMAT_NV12;
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_NV21M:
+		return MM_PIXEL_FORMAT_NV21;
+	case V4L2_PIX_FMT_NV16:
+	case V4L2_PIX_FMT_NV16M:
+		return MM_PIXEL_FORMAT_NV16;
+	case V4L2_PIX_FMT_YUYV:
+		return MM_PIXEL_FORMAT_YUYV;
+	case V4L2_PIX_FMT_UYVY:
+		return MM_PIXEL_FORMAT_UYVY;
+	case V4L2_PIX_FMT_YUV422P:
+	case V4L2_PIX_FMT_YUV422M:
+		return MM_PIXEL_FORMAT_422P;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YUV420M:
+		return MM_PIXEL_FORMAT_I420;
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_YVU420M:
+		return MM_PIXEL_FORMAT_YV12;
+	case V4L2_PIX_FMT_RGB565:
+		return MM_PIXEL_FORMAT_RGB565;
+	case V4L2_PIX_FMT_RGB24:
+		return MM_PIXEL_FORMAT_RGB888;
+	case V4L2_PIX_FMT_RGBA32:
+		return MM_PIXEL_FORMAT_RGBA;
+	case V4L2_PIX_FMT_XRGB32:
+		return MM_PIXEL_FORMAT_ARGB;
+	default:
+		return MM_PIXEL_FORMAT_INVALID;
+	}
+}
+
+int nx_v4l2_mm_from_frame(MMVideoBuffer *mm,
+			  const struct nx_v4l2_format_info *fmt,
+			  const struct nx_v4l2_frame *frame)
+{
+	const struct nx_v4l2_pixfmt *pf;
+	struct nx_v4l2_layout layout;
+	struct nx_v4l2_plane_layout *p;
+	int ret;
+	int i, b;
+
+	pf = nx_v4l2_pixfmt_find(fmt->format);
+	if (!pf || nx_v4l2_mm_pixel_format(fmt->format) ==
+	    MM_PIXEL_FORMAT_INVALID)
+		return -EINVAL;
+
+	ret = nx_v4l2_layout_from_format_info(fmt, &layout);
+	if (ret)
+		return ret;
+
+	if (frame->plane_num < layout.buffer_num)
+		return -EINVAL;
+
+	bzero(mm, sizeof(*mm));
+	mm->type = MM_VIDEO_BUFFER_TYPE_DMABUF_FD;
+	mm->format = nx_v4l2_mm_pixel_format(fmt->format);
+	mm->plane_num = layout.plane_num;
+	mm->handle_num = layout.buffer_num;
+	mm->buffer_index = frame->index;
+
+	for (b = 0; b < layout.buffer_num; b++) {
+		mm->handle.dmabuf_fd[b] = frame->fds[b];
+		mm->handle_size[b] = frame->sizes[b] ? frame->sizes[b] :
+				     layout.buffer_sizes[b];
+	}
+
+	for (i = 0; i < layout.plane_num; i++) {
+		p = &layout.planes[i];
+		mm->width[i] = i ? (fmt->width + pf->hsub - 1) / pf->hsub :
+			       fmt->width;
+		mm->height[i] = i ? (fmt->height + pf->vsub - 1) / pf->vsub :
+				fmt->height;
+		mm->stride_width[i] = p->stride;
+		mm->stride_height[i] = p->height;
+		mm->size[i] = p->size;
+		if (frame->virt[p->buffer])
+			mm->data[i] = (uint8_t *)frame->virt[p->buffer] +
+				      p->offset;
+	}
+
+	return 0;
+}
+
+struct nx_v4l2_mm_bridge *nx_v4l2_mm_bridge_create(int fd, int type,
+				const struct nx_v4l2_format_info *fmt,
+				int buf_count)
+{
+	struct nx_v4l2_mm_bridge *bridge;
+	int i;
+
+	if (buf_count <= 0 || buf_count > VIDEO_MAX_FRAME)
+		return NULL;
+
+	bridge = calloc(1, sizeof(*bridge));
+	if (!bridge)
+		return NULL;
+
+	bridge->fd = fd;
+	bridge->type = type;
+	bridge->fmt = *fmt;
+	bridge->buf_count = buf_count;
+	pthread_mutex_init(&bridge->lock, NULL);
+	for (i = 0; i < VIDEO_MAX_FRAME; i++)
+		bridge->slots[i].export_fd = -1;
+
+	return bridge;
+}
+
+void nx_v4l2_mm_bridge_destroy(struct nx_v4l2_mm_bridge *bridge)
+{
+	int i;
+
+	if (!bridge)
+		return;
+
+	for (i = 0; i < bridge->buf_count; i++)
+		if (bridge->slots[i].export_fd >= 0)
+			close(bridge->slots[i].export_fd);
+	pthread_mutex_destroy(&bridge->lock);
+	free(bridge);
+}
+
+int nx_v4l2_mm_fill(struct nx_v4l2_mm_bridge *bridge,
+		    const struct nx_v4l2_frame *frame, MMVideoBuffer *mm)
+{
+	struct nx_v4l2_frame desc = *frame;
+	struct mm_slot *slot;
+	int ret;
+
+	if (frame->index < 0 || frame->index >= bridge->buf_count)
+		return -EINVAL;
+
+	pthread_mutex_lock(&bridge->lock);
+	slot = &bridge->slots[frame->index];
+	if (slot->in_flight) {
+		pthread_mutex_unlock(&bridge->lock);
+		return -EBUSY;
+	}
+
+	/* mmap buffers have no fd, export them once */
+	if (frame->memory == V4L2_MEMORY_MMAP) {
+		if (slot->export_fd < 0 &&
+		    nx_v4l2_expbuf_mmap(bridge->fd, bridge->type,
+					frame->index, &slot->export_fd)) {
+			ret = -errno;
+			slot->export_fd = -1;
+			pthread_mutex_unlock(&bridge->lock);
+			fprintf(stderr, "%s: failed to export buffer %d\n",
+				__func__, frame->index);
+			return ret;
+		}
+		desc.fds[0] = slot->export_fd;
+	}
+
+	ret = nx_v4l2_mm_from_frame(mm, &bridge->fmt, &desc);
+	if (!ret) {
+		slot->frame = *frame;
+		slot->in_flight = true;
+	}
+	pthread_mutex_unlock(&bridge->lock);
+
+	return ret;
+}
+
+int nx_v4l2_mm_release(struct nx_v4l2_mm_bridge *bridge,
+		       const MMVideoBuffer *mm)
+{
+	struct nx_v4l2_frame frame;
+	struct mm_slot *slot;
+
+	if (mm->buffer_index < 0 || mm->buffer_index >= bridge->buf_count)
+		return -EINVAL;
+
+	pthread_mutex_lock(&bridge->lock);
+	slot = &bridge->slots[mm->buffer_index];
+	if (!slot->in_flight) {
+		pthread_mutex_unlock(&bridge->lock);
+		fprintf(stderr, "%s: buffer %d is not in flight\n", __func__,
+			mm->buffer_index);
+		return -EINVAL;
+	}
+	slot->in_flight = false;
+	frame = slot->frame;
+	pthread_mutex_unlock(&bridge->lock);
+
+	return nx_v4l2_qbuf_frame(bridge->fd, bridge->type, &frame);
+}
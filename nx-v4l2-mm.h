@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_MM_H
+#define _NX_V4L2_MM_H
+
+#include "nx-v4l2.h"
+#include "mm_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bridge from dequeued buffers to MMVideoBuffer.
+ *
+ * nx_v4l2_mm_fill() describes the dequeued frame as a dmabuf MMVideoBuffer
+ * without touching the pixels, MMAP buffers are exported once with
+ * VIDIOC_EXPBUF and the fds are kept by the bridge. The frame belongs to
+ * the framework until it comes back through nx_v4l2_mm_release(), which
+ * queues it to the driver again. data[] is filled only when the frame has
+ * cpu mappings.
+ */
+
+struct nx_v4l2_mm_bridge;
+
+MMPixelFormatType nx_v4l2_mm_pixel_format(uint32_t format);
+int nx_v4l2_mm_from_frame(MMVideoBuffer *mm,
+			  const struct nx_v4l2_format_info *fmt,
+			  const struct nx_v4l2_frame *frame);
+
+struct nx_v4l2_mm_bridge *nx_v4l2_mm_bridge_create(int fd, int type,
+				const struct nx_v4l2_format_info *fmt,
+				int buf_count);
+void nx_v4l2_mm_bridge_destroy(struct nx_v4l2_mm_bridge *bridge);
+int nx_v4l2_mm_fill(struct nx_v4l2_mm_bridge *bridge,
+		    const struct nx_v4l2_frame *frame, MMVideoBuffer *mm);
+int nx_v4l2_mm_release(struct nx_v4l2_mm_bridge *bridge,
+		       const MMVideoBuffer *mm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-caps.h"
+#include "nx-v4l2-mode.h"
+
+static uint32_t lap_us(struct timespec *t)
+{
+	struct timespec now;
+	uint32_t us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - t->tv_sec) * 1000000 +
+	     (now.tv_nsec - t->tv_nsec) / 1000;
+	*t = now;
+
+	return us;
+}
+
+static bool is_video(int type)
+{
+	return type == nx_clipper_video || type == nx_decimator_video;
+}
+
+static bool crop_differs(const struct nx_v4l2_mode_node *node)
+{
+	uint32_t x, y, w, h;
+
+	if (nx_v4l2_get_crop(node->fd, node->type, &x, &y, &w, &h))
+		return true;
+
+	return x != (uint32_t)node->crop.left ||
+	       y != (uint32_t)node->crop.top ||
+	       w != node->crop.width || h != node->crop.height;
+}
+
+static bool format_differs(const struct nx_v4l2_mode_node *node)
+{
+	uint32_t w, h, format;
+
+	if (nx_v4l2_get_format(node->fd, node->type, &w, &h, &format))
+		return true;
+
+	return w != node->width || h != node->height || format != node->format;
+}
+
+static int config_node(const struct nx_v4l2_mode_node *node,
+		       struct nx_v4l2_mode_timing *timing)
+{
+	int ret;
+
+	/* the crop bounds the format on clipper, program it first */
+	if (node->crop_valid && crop_differs(node)) {
+		ret = nx_v4l2_set_crop(node->fd, node->type, node->crop.left,
+				       node->crop.top, node->crop.width,
+				       node->crop.height);
+		if (ret) {
+			fprintf(stderr, "%s: failed to set crop of type %d\n",
+				__func__, node->type);
+			return ret;
+		}
+		timing->crops_set++;
+	}
+
+	if (format_differs(node)) {
+		ret = nx_v4l2_set_format(node->fd, node->type, node->width,
+					 node->height, node->format);
+		if (ret) {
+			fprintf(stderr, "%s: failed to set format of type %d\n",
+				__func__, node->type);
+			return ret;
+		}
+		timing->formats_set++;
+	}
+
+	return 0;
+}
+
+int nx_v4l2_mode_add_node(struct nx_v4l2_mode *mode, int fd, int type,
+			  uint32_t width, uint32_t height, uint32_t format,
+			  const struct v4l2_rect *crop)
+{
+	struct nx_v4l2_mode_node *node;
+
+	if (mode->node_num >= NX_V4L2_MODE_MAX_NODES)
+		return -ENOSPC;
+
+	node = &mode->nodes[mode->node_num++];
+	node->fd = fd;
+	node->type = type;
+	node->width = width;
+	node->height = height;
+	node->format = format;
+	node->crop_valid = crop != NULL;
+	if (crop)
+		node->crop = *crop;
+	else
+		bzero(&node->crop, sizeof(node->crop));
+
+	return 0;
+}
+
+int nx_v4l2_mode_switch(struct nx_v4l2_stream *stream,
+			const struct nx_v4l2_mode *mode,
+			struct nx_v4l2_mode_timing *timing)
+{
+	const struct nx_v4l2_mode_node *video = NULL;
+	const struct nx_v4l2_mode_node *node;
+	struct timespec start, t;
+	bool set_crop;
+	int stream_fd;
+	int ret;
+	int i;
+
+	stream_fd = nx_v4l2_stream_get_fd(stream);
+	for (i = 0; i < mode->node_num; i++) {
+		node = &mode->nodes[i];
+		if (node->fd == stream_fd && is_video(node->type))
+			video = node;
+	}
+	if (!video) {
+		fprintf(stderr, "%s: no node for the stream\n", __func__);
+		return -EINVAL;
+	}
+
+	bzero(timing, sizeof(*timing));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	t = start;
+
+	ret = nx_v4l2_stream_stop(stream);
+	if (ret)
+		return ret;
+	timing->stop_us = lap_us(&t);
+
+	for (i = 0; i < mode->node_num; i++) {
+		node = &mode->nodes[i];
+		if (node == video)
+			continue;
+		ret = config_node(node, timing);
+		if (ret)
+			return ret;
+	}
+	timing->config_us = lap_us(&t);
+
+	set_crop = video->crop_valid && crop_differs(video);
+	if (set_crop)
+		timing->crops_set++;
+	if (video->width != stream->fmt.width ||
+	    video->height != stream->fmt.height ||
+	    video->format != stream->fmt.format)
+		timing->formats_set++;
+	ret = nx_v4l2_stream_reformat(stream, video->width, video->height,
+				      video->format,
+				      set_crop ? &video->crop : NULL,
+				      &timing->reallocated);
+	if (ret)
+		return ret;
+	timing->buffer_us = lap_us(&t);
+	timing->total_us = lap_us(&start);
+
+	/* the old dmabufs don't fit the reallocated queue */
+	if (nx_v4l2_stream_needs_buffers(stream))
+		return NX_V4L2_MODE_NEED_BUFFERS;
+
+	return nx_v4l2_mode_resume(stream, timing);
+}
+
+/* queue every buffer and start, the second half of nx_v4l2_mode_switch() */
+int nx_v4l2_mode_resume(struct nx_v4l2_stream *stream,
+			struct nx_v4l2_mode_timing *timing)
+{
+	struct timespec t;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	ret = nx_v4l2_stream_requeue(stream);
+	if (ret)
+		return ret;
+	timing->queue_us = lap_us(&t);
+
+	ret = nx_v4l2_stream_start(stream);
+	if (ret)
+		return ret;
+	timing->start_us = lap_us(&t);
+	timing->total_us += timing->queue_us + timing->start_us;
+
+	return 0;
+}
+
+int nx_v4l2_mode_subscribe(int fd, bool subscribe)
+{
+	struct v4l2_event_subscription sub;
+
+	bzero(&sub, sizeof(sub));
+	sub.type = V4L2_EVENT_SOURCE_CHANGE;
+	return ioctl(fd, subscribe ? VIDIOC_SUBSCRIBE_EVENT :
+		     VIDIOC_UNSUBSCRIBE_EVENT, &sub);
+}
+
+static void clamp_node(struct nx_v4l2_mode_node *node, uint32_t old_w,
+		       uint32_t old_h, uint32_t w, uint32_t h)
+{
+	if (node->width == old_w && node->height == old_h) {
+		node->width = w;
+		node->height = h;
+	} else {
+		if (node->width > w)
+			node->width = w;
+		if (node->height > h)
+			node->height = h;
+	}
+
+	if (!node->crop_valid)
+		return;
+
+	if (node->crop.left + node->crop.width > w) {
+		node->crop.left = 0;
+		if (node->crop.width > w)
+			node->crop.width = w;
+	}
+	if (node->crop.top + node->crop.height > h) {
+		node->crop.top = 0;
+		if (node->crop.height > h)
+			node->crop.height = h;
+	}
+}
+
+int nx_v4l2_mode_handle_event(int fd, struct nx_v4l2_stream *stream,
+			      struct nx_v4l2_mode *mode,
+			      struct nx_v4l2_mode_timing *timing)
+{
+	struct nx_v4l2_mode_node *source = NULL;
+	struct v4l2_event ev;
+	bool changed = false;
+	uint32_t w, h, format;
+	uint32_t old_w, old_h;
+	int ret;
+	int i;
+
+	do {
+		bzero(&ev, sizeof(ev));
+		ret = ioctl(fd, VIDIOC_DQEVENT, &ev);
+		if (ret)
+			return errno == ENOENT ? 0 : -errno;
+		if (ev.type == V4L2_EVENT_SOURCE_CHANGE &&
+		    ev.u.src_change.changes & V4L2_EVENT_SRC_CH_RESOLUTION)
+			changed = true;
+	} while (ev.pending);
+
+	if (!changed)
+		return 0;
+
+	for (i = 0; i < mode->node_num && !source; i++)
+		if (mode->nodes[i].fd == fd)
+			source = &mode->nodes[i];
+	if (!source)
+		return -EINVAL;
+
+	ret = nx_v4l2_get_format(fd, source->type, &w, &h, &format);
+	if (ret)
+		return ret;
+
+	nx_v4l2_caps_invalidate(fd);
+
+	old_w = source->width;
+	old_h = source->height;
+	source->format = format;
+	for (; source < &mode->nodes[mode->node_num]; source++)
+		clamp_node(source, old_w, old_h, w, h);
+
+	ret = nx_v4l2_mode_switch(stream, mode, timing);
+	if (ret)
+		return ret;
+
+	return 1;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_MODE_H
+#define _NX_V4L2_MODE_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fast mode switch(preview <-> recording resolution).
+ *
+ * A mode lists the format and crop of every node of a chain in pipeline
+ * order(sensor, csi, clipper subdev, ..., video node). The video node is
+ * the one whose fd is the fd of the stream given to nx_v4l2_mode_switch().
+ *
+ * The switch stops the stream, programs only the formats and crops which
+ * differ from the current ones, keeps the buffers of the stream if the new
+ * planes fit into them(see nx_v4l2_stream_reformat()), queues every buffer
+ * in one batch and starts streaming again. Frames dequeued before the
+ * switch must not be queued back after it.
+ *
+ * When a dmabuf stream had to allocate its queue again the old descriptors
+ * don't fit the new planes. The switch then leaves the stream stopped and
+ * returns NX_V4L2_MODE_NEED_BUFFERS, the caller sets every buffer with
+ * nx_v4l2_stream_set_buffer() and finishes with nx_v4l2_mode_resume().
+ *
+ * nx_v4l2_mode_subscribe() subscribes V4L2_EVENT_SOURCE_CHANGE on a node,
+ * the event raises POLLPRI on the fd. nx_v4l2_mode_handle_event() dequeues
+ * it and, when the resolution of the source changed, propagates the new
+ * size to the mode and switches to it. It returns 1 after a switch and
+ * NX_V4L2_MODE_NEED_BUFFERS like nx_v4l2_mode_switch().
+ */
+
+#define NX_V4L2_MODE_MAX_NODES	8
+
+/* stream stopped, dmabuf buffers have to be set before resuming */
+#define NX_V4L2_MODE_NEED_BUFFERS	2
+
+struct nx_v4l2_mode_node {
+	int fd;
+	int type;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;	/* media bus code or pixel format */
+	bool crop_valid;
+	struct v4l2_rect crop;
+};
+
+struct nx_v4l2_mode {
+	int node_num;
+	struct nx_v4l2_mode_node nodes[NX_V4L2_MODE_MAX_NODES];
+};
+
+/* time spent in each phase of a switch in microseconds */
+struct nx_v4l2_mode_timing {
+	uint32_t stop_us;
+	uint32_t config_us;	/* formats and crops */
+	uint32_t buffer_us;	/* video node format and queue */
+	uint32_t queue_us;
+	uint32_t start_us;
+	uint32_t total_us;
+	int formats_set;
+	int crops_set;
+	bool reallocated;
+};
+
+int nx_v4l2_mode_add_node(struct nx_v4l2_mode *mode, int fd, int type,
+			  uint32_t width, uint32_t height, uint32_t format,
+			  const struct v4l2_rect *crop);
+int nx_v4l2_mode_switch(struct nx_v4l2_stream *stream,
+			const struct nx_v4l2_mode *mode,
+			struct nx_v4l2_mode_timing *timing);
+int nx_v4l2_mode_resume(struct nx_v4l2_stream *stream,
+			struct nx_v4l2_mode_timing *timing);
+
+int nx_v4l2_mode_subscribe(int fd, bool subscribe);
+int nx_v4l2_mode_handle_event(int fd, struct nx_v4l2_stream *stream,
+			      struct nx_v4l2_mode *mode,
+			      struct nx_v4l2_mode_timing *timing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include <sys/epoll.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-pair.h"
+
+enum {
+	pair_full,
+	pair_scaled,
+	pair_side_max,
+};
+
+struct pair_side {
+	int fd;
+	struct nx_v4l2_stream *stream;
+	int head;
+	int count;
+	struct nx_v4l2_frame frames[VIDEO_MAX_FRAME];
+};
+
+struct nx_v4l2_pair {
+	struct nx_v4l2_pair_config cfg;
+	int max_pending;
+	int epoll_fd;
+	bool calibrated;
+	struct pair_side sides[pair_side_max];
+	struct nx_v4l2_pair_stats stats;
+};
+
+static uint64_t frame_us(const struct nx_v4l2_frame *frame)
+{
+	return (uint64_t)frame->timestamp.tv_sec * 1000000 +
+		frame->timestamp.tv_usec;
+}
+
+static struct nx_v4l2_frame *side_head(struct pair_side *side)
+{
+	return &side->frames[side->head];
+}
+
+static void side_pop(struct pair_side *side, struct nx_v4l2_frame *frame)
+{
+	*frame = side->frames[side->head];
+	side->head = (side->head + 1) % VIDEO_MAX_FRAME;
+	side->count--;
+}
+
+static void side_drop(struct nx_v4l2_pair *pair, int s)
+{
+	struct pair_side *side = &pair->sides[s];
+	struct nx_v4l2_frame frame;
+
+	side_pop(side, &frame);
+	if (s == pair_full)
+		pair->stats.dropped_full++;
+	else
+		pair->stats.dropped_scaled++;
+
+	if (nx_v4l2_stream_qbuf(side->stream, &frame))
+		fprintf(stderr, "%s: failed to queue buffer %d\n", __func__,
+			frame.index);
+}
+
+static void side_flush(struct pair_side *side)
+{
+	side->head = 0;
+	side->count = 0;
+}
+
+/* programs the subdev size keeping the media bus code of the sensor */
+static int pair_configure_subdev(int type, int module, uint32_t w, uint32_t h)
+{
+	uint32_t cur_w, cur_h, code;
+	int fd;
+	int ret;
+
+	fd = nx_v4l2_open_device(type, module);
+	if (fd < 0)
+		return fd;
+
+	ret = nx_v4l2_get_format(fd, type, &cur_w, &cur_h, &code);
+	if (!ret && (cur_w != w || cur_h != h))
+		ret = nx_v4l2_set_format(fd, type, w, h, code);
+	close(fd);
+
+	if (ret)
+		fprintf(stderr, "%s: failed to set %ux%u on type %d\n",
+			__func__, w, h, type);
+	return ret;
+}
+
+static int pair_configure_video(int fd, int type, uint32_t memory,
+				uint32_t w, uint32_t h, uint32_t format)
+{
+	int ret;
+
+	if (memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_set_format_mmap(fd, type, w, h, format);
+	else
+		ret = nx_v4l2_set_format(fd, type, w, h, format);
+	if (ret)
+		fprintf(stderr, "%s: failed to set %ux%u on type %d\n",
+			__func__, w, h, type);
+
+	return ret;
+}
+
+static int pair_open_side(struct nx_v4l2_pair *pair, int s, int module)
+{
+	const struct nx_v4l2_pair_config *cfg = &pair->cfg;
+	struct pair_side *side = &pair->sides[s];
+	struct epoll_event ev;
+	int subdev = s == pair_full ? nx_clipper_subdev : nx_decimator_subdev;
+	int type = s == pair_full ? nx_clipper_video : nx_decimator_video;
+	uint32_t w = s == pair_full ? cfg->width : cfg->dec_width;
+	uint32_t h = s == pair_full ? cfg->height : cfg->dec_height;
+	uint32_t format = s == pair_full ? cfg->format : cfg->dec_format;
+	int ret;
+
+	ret = pair_configure_subdev(subdev, module, w, h);
+	if (ret)
+		return ret;
+
+	side->fd = nx_v4l2_open_device(type, module);
+	if (side->fd < 0)
+		return side->fd;
+
+	ret = pair_configure_video(side->fd, type, cfg->memory, w, h, format);
+	if (ret)
+		return ret;
+
+	side->stream = nx_v4l2_stream_create(side->fd, type, cfg->memory,
+					     cfg->count);
+	if (!side->stream)
+		return -EINVAL;
+
+	bzero(&ev, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = s;
+	if (epoll_ctl(pair->epoll_fd, EPOLL_CTL_ADD, side->fd, &ev))
+		return -errno;
+
+	return 0;
+}
+
+struct nx_v4l2_pair *nx_v4l2_pair_create(int module,
+				const struct nx_v4l2_pair_config *cfg)
+{
+	struct nx_v4l2_pair *pair;
+	int s;
+
+	if (cfg->count < 2 || cfg->count > VIDEO_MAX_FRAME)
+		return NULL;
+
+	pair = calloc(1, sizeof(*pair));
+	if (!pair)
+		return NULL;
+
+	pair->cfg = *cfg;
+	if (!pair->cfg.tolerance_us)
+		pair->cfg.tolerance_us = 5000;
+	pair->max_pending = cfg->count / 2;
+	for (s = 0; s < pair_side_max; s++)
+		pair->sides[s].fd = -1;
+
+	pair->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (pair->epoll_fd < 0)
+		goto fail;
+
+	for (s = 0; s < pair_side_max; s++) {
+		if (pair_open_side(pair, s, module)) {
+			fprintf(stderr, "%s: failed to open %s of module %d\n",
+				__func__, s == pair_full ? "clipper" :
+				"decimator", module);
+			goto fail;
+		}
+	}
+
+	return pair;
+
+fail:
+	nx_v4l2_pair_destroy(pair);
+	return NULL;
+}
+
+void nx_v4l2_pair_destroy(struct nx_v4l2_pair *pair)
+{
+	struct pair_side *side;
+	int s;
+
+	if (!pair)
+		return;
+
+	for (s = 0; s < pair_side_max; s++) {
+		side = &pair->sides[s];
+		nx_v4l2_stream_destroy(side->stream);
+		if (side->fd >= 0)
+			close(side->fd);
+	}
+
+	if (pair->epoll_fd >= 0)
+		close(pair->epoll_fd);
+	free(pair);
+}
+
+struct nx_v4l2_stream *nx_v4l2_pair_get_stream(struct nx_v4l2_pair *pair,
+					       bool scaled)
+{
+	return pair->sides[scaled ? pair_scaled : pair_full].stream;
+}
+
+int nx_v4l2_pair_start(struct nx_v4l2_pair *pair)
+{
+	int ret;
+
+	pair->calibrated = false;
+	side_flush(&pair->sides[pair_full]);
+	side_flush(&pair->sides[pair_scaled]);
+
+	/* the decimator is fed by the clipper, it must be ready first */
+	ret = nx_v4l2_stream_start(pair->sides[pair_scaled].stream);
+	if (ret)
+		return ret;
+
+	ret = nx_v4l2_stream_start(pair->sides[pair_full].stream);
+	if (ret)
+		nx_v4l2_stream_stop(pair->sides[pair_scaled].stream);
+
+	return ret;
+}
+
+int nx_v4l2_pair_stop(struct nx_v4l2_pair *pair)
+{
+	int ret, ret2;
+
+	ret = nx_v4l2_stream_stop(pair->sides[pair_full].stream);
+	ret2 = nx_v4l2_stream_stop(pair->sides[pair_scaled].stream);
+	side_flush(&pair->sides[pair_full]);
+	side_flush(&pair->sides[pair_scaled]);
+
+	return ret ? ret : ret2;
+}
+
+int nx_v4l2_pair_get_fd(struct nx_v4l2_pair *pair)
+{
+	return pair->epoll_fd;
+}
+
+static int pair_match(struct nx_v4l2_pair *pair,
+		      struct nx_v4l2_pair_frame *frame)
+{
+	struct pair_side *full = &pair->sides[pair_full];
+	struct pair_side *scaled = &pair->sides[pair_scaled];
+	uint64_t full_us, scaled_us;
+	int32_t diff;
+
+	for (;;) {
+		if (!full->count || !scaled->count) {
+			/* the partner of the oldest frame was lost */
+			if (full->count >= pair->max_pending)
+				side_drop(pair, pair_full);
+			else if (scaled->count >= pair->max_pending)
+				side_drop(pair, pair_scaled);
+			else
+				return -EAGAIN;
+			continue;
+		}
+
+		if (!pair->calibrated) {
+			full_us = frame_us(side_head(full));
+			scaled_us = frame_us(side_head(scaled));
+			if (full_us + pair->cfg.tolerance_us < scaled_us) {
+				side_drop(pair, pair_full);
+				continue;
+			}
+			if (scaled_us + pair->cfg.tolerance_us < full_us) {
+				side_drop(pair, pair_scaled);
+				continue;
+			}
+			pair->stats.sequence_offset =
+				side_head(scaled)->sequence -
+				side_head(full)->sequence;
+			pair->calibrated = true;
+		}
+
+		diff = side_head(scaled)->sequence -
+		       pair->stats.sequence_offset - side_head(full)->sequence;
+		if (diff < 0) {
+			side_drop(pair, pair_scaled);
+			continue;
+		}
+		if (diff > 0) {
+			side_drop(pair, pair_full);
+			continue;
+		}
+
+		side_pop(full, &frame->full);
+		side_pop(scaled, &frame->scaled);
+		frame->sequence = frame->full.sequence;
+		pair->stats.pairs++;
+		return 0;
+	}
+}
+
+int nx_v4l2_pair_read(struct nx_v4l2_pair *pair,
+		      struct nx_v4l2_pair_frame *frame)
+{
+	struct epoll_event events[pair_side_max];
+	struct pair_side *side;
+	int ret;
+	int n;
+	int i;
+
+	ret = pair_match(pair, frame);
+	if (ret != -EAGAIN)
+		return ret;
+
+	n = epoll_wait(pair->epoll_fd, events, pair_side_max, 0);
+	if (n < 0)
+		return -errno;
+
+	for (i = 0; i < n; i++) {
+		side = &pair->sides[events[i].data.u32];
+		if (side->count >= pair->max_pending)
+			continue;
+
+		ret = nx_v4l2_stream_dqbuf(side->stream,
+			&side->frames[(side->head + side->count) %
+				      VIDEO_MAX_FRAME]);
+		if (!ret)
+			side->count++;
+	}
+
+	return pair_match(pair, frame);
+}
+
+int nx_v4l2_pair_release(struct nx_v4l2_pair *pair,
+			 struct nx_v4l2_pair_frame *frame)
+{
+	int ret, ret2;
+
+	ret = nx_v4l2_stream_qbuf(pair->sides[pair_full].stream, &frame->full);
+	ret2 = nx_v4l2_stream_qbuf(pair->sides[pair_scaled].stream,
+				   &frame->scaled);
+
+	return ret ? ret : ret2;
+}
+
+void nx_v4l2_pair_get_stats(struct nx_v4l2_pair *pair,
+			    struct nx_v4l2_pair_stats *stats)
+{
+	*stats = pair->stats;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_PAIR_H
+#define _NX_V4L2_PAIR_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Clipper and decimator capture of one module as a single object.
+ *
+ * nx_v4l2_pair_create() opens both video nodes of the module, programs
+ * the clipper and decimator subdevs and video nodes together and creates
+ * their streams. Both nodes are fed by the same sensor, so a frame of the
+ * clipper and the frame of the decimator with the same sequence belong
+ * together. As the nodes are streamed on one after the other, their
+ * sequences may differ by a constant which is found with the timestamps of
+ * the first frames.
+ *
+ * nx_v4l2_pair_read() gives joined (full, scaled) frames, a frame whose
+ * partner was lost is queued back at once so that both queues stay
+ * balanced. The epoll fd of nx_v4l2_pair_get_fd() becomes readable when
+ * either node has a frame.
+ */
+
+struct nx_v4l2_pair;
+
+struct nx_v4l2_pair_config {
+	uint32_t width;			/* clipper */
+	uint32_t height;
+	uint32_t format;
+	uint32_t dec_width;		/* decimator */
+	uint32_t dec_height;
+	uint32_t dec_format;
+	uint32_t memory;
+	int count;
+	uint32_t tolerance_us;		/* to find the sequence offset */
+};
+
+struct nx_v4l2_pair_frame {
+	uint32_t sequence;		/* of the clipper */
+	struct nx_v4l2_frame full;
+	struct nx_v4l2_frame scaled;
+};
+
+struct nx_v4l2_pair_stats {
+	uint32_t pairs;
+	uint32_t dropped_full;
+	uint32_t dropped_scaled;
+	int32_t sequence_offset;	/* scaled - full */
+};
+
+struct nx_v4l2_pair *nx_v4l2_pair_create(int module,
+				const struct nx_v4l2_pair_config *cfg);
+void nx_v4l2_pair_destroy(struct nx_v4l2_pair *pair);
+struct nx_v4l2_stream *nx_v4l2_pair_get_stream(struct nx_v4l2_pair *pair,
+					       bool scaled);
+int nx_v4l2_pair_start(struct nx_v4l2_pair *pair);
+int nx_v4l2_pair_stop(struct nx_v4l2_pair *pair);
+int nx_v4l2_pair_get_fd(struct nx_v4l2_pair *pair);
+int nx_v4l2_pair_read(struct nx_v4l2_pair *pair,
+		      struct nx_v4l2_pair_frame *frame);
+int nx_v4l2_pair_release(struct nx_v4l2_pair *pair,
+			 struct nx_v4l2_pair_frame *frame);
+void nx_v4l2_pair_get_stats(struct nx_v4l2_pair *pair,
+			    struct nx_v4l2_pair_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
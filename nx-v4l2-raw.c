@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-raw.h"
+
+struct nx_v4l2_raw {
+	int fd;
+	size_t size;
+	uint8_t *base;
+	const struct nx_v4l2_raw_header *header;
+	const struct nx_v4l2_raw_index *index;
+};
+
+static int raw_check_header(const struct nx_v4l2_raw_header *h, size_t size)
+{
+	uint64_t end;
+	uint32_t i;
+
+	if (memcmp(h->magic, NX_V4L2_RAW_MAGIC, sizeof(h->magic)) ||
+	    h->version != NX_V4L2_RAW_VERSION)
+		return -EINVAL;
+
+	if (h->plane_num == 0 || h->plane_num > NX_V4L2_MAX_PLANES ||
+	    h->frame_count > h->max_frames)
+		return -EINVAL;
+
+	if (h->index_offset + (uint64_t)h->max_frames *
+	    sizeof(struct nx_v4l2_raw_index) > h->data_offset)
+		return -EINVAL;
+
+	for (i = 0; i < h->plane_num; i++)
+		if (h->plane_offsets[i] + h->plane_sizes[i] > h->slot_size)
+			return -EINVAL;
+
+	end = h->data_offset + (uint64_t)h->frame_count * h->slot_size;
+	if (end > size)
+		return -EINVAL;
+
+	return 0;
+}
+
+struct nx_v4l2_raw *nx_v4l2_raw_open(const char *path)
+{
+	struct nx_v4l2_raw *raw;
+	struct stat st;
+	void *base;
+
+	raw = calloc(1, sizeof(*raw));
+	if (!raw)
+		return NULL;
+
+	raw->fd = open(path, O_RDONLY);
+	if (raw->fd < 0) {
+		fprintf(stderr, "%s: failed to open %s\n", __func__, path);
+		goto fail;
+	}
+
+	if (fstat(raw->fd, &st) < 0 ||
+	    st.st_size < (off_t)sizeof(struct nx_v4l2_raw_header)) {
+		fprintf(stderr, "%s: invalid file %s\n", __func__, path);
+		goto fail;
+	}
+	raw->size = st.st_size;
+
+	base = mmap(NULL, raw->size, PROT_READ, MAP_SHARED, raw->fd, 0);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "%s: failed to mmap %s\n", __func__, path);
+		goto fail;
+	}
+	raw->base = base;
+	raw->header = base;
+
+	if (raw_check_header(raw->header, raw->size)) {
+		fprintf(stderr, "%s: invalid header %s\n", __func__, path);
+		goto fail;
+	}
+	raw->index = (const void *)(raw->base + raw->header->index_offset);
+
+	madvise(raw->base + raw->header->data_offset,
+		raw->size - raw->header->data_offset, MADV_SEQUENTIAL);
+
+	return raw;
+
+fail:
+	nx_v4l2_raw_close(raw);
+	return NULL;
+}
+
+void nx_v4l2_raw_close(struct nx_v4l2_raw *raw)
+{
+	if (!raw)
+		return;
+
+	if (raw->base)
+		munmap(raw->base, raw->size);
+	if (raw->fd >= 0)
+		close(raw->fd);
+	free(raw);
+}
+
+const struct nx_v4l2_raw_header *nx_v4l2_raw_get_header(
+						struct nx_v4l2_raw *raw)
+{
+	return raw->header;
+}
+
+int nx_v4l2_raw_get_format(struct nx_v4l2_raw *raw,
+			   struct nx_v4l2_format_info *fmt)
+{
+	const struct nx_v4l2_raw_header *h = raw->header;
+	uint32_t i;
+
+	bzero(fmt, sizeof(*fmt));
+	fmt->format = h->format;
+	fmt->width = h->width;
+	fmt->height = h->height;
+	fmt->plane_num = h->plane_num;
+	for (i = 0; i < h->plane_num; i++) {
+		fmt->strides[i] = h->strides[i];
+		fmt->sizes[i] = h->plane_sizes[i];
+	}
+
+	return 0;
+}
+
+int nx_v4l2_raw_get_frame(struct nx_v4l2_raw *raw, uint32_t n,
+			  struct nx_v4l2_frame *frame)
+{
+	const struct nx_v4l2_raw_header *h = raw->header;
+	const struct nx_v4l2_raw_index *idx;
+	uint32_t i;
+
+	if (n >= h->frame_count)
+		return -ENODATA;
+
+	idx = &raw->index[n];
+	if (idx->offset < h->data_offset ||
+	    idx->offset + h->slot_size > raw->size)
+		return -EINVAL;
+
+	bzero(frame, sizeof(*frame));
+	frame->index = n;
+	frame->memory = V4L2_MEMORY_USERPTR;
+	frame->plane_num = h->plane_num;
+	for (i = 0; i < h->plane_num; i++) {
+		frame->fds[i] = -1;
+		frame->virt[i] = raw->base + idx->offset + h->plane_offsets[i];
+		frame->sizes[i] = h->plane_sizes[i];
+		frame->bytesused[i] = idx->bytesused[i];
+	}
+	frame->sequence = idx->sequence;
+	frame->timestamp.tv_sec = idx->timestamp_us / 1000000;
+	frame->timestamp.tv_usec = idx->timestamp_us % 1000000;
+
+	return 0;
+}
+
+/****************************************************************
+ * replay source
+ */
+struct replay_source {
+	struct nx_v4l2_raw *raw;
+	uint32_t flags;
+	bool streaming;
+	int timer_fd;
+
+	/* queued buffer indexes in queueing order */
+	int fifo[VIDEO_MAX_FRAME];
+	int fifo_head;
+	int fifo_count;
+
+	uint32_t next;
+	uint32_t loops;
+	uint64_t loop_span_us;
+	uint32_t loop_seq_span;
+	uint64_t first_ts_us;
+	struct timespec base;
+};
+
+static uint64_t replay_due_us(struct replay_source *src)
+{
+	const struct nx_v4l2_raw_index *idx = &src->raw->index[src->next];
+
+	return idx->timestamp_us + src->loops * src->loop_span_us -
+		src->first_ts_us;
+}
+
+static bool replay_has_next(struct replay_source *src)
+{
+	uint32_t count = src->raw->header->frame_count;
+
+	if (!count)
+		return false;
+
+	return src->next < count || (src->flags & NX_V4L2_REPLAY_LOOP);
+}
+
+static void replay_rewind_if_needed(struct replay_source *src)
+{
+	if (src->next >= src->raw->header->frame_count &&
+	    (src->flags & NX_V4L2_REPLAY_LOOP)) {
+		src->next = 0;
+		src->loops++;
+	}
+}
+
+static struct timespec replay_due_time(struct replay_source *src)
+{
+	struct timespec due = src->base;
+	uint64_t us = 0;
+
+	if (src->flags & NX_V4L2_REPLAY_REALTIME)
+		us = replay_due_us(src);
+
+	due.tv_sec += us / 1000000;
+	due.tv_nsec += (us % 1000000) * 1000;
+	if (due.tv_nsec >= 1000000000) {
+		due.tv_sec++;
+		due.tv_nsec -= 1000000000;
+	}
+
+	return due;
+}
+
+static bool replay_is_due(struct replay_source *src)
+{
+	struct timespec due, now;
+
+	if (!(src->flags & NX_V4L2_REPLAY_REALTIME))
+		return true;
+
+	due = replay_due_time(src);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec != due.tv_sec)
+		return now.tv_sec > due.tv_sec;
+	return now.tv_nsec >= due.tv_nsec;
+}
+
+static void replay_arm_timer(struct replay_source *src)
+{
+	struct itimerspec its;
+
+	bzero(&its, sizeof(its));
+	replay_rewind_if_needed(src);
+	if (src->streaming && src->fifo_count && replay_has_next(src)) {
+		its.it_value = replay_due_time(src);
+		/* zero means disarm, the base itself is always in the past */
+		if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+			its.it_value.tv_nsec = 1;
+	}
+
+	timerfd_settime(src->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static int replay_start(struct nx_v4l2_stream *stream)
+{
+	struct replay_source *src = stream->priv;
+	int i;
+
+	src->fifo_head = 0;
+	src->fifo_count = stream->buf_count;
+	for (i = 0; i < stream->buf_count; i++)
+		src->fifo[i] = i;
+
+	src->next = 0;
+	src->loops = 0;
+	clock_gettime(CLOCK_MONOTONIC, &src->base);
+	src->streaming = true;
+	replay_arm_timer(src);
+
+	return 0;
+}
+
+static int replay_stop(struct nx_v4l2_stream *stream)
+{
+	struct replay_source *src = stream->priv;
+
+	src->streaming = false;
+	src->fifo_count = 0;
+	replay_arm_timer(src);
+
+	return 0;
+}
+
+static int replay_dqbuf(struct nx_v4l2_stream *stream,
+			struct nx_v4l2_frame *frame)
+{
+	struct replay_source *src = stream->priv;
+	uint64_t expirations;
+	uint64_t ts_us;
+	int index;
+	int ret;
+
+	if (!src->streaming)
+		return -EINVAL;
+
+	replay_rewind_if_needed(src);
+	if (!replay_has_next(src))
+		return -ENODATA;
+
+	/* like a camera, the timer fd turns readable when the frame is due */
+	if (!src->fifo_count || !replay_is_due(src))
+		return -EAGAIN;
+
+	ret = nx_v4l2_raw_get_frame(src->raw, src->next, frame);
+	if (ret)
+		return ret;
+
+	index = src->fifo[src->fifo_head];
+	src->fifo_head = (src->fifo_head + 1) % VIDEO_MAX_FRAME;
+	src->fifo_count--;
+
+	ts_us = src->raw->index[src->next].timestamp_us +
+		src->loops * src->loop_span_us;
+	frame->index = index;
+	frame->sequence += src->loops * src->loop_seq_span;
+	frame->timestamp.tv_sec = ts_us / 1000000;
+	frame->timestamp.tv_usec = ts_us % 1000000;
+
+	src->next++;
+	if (read(src->timer_fd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		fprintf(stderr, "%s: failed to read timer\n", __func__);
+	replay_arm_timer(src);
+
+	return 0;
+}
+
+static int replay_qbuf(struct nx_v4l2_stream *stream,
+		       struct nx_v4l2_frame *frame)
+{
+	struct replay_source *src = stream->priv;
+	int i;
+
+	if (frame->index < 0 || frame->index >= stream->buf_count)
+		return -EINVAL;
+
+	for (i = 0; i < src->fifo_count; i++)
+		if (src->fifo[(src->fifo_head + i) % VIDEO_MAX_FRAME] ==
+		    frame->index)
+			return -EBUSY;
+
+	src->fifo[(src->fifo_head + src->fifo_count) % VIDEO_MAX_FRAME] =
+		frame->index;
+	src->fifo_count++;
+	if (src->fifo_count == 1)
+		replay_arm_timer(src);
+
+	return 0;
+}
+
+static int replay_get_fd(struct nx_v4l2_stream *stream)
+{
+	struct replay_source *src = stream->priv;
+
+	return src->timer_fd;
+}
+
+static void replay_release(struct nx_v4l2_stream *stream)
+{
+	struct replay_source *src = stream->priv;
+
+	if (src->timer_fd >= 0)
+		close(src->timer_fd);
+	nx_v4l2_raw_close(src->raw);
+}
+
+static const struct nx_v4l2_stream_ops replay_ops = {
+	.start = replay_start,
+	.stop = replay_stop,
+	.dqbuf = replay_dqbuf,
+	.qbuf = replay_qbuf,
+	.get_fd = replay_get_fd,
+	.release = replay_release,
+};
+
+struct nx_v4l2_stream *nx_v4l2_replay_create(const char *path, int type,
+					     int count, uint32_t flags)
+{
+	struct nx_v4l2_stream *stream;
+	struct replay_source *src;
+	const struct nx_v4l2_raw_header *h;
+	const struct nx_v4l2_raw_index *first, *last;
+
+	if (count <= 0 || count > VIDEO_MAX_FRAME)
+		return NULL;
+
+	stream = nx_v4l2_stream_alloc(&replay_ops, sizeof(*src));
+	if (!stream)
+		return NULL;
+
+	src = stream->priv;
+	src->flags = flags;
+	src->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				       TFD_NONBLOCK | TFD_CLOEXEC);
+	src->raw = nx_v4l2_raw_open(path);
+	if (src->timer_fd < 0 || !src->raw) {
+		nx_v4l2_stream_destroy(stream);
+		return NULL;
+	}
+
+	stream->type = type;
+	stream->buf_count = count;
+	nx_v4l2_raw_get_format(src->raw, &stream->fmt);
+
+	h = nx_v4l2_raw_get_header(src->raw);
+	if (h->frame_count) {
+		first = &src->raw->index[0];
+		last = &src->raw->index[h->frame_count - 1];
+		src->first_ts_us = first->timestamp_us;
+		src->loop_span_us = last->timestamp_us - first->timestamp_us;
+		/* one more average frame interval between the loops */
+		if (h->frame_count > 1)
+			src->loop_span_us += src->loop_span_us /
+				(h->frame_count - 1);
+		else
+			src->loop_span_us = 33333;
+		src->loop_seq_span = last->sequence - first->sequence + 1;
+	}
+
+	return stream;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_RAW_H
+#define _NX_V4L2_RAW_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Raw frame container
+ *
+ * +----------------------+ 0
+ * | nx_v4l2_raw_header   |
+ * | nx_v4l2_raw_index[]  | max_frames entries
+ * +----------------------+ data_offset(page aligned)
+ * | frame 0              | slot_size bytes, planes at plane_offsets[]
+ * | frame 1              |
+ * | ...                  |
+ * +----------------------+
+ *
+ * All fields are little endian.
+ */
+#define NX_V4L2_RAW_MAGIC	"NXV4LRAW"
+#define NX_V4L2_RAW_VERSION	1
+#define NX_V4L2_RAW_ALIGN	4096
+
+struct nx_v4l2_raw_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t plane_num;
+	uint32_t strides[NX_V4L2_MAX_PLANES];
+	uint32_t plane_sizes[NX_V4L2_MAX_PLANES];
+	uint32_t plane_offsets[NX_V4L2_MAX_PLANES];
+	uint32_t slot_size;
+	uint32_t frame_count;
+	uint32_t max_frames;
+	uint32_t reserved;
+	uint64_t index_offset;
+	uint64_t data_offset;
+};
+
+struct nx_v4l2_raw_index {
+	uint64_t offset;
+	uint64_t timestamp_us;
+	uint32_t sequence;
+	uint32_t bytesused[NX_V4L2_MAX_PLANES];
+};
+
+struct nx_v4l2_raw;
+
+struct nx_v4l2_raw *nx_v4l2_raw_open(const char *path);
+void nx_v4l2_raw_close(struct nx_v4l2_raw *raw);
+const struct nx_v4l2_raw_header *nx_v4l2_raw_get_header(
+						struct nx_v4l2_raw *raw);
+int nx_v4l2_raw_get_format(struct nx_v4l2_raw *raw,
+			   struct nx_v4l2_format_info *fmt);
+int nx_v4l2_raw_get_frame(struct nx_v4l2_raw *raw, uint32_t n,
+			  struct nx_v4l2_frame *frame);
+
+/*
+ * Replay source, presents a container through nx_v4l2_stream.
+ * Frames point straight into the file mapping and keep their recorded
+ * sequence and timestamp. The dequeue never blocks, it returns -EAGAIN
+ * until the next frame is due and nx_v4l2_stream_get_fd() polls readable
+ * once it is.
+ */
+#define NX_V4L2_REPLAY_REALTIME	(1 << 0)	/* pace by timestamps */
+#define NX_V4L2_REPLAY_LOOP	(1 << 1)	/* restart at the end */
+
+struct nx_v4l2_stream *nx_v4l2_replay_create(const char *path, int type,
+					     int count, uint32_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,814 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(__has_include)
+/* no configure, IORING_FEAT_RW_CUR_POS came with IORING_OP_WRITE */
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_RW_CUR_POS
+#define HAVE_IO_URING	1
+#endif
+#endif
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-raw.h"
+#include "nx-v4l2-recorder.h"
+
+#define ALIGN_UP(v, a)	(((v) + (a) - 1) & ~((typeof(v))(a) - 1))
+
+/* user_data encoding of a write request */
+#define UDATA(slot, plane, bounce)	(((slot) << 8) | ((plane) << 1) | \
+					 ((bounce) ? 1 : 0))
+#define UDATA_SLOT(u)			((int)((u) >> 8))
+#define UDATA_PLANE(u)			((int)(((u) >> 1) & 0x7f))
+#define UDATA_BOUNCE(u)			((int)((u) & 1))
+
+#ifdef HAVE_IO_URING
+struct rec_ring {
+	int fd;
+	unsigned entries;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqes_size;
+	unsigned to_submit;
+};
+#else
+struct rec_ring {
+	int fd;
+};
+#endif
+
+struct rec_slot {
+	bool busy;
+	int v4l2_fd;
+	int type;
+	int pending;
+	int error;
+	uint32_t file_index;
+	struct nx_v4l2_frame frame;
+	void *bounce;
+};
+
+struct nx_v4l2_recorder {
+	int fd;
+	bool direct;
+	bool direct_ok;
+	bool sync;		/* no io_uring, submit writes with pwrite */
+	struct rec_ring ring;
+
+	struct nx_v4l2_format_info fmt;
+	int plane_num;
+	uint32_t plane_sizes[NX_V4L2_MAX_PLANES];
+	uint32_t plane_offsets[NX_V4L2_MAX_PLANES];
+	uint32_t slot_size;
+	uint64_t data_offset;
+	int max_frames;
+	int count;
+	struct nx_v4l2_raw_index *index;
+
+	int depth;
+	int inflight;
+	struct rec_slot *slots;
+
+	/* registered buffers: bounce buffers first, then capture planes */
+	struct iovec *iovs;
+	int capture_count;
+};
+
+#ifdef HAVE_IO_URING
+static int ring_setup(struct rec_ring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	void *ptr;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -errno;
+
+	r->entries = p.sq_entries;
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_size > r->sq_size)
+			r->sq_size = r->cq_size;
+		r->cq_size = r->sq_size;
+	}
+
+	r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		goto fail_sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ptr = r->sq_ptr;
+	} else {
+		r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_POPULATE, r->fd,
+				 IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED)
+			goto fail_cq;
+	}
+
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ptr = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (ptr == MAP_FAILED)
+		goto fail_sqes;
+	r->sqes = ptr;
+
+	r->sq_head = r->sq_ptr + p.sq_off.head;
+	r->sq_tail = r->sq_ptr + p.sq_off.tail;
+	r->sq_mask = r->sq_ptr + p.sq_off.ring_mask;
+	r->sq_array = r->sq_ptr + p.sq_off.array;
+	r->cq_head = r->cq_ptr + p.cq_off.head;
+	r->cq_tail = r->cq_ptr + p.cq_off.tail;
+	r->cq_mask = r->cq_ptr + p.cq_off.ring_mask;
+	r->cqes = r->cq_ptr + p.cq_off.cqes;
+	r->to_submit = 0;
+
+	return 0;
+
+fail_sqes:
+	if (r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+fail_cq:
+	munmap(r->sq_ptr, r->sq_size);
+fail_sq:
+	close(r->fd);
+	r->fd = -1;
+	return -ENOMEM;
+}
+
+static void ring_release(struct rec_ring *r)
+{
+	if (r->fd < 0)
+		return;
+
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+	munmap(r->sq_ptr, r->sq_size);
+	close(r->fd);
+	r->fd = -1;
+}
+
+static struct io_uring_sqe *ring_get_sqe(struct rec_ring *r)
+{
+	unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	unsigned tail = *r->sq_tail;
+	unsigned idx;
+
+	if (tail - head >= r->entries)
+		return NULL;
+
+	idx = tail & *r->sq_mask;
+	r->sq_array[idx] = idx;
+	memset(&r->sqes[idx], 0, sizeof(r->sqes[idx]));
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->to_submit++;
+
+	return &r->sqes[idx];
+}
+
+static int ring_enter(struct rec_ring *r, unsigned min_complete)
+{
+	int ret;
+	unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+	if (!r->to_submit && !min_complete)
+		return 0;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit,
+			      min_complete, flags, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		return -errno;
+
+	if ((unsigned)ret >= r->to_submit)
+		r->to_submit = 0;
+	else
+		r->to_submit -= ret;
+	return 0;
+}
+
+static int register_iovs(struct nx_v4l2_recorder *rec, int capture_count)
+{
+	int nr = rec->depth + capture_count * rec->plane_num;
+	int ret;
+
+	syscall(__NR_io_uring_register, rec->ring.fd,
+		IORING_UNREGISTER_BUFFERS, NULL, 0);
+	ret = syscall(__NR_io_uring_register, rec->ring.fd,
+		      IORING_REGISTER_BUFFERS, rec->iovs, nr);
+	if (ret < 0)
+		return -errno;
+
+	rec->capture_count = capture_count;
+	return 0;
+}
+#else
+static int ring_setup(struct rec_ring *r, unsigned entries)
+{
+	r->fd = -1;
+	return -ENOSYS;
+}
+
+static void ring_release(struct rec_ring *r)
+{
+}
+
+static int register_iovs(struct nx_v4l2_recorder *rec, int capture_count)
+{
+	return -ENOSYS;
+}
+#endif
+
+static uint32_t plane_used(const struct nx_v4l2_recorder *rec,
+			   const struct nx_v4l2_frame *frame, int plane)
+{
+	uint32_t used = frame->bytesused[plane] ? frame->bytesused[plane] :
+			frame->sizes[plane];
+
+	return used > rec->plane_sizes[plane] ? rec->plane_sizes[plane] : used;
+}
+
+struct nx_v4l2_recorder *nx_v4l2_recorder_create(const char *path,
+				const struct nx_v4l2_format_info *fmt,
+				int max_frames, int depth)
+{
+	int plane_num = fmt->plane_num;
+	struct nx_v4l2_recorder *rec;
+	off_t total;
+	int ret;
+	int i;
+
+	if (plane_num <= 0 || plane_num > NX_V4L2_MAX_PLANES ||
+	    max_frames <= 0 || depth <= 0 || depth > 0xffffff) {
+		fprintf(stderr, "%s: invalid argument\n", __func__);
+		return NULL;
+	}
+
+	rec = calloc(1, sizeof(*rec));
+	if (!rec)
+		return NULL;
+
+	rec->fd = -1;
+	rec->ring.fd = -1;
+	rec->fmt = *fmt;
+	rec->plane_num = plane_num;
+	rec->max_frames = max_frames;
+	rec->depth = depth;
+	for (i = 0; i < plane_num; i++) {
+		rec->plane_sizes[i] = fmt->sizes[i];
+		rec->plane_offsets[i] = rec->slot_size;
+		rec->slot_size += ALIGN_UP(fmt->sizes[i], NX_V4L2_RAW_ALIGN);
+	}
+	rec->data_offset = ALIGN_UP(sizeof(struct nx_v4l2_raw_header) +
+				    (uint64_t)max_frames *
+				    sizeof(struct nx_v4l2_raw_index),
+				    NX_V4L2_RAW_ALIGN);
+
+	rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (rec->fd < 0 && errno == EINVAL) {
+		fprintf(stderr, "%s: O_DIRECT is not supported for %s\n",
+			__func__, path);
+		rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	} else {
+		rec->direct = true;
+	}
+	if (rec->fd < 0) {
+		fprintf(stderr, "%s: failed to open %s\n", __func__, path);
+		goto fail;
+	}
+	rec->direct_ok = rec->direct;
+
+	total = rec->data_offset + (off_t)rec->slot_size * max_frames;
+	if (fallocate(rec->fd, 0, 0, total) < 0 &&
+	    ftruncate(rec->fd, total) < 0) {
+		fprintf(stderr, "%s: failed to preallocate %lld bytes\n",
+			__func__, (long long)total);
+		goto fail;
+	}
+
+	rec->index = calloc(max_frames, sizeof(*rec->index));
+	rec->slots = calloc(depth, sizeof(*rec->slots));
+	rec->iovs = calloc(depth + plane_num * VIDEO_MAX_FRAME,
+			   sizeof(*rec->iovs));
+	if (!rec->index || !rec->slots || !rec->iovs)
+		goto fail;
+
+	for (i = 0; i < depth; i++) {
+		if (posix_memalign(&rec->slots[i].bounce,
+				   NX_V4L2_RAW_ALIGN, rec->slot_size))
+			goto fail;
+		rec->iovs[i].iov_base = rec->slots[i].bounce;
+		rec->iovs[i].iov_len = rec->slot_size;
+	}
+
+	ret = ring_setup(&rec->ring, depth * plane_num);
+	if (ret == -ENOSYS || ret == -EPERM) {
+		/* not built in, too old a kernel or disabled by sysctl */
+		fprintf(stderr, "%s: no io_uring(%d), writing synchronously\n",
+			__func__, ret);
+		rec->sync = true;
+		return rec;
+	}
+	if (ret) {
+		fprintf(stderr, "%s: failed to setup io_uring(%d)\n",
+			__func__, ret);
+		goto fail;
+	}
+
+	ret = register_iovs(rec, 0);
+	if (ret) {
+		fprintf(stderr, "%s: failed to register bounce buffers(%d)\n",
+			__func__, ret);
+		goto fail;
+	}
+
+	return rec;
+
+fail:
+	nx_v4l2_recorder_destroy(rec);
+	return NULL;
+}
+
+int nx_v4l2_recorder_register_buffers(struct nx_v4l2_recorder *rec,
+				      struct nx_v4l2_frame *bufs, int count)
+{
+	int i, j;
+	int ret;
+	struct iovec *iov;
+
+	if (count > VIDEO_MAX_FRAME)
+		return -EINVAL;
+
+	if (rec->inflight) {
+		fprintf(stderr, "%s: recorder is busy\n", __func__);
+		return -EBUSY;
+	}
+
+	/* pwrite doesn't use registered buffers */
+	if (rec->sync)
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		if (bufs[i].plane_num != rec->plane_num)
+			return -EINVAL;
+
+		iov = &rec->iovs[rec->depth + i * rec->plane_num];
+		for (j = 0; j < rec->plane_num; j++) {
+			iov[j].iov_base = bufs[i].virt[j];
+			iov[j].iov_len = bufs[i].sizes[j];
+		}
+	}
+
+	ret = register_iovs(rec, count);
+	if (ret) {
+		/*
+		 * pfn mapped buffers(e.g. dma-contig) can't be pinned,
+		 * keep the bounce buffers registered and go on unregistered.
+		 */
+		fprintf(stderr, "%s: can't register capture buffers(%d)\n",
+			__func__, ret);
+		return register_iovs(rec, 0);
+	}
+
+	return 0;
+}
+
+/* copy the plane to the bounce buffer of the slot, returns the copy */
+static char *bounce_plane(struct nx_v4l2_recorder *rec, struct rec_slot *slot,
+			  int plane, uint32_t used, uint32_t len)
+{
+	char *dst = (char *)slot->bounce + rec->plane_offsets[plane];
+
+	memcpy(dst, slot->frame.virt[plane], used);
+	if (len > used)
+		memset(dst + used, 0, len - used);
+
+	return dst;
+}
+
+static bool need_bounce(const struct nx_v4l2_recorder *rec,
+			const struct nx_v4l2_frame *frame, int plane,
+			uint32_t len)
+{
+	return !rec->direct_ok ||
+	       ((uintptr_t)frame->virt[plane] & (NX_V4L2_RAW_ALIGN - 1)) ||
+	       len > frame->sizes[plane];
+}
+
+static int write_sync(struct nx_v4l2_recorder *rec, struct rec_slot *slot,
+		      int plane)
+{
+	uint32_t used = plane_used(rec, &slot->frame, plane);
+	uint32_t len = rec->direct ? ALIGN_UP(used, NX_V4L2_RAW_ALIGN) : used;
+	off_t off = rec->index[slot->file_index].offset +
+		rec->plane_offsets[plane];
+	bool bounce = need_bounce(rec, &slot->frame, plane, len);
+	const char *src;
+	size_t done = 0;
+	ssize_t ret;
+
+retry:
+	src = bounce ? bounce_plane(rec, slot, plane, used, len) :
+		       slot->frame.virt[plane];
+	while (done < len) {
+		ret = pwrite(rec->fd, src + done, len - done, off + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno == EFAULT && !bounce && !done) {
+			/* source can't be used for direct io, copy from now */
+			rec->direct_ok = false;
+			bounce = true;
+			goto retry;
+		}
+		if (ret < 0)
+			return -errno;
+		if (!ret)
+			return -EIO;
+		done += ret;
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_IO_URING
+static int queue_write(struct nx_v4l2_recorder *rec, int slot_index,
+		       int plane, bool bounce)
+{
+	struct rec_slot *slot = &rec->slots[slot_index];
+	struct nx_v4l2_frame *frame = &slot->frame;
+	struct io_uring_sqe *sqe;
+	uint32_t used;
+	uint32_t len;
+	int reg;
+	char *src = frame->virt[plane];
+
+	used = plane_used(rec, frame, plane);
+	len = rec->direct ? ALIGN_UP(used, NX_V4L2_RAW_ALIGN) : used;
+
+	if (!bounce && need_bounce(rec, frame, plane, len))
+		bounce = true;
+
+	sqe = ring_get_sqe(&rec->ring);
+	if (!sqe)
+		return -EBUSY;
+
+	sqe->fd = rec->fd;
+	sqe->off = rec->index[slot->file_index].offset +
+		rec->plane_offsets[plane];
+	sqe->len = len;
+	sqe->user_data = UDATA((uint64_t)slot_index, plane, bounce);
+
+	if (bounce) {
+		char *dst = bounce_plane(rec, slot, plane, used, len);
+
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->addr = (uintptr_t)dst;
+		sqe->buf_index = slot_index;
+		return 0;
+	}
+
+	reg = rec->depth + frame->index * rec->plane_num + plane;
+	if (frame->index < rec->capture_count &&
+	    rec->iovs[reg].iov_base == src) {
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->buf_index = reg;
+	} else {
+		sqe->opcode = IORING_OP_WRITE;
+	}
+	sqe->addr = (uintptr_t)src;
+
+	return 0;
+}
+#else
+static int queue_write(struct nx_v4l2_recorder *rec, int slot_index,
+		       int plane, bool bounce)
+{
+	return -ENOSYS;
+}
+
+static int ring_enter(struct rec_ring *r, unsigned min_complete)
+{
+	return 0;
+}
+#endif
+
+static int complete_slot(struct nx_v4l2_recorder *rec,
+			 struct rec_slot *slot);
+
+int nx_v4l2_recorder_submit(struct nx_v4l2_recorder *rec, int fd, int type,
+			    struct nx_v4l2_frame *frame)
+{
+	struct rec_slot *slot = NULL;
+	struct nx_v4l2_raw_index *idx;
+	int slot_index;
+	int ret;
+	int i;
+
+	if (frame->plane_num != rec->plane_num)
+		return -EINVAL;
+
+	for (i = 0; i < frame->plane_num; i++)
+		if (!frame->virt[i])
+			return -EINVAL;
+
+	if (rec->count >= rec->max_frames)
+		return -ENOSPC;
+
+	while (rec->inflight >= rec->depth) {
+		ret = nx_v4l2_recorder_reap(rec, true);
+		if (ret < 0)
+			return ret;
+	}
+
+	for (slot_index = 0; slot_index < rec->depth; slot_index++) {
+		if (!rec->slots[slot_index].busy) {
+			slot = &rec->slots[slot_index];
+			break;
+		}
+	}
+	if (!slot)
+		return -EBUSY;
+
+	slot->busy = true;
+	slot->v4l2_fd = fd;
+	slot->type = type;
+	slot->pending = frame->plane_num;
+	slot->error = 0;
+	slot->file_index = rec->count;
+	memcpy(&slot->frame, frame, sizeof(*frame));
+
+	idx = &rec->index[rec->count];
+	idx->offset = rec->data_offset + (uint64_t)rec->count * rec->slot_size;
+	idx->timestamp_us = (uint64_t)frame->timestamp.tv_sec * 1000000 +
+		frame->timestamp.tv_usec;
+	idx->sequence = frame->sequence;
+	for (i = 0; i < frame->plane_num; i++)
+		idx->bytesused[i] = frame->bytesused[i];
+
+	if (rec->sync) {
+		for (i = 0; i < frame->plane_num; i++) {
+			ret = write_sync(rec, slot, i);
+			if (ret && !slot->error)
+				slot->error = ret;
+		}
+		rec->count++;
+		rec->inflight++;
+		complete_slot(rec, slot);
+		return 0;
+	}
+
+	for (i = 0; i < frame->plane_num; i++) {
+		ret = queue_write(rec, slot_index, i, false);
+		if (ret) {
+			/* ring is sized depth * planes, never happens */
+			fprintf(stderr, "%s: no sqe\n", __func__);
+			return ret;
+		}
+	}
+
+	rec->count++;
+	rec->inflight++;
+
+	return ring_enter(&rec->ring, 0);
+}
+
+static int complete_slot(struct nx_v4l2_recorder *rec, struct rec_slot *slot)
+{
+	int ret;
+
+	if (slot->error)
+		fprintf(stderr, "%s: write of frame %u failed(%d)\n",
+			__func__, slot->file_index, slot->error);
+
+	ret = nx_v4l2_qbuf_frame(slot->v4l2_fd, slot->type, &slot->frame);
+	if (ret)
+		fprintf(stderr, "%s: failed to qbuf %d\n", __func__,
+			slot->frame.index);
+
+	slot->busy = false;
+	rec->inflight--;
+
+	return ret;
+}
+
+int nx_v4l2_recorder_reap(struct nx_v4l2_recorder *rec, bool wait)
+{
+#ifdef HAVE_IO_URING
+	struct rec_ring *r = &rec->ring;
+	unsigned head, tail;
+	int done = 0;
+	int ret;
+
+	if (!rec->inflight)
+		return 0;
+
+	head = *r->cq_head;
+	tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	if (head == tail && wait) {
+		ret = ring_enter(r, 1);
+		if (ret)
+			return ret;
+		tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	}
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+		int slot_index = UDATA_SLOT(cqe->user_data);
+		int plane = UDATA_PLANE(cqe->user_data);
+		struct rec_slot *slot = &rec->slots[slot_index];
+
+		if (cqe->res == -EFAULT && !UDATA_BOUNCE(cqe->user_data)) {
+			/* source can't be used for direct io, copy from now */
+			rec->direct_ok = false;
+			if (!queue_write(rec, slot_index, plane, true))
+				continue;
+		}
+
+		if (cqe->res < 0)
+			slot->error = cqe->res;
+		else if ((uint32_t)cqe->res < slot->frame.bytesused[plane])
+			slot->error = -EIO;
+
+		if (--slot->pending == 0) {
+			complete_slot(rec, slot);
+			done++;
+		}
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+	ret = ring_enter(r, 0);
+	if (ret)
+		return ret;
+
+	return done;
+#else
+	/* synchronous writes complete in submit */
+	return 0;
+#endif
+}
+
+static int write_header(struct nx_v4l2_recorder *rec)
+{
+	struct nx_v4l2_raw_header *h;
+	void *buf;
+	size_t done = 0;
+	ssize_t ret;
+	int i;
+
+	/* header block is written through the same O_DIRECT fd */
+	if (posix_memalign(&buf, NX_V4L2_RAW_ALIGN, rec->data_offset))
+		return -ENOMEM;
+
+	memset(buf, 0, rec->data_offset);
+	h = buf;
+	memcpy(h->magic, NX_V4L2_RAW_MAGIC, sizeof(h->magic));
+	h->version = NX_V4L2_RAW_VERSION;
+	h->format = rec->fmt.format;
+	h->width = rec->fmt.width;
+	h->height = rec->fmt.height;
+	h->plane_num = rec->plane_num;
+	for (i = 0; i < rec->plane_num; i++) {
+		h->strides[i] = rec->fmt.strides[i];
+		h->plane_sizes[i] = rec->plane_sizes[i];
+		h->plane_offsets[i] = rec->plane_offsets[i];
+	}
+	h->slot_size = rec->slot_size;
+	h->frame_count = rec->count;
+	h->max_frames = rec->max_frames;
+	h->index_offset = sizeof(*h);
+	h->data_offset = rec->data_offset;
+	memcpy((char *)buf + h->index_offset, rec->index,
+	       rec->count * sizeof(*rec->index));
+
+	while (done < rec->data_offset) {
+		ret = pwrite(rec->fd, (char *)buf + done,
+			     rec->data_offset - done, done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			free(buf);
+			return ret;
+		}
+		done += ret;
+	}
+
+	free(buf);
+	return 0;
+}
+
+int nx_v4l2_recorder_flush(struct nx_v4l2_recorder *rec)
+{
+	int ret;
+
+	while (rec->inflight) {
+		ret = nx_v4l2_recorder_reap(rec, true);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = write_header(rec);
+	if (ret) {
+		fprintf(stderr, "%s: failed to write header(%d)\n", __func__,
+			ret);
+		return ret;
+	}
+
+	return fdatasync(rec->fd);
+}
+
+int nx_v4l2_recorder_get_fd(struct nx_v4l2_recorder *rec)
+{
+	return rec->ring.fd;
+}
+
+int nx_v4l2_recorder_get_count(struct nx_v4l2_recorder *rec)
+{
+	return rec->count;
+}
+
+void nx_v4l2_recorder_destroy(struct nx_v4l2_recorder *rec)
+{
+	int i;
+
+	if (!rec)
+		return;
+
+	if ((rec->ring.fd >= 0 || rec->sync) && rec->fd >= 0 && rec->index) {
+		nx_v4l2_recorder_flush(rec);
+		if (ftruncate(rec->fd, rec->data_offset +
+			      (off_t)rec->slot_size * rec->count) < 0)
+			fprintf(stderr, "%s: failed to truncate\n", __func__);
+	}
+	ring_release(&rec->ring);
+
+	if (rec->fd >= 0)
+		close(rec->fd);
+
+	if (rec->slots) {
+		for (i = 0; i < rec->depth; i++)
+			free(rec->slots[i].bounce);
+		free(rec->slots);
+	}
+	free(rec->iovs);
+	free(rec->index);
+	free(rec);
+}
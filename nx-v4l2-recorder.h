@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_RECORDER_H
+#define _NX_V4L2_RECORDER_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-raw.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Raw frame recorder.
+ *
+ * Dequeued planes are written to a preallocated container file(see
+ * nx-v4l2-raw.h) with io_uring and O_DIRECT, every frame occupies a fixed
+ * size slot whose planes start on NX_V4L2_RAW_ALIGN boundary. The frame
+ * given to submit is owned by the recorder until its writes are completed,
+ * then it is queued back to the driver with nx_v4l2_qbuf_frame() from
+ * nx_v4l2_recorder_reap(). The header and frame index are written by
+ * nx_v4l2_recorder_flush() and nx_v4l2_recorder_destroy().
+ *
+ * Without io_uring(not in the headers at build time, or refused by the
+ * kernel) submit writes the planes with pwrite and queues the frame back
+ * before it returns, reap has nothing to do and get_fd returns -1.
+ */
+
+struct nx_v4l2_recorder;
+
+struct nx_v4l2_recorder *nx_v4l2_recorder_create(const char *path,
+				const struct nx_v4l2_format_info *fmt,
+				int max_frames, int depth);
+void nx_v4l2_recorder_destroy(struct nx_v4l2_recorder *rec);
+int nx_v4l2_recorder_register_buffers(struct nx_v4l2_recorder *rec,
+				      struct nx_v4l2_frame *bufs, int count);
+int nx_v4l2_recorder_submit(struct nx_v4l2_recorder *rec, int fd, int type,
+			    struct nx_v4l2_frame *frame);
+int nx_v4l2_recorder_reap(struct nx_v4l2_recorder *rec, bool wait);
+int nx_v4l2_recorder_flush(struct nx_v4l2_recorder *rec);
+int nx_v4l2_recorder_get_fd(struct nx_v4l2_recorder *rec);
+int nx_v4l2_recorder_get_count(struct nx_v4l2_recorder *rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
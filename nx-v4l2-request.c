@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include <sys/ioctl.h>
+
+#include <linux/videodev2.h>
+#include <linux/media.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-request.h"
+
+#define MAX_PENDING	16
+
+/* media requests arrived with linux 4.20, older headers only get fallback */
+#if defined(MEDIA_IOC_REQUEST_ALLOC) && defined(V4L2_BUF_FLAG_REQUEST_FD) && \
+	defined(V4L2_BUF_CAP_SUPPORTS_REQUESTS) && \
+	defined(V4L2_CTRL_WHICH_REQUEST_VAL)
+#define HAVE_MEDIA_REQUEST
+#endif
+
+enum {
+	SLOT_FREE,
+	SLOT_QUEUED,
+	SLOT_DONE,		/* buffer dequeued, request not completed yet */
+};
+
+struct request_target {
+	int fd;
+	int type;
+	int count;
+	struct v4l2_ext_control ctrls[NX_V4L2_REQUEST_MAX_CTRLS];
+};
+
+struct request_slot {
+	int fd;
+	int state;
+	uint32_t tag;
+};
+
+struct pending_ctrls {
+	uint32_t tag;
+	uint32_t sequence;	/* first frame in effect */
+};
+
+struct nx_v4l2_request_pool {
+	struct nx_v4l2_request_config cfg;
+	bool native;
+
+	/* staged for the next qbuf */
+	int target_num;
+	struct request_target targets[NX_V4L2_REQUEST_MAX_TARGETS];
+	uint32_t last_tag;
+	uint32_t current_tag;
+
+	/* native */
+	struct request_slot *slots;
+	int *buf_slots;
+
+	/* fallback */
+	uint32_t next_sequence;
+	int pending_num;
+	struct pending_ctrls pending[MAX_PENDING];
+};
+
+static int ioctl_ret(int ret)
+{
+	return ret == -1 ? -errno : ret;
+}
+
+static void free_slots(struct nx_v4l2_request_pool *pool)
+{
+	int i;
+
+	if (!pool->slots)
+		return;
+
+	for (i = 0; i < pool->cfg.count; i++)
+		if (pool->slots[i].fd >= 0)
+			close(pool->slots[i].fd);
+	free(pool->slots);
+	pool->slots = NULL;
+}
+
+#ifdef HAVE_MEDIA_REQUEST
+static int alloc_slots(struct nx_v4l2_request_pool *pool)
+{
+	struct nx_v4l2_request_config *cfg = &pool->cfg;
+	uint32_t caps = 0;
+	int i;
+
+	if (cfg->media_fd < 0)
+		return -ENODEV;
+
+	if (nx_v4l2_query_buf_caps(cfg->video_fd, cfg->type, cfg->memory,
+				   &caps) ||
+	    !(caps & V4L2_BUF_CAP_SUPPORTS_REQUESTS))
+		return -ENOTSUP;
+
+	pool->slots = calloc(cfg->count, sizeof(*pool->slots));
+	if (!pool->slots)
+		return -ENOMEM;
+
+	for (i = 0; i < cfg->count; i++)
+		pool->slots[i].fd = -1;
+
+	for (i = 0; i < cfg->count; i++) {
+		if (ioctl(cfg->media_fd, MEDIA_IOC_REQUEST_ALLOC,
+			  &pool->slots[i].fd)) {
+			pool->slots[i].fd = -1;
+			free_slots(pool);
+			return -ENOTSUP;
+		}
+	}
+
+	return 0;
+}
+#else
+static int alloc_slots(struct nx_v4l2_request_pool *pool)
+{
+	return -ENOTSUP;
+}
+#endif
+
+struct nx_v4l2_request_pool *nx_v4l2_request_pool_create(
+				const struct nx_v4l2_request_config *cfg)
+{
+	struct nx_v4l2_request_pool *pool;
+	int i;
+
+	if (cfg->count <= 0 || cfg->plane_num <= 0 ||
+	    cfg->plane_num > NX_V4L2_MAX_PLANES)
+		return NULL;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->cfg = *cfg;
+	pool->buf_slots = calloc(cfg->count, sizeof(*pool->buf_slots));
+	if (!pool->buf_slots) {
+		free(pool);
+		return NULL;
+	}
+	for (i = 0; i < cfg->count; i++)
+		pool->buf_slots[i] = -1;
+
+	pool->native = alloc_slots(pool) == 0;
+
+	return pool;
+}
+
+void nx_v4l2_request_pool_destroy(struct nx_v4l2_request_pool *pool)
+{
+	if (!pool)
+		return;
+
+	free_slots(pool);
+	free(pool->buf_slots);
+	free(pool);
+}
+
+bool nx_v4l2_request_pool_is_native(struct nx_v4l2_request_pool *pool)
+{
+	return pool->native;
+}
+
+int nx_v4l2_request_set_ctrls(struct nx_v4l2_request_pool *pool, int fd,
+			      int type, const struct v4l2_ext_control *ctrls,
+			      int count)
+{
+	struct request_target *t = NULL;
+	int i, j;
+
+	for (i = 0; i < pool->target_num; i++) {
+		if (pool->targets[i].fd == fd) {
+			t = &pool->targets[i];
+			break;
+		}
+	}
+
+	if (!t) {
+		if (pool->target_num >= NX_V4L2_REQUEST_MAX_TARGETS)
+			return -ENOSPC;
+		t = &pool->targets[pool->target_num++];
+		t->fd = fd;
+		t->type = type;
+		t->count = 0;
+	}
+
+	/* the last value staged for a control wins */
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < t->count; j++)
+			if (t->ctrls[j].id == ctrls[i].id)
+				break;
+		if (j == t->count) {
+			if (t->count >= NX_V4L2_REQUEST_MAX_CTRLS)
+				return -ENOSPC;
+			t->count++;
+		}
+		t->ctrls[j] = ctrls[i];
+	}
+
+	return 0;
+}
+
+static uint32_t take_staged(struct nx_v4l2_request_pool *pool)
+{
+	if (!pool->target_num)
+		return 0;
+
+	pool->target_num = 0;
+	if (!++pool->last_tag)
+		pool->last_tag = 1;
+
+	return pool->last_tag;
+}
+
+#ifdef HAVE_MEDIA_REQUEST
+static int reinit_slot(struct request_slot *slot)
+{
+	if (ioctl(slot->fd, MEDIA_REQUEST_IOC_REINIT, NULL)) {
+		if (errno != EBUSY)
+			return -errno;
+		slot->state = SLOT_DONE;
+		return -EBUSY;
+	}
+
+	slot->state = SLOT_FREE;
+	slot->tag = 0;
+	return 0;
+}
+
+static struct request_slot *get_free_slot(struct nx_v4l2_request_pool *pool)
+{
+	struct request_slot *slot;
+	int i;
+
+	for (i = 0; i < pool->cfg.count; i++) {
+		slot = &pool->slots[i];
+		if (slot->state == SLOT_DONE)
+			reinit_slot(slot);
+		if (slot->state == SLOT_FREE)
+			return slot;
+	}
+
+	return NULL;
+}
+
+static int native_qbuf(struct nx_v4l2_request_pool *pool,
+		       struct nx_v4l2_frame *frame)
+{
+	struct nx_v4l2_request_config *cfg = &pool->cfg;
+	struct v4l2_ext_controls ext;
+	struct request_target *t;
+	struct request_slot *slot;
+	int ret;
+	int i;
+
+	slot = get_free_slot(pool);
+	if (!slot)
+		return -EBUSY;
+
+	for (i = 0; i < pool->target_num; i++) {
+		t = &pool->targets[i];
+		bzero(&ext, sizeof(ext));
+		ext.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		ext.request_fd = slot->fd;
+		ext.count = t->count;
+		ext.controls = t->ctrls;
+		if (ioctl(t->fd, VIDIOC_S_EXT_CTRLS, &ext)) {
+			ret = -errno;
+			fprintf(stderr, "%s: failed to bind controls(%d)\n",
+				__func__, ret);
+			goto reinit;
+		}
+	}
+
+	ret = ioctl_ret(nx_v4l2_qbuf_frame_request(cfg->video_fd, cfg->type,
+						   frame, slot->fd));
+	if (ret)
+		goto reinit;
+
+	if (ioctl(slot->fd, MEDIA_REQUEST_IOC_QUEUE, NULL)) {
+		ret = -errno;
+		fprintf(stderr, "%s: failed to queue request(%d)\n", __func__,
+			ret);
+		goto reinit;
+	}
+
+	slot->state = SLOT_QUEUED;
+	slot->tag = take_staged(pool);
+	pool->buf_slots[frame->index] = slot - pool->slots;
+
+	return slot->tag;
+
+reinit:
+	reinit_slot(slot);
+	return ret;
+}
+#else
+/* never reached, pools without slots are not native */
+static int reinit_slot(struct request_slot *slot)
+{
+	return -ENOTSUP;
+}
+
+static int native_qbuf(struct nx_v4l2_request_pool *pool,
+		       struct nx_v4l2_frame *frame)
+{
+	return -ENOTSUP;
+}
+#endif
+
+static int fallback_qbuf(struct nx_v4l2_request_pool *pool,
+			 struct nx_v4l2_frame *frame)
+{
+	struct nx_v4l2_request_config *cfg = &pool->cfg;
+	struct pending_ctrls *p;
+	struct request_target *t;
+	uint32_t tag;
+	int ret;
+	int i;
+
+	for (i = 0; i < pool->target_num; i++) {
+		t = &pool->targets[i];
+		ret = ioctl_ret(nx_v4l2_set_ext_ctrls(t->fd, t->type,
+						      t->ctrls, t->count));
+		if (ret)
+			return ret;
+	}
+
+	ret = ioctl_ret(nx_v4l2_qbuf_frame(cfg->video_fd, cfg->type, frame));
+	if (ret)
+		return ret;
+
+	tag = take_staged(pool);
+	if (!tag)
+		return 0;
+
+	/* the oldest set is certainly in effect when the list is full */
+	if (pool->pending_num == MAX_PENDING) {
+		pool->current_tag = pool->pending[0].tag;
+		memmove(pool->pending, pool->pending + 1,
+			sizeof(pool->pending[0]) * (MAX_PENDING - 1));
+		pool->pending_num--;
+	}
+
+	p = &pool->pending[pool->pending_num++];
+	p->tag = tag;
+	p->sequence = pool->next_sequence + cfg->ctrl_delay;
+
+	return tag;
+}
+
+int nx_v4l2_request_qbuf(struct nx_v4l2_request_pool *pool,
+			 struct nx_v4l2_frame *frame)
+{
+	if (frame->index < 0 || frame->index >= pool->cfg.count)
+		return -EINVAL;
+
+	if (pool->native)
+		return native_qbuf(pool, frame);
+
+	return fallback_qbuf(pool, frame);
+}
+
+int nx_v4l2_request_dqbuf(struct nx_v4l2_request_pool *pool,
+			  struct nx_v4l2_frame *frame, uint32_t *tag)
+{
+	struct nx_v4l2_request_config *cfg = &pool->cfg;
+	struct request_slot *slot;
+	int ret;
+	int n;
+
+	if (cfg->memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_dqbuf_mmap_frame(cfg->video_fd, cfg->type,
+					       frame);
+	else
+		ret = nx_v4l2_dqbuf_frame(cfg->video_fd, cfg->type,
+					  cfg->plane_num, frame);
+	if (ret)
+		return ioctl_ret(ret);
+
+	if (frame->index < 0 || frame->index >= cfg->count)
+		return -EINVAL;
+
+	if (pool->native) {
+		n = pool->buf_slots[frame->index];
+		if (n >= 0) {
+			slot = &pool->slots[n];
+			if (slot->tag)
+				pool->current_tag = slot->tag;
+			reinit_slot(slot);
+			pool->buf_slots[frame->index] = -1;
+		}
+	} else {
+		for (n = 0; n < pool->pending_num; n++)
+			if ((int32_t)(frame->sequence -
+				      pool->pending[n].sequence) < 0)
+				break;
+		if (n) {
+			pool->current_tag = pool->pending[n - 1].tag;
+			memmove(pool->pending, pool->pending + n,
+				sizeof(pool->pending[0]) *
+				(pool->pending_num - n));
+			pool->pending_num -= n;
+		}
+		pool->next_sequence = frame->sequence + 1;
+	}
+
+	if (tag)
+		*tag = pool->current_tag;
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_REQUEST_H
+#define _NX_V4L2_REQUEST_H
+
+#include "nx-v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Controls bound to frames with the media request api.
+ *
+ * Controls given to nx_v4l2_request_set_ctrls() are staged and go out with
+ * the next buffer queued by nx_v4l2_request_qbuf(), which returns the tag of
+ * that control set. nx_v4l2_request_dqbuf() returns the tag of the newest
+ * control set in effect on the dequeued frame, so 3a and bracketing know
+ * exactly which frame carries which values.
+ *
+ * When the media device allocates requests and the video queue reports
+ * V4L2_BUF_CAP_SUPPORTS_REQUESTS, every buffer is queued in its own request
+ * together with the staged controls and the driver applies them to that
+ * frame. Otherwise the controls are written when the buffer is queued and
+ * counted in effect ctrl_delay frames after the next one to be dequeued,
+ * the latching delay of the sensor.
+ *
+ * Once requests are used every buffer of the queue has to be queued with
+ * nx_v4l2_request_qbuf(). A pool is not thread safe.
+ */
+
+#define NX_V4L2_REQUEST_MAX_TARGETS	4
+#define NX_V4L2_REQUEST_MAX_CTRLS	16
+
+struct nx_v4l2_request_config {
+	int media_fd;			/* -1 always uses the fallback */
+	int video_fd;
+	int type;			/* nx_clipper_video, ... */
+	uint32_t memory;
+	int plane_num;
+	int count;			/* requests, at least the buffer count */
+	int ctrl_delay;			/* frames, fallback only */
+};
+
+struct nx_v4l2_request_pool;
+
+struct nx_v4l2_request_pool *nx_v4l2_request_pool_create(
+				const struct nx_v4l2_request_config *cfg);
+void nx_v4l2_request_pool_destroy(struct nx_v4l2_request_pool *pool);
+/* true when controls are applied by the driver with the buffer */
+bool nx_v4l2_request_pool_is_native(struct nx_v4l2_request_pool *pool);
+
+/* fd and type of the control target, usually nx_sensor_subdev */
+int nx_v4l2_request_set_ctrls(struct nx_v4l2_request_pool *pool, int fd,
+			      int type, const struct v4l2_ext_control *ctrls,
+			      int count);
+/* returns the tag of the control set sent with the frame, 0 for none */
+int nx_v4l2_request_qbuf(struct nx_v4l2_request_pool *pool,
+			 struct nx_v4l2_frame *frame);
+int nx_v4l2_request_dqbuf(struct nx_v4l2_request_pool *pool,
+			  struct nx_v4l2_frame *frame, uint32_t *tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1100 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <sys/eventfd.h>
+
+#include <linux/videodev2.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-convert.h"
+#include "nx-v4l2-scaler.h"
+
+#define MAX_SCALE_PLANES	3
+#define WEIGHT_BITS		8
+#define WEIGHT_ONE		(1 << WEIGHT_BITS)
+
+/*
+ * Separable filter, both passes use Q8 weights which sum to WEIGHT_ONE.
+ * The horizontal pass keeps 8 fractional bits in 16bit rows, the vertical
+ * pass accumulates them in 32bit and rounds back to 8bit.
+ */
+struct scale_taps {
+	int taps;
+	int32_t *idx;
+	uint16_t *w;
+	uint16_t *w8;		/* w padded to 8 taps for simd, or NULL */
+};
+
+#if defined(HAVE_SSE2) || defined(HAVE_NEON)
+#define HAVE_SIMD_HPASS
+#endif
+#define SIMD_TAPS		8
+
+struct scale_plane {
+	uint32_t sw, sh;
+	uint32_t dw, dh;
+	int channels;
+	struct scale_taps x;
+	struct scale_taps y;
+	uint8_t *yneed;
+	uint16_t *ring;
+	uint32_t next_dst;
+};
+
+struct scale_output {
+	struct scale_plane planes[MAX_SCALE_PLANES];
+};
+
+struct nx_v4l2_scaler {
+	uint32_t format;
+	int plane_num;
+	int count;
+	struct scale_output *outputs;
+};
+
+static uint32_t scale_base_format(uint32_t format)
+{
+	switch (format) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV12M:
+		return V4L2_PIX_FMT_NV12;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YUV420M:
+		return V4L2_PIX_FMT_YUV420;
+	default:
+		return 0;
+	}
+}
+
+/****************************************************************
+ * row kernels
+ */
+static void hpass_c(const uint8_t *src, uint16_t *dst,
+		    const struct scale_plane *sp, uint32_t x)
+{
+	const int taps = sp->x.taps;
+	const int ch = sp->channels;
+	int c, k;
+
+	dst += (size_t)x * ch;
+	for (; x < sp->dw; x++) {
+		const uint8_t *s = src + sp->x.idx[x] * ch;
+		const uint16_t *w = sp->x.w + x * taps;
+
+		for (c = 0; c < ch; c++) {
+			uint32_t sum = 0;
+
+			for (k = 0; k < taps; k++)
+				sum += w[k] * s[k * ch + c];
+			*dst++ = sum;
+		}
+	}
+}
+
+/*
+ * Up to SIMD_TAPS taps of one destination pixel per iteration, the zero
+ * padded weights cancel the extra samples. The load covers SIMD_TAPS
+ * samples, the pixels whose window ends closer to the row end go through
+ * hpass_c().
+ */
+#if defined(HAVE_SSE2)
+static inline uint32_t hsum_epi32(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+static uint32_t hpass_simd(const uint8_t *src, uint16_t *dst,
+			   const struct scale_plane *sp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo8 = _mm_set1_epi16(0xff);
+	const uint32_t end = sp->sw - SIMD_TAPS;
+	__m128i v, w;
+	uint32_t x;
+
+	for (x = 0; x < sp->dw && (uint32_t)sp->x.idx[x] <= end; x++) {
+		w = _mm_loadu_si128((const __m128i *)(sp->x.w8 +
+						      x * SIMD_TAPS));
+		if (sp->channels == 1) {
+			v = _mm_loadl_epi64((const __m128i *)
+					    (src + sp->x.idx[x]));
+			v = _mm_unpacklo_epi8(v, zero);
+			*dst++ = hsum_epi32(_mm_madd_epi16(v, w));
+		} else {
+			v = _mm_loadu_si128((const __m128i *)
+					    (src + sp->x.idx[x] * 2));
+			*dst++ = hsum_epi32(_mm_madd_epi16(_mm_and_si128(v,
+								lo8), w));
+			*dst++ = hsum_epi32(_mm_madd_epi16(_mm_srli_epi16(v,
+								8), w));
+		}
+	}
+
+	return x;
+}
+#elif defined(HAVE_NEON)
+static inline uint32_t hsum_u32(uint32x4_t v)
+{
+	uint32x2_t t = vadd_u32(vget_low_u32(v), vget_high_u32(v));
+
+	return vget_lane_u32(vpadd_u32(t, t), 0);
+}
+
+static inline uint32_t dot_u16(uint16x8_t v, uint16x8_t w)
+{
+	uint32x4_t acc = vmull_u16(vget_low_u16(v), vget_low_u16(w));
+
+	return hsum_u32(vmlal_u16(acc, vget_high_u16(v), vget_high_u16(w)));
+}
+
+static uint32_t hpass_simd(const uint8_t *src, uint16_t *dst,
+			   const struct scale_plane *sp)
+{
+	const uint32_t end = sp->sw - SIMD_TAPS;
+	uint16x8_t w;
+	uint8x8x2_t uv;
+	uint32_t x;
+
+	for (x = 0; x < sp->dw && (uint32_t)sp->x.idx[x] <= end; x++) {
+		w = vld1q_u16(sp->x.w8 + x * SIMD_TAPS);
+		if (sp->channels == 1) {
+			*dst++ = dot_u16(vmovl_u8(vld1_u8(src +
+							  sp->x.idx[x])), w);
+		} else {
+			uv = vld2_u8(src + sp->x.idx[x] * 2);
+			*dst++ = dot_u16(vmovl_u8(uv.val[0]), w);
+			*dst++ = dot_u16(vmovl_u8(uv.val[1]), w);
+		}
+	}
+
+	return x;
+}
+#endif
+
+static void hpass(const uint8_t *src, uint16_t *dst,
+		  const struct scale_plane *sp)
+{
+	uint32_t x = 0;
+
+#if defined(HAVE_SIMD_HPASS)
+	if (sp->x.w8)
+		x = hpass_simd(src, dst, sp);
+#endif
+	hpass_c(src, dst, sp, x);
+}
+
+static void vpass_c(const uint16_t * const *rows, const uint16_t *w,
+		    int taps, uint8_t *dst, int n)
+{
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		uint32_t sum = 0;
+
+		for (k = 0; k < taps; k++)
+			sum += (uint32_t)w[k] * rows[k][i];
+		dst[i] = (sum + (1 << 15)) >> 16;
+	}
+}
+
+#if defined(HAVE_SSE2)
+static void vpass(const uint16_t * const *rows, const uint16_t *w,
+		  int taps, uint8_t *dst, int n)
+{
+	const __m128i round = _mm_set1_epi32(1 << 15);
+	__m128i acc_lo, acc_hi, h, wv, lo, hi;
+	int i, k;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		acc_lo = round;
+		acc_hi = round;
+		for (k = 0; k < taps; k++) {
+			h = _mm_loadu_si128((const __m128i *)(rows[k] + i));
+			wv = _mm_set1_epi16(w[k]);
+			lo = _mm_mullo_epi16(h, wv);
+			hi = _mm_mulhi_epu16(h, wv);
+			acc_lo = _mm_add_epi32(acc_lo,
+					       _mm_unpacklo_epi16(lo, hi));
+			acc_hi = _mm_add_epi32(acc_hi,
+					       _mm_unpackhi_epi16(lo, hi));
+		}
+		acc_lo = _mm_srli_epi32(acc_lo, 16);
+		acc_hi = _mm_srli_epi32(acc_hi, 16);
+		h = _mm_packs_epi32(acc_lo, acc_hi);
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(h, h));
+	}
+
+	if (i < n) {
+		const uint16_t *tail[WEIGHT_ONE];
+
+		for (k = 0; k < taps; k++)
+			tail[k] = rows[k] + i;
+		vpass_c(tail, w, taps, dst + i, n - i);
+	}
+}
+#elif defined(HAVE_NEON)
+static void vpass(const uint16_t * const *rows, const uint16_t *w,
+		  int taps, uint8_t *dst, int n)
+{
+	uint32x4_t acc_lo, acc_hi;
+	uint16x8_t h;
+	int i, k;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		acc_lo = vdupq_n_u32(0);
+		acc_hi = vdupq_n_u32(0);
+		for (k = 0; k < taps; k++) {
+			h = vld1q_u16(rows[k] + i);
+			acc_lo = vmlal_n_u16(acc_lo, vget_low_u16(h), w[k]);
+			acc_hi = vmlal_n_u16(acc_hi, vget_high_u16(h), w[k]);
+		}
+		h = vcombine_u16(vrshrn_n_u32(acc_lo, 16),
+				 vrshrn_n_u32(acc_hi, 16));
+		vst1_u8(dst + i, vqmovn_u16(h));
+	}
+
+	if (i < n) {
+		const uint16_t *tail[WEIGHT_ONE];
+
+		for (k = 0; k < taps; k++)
+			tail[k] = rows[k] + i;
+		vpass_c(tail, w, taps, dst + i, n - i);
+	}
+}
+#else
+#define vpass	vpass_c
+#endif
+
+/* 2x2 box, ch is 1 for planar and 2 for interleaved chroma */
+static void box2_c(const uint8_t *s0, const uint8_t *s1, uint8_t *d,
+		   uint32_t sw, uint32_t dw, int ch)
+{
+	uint32_t x, x0, x1;
+	int c;
+
+	for (x = 0; x < dw; x++) {
+		x0 = 2 * x;
+		x1 = x0 + 1 < sw ? x0 + 1 : x0;
+		for (c = 0; c < ch; c++)
+			d[x * ch + c] = (s0[x0 * ch + c] + s0[x1 * ch + c] +
+					 s1[x0 * ch + c] + s1[x1 * ch + c] +
+					 2) >> 2;
+	}
+}
+
+#if defined(HAVE_SSE2)
+static void box2(const uint8_t *s0, const uint8_t *s1, uint8_t *d,
+		 uint32_t sw, uint32_t dw, int ch)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	const __m128i two = _mm_set1_epi16(2);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a, b, sa, sb, lo, hi;
+	uint32_t x = 0;
+
+	if (ch == 1) {
+		/* 16 output pixels from 32 source pixels of each row */
+		for (; 2 * x + 32 <= sw && x + 16 <= dw; x += 16) {
+			a = _mm_loadu_si128((const __m128i *)(s0 + 2 * x));
+			b = _mm_loadu_si128((const __m128i *)(s1 + 2 * x));
+			sa = _mm_add_epi16(_mm_and_si128(a, mask),
+					   _mm_srli_epi16(a, 8));
+			sa = _mm_add_epi16(sa, _mm_and_si128(b, mask));
+			sa = _mm_add_epi16(sa, _mm_srli_epi16(b, 8));
+
+			a = _mm_loadu_si128((const __m128i *)(s0 + 2 * x + 16));
+			b = _mm_loadu_si128((const __m128i *)(s1 + 2 * x + 16));
+			sb = _mm_add_epi16(_mm_and_si128(a, mask),
+					   _mm_srli_epi16(a, 8));
+			sb = _mm_add_epi16(sb, _mm_and_si128(b, mask));
+			sb = _mm_add_epi16(sb, _mm_srli_epi16(b, 8));
+
+			sa = _mm_srli_epi16(_mm_add_epi16(sa, two), 2);
+			sb = _mm_srli_epi16(_mm_add_epi16(sb, two), 2);
+			_mm_storeu_si128((__m128i *)(d + x),
+					 _mm_packus_epi16(sa, sb));
+		}
+	} else {
+		/* 4 output pairs from 8 source pairs of each row */
+		for (; 2 * x + 8 <= sw && x + 4 <= dw; x += 4) {
+			a = _mm_loadu_si128((const __m128i *)(s0 + 4 * x));
+			b = _mm_loadu_si128((const __m128i *)(s1 + 4 * x));
+			lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+					   _mm_unpacklo_epi8(b, zero));
+			hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+					   _mm_unpackhi_epi8(b, zero));
+			/* add neighbouring pairs, keep even 32bit lanes */
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 4));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 4));
+			lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+			hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+			lo = _mm_unpacklo_epi64(lo, hi);
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+			_mm_storel_epi64((__m128i *)(d + 2 * x),
+					 _mm_packus_epi16(lo, lo));
+		}
+	}
+
+	box2_c(s0 + 2 * x * ch, s1 + 2 * x * ch, d + x * ch, sw - 2 * x,
+	       dw - x, ch);
+}
+#elif defined(HAVE_NEON)
+static void box2(const uint8_t *s0, const uint8_t *s1, uint8_t *d,
+		 uint32_t sw, uint32_t dw, int ch)
+{
+	uint32_t x = 0;
+
+	if (ch == 1) {
+		for (; 2 * x + 32 <= sw && x + 16 <= dw; x += 16) {
+			uint8x16x2_t a = vld2q_u8(s0 + 2 * x);
+			uint8x16x2_t b = vld2q_u8(s1 + 2 * x);
+			uint16x8_t lo, hi;
+
+			lo = vaddl_u8(vget_low_u8(a.val[0]),
+				      vget_low_u8(a.val[1]));
+			lo = vaddw_u8(lo, vget_low_u8(b.val[0]));
+			lo = vaddw_u8(lo, vget_low_u8(b.val[1]));
+			hi = vaddl_u8(vget_high_u8(a.val[0]),
+				      vget_high_u8(a.val[1]));
+			hi = vaddw_u8(hi, vget_high_u8(b.val[0]));
+			hi = vaddw_u8(hi, vget_high_u8(b.val[1]));
+			vst1q_u8(d + x, vcombine_u8(vrshrn_n_u16(lo, 2),
+						    vrshrn_n_u16(hi, 2)));
+		}
+	} else {
+		for (; 2 * x + 16 <= sw && x + 8 <= dw; x += 8) {
+			uint8x8x4_t a = vld4_u8(s0 + 4 * x);
+			uint8x8x4_t b = vld4_u8(s1 + 4 * x);
+			uint16x8_t u, v;
+			uint8x8x2_t out;
+
+			u = vaddl_u8(a.val[0], a.val[2]);
+			u = vaddw_u8(u, b.val[0]);
+			u = vaddw_u8(u, b.val[2]);
+			v = vaddl_u8(a.val[1], a.val[3]);
+			v = vaddw_u8(v, b.val[1]);
+			v = vaddw_u8(v, b.val[3]);
+			out.val[0] = vrshrn_n_u16(u, 2);
+			out.val[1] = vrshrn_n_u16(v, 2);
+			vst2_u8(d + 2 * x, out);
+		}
+	}
+
+	box2_c(s0 + 2 * x * ch, s1 + 2 * x * ch, d + x * ch, sw - 2 * x,
+	       dw - x, ch);
+}
+#else
+#define box2	box2_c
+#endif
+
+/****************************************************************
+ * filter tables
+ */
+static void free_taps(struct scale_taps *t)
+{
+	free(t->idx);
+	free(t->w);
+	free(t->w8);
+	t->idx = NULL;
+	t->w = NULL;
+	t->w8 = NULL;
+}
+
+static int max_taps(uint32_t sn, uint32_t dn, int filter)
+{
+	int taps;
+
+	if (filter == NX_V4L2_SCALE_BILINEAR)
+		taps = 2;
+	else
+		taps = (int)ceil((double)sn / dn) + 1;
+
+	return taps > (int)sn ? (int)sn : taps;
+}
+
+/* weights of the source pixels covered by the destination pixel d */
+static void calc_weights(uint32_t sn, uint32_t dn, uint32_t d, int filter,
+			 double *w, uint32_t *first, uint32_t *last)
+{
+	double r = (double)sn / dn;
+	uint32_t i;
+
+	if (filter == NX_V4L2_SCALE_BILINEAR) {
+		double f = (d + 0.5) * r - 0.5;
+		uint32_t i0;
+
+		if (f < 0)
+			f = 0;
+		i0 = (uint32_t)f;
+		if (i0 >= sn - 1) {
+			i0 = sn - 1;
+			f = i0;
+		}
+		*first = i0;
+		*last = i0 + 1 < sn ? i0 + 1 : i0;
+		w[0] = 1.0 - (f - i0);
+		w[1] = f - i0;
+		return;
+	}
+
+	{
+		double a = d * r;
+		double b = (d + 1) * r;
+
+		*first = (uint32_t)a;
+		*last = (uint32_t)ceil(b) - 1;
+		if (*last >= sn)
+			*last = sn - 1;
+		for (i = *first; i <= *last; i++) {
+			double lo = i > a ? i : a;
+			double hi = i + 1 < b ? i + 1 : b;
+
+			w[i - *first] = hi > lo ? (hi - lo) / r : 0;
+		}
+	}
+}
+
+static int build_taps(struct scale_taps *t, uint32_t sn, uint32_t dn,
+		      int filter)
+{
+	double w[WEIGHT_ONE];
+	uint32_t d, first, last, start;
+	int taps = max_taps(sn, dn, filter);
+	int k, sum, big;
+
+	if (taps > WEIGHT_ONE)
+		return -EINVAL;
+
+	t->taps = taps;
+	t->idx = calloc(dn, sizeof(*t->idx));
+	t->w = calloc((size_t)dn * taps, sizeof(*t->w));
+	if (!t->idx || !t->w)
+		return -ENOMEM;
+
+	for (d = 0; d < dn; d++) {
+		uint16_t *q = t->w + d * taps;
+
+		calc_weights(sn, dn, d, filter, w, &first, &last);
+
+		/* keep every tap inside the source */
+		start = first;
+		if (start + taps > sn)
+			start = sn - taps;
+		t->idx[d] = start;
+
+		sum = 0;
+		big = first - start;
+		for (k = 0; k <= (int)(last - first); k++) {
+			int v = (int)(w[k] * WEIGHT_ONE + 0.5);
+
+			q[first - start + k] = v;
+			sum += v;
+			if (v > q[big])
+				big = first - start + k;
+		}
+		/* give the rounding error to the biggest weight */
+		q[big] += WEIGHT_ONE - sum;
+	}
+
+	return 0;
+}
+
+/* weights of the simd hpass, only worth it for short filters */
+static int pad_taps(struct scale_taps *t, uint32_t dn)
+{
+	uint32_t d;
+
+	if (t->taps > SIMD_TAPS)
+		return 0;
+
+	t->w8 = calloc((size_t)dn * SIMD_TAPS, sizeof(*t->w8));
+	if (!t->w8)
+		return -ENOMEM;
+
+	for (d = 0; d < dn; d++)
+		memcpy(t->w8 + d * SIMD_TAPS, t->w + d * t->taps,
+		       t->taps * sizeof(*t->w));
+
+	return 0;
+}
+
+static void free_plane(struct scale_plane *sp)
+{
+	free_taps(&sp->x);
+	free_taps(&sp->y);
+	free(sp->yneed);
+	free(sp->ring);
+}
+
+static int init_plane(struct scale_plane *sp, uint32_t sw, uint32_t sh,
+		      uint32_t dw, uint32_t dh, int channels, int filter)
+{
+	uint32_t d;
+	int k;
+
+	if (!sw || !sh || !dw || !dh || dw > sw || dh > sh)
+		return -EINVAL;
+
+	sp->sw = sw;
+	sp->sh = sh;
+	sp->dw = dw;
+	sp->dh = dh;
+	sp->channels = channels;
+
+	if (build_taps(&sp->x, sw, dw, filter) ||
+	    build_taps(&sp->y, sh, dh, filter))
+		return -ENOMEM;
+
+#if defined(HAVE_SIMD_HPASS)
+	if (sw >= SIMD_TAPS && pad_taps(&sp->x, dw))
+		return -ENOMEM;
+#endif
+
+	sp->yneed = calloc(sh, 1);
+	sp->ring = calloc((size_t)sp->y.taps * dw * channels,
+			  sizeof(*sp->ring));
+	if (!sp->yneed || !sp->ring)
+		return -ENOMEM;
+
+	for (d = 0; d < dh; d++)
+		for (k = 0; k < sp->y.taps; k++)
+			if (sp->y.w[d * sp->y.taps + k])
+				sp->yneed[sp->y.idx[d] + k] = 1;
+
+	return 0;
+}
+
+/****************************************************************
+ * scaler
+ */
+void nx_v4l2_scaler_destroy(struct nx_v4l2_scaler *scaler)
+{
+	int i, p;
+
+	if (!scaler)
+		return;
+
+	if (scaler->outputs) {
+		for (i = 0; i < scaler->count; i++)
+			for (p = 0; p < MAX_SCALE_PLANES; p++)
+				free_plane(&scaler->outputs[i].planes[p]);
+		free(scaler->outputs);
+	}
+	free(scaler);
+}
+
+struct nx_v4l2_scaler *nx_v4l2_scaler_create(
+				const struct nx_v4l2_format_info *src,
+				const struct nx_v4l2_format_info *dsts,
+				int count, int filter)
+{
+	struct nx_v4l2_scaler *scaler;
+	struct scale_output *out;
+	uint32_t format = scale_base_format(src->format);
+	uint32_t scw = (src->width + 1) / 2;
+	uint32_t sch = (src->height + 1) / 2;
+	uint32_t dcw, dch;
+	int ret = 0;
+	int i;
+
+	if (!format || count <= 0 ||
+	    (filter != NX_V4L2_SCALE_AREA &&
+	     filter != NX_V4L2_SCALE_BILINEAR)) {
+		fprintf(stderr, "%s: invalid argument\n", __func__);
+		return NULL;
+	}
+
+	scaler = calloc(1, sizeof(*scaler));
+	if (!scaler)
+		return NULL;
+
+	scaler->format = format;
+	scaler->plane_num = format == V4L2_PIX_FMT_NV12 ? 2 : 3;
+	scaler->count = count;
+	scaler->outputs = calloc(count, sizeof(*scaler->outputs));
+	if (!scaler->outputs)
+		goto fail;
+
+	for (i = 0; i < count; i++) {
+		if (scale_base_format(dsts[i].format) != format) {
+			fprintf(stderr, "%s: output %d format mismatch\n",
+				__func__, i);
+			goto fail;
+		}
+
+		out = &scaler->outputs[i];
+		dcw = (dsts[i].width + 1) / 2;
+		dch = (dsts[i].height + 1) / 2;
+		ret = init_plane(&out->planes[0], src->width, src->height,
+				 dsts[i].width, dsts[i].height, 1, filter);
+		if (!ret && format == V4L2_PIX_FMT_NV12)
+			ret = init_plane(&out->planes[1], scw, sch, dcw, dch, 2,
+					 filter);
+		else if (!ret)
+			ret = init_plane(&out->planes[1], scw, sch, dcw, dch, 1,
+					 filter) ||
+			      init_plane(&out->planes[2], scw, sch, dcw, dch, 1,
+					 filter);
+		if (ret) {
+			fprintf(stderr, "%s: can't scale %ux%u to %ux%u\n",
+				__func__, src->width, src->height,
+				dsts[i].width, dsts[i].height);
+			goto fail;
+		}
+	}
+
+	return scaler;
+
+fail:
+	nx_v4l2_scaler_destroy(scaler);
+	return NULL;
+}
+
+static void emit_rows(struct scale_plane *sp, uint32_t y, uint8_t *dst,
+		      uint32_t stride)
+{
+	const uint16_t *rows[WEIGHT_ONE];
+	const int taps = sp->y.taps;
+	const size_t len = (size_t)sp->dw * sp->channels;
+	uint32_t d;
+	int k;
+
+	while (sp->next_dst < sp->dh) {
+		d = sp->next_dst;
+		if (sp->y.idx[d] + taps - 1 > (int32_t)y)
+			break;
+
+		for (k = 0; k < taps; k++)
+			rows[k] = sp->ring + ((sp->y.idx[d] + k) % taps) * len;
+		vpass(rows, sp->y.w + d * taps, taps, dst + d * stride, len);
+		sp->next_dst++;
+	}
+}
+
+int nx_v4l2_scaler_run(struct nx_v4l2_scaler *scaler,
+		       const struct nx_v4l2_image *src,
+		       struct nx_v4l2_image *dsts)
+{
+	struct scale_plane *sp;
+	const uint8_t *row;
+	uint32_t y;
+	int i, p;
+
+	if (scale_base_format(src->format) != scaler->format)
+		return -EINVAL;
+
+	for (i = 0; i < scaler->count; i++) {
+		sp = &scaler->outputs[i].planes[0];
+		if (scale_base_format(dsts[i].format) != scaler->format ||
+		    dsts[i].width != sp->dw || dsts[i].height != sp->dh ||
+		    src->width != sp->sw || src->height != sp->sh)
+			return -EINVAL;
+	}
+
+	for (p = 0; p < scaler->plane_num; p++) {
+		for (i = 0; i < scaler->count; i++)
+			scaler->outputs[i].planes[p].next_dst = 0;
+
+		sp = &scaler->outputs[0].planes[p];
+		for (y = 0; y < sp->sh; y++) {
+			row = src->data[p] + (size_t)y * src->strides[p];
+			for (i = 0; i < scaler->count; i++) {
+				sp = &scaler->outputs[i].planes[p];
+				if (sp->yneed[y])
+					hpass(row, sp->ring + (y % sp->y.taps) *
+					      (size_t)sp->dw * sp->channels, sp);
+				emit_rows(sp, y, dsts[i].data[p],
+					  dsts[i].strides[p]);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/****************************************************************
+ * pyramid
+ */
+static void pyramid_row(const struct nx_v4l2_image *src,
+			struct nx_v4l2_image *levels, int count, int level,
+			int p, uint32_t y, uint32_t h)
+{
+	const struct nx_v4l2_image *s = level ? &levels[level - 1] : src;
+	struct nx_v4l2_image *d = &levels[level];
+	int ch = (s->plane_num == 2 && p == 1) ? 2 : 1;
+	uint32_t sw = p ? (s->width + 1) / 2 : s->width;
+	uint32_t dw = p ? (d->width + 1) / 2 : d->width;
+	uint32_t dh = p ? (d->height + 1) / 2 : d->height;
+	const uint8_t *s0 = s->data[p] + (size_t)2 * y * s->strides[p];
+	const uint8_t *s1 = 2 * y + 1 < h ? s0 + s->strides[p] : s0;
+
+	box2(s0, s1, d->data[p] + (size_t)y * d->strides[p], sw, dw, ch);
+
+	/* a row pair of this level is complete, go one level down */
+	if (level + 1 < count && ((y & 1) || y + 1 == dh))
+		pyramid_row(src, levels, count, level + 1, p, y / 2, dh);
+}
+
+int nx_v4l2_scale_pyramid(const struct nx_v4l2_image *src,
+			  struct nx_v4l2_image *levels, int count)
+{
+	const struct nx_v4l2_image *prev = src;
+	uint32_t format = scale_base_format(src->format);
+	uint32_t h, dh, y;
+	int i, p;
+
+	if (!format || count <= 0)
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		if (scale_base_format(levels[i].format) != format ||
+		    levels[i].width != (prev->width + 1) / 2 ||
+		    levels[i].height != (prev->height + 1) / 2 ||
+		    !levels[i].width || !levels[i].height)
+			return -EINVAL;
+		prev = &levels[i];
+	}
+
+	for (p = 0; p < src->plane_num; p++) {
+		h = p ? (src->height + 1) / 2 : src->height;
+		dh = p ? (levels[0].height + 1) / 2 : levels[0].height;
+		for (y = 0; y < dh; y++)
+			pyramid_row(src, levels, count, 0, p, y, h);
+	}
+
+	return 0;
+}
+
+/****************************************************************
+ * virtual decimator
+ */
+struct vdec_buf {
+	bool ready;
+	bool queued;
+	uint8_t *data;
+	struct nx_v4l2_frame frame;
+};
+
+struct vdec_source {
+	struct nx_v4l2_stream *source;
+	struct nx_v4l2_format_info src_fmt;
+	struct nx_v4l2_scaler *scaler;
+	size_t size;
+	bool streaming;
+	int event_fd;
+	uint32_t dropped;
+	pthread_mutex_t lock;
+	/* ready buffer indexes in completion order */
+	int fifo[VIDEO_MAX_FRAME];
+	int fifo_head;
+	int fifo_count;
+	struct vdec_buf bufs[VIDEO_MAX_FRAME];
+};
+
+/* scale frame into a free buffer, called with lock held */
+static int vdec_scale(struct nx_v4l2_stream *stream,
+		      const struct nx_v4l2_frame *frame)
+{
+	struct vdec_source *src = stream->priv;
+	struct nx_v4l2_image simg, dimg;
+	struct vdec_buf *buf = NULL;
+	int ret;
+	int i;
+
+	for (i = 0; i < stream->buf_count; i++) {
+		if (src->bufs[i].queued) {
+			buf = &src->bufs[i];
+			break;
+		}
+	}
+	if (!buf) {
+		src->dropped++;
+		return -ENOBUFS;
+	}
+
+	ret = nx_v4l2_image_from_frame(&simg, &src->src_fmt, frame);
+	if (ret)
+		return ret;
+
+	nx_v4l2_image_setup(&dimg, stream->fmt.format, stream->fmt.width,
+			    stream->fmt.height, buf->data);
+	ret = nx_v4l2_scaler_run(src->scaler, &simg, &dimg);
+	if (ret)
+		return ret;
+
+	buf->queued = false;
+	buf->ready = true;
+	buf->frame.sequence = frame->sequence;
+	buf->frame.timestamp = frame->timestamp;
+	buf->frame.bytesused[0] = src->size;
+	src->fifo[(src->fifo_head + src->fifo_count) % VIDEO_MAX_FRAME] = i;
+	src->fifo_count++;
+
+	return 0;
+}
+
+static int vdec_start(struct nx_v4l2_stream *stream)
+{
+	struct vdec_source *src = stream->priv;
+	int ret = 0;
+	int i;
+
+	pthread_mutex_lock(&src->lock);
+	for (i = 0; i < stream->buf_count; i++) {
+		src->bufs[i].queued = true;
+		src->bufs[i].ready = false;
+	}
+	src->fifo_count = 0;
+	src->streaming = true;
+	pthread_mutex_unlock(&src->lock);
+
+	if (src->source)
+		ret = nx_v4l2_stream_start(src->source);
+
+	return ret;
+}
+
+static int vdec_stop(struct nx_v4l2_stream *stream)
+{
+	struct vdec_source *src = stream->priv;
+	uint64_t v;
+	int ret = 0;
+
+	if (src->source)
+		ret = nx_v4l2_stream_stop(src->source);
+
+	pthread_mutex_lock(&src->lock);
+	src->streaming = false;
+	src->fifo_count = 0;
+	if (read(src->event_fd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+		fprintf(stderr, "%s: failed to clear event\n", __func__);
+	pthread_mutex_unlock(&src->lock);
+
+	return ret;
+}
+
+static int vdec_dqbuf(struct nx_v4l2_stream *stream,
+		      struct nx_v4l2_frame *frame)
+{
+	struct vdec_source *src = stream->priv;
+	struct nx_v4l2_frame sframe;
+	struct vdec_buf *buf;
+	uint64_t v;
+	int ret;
+
+	if (src->source) {
+		ret = nx_v4l2_stream_dqbuf(src->source, &sframe);
+		if (ret)
+			return ret;
+
+		pthread_mutex_lock(&src->lock);
+		ret = src->streaming ? vdec_scale(stream, &sframe) : -EINVAL;
+		pthread_mutex_unlock(&src->lock);
+
+		nx_v4l2_stream_qbuf(src->source, &sframe);
+		if (ret)
+			return ret;
+	}
+
+	pthread_mutex_lock(&src->lock);
+	if (!src->streaming) {
+		pthread_mutex_unlock(&src->lock);
+		return -EINVAL;
+	}
+
+	if (!src->fifo_count) {
+		pthread_mutex_unlock(&src->lock);
+		return -EAGAIN;
+	}
+
+	buf = &src->bufs[src->fifo[src->fifo_head]];
+	src->fifo_head = (src->fifo_head + 1) % VIDEO_MAX_FRAME;
+	src->fifo_count--;
+	buf->ready = false;
+	*frame = buf->frame;
+
+	if (!src->source && !src->fifo_count &&
+	    read(src->event_fd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+		fprintf(stderr, "%s: failed to clear event\n", __func__);
+	pthread_mutex_unlock(&src->lock);
+
+	return 0;
+}
+
+static int vdec_qbuf(struct nx_v4l2_stream *stream,
+		     struct nx_v4l2_frame *frame)
+{
+	struct vdec_source *src = stream->priv;
+	struct vdec_buf *buf;
+	int ret = 0;
+
+	if (frame->index < 0 || frame->index >= stream->buf_count)
+		return -EINVAL;
+
+	pthread_mutex_lock(&src->lock);
+	buf = &src->bufs[frame->index];
+	if (buf->queued || buf->ready)
+		ret = -EBUSY;
+	else
+		buf->queued = true;
+	pthread_mutex_unlock(&src->lock);
+
+	return ret;
+}
+
+static int vdec_get_fd(struct nx_v4l2_stream *stream)
+{
+	struct vdec_source *src = stream->priv;
+
+	if (src->source)
+		return nx_v4l2_stream_get_fd(src->source);
+
+	return src->event_fd;
+}
+
+static void vdec_release(struct nx_v4l2_stream *stream)
+{
+	struct vdec_source *src = stream->priv;
+	int i;
+
+	for (i = 0; i < stream->buf_count; i++)
+		free(src->bufs[i].data);
+	nx_v4l2_scaler_destroy(src->scaler);
+	if (src->event_fd >= 0)
+		close(src->event_fd);
+	pthread_mutex_destroy(&src->lock);
+}
+
+static const struct nx_v4l2_stream_ops vdec_ops = {
+	.start = vdec_start,
+	.stop = vdec_stop,
+	.dqbuf = vdec_dqbuf,
+	.qbuf = vdec_qbuf,
+	.get_fd = vdec_get_fd,
+	.release = vdec_release,
+};
+
+struct nx_v4l2_stream *nx_v4l2_vdecimator_create(
+				struct nx_v4l2_stream *source,
+				const struct nx_v4l2_format_info *src_fmt,
+				uint32_t width, uint32_t height,
+				int count, int filter)
+{
+	struct nx_v4l2_stream *stream;
+	struct vdec_source *src;
+	struct nx_v4l2_image img;
+	int i;
+
+	if (source && !src_fmt)
+		src_fmt = &source->fmt;
+
+	if (!src_fmt || count <= 0 || count > VIDEO_MAX_FRAME)
+		return NULL;
+
+	stream = nx_v4l2_stream_alloc(&vdec_ops, sizeof(*src));
+	if (!stream)
+		return NULL;
+
+	src = stream->priv;
+	pthread_mutex_init(&src->lock, NULL);
+	src->source = source;
+	src->src_fmt = *src_fmt;
+	src->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	stream->type = nx_decimator_video;
+	stream->buf_count = count;
+	stream->fmt.format = scale_base_format(src_fmt->format);
+	stream->fmt.width = width;
+	stream->fmt.height = height;
+	stream->fmt.plane_num = 1;
+	src->size = nx_v4l2_image_setup(&img, stream->fmt.format, width,
+					height, NULL);
+	stream->fmt.strides[0] = img.strides[0];
+	stream->fmt.sizes[0] = src->size;
+
+	src->scaler = nx_v4l2_scaler_create(src_fmt, &stream->fmt, 1, filter);
+	if (!src->scaler || src->event_fd < 0)
+		goto fail;
+
+	for (i = 0; i < count; i++) {
+		struct vdec_buf *buf = &src->bufs[i];
+
+		if (posix_memalign((void **)&buf->data, 64, src->size))
+			goto fail;
+
+		buf->frame.index = i;
+		buf->frame.memory = V4L2_MEMORY_USERPTR;
+		buf->frame.plane_num = 1;
+		buf->frame.fds[0] = -1;
+		buf->frame.virt[0] = buf->data;
+		buf->frame.sizes[0] = src->size;
+	}
+
+	return stream;
+
+fail:
+	nx_v4l2_stream_destroy(stream);
+	return NULL;
+}
+
+int nx_v4l2_vdecimator_push(struct nx_v4l2_stream *stream,
+			    const struct nx_v4l2_frame *frame)
+{
+	struct vdec_source *src = stream->priv;
+	uint64_t v = 1;
+	int ret;
+
+	if (stream->ops != &vdec_ops || src->source)
+		return -EINVAL;
+
+	pthread_mutex_lock(&src->lock);
+	ret = src->streaming ? vdec_scale(stream, frame) : -EINVAL;
+	pthread_mutex_unlock(&src->lock);
+
+	if (!ret && write(src->event_fd, &v, sizeof(v)) < 0)
+		fprintf(stderr, "%s: failed to signal event\n", __func__);
+
+	return ret;
+}
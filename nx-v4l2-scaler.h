@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_SCALER_H
+#define _NX_V4L2_SCALER_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-convert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Software downscaler for NV12(M) and YUV420(M).
+ *
+ * A scaler produces several outputs from one pass over the source, each
+ * source row is filtered for every output while it is still in cache.
+ * The pyramid variant halves the source repeatedly with a 2x2 box filter,
+ * level n + 1 is built from level n rows as soon as they are written.
+ */
+enum {
+	NX_V4L2_SCALE_AREA = 0,
+	NX_V4L2_SCALE_BILINEAR,
+};
+
+struct nx_v4l2_scaler;
+
+struct nx_v4l2_scaler *nx_v4l2_scaler_create(
+				const struct nx_v4l2_format_info *src,
+				const struct nx_v4l2_format_info *dsts,
+				int count, int filter);
+void nx_v4l2_scaler_destroy(struct nx_v4l2_scaler *scaler);
+int nx_v4l2_scaler_run(struct nx_v4l2_scaler *scaler,
+		       const struct nx_v4l2_image *src,
+		       struct nx_v4l2_image *dsts);
+
+/* levels[n] must be ((w + 1) / 2) x ((h + 1) / 2) of the previous one */
+int nx_v4l2_scale_pyramid(const struct nx_v4l2_image *src,
+			  struct nx_v4l2_image *levels, int count);
+
+/*
+ * Virtual decimator, a stream of scaled clipper frames.
+ *
+ * With a source stream it dequeues the source itself, scales the frame
+ * and queues it back before returning the scaled one. Without source the
+ * owner of the clipper frames feeds them with nx_v4l2_vdecimator_push(),
+ * frames are dropped when every scaled buffer is held by the consumer.
+ */
+struct nx_v4l2_stream *nx_v4l2_vdecimator_create(
+				struct nx_v4l2_stream *source,
+				const struct nx_v4l2_format_info *src_fmt,
+				uint32_t width, uint32_t height,
+				int count, int filter);
+int nx_v4l2_vdecimator_push(struct nx_v4l2_stream *stream,
+			    const struct nx_v4l2_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
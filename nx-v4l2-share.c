@@ -0,0 +1,1066 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-fanout.h"
+#include "nx-v4l2-layout.h"
+#include "nx-v4l2-share.h"
+
+#define SHARE_RING_SIZE		VIDEO_MAX_FRAME
+
+enum {
+	share_msg_hello,	/* client: arg is stream id */
+	share_msg_info,		/* server: ring and event fds */
+	share_msg_buffer,	/* server: arg is index, plane fds */
+	share_msg_release,	/* client: arg is index */
+	share_msg_error,	/* server: arg is -errno */
+};
+
+struct share_msg {
+	uint32_t type;
+	int32_t arg;
+	int32_t depth;
+	int32_t buf_count;
+	struct nx_v4l2_format_info fmt;
+	uint32_t sizes[NX_V4L2_MAX_PLANES];
+};
+
+struct share_entry {
+	int32_t index;
+	uint32_t sequence;
+	uint64_t timestamp_us;
+	uint32_t bytesused[NX_V4L2_MAX_PLANES];
+};
+
+/* shared with the client, head is written by server, tail by client */
+struct share_ring {
+	uint32_t head;
+	uint32_t tail;
+	struct share_entry entries[SHARE_RING_SIZE];
+};
+
+static int send_msg(int sock, const struct share_msg *msg, const int *fds,
+		    int fd_num)
+{
+	char cbuf[CMSG_SPACE(sizeof(int) * NX_V4L2_MAX_PLANES)];
+	struct iovec iov = { (void *)msg, sizeof(*msg) };
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+
+	bzero(&mh, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	if (fd_num) {
+		bzero(cbuf, sizeof(cbuf));
+		mh.msg_control = cbuf;
+		mh.msg_controllen = CMSG_SPACE(sizeof(int) * fd_num);
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fd_num);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fd_num);
+	}
+
+	if (sendmsg(sock, &mh, MSG_NOSIGNAL) != sizeof(*msg))
+		return -errno;
+
+	return 0;
+}
+
+/* returns the number of received fds, 0 if the peer is closed */
+static int recv_msg(int sock, struct share_msg *msg, int *fds, int *fd_num)
+{
+	char cbuf[CMSG_SPACE(sizeof(int) * NX_V4L2_MAX_PLANES)];
+	struct iovec iov = { msg, sizeof(*msg) };
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	ssize_t len;
+
+	bzero(&mh, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = sizeof(cbuf);
+
+	len = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+	if (len < 0)
+		return -errno;
+	if (len == 0)
+		return -ECONNRESET;
+
+	*fd_num = 0;
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		*fd_num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * *fd_num);
+	}
+
+	if (len != sizeof(*msg)) {
+		while (*fd_num)
+			close(fds[--*fd_num]);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static uint64_t timeval_to_us(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/****************************************************************
+ * server
+ */
+enum {
+	share_kind_listen,
+	share_kind_stream,
+	share_kind_client,
+};
+
+struct share_stream {
+	int kind;
+	int id;
+	struct nx_v4l2_stream *stream;
+	struct nx_v4l2_fanout *fanout;
+	int exported[VIDEO_MAX_FRAME];	/* mmap buffers */
+};
+
+struct share_client {
+	int kind;
+	int sock;
+	struct nx_v4l2_share_server *server;
+	struct share_stream *ss;
+	struct nx_v4l2_fanout_consumer *consumer;
+	int event_fd;
+	struct share_ring *ring;
+	bool sent[VIDEO_MAX_FRAME];
+	struct nx_v4l2_fanout_ref *held[VIDEO_MAX_FRAME];
+	struct share_client *next;
+};
+
+struct nx_v4l2_share_server {
+	int kind;
+	int listen_fd;
+	int epoll_fd;
+	struct sockaddr_un addr;
+	int stream_num;
+	struct share_stream streams[NX_V4L2_SHARE_MAX_STREAMS];
+	struct share_client *clients;
+};
+
+static int epoll_add(int epoll_fd, int fd, void *ptr)
+{
+	struct epoll_event ev;
+
+	bzero(&ev, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = ptr;
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void client_free(struct share_client *c)
+{
+	struct nx_v4l2_share_server *server = c->server;
+	struct share_client **p;
+	int i;
+
+	for (p = &server->clients; *p; p = &(*p)->next) {
+		if (*p == c) {
+			*p = c->next;
+			break;
+		}
+	}
+
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, c->sock, NULL);
+	for (i = 0; i < VIDEO_MAX_FRAME; i++)
+		if (c->held[i])
+			nx_v4l2_fanout_put(c->held[i]);
+	if (c->consumer)
+		nx_v4l2_fanout_detach(c->consumer);
+	if (c->ring)
+		munmap(c->ring, sizeof(*c->ring));
+	if (c->event_fd >= 0)
+		close(c->event_fd);
+	close(c->sock);
+	free(c);
+}
+
+static int client_buffer_fds(struct share_client *c,
+			     const struct nx_v4l2_frame *frame, int *fds)
+{
+	struct share_stream *ss = c->ss;
+	int stream_fd;
+	int i;
+
+	if (frame->memory != V4L2_MEMORY_MMAP) {
+		for (i = 0; i < frame->plane_num; i++) {
+			if (frame->fds[i] < 0)
+				return -EINVAL;
+			fds[i] = frame->fds[i];
+		}
+		return frame->plane_num;
+	}
+
+	if (ss->exported[frame->index] < 0) {
+		stream_fd = nx_v4l2_stream_get_fd(ss->stream);
+		if (nx_v4l2_expbuf_mmap(stream_fd, ss->stream->type,
+					frame->index,
+					&ss->exported[frame->index])) {
+			ss->exported[frame->index] = -1;
+			fprintf(stderr, "%s: failed to export buffer %d\n",
+				__func__, frame->index);
+			return -errno;
+		}
+	}
+	fds[0] = ss->exported[frame->index];
+
+	return 1;
+}
+
+static int client_deliver(struct share_client *c,
+			  struct nx_v4l2_fanout_ref *ref)
+{
+	const struct nx_v4l2_frame *frame = nx_v4l2_fanout_frame(ref);
+	struct share_entry *e;
+	struct share_msg msg;
+	int fds[NX_V4L2_MAX_PLANES];
+	uint64_t v = 1;
+	uint32_t head;
+	int ret;
+	int i;
+
+	if (!c->sent[frame->index]) {
+		ret = client_buffer_fds(c, frame, fds);
+		if (ret < 0)
+			return ret;
+
+		bzero(&msg, sizeof(msg));
+		msg.type = share_msg_buffer;
+		msg.arg = frame->index;
+		msg.fmt = c->ss->stream->fmt;
+		for (i = 0; i < frame->plane_num; i++)
+			msg.sizes[i] = frame->sizes[i];
+		ret = send_msg(c->sock, &msg, fds, ret);
+		if (ret)
+			return ret;
+		c->sent[frame->index] = true;
+	}
+
+	head = c->ring->head;
+	e = &c->ring->entries[head % SHARE_RING_SIZE];
+	e->index = frame->index;
+	e->sequence = frame->sequence;
+	e->timestamp_us = timeval_to_us(&frame->timestamp);
+	for (i = 0; i < NX_V4L2_MAX_PLANES; i++)
+		e->bytesused[i] = i < frame->plane_num ? frame->bytesused[i] : 0;
+	__atomic_store_n(&c->ring->head, head + 1, __ATOMIC_RELEASE);
+
+	if (write(c->event_fd, &v, sizeof(v)) < 0)
+		return -errno;
+
+	/* on failure the caller puts ref, the client must not hold it too */
+	c->held[frame->index] = ref;
+
+	return 0;
+}
+
+/* returns true if a client is dropped */
+static bool stream_dispatch(struct nx_v4l2_share_server *server,
+			    struct share_stream *ss)
+{
+	struct share_client *c, *next;
+	struct nx_v4l2_fanout_ref *ref;
+	bool dropped = false;
+	int ret;
+
+	ret = nx_v4l2_fanout_dispatch(ss->fanout);
+	if (ret <= 0)
+		return false;
+
+	for (c = server->clients; c; c = next) {
+		next = c->next;
+		if (c->ss != ss)
+			continue;
+		while (!nx_v4l2_fanout_acquire(c->consumer, &ref)) {
+			ret = client_deliver(c, ref);
+			if (ret) {
+				nx_v4l2_fanout_put(ref);
+				fprintf(stderr, "%s: client %d dropped(%d)\n",
+					__func__, c->sock, ret);
+				client_free(c);
+				dropped = true;
+				break;
+			}
+		}
+	}
+
+	return dropped;
+}
+
+static int client_hello(struct share_client *c, const struct share_msg *hello)
+{
+	struct nx_v4l2_share_server *server = c->server;
+	struct share_stream *ss = NULL;
+	struct share_msg msg;
+	int fds[2];
+	int ring_fd;
+	int depth;
+	int ret;
+	int i;
+
+	for (i = 0; i < server->stream_num; i++)
+		if (server->streams[i].id == hello->arg)
+			ss = &server->streams[i];
+	if (!ss) {
+		ret = -ENOENT;
+		goto err;
+	}
+
+	depth = hello->depth;
+	if (depth > ss->stream->buf_count - 1)
+		depth = ss->stream->buf_count - 1;
+	if (depth < 1)
+		depth = 1;
+
+	ring_fd = memfd_create("nx-v4l2-share", MFD_CLOEXEC);
+	if (ring_fd < 0) {
+		ret = -errno;
+		goto err;
+	}
+	if (ftruncate(ring_fd, sizeof(*c->ring))) {
+		ret = -errno;
+		close(ring_fd);
+		goto err;
+	}
+	c->ring = mmap(NULL, sizeof(*c->ring), PROT_READ | PROT_WRITE,
+		       MAP_SHARED, ring_fd, 0);
+	if (c->ring == MAP_FAILED) {
+		ret = -errno;
+		c->ring = NULL;
+		close(ring_fd);
+		goto err;
+	}
+
+	c->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	c->consumer = nx_v4l2_fanout_attach(ss->fanout, depth, false);
+	if (c->event_fd < 0 || !c->consumer) {
+		ret = -ENOMEM;
+		close(ring_fd);
+		goto err;
+	}
+	c->ss = ss;
+
+	bzero(&msg, sizeof(msg));
+	msg.type = share_msg_info;
+	msg.arg = ss->id;
+	msg.depth = depth;
+	msg.buf_count = ss->stream->buf_count;
+	msg.fmt = ss->stream->fmt;
+	fds[0] = ring_fd;
+	fds[1] = c->event_fd;
+	ret = send_msg(c->sock, &msg, fds, 2);
+	close(ring_fd);
+
+	return ret;
+
+err:
+	bzero(&msg, sizeof(msg));
+	msg.type = share_msg_error;
+	msg.arg = ret;
+	send_msg(c->sock, &msg, NULL, 0);
+	return ret;
+}
+
+static int client_receive(struct share_client *c)
+{
+	struct share_msg msg;
+	int fds[NX_V4L2_MAX_PLANES];
+	int fd_num;
+	int ret;
+
+	ret = recv_msg(c->sock, &msg, fds, &fd_num);
+	if (ret)
+		return ret == -EAGAIN ? 0 : ret;
+
+	while (fd_num)
+		close(fds[--fd_num]);
+
+	switch (msg.type) {
+	case share_msg_hello:
+		if (c->ss)
+			return -EPROTO;
+		return client_hello(c, &msg);
+	case share_msg_release:
+		if (!c->ss || msg.arg < 0 || msg.arg >= VIDEO_MAX_FRAME ||
+		    !c->held[msg.arg])
+			return -EPROTO;
+		ret = nx_v4l2_fanout_put(c->held[msg.arg]);
+		c->held[msg.arg] = NULL;
+		return ret;
+	default:
+		return -EPROTO;
+	}
+}
+
+static void server_accept(struct nx_v4l2_share_server *server)
+{
+	struct share_client *c;
+	int sock;
+
+	sock = accept4(server->listen_fd, NULL, NULL,
+		       SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (sock < 0)
+		return;
+
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		close(sock);
+		return;
+	}
+
+	c->kind = share_kind_client;
+	c->sock = sock;
+	c->server = server;
+	c->event_fd = -1;
+	if (epoll_add(server->epoll_fd, sock, c)) {
+		close(sock);
+		free(c);
+		return;
+	}
+
+	c->next = server->clients;
+	server->clients = c;
+}
+
+struct nx_v4l2_share_server *nx_v4l2_share_server_create(const char *path)
+{
+	struct nx_v4l2_share_server *server;
+
+	server = calloc(1, sizeof(*server));
+	if (!server)
+		return NULL;
+
+	server->kind = share_kind_listen;
+	server->addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(server->addr.sun_path)) {
+		free(server);
+		return NULL;
+	}
+	strcpy(server->addr.sun_path, path);
+
+	server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	server->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (server->epoll_fd < 0 || server->listen_fd < 0)
+		goto fail;
+
+	unlink(path);
+	if (bind(server->listen_fd, (struct sockaddr *)&server->addr,
+		 sizeof(server->addr)) ||
+	    listen(server->listen_fd, 8)) {
+		fprintf(stderr, "%s: failed to listen on %s\n", __func__, path);
+		goto fail;
+	}
+
+	if (epoll_add(server->epoll_fd, server->listen_fd, server))
+		goto fail;
+
+	return server;
+
+fail:
+	if (server->listen_fd >= 0)
+		close(server->listen_fd);
+	if (server->epoll_fd >= 0)
+		close(server->epoll_fd);
+	free(server);
+	return NULL;
+}
+
+void nx_v4l2_share_server_destroy(struct nx_v4l2_share_server *server)
+{
+	struct share_stream *ss;
+	int i, j;
+
+	if (!server)
+		return;
+
+	while (server->clients)
+		client_free(server->clients);
+
+	for (i = 0; i < server->stream_num; i++) {
+		ss = &server->streams[i];
+		nx_v4l2_fanout_destroy(ss->fanout);
+		for (j = 0; j < VIDEO_MAX_FRAME; j++)
+			if (ss->exported[j] >= 0)
+				close(ss->exported[j]);
+	}
+
+	close(server->listen_fd);
+	close(server->epoll_fd);
+	unlink(server->addr.sun_path);
+	free(server);
+}
+
+int nx_v4l2_share_server_add_stream(struct nx_v4l2_share_server *server,
+				    int id, struct nx_v4l2_stream *stream)
+{
+	struct share_stream *ss;
+	int fd;
+	int i;
+
+	if (server->stream_num >= NX_V4L2_SHARE_MAX_STREAMS)
+		return -ENOSPC;
+
+	fd = nx_v4l2_stream_get_fd(stream);
+	if (fd < 0)
+		return -EINVAL;
+
+	for (i = 0; i < server->stream_num; i++)
+		if (server->streams[i].id == id)
+			return -EEXIST;
+
+	ss = &server->streams[server->stream_num];
+	bzero(ss, sizeof(*ss));
+	ss->kind = share_kind_stream;
+	ss->id = id;
+	ss->stream = stream;
+	for (i = 0; i < VIDEO_MAX_FRAME; i++)
+		ss->exported[i] = -1;
+
+	ss->fanout = nx_v4l2_fanout_create(stream);
+	if (!ss->fanout)
+		return -ENOMEM;
+
+	if (epoll_add(server->epoll_fd, fd, ss)) {
+		nx_v4l2_fanout_destroy(ss->fanout);
+		return -errno;
+	}
+
+	server->stream_num++;
+	return 0;
+}
+
+int nx_v4l2_share_server_get_fd(struct nx_v4l2_share_server *server)
+{
+	return server->epoll_fd;
+}
+
+int nx_v4l2_share_server_process(struct nx_v4l2_share_server *server,
+				 int timeout_ms)
+{
+	struct epoll_event events[16];
+	struct share_client *c;
+	int kind;
+	int n;
+	int i;
+
+	n = epoll_wait(server->epoll_fd, events, 16, timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	/*
+	 * Later events may point to a freed client, they are reported again
+	 * by the next call.
+	 */
+	for (i = 0; i < n; i++) {
+		kind = *(int *)events[i].data.ptr;
+		switch (kind) {
+		case share_kind_listen:
+			server_accept(server);
+			break;
+		case share_kind_stream:
+			if (stream_dispatch(server, events[i].data.ptr))
+				return n;
+			break;
+		case share_kind_client:
+			c = events[i].data.ptr;
+			if (client_receive(c)) {
+				client_free(c);
+				return n;
+			}
+			break;
+		}
+	}
+
+	return n;
+}
+
+/****************************************************************
+ * client
+ */
+struct share_client_buf {
+	bool valid;
+	int fds[NX_V4L2_MAX_PLANES];
+	void *virt[NX_V4L2_MAX_PLANES];
+	uint32_t sizes[NX_V4L2_MAX_PLANES];
+};
+
+struct nx_v4l2_share_client {
+	int sock;
+	int event_fd;
+	int depth;
+	int buf_count;
+	struct share_ring *ring;
+	struct nx_v4l2_format_info fmt;
+	struct share_client_buf bufs[VIDEO_MAX_FRAME];
+};
+
+struct nx_v4l2_share_client *nx_v4l2_share_client_connect(const char *path,
+							  int id, int depth)
+{
+	struct nx_v4l2_share_client *client;
+	struct sockaddr_un addr;
+	struct share_msg msg;
+	int fds[NX_V4L2_MAX_PLANES];
+	int fd_num = 0;
+	int i;
+
+	bzero(&addr, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return NULL;
+	strcpy(addr.sun_path, path);
+
+	client = calloc(1, sizeof(*client));
+	if (!client)
+		return NULL;
+	client->event_fd = -1;
+	for (i = 0; i < VIDEO_MAX_FRAME; i++)
+		memset(client->bufs[i].fds, -1, sizeof(client->bufs[i].fds));
+
+	client->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (client->sock < 0)
+		goto fail;
+
+	if (connect(client->sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		fprintf(stderr, "%s: failed to connect to %s\n", __func__,
+			path);
+		goto fail;
+	}
+
+	bzero(&msg, sizeof(msg));
+	msg.type = share_msg_hello;
+	msg.arg = id;
+	msg.depth = depth;
+	if (send_msg(client->sock, &msg, NULL, 0) ||
+	    recv_msg(client->sock, &msg, fds, &fd_num))
+		goto fail;
+
+	if (msg.type != share_msg_info || fd_num != 2) {
+		fprintf(stderr, "%s: stream %d is refused(%d)\n", __func__, id,
+			msg.type == share_msg_error ? msg.arg : -EPROTO);
+		while (fd_num)
+			close(fds[--fd_num]);
+		goto fail;
+	}
+
+	client->ring = mmap(NULL, sizeof(*client->ring),
+			    PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+	close(fds[0]);
+	client->event_fd = fds[1];
+	if (client->ring == MAP_FAILED) {
+		client->ring = NULL;
+		goto fail;
+	}
+
+	client->depth = msg.depth;
+	client->buf_count = msg.buf_count;
+	client->fmt = msg.fmt;
+
+	return client;
+
+fail:
+	nx_v4l2_share_client_close(client);
+	return NULL;
+}
+
+void nx_v4l2_share_client_close(struct nx_v4l2_share_client *client)
+{
+	struct share_client_buf *buf;
+	int i, j;
+
+	if (!client)
+		return;
+
+	for (i = 0; i < VIDEO_MAX_FRAME; i++) {
+		buf = &client->bufs[i];
+		for (j = 0; j < NX_V4L2_MAX_PLANES; j++) {
+			if (buf->virt[j])
+				munmap(buf->virt[j], buf->sizes[j]);
+			if (buf->fds[j] >= 0)
+				close(buf->fds[j]);
+		}
+	}
+
+	if (client->ring)
+		munmap(client->ring, sizeof(*client->ring));
+	if (client->event_fd >= 0)
+		close(client->event_fd);
+	if (client->sock >= 0)
+		close(client->sock);
+	free(client);
+}
+
+int nx_v4l2_share_client_get_fd(struct nx_v4l2_share_client *client)
+{
+	return client->event_fd;
+}
+
+const struct nx_v4l2_format_info *nx_v4l2_share_client_get_format(
+				struct nx_v4l2_share_client *client)
+{
+	return &client->fmt;
+}
+
+/* buffer messages are sent before the ring entry, so they are waiting */
+static int client_receive_buffer(struct nx_v4l2_share_client *client)
+{
+	struct share_client_buf *buf;
+	struct share_msg msg;
+	int fds[NX_V4L2_MAX_PLANES];
+	int fd_num;
+	void *virt;
+	int ret;
+	int i;
+
+	ret = recv_msg(client->sock, &msg, fds, &fd_num);
+	if (ret)
+		return ret;
+
+	if (msg.type != share_msg_buffer || msg.arg < 0 ||
+	    msg.arg >= VIDEO_MAX_FRAME || client->bufs[msg.arg].valid) {
+		while (fd_num)
+			close(fds[--fd_num]);
+		return -EPROTO;
+	}
+
+	buf = &client->bufs[msg.arg];
+	for (i = 0; i < fd_num; i++) {
+		buf->fds[i] = fds[i];
+		buf->sizes[i] = msg.sizes[i];
+		/* cpu access is optional, not every exporter allows mmap */
+		virt = mmap(NULL, msg.sizes[i], PROT_READ, MAP_SHARED, fds[i],
+			    0);
+		buf->virt[i] = virt == MAP_FAILED ? NULL : virt;
+	}
+	buf->valid = true;
+
+	return 0;
+}
+
+int nx_v4l2_share_client_acquire(struct nx_v4l2_share_client *client,
+				 struct nx_v4l2_frame *frame)
+{
+	struct share_client_buf *buf;
+	struct share_entry *e;
+	uint32_t tail = client->ring->tail;
+	uint64_t v;
+	int ret;
+	int i;
+
+	if (tail == __atomic_load_n(&client->ring->head, __ATOMIC_ACQUIRE)) {
+		/* clear before checking again, a later entry signals again */
+		if (read(client->event_fd, &v, sizeof(v)) < 0 &&
+		    errno != EAGAIN)
+			return -errno;
+		if (tail == __atomic_load_n(&client->ring->head,
+					    __ATOMIC_ACQUIRE))
+			return -EAGAIN;
+	}
+
+	e = &client->ring->entries[tail % SHARE_RING_SIZE];
+	if (e->index < 0 || e->index >= VIDEO_MAX_FRAME)
+		return -EPROTO;
+
+	buf = &client->bufs[e->index];
+	while (!buf->valid) {
+		ret = client_receive_buffer(client);
+		if (ret)
+			return ret;
+	}
+
+	bzero(frame, sizeof(*frame));
+	frame->index = e->index;
+	frame->memory = V4L2_MEMORY_DMABUF;
+	frame->plane_num = client->fmt.plane_num;
+	for (i = 0; i < frame->plane_num; i++) {
+		frame->fds[i] = buf->fds[i];
+		frame->virt[i] = buf->virt[i];
+		frame->sizes[i] = buf->sizes[i];
+		frame->bytesused[i] = e->bytesused[i];
+	}
+	frame->sequence = e->sequence;
+	frame->timestamp.tv_sec = e->timestamp_us / 1000000;
+	frame->timestamp.tv_usec = e->timestamp_us % 1000000;
+
+	__atomic_store_n(&client->ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int nx_v4l2_share_client_release(struct nx_v4l2_share_client *client,
+				 const struct nx_v4l2_frame *frame)
+{
+	struct share_msg msg;
+
+	bzero(&msg, sizeof(msg));
+	msg.type = share_msg_release;
+	msg.arg = frame->index;
+
+	return send_msg(client->sock, &msg, NULL, 0);
+}
+
+/****************************************************************
+ * simulated source with memfd buffers
+ */
+struct sim_source {
+	int timer_fd;
+	uint32_t interval_ns;
+	bool streaming;
+	uint32_t sequence;
+	struct nx_v4l2_layout layout;
+	int fifo[VIDEO_MAX_FRAME];
+	int fifo_head;
+	int fifo_count;
+	int fds[VIDEO_MAX_FRAME][NX_V4L2_MAX_PLANES];
+	void *virt[VIDEO_MAX_FRAME][NX_V4L2_MAX_PLANES];
+};
+
+static int sim_arm(struct sim_source *src, bool on)
+{
+	struct itimerspec its;
+
+	bzero(&its, sizeof(its));
+	if (on) {
+		its.it_interval.tv_sec = src->interval_ns / 1000000000;
+		its.it_interval.tv_nsec = src->interval_ns % 1000000000;
+		its.it_value = its.it_interval;
+	}
+
+	return timerfd_settime(src->timer_fd, 0, &its, NULL);
+}
+
+static int sim_start(struct nx_v4l2_stream *stream)
+{
+	struct sim_source *src = stream->priv;
+	int i;
+
+	src->fifo_head = 0;
+	src->fifo_count = stream->buf_count;
+	for (i = 0; i < stream->buf_count; i++)
+		src->fifo[i] = i;
+	src->streaming = true;
+
+	return sim_arm(src, true);
+}
+
+static int sim_stop(struct nx_v4l2_stream *stream)
+{
+	struct sim_source *src = stream->priv;
+
+	src->streaming = false;
+	src->fifo_count = 0;
+
+	return sim_arm(src, false);
+}
+
+static int sim_dqbuf(struct nx_v4l2_stream *stream,
+		     struct nx_v4l2_frame *frame)
+{
+	struct sim_source *src = stream->priv;
+	const struct nx_v4l2_plane_layout *p;
+	struct timespec now;
+	uint64_t expirations;
+	int index;
+	int i;
+
+	if (!src->streaming)
+		return -EINVAL;
+
+	if (read(src->timer_fd, &expirations, sizeof(expirations)) < 0)
+		return -errno;
+
+	/* a sensor keeps counting while there is no buffer */
+	src->sequence += expirations;
+	if (!src->fifo_count)
+		return -EAGAIN;
+
+	index = src->fifo[src->fifo_head];
+	src->fifo_head = (src->fifo_head + 1) % VIDEO_MAX_FRAME;
+	src->fifo_count--;
+
+	for (i = 0; i < src->layout.plane_num; i++) {
+		p = &src->layout.planes[i];
+		memset((uint8_t *)src->virt[index][p->buffer] + p->offset,
+		       i ? 128 : (src->sequence - 1) & 0xff, p->size);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	frame->index = index;
+	frame->memory = V4L2_MEMORY_DMABUF;
+	frame->plane_num = stream->fmt.plane_num;
+	for (i = 0; i < frame->plane_num; i++) {
+		frame->fds[i] = src->fds[index][i];
+		frame->virt[i] = src->virt[index][i];
+		frame->sizes[i] = stream->fmt.sizes[i];
+		frame->bytesused[i] = stream->fmt.sizes[i];
+	}
+	frame->sequence = src->sequence - 1;
+	frame->timestamp.tv_sec = now.tv_sec;
+	frame->timestamp.tv_usec = now.tv_nsec / 1000;
+
+	return 0;
+}
+
+static int sim_qbuf(struct nx_v4l2_stream *stream,
+		    struct nx_v4l2_frame *frame)
+{
+	struct sim_source *src = stream->priv;
+
+	if (frame->index < 0 || frame->index >= stream->buf_count)
+		return -EINVAL;
+
+	if (!src->streaming)
+		return 0;
+
+	src->fifo[(src->fifo_head + src->fifo_count) % VIDEO_MAX_FRAME] =
+		frame->index;
+	src->fifo_count++;
+
+	return 0;
+}
+
+static int sim_get_fd(struct nx_v4l2_stream *stream)
+{
+	struct sim_source *src = stream->priv;
+
+	return src->timer_fd;
+}
+
+static void sim_release(struct nx_v4l2_stream *stream)
+{
+	struct sim_source *src = stream->priv;
+	int i, j;
+
+	for (i = 0; i < stream->buf_count; i++) {
+		for (j = 0; j < stream->fmt.plane_num; j++) {
+			if (src->virt[i][j])
+				munmap(src->virt[i][j], stream->fmt.sizes[j]);
+			if (src->fds[i][j] >= 0)
+				close(src->fds[i][j]);
+		}
+	}
+
+	if (src->timer_fd >= 0)
+		close(src->timer_fd);
+}
+
+static const struct nx_v4l2_stream_ops sim_ops = {
+	.start = sim_start,
+	.stop = sim_stop,
+	.dqbuf = sim_dqbuf,
+	.qbuf = sim_qbuf,
+	.get_fd = sim_get_fd,
+	.release = sim_release,
+};
+
+struct nx_v4l2_stream *nx_v4l2_share_sim_create(uint32_t format,
+						uint32_t width,
+						uint32_t height, int count,
+						uint32_t fps)
+{
+	struct nx_v4l2_stream *stream;
+	struct sim_source *src;
+	void *virt;
+	int fd;
+	int i, j;
+
+	if (count <= 0 || count > VIDEO_MAX_FRAME || !fps)
+		return NULL;
+
+	stream = nx_v4l2_stream_alloc(&sim_ops, sizeof(*src));
+	if (!stream)
+		return NULL;
+
+	src = stream->priv;
+	src->interval_ns = 1000000000 / fps;
+	memset(src->fds, -1, sizeof(src->fds));
+	stream->type = nx_clipper_video;
+
+	src->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				       TFD_NONBLOCK | TFD_CLOEXEC);
+	if (src->timer_fd < 0 ||
+	    nx_v4l2_layout_calc(format, width, height, NX_V4L2_STRIDE_ALIGN,
+				1, &src->layout)) {
+		stream->buf_count = 0;
+		goto fail;
+	}
+	nx_v4l2_layout_to_format_info(&src->layout, &stream->fmt);
+
+	stream->buf_count = count;
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < stream->fmt.plane_num; j++) {
+			fd = memfd_create("nx-v4l2-sim", MFD_CLOEXEC);
+			if (fd < 0)
+				goto fail;
+			src->fds[i][j] = fd;
+			if (ftruncate(fd, stream->fmt.sizes[j]))
+				goto fail;
+			virt = mmap(NULL, stream->fmt.sizes[j],
+				    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (virt == MAP_FAILED)
+				goto fail;
+			src->virt[i][j] = virt;
+		}
+	}
+
+	return stream;
+
+fail:
+	fprintf(stderr, "%s: failed to create %ux%u source\n", __func__,
+		width, height);
+	nx_v4l2_stream_destroy(stream);
+	return NULL;
+}
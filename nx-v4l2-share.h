@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_SHARE_H
+#define _NX_V4L2_SHARE_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frame sharing between processes.
+ *
+ * The server(see tools/nx-v4l2-shared) owns the streams and listens on a
+ * unix domain socket. A client subscribes to one stream with a queue depth
+ * and receives a shared memory ring and an eventfd. Buffer fds are passed
+ * with SCM_RIGHTS the first time a buffer is delivered, afterwards frames
+ * are referenced by index in the ring. A frame stays owned by the client
+ * until nx_v4l2_share_client_release() sends it back, the server queues
+ * it to the stream when every client has released it(see
+ * nx-v4l2-fanout.h). Frames exceeding the depth of a client are dropped
+ * for that client, the depth is limited to buf_count - 1 so that the
+ * capture always keeps a buffer.
+ *
+ * Dmabuf streams share their fds, mmap streams are exported with
+ * VIDIOC_EXPBUF. nx_v4l2_share_sim_create() is a stream with memfd
+ * buffers whose luma is filled with the low byte of the sequence, it
+ * allows testing without a capture device.
+ */
+
+#define NX_V4L2_SHARE_MAX_STREAMS	4
+
+struct nx_v4l2_share_server;
+struct nx_v4l2_share_client;
+
+struct nx_v4l2_share_server *nx_v4l2_share_server_create(const char *path);
+void nx_v4l2_share_server_destroy(struct nx_v4l2_share_server *server);
+int nx_v4l2_share_server_add_stream(struct nx_v4l2_share_server *server,
+				    int id, struct nx_v4l2_stream *stream);
+int nx_v4l2_share_server_get_fd(struct nx_v4l2_share_server *server);
+int nx_v4l2_share_server_process(struct nx_v4l2_share_server *server,
+				 int timeout_ms);
+
+struct nx_v4l2_share_client *nx_v4l2_share_client_connect(const char *path,
+							  int id, int depth);
+void nx_v4l2_share_client_close(struct nx_v4l2_share_client *client);
+int nx_v4l2_share_client_get_fd(struct nx_v4l2_share_client *client);
+const struct nx_v4l2_format_info *nx_v4l2_share_client_get_format(
+				struct nx_v4l2_share_client *client);
+int nx_v4l2_share_client_acquire(struct nx_v4l2_share_client *client,
+				 struct nx_v4l2_frame *frame);
+int nx_v4l2_share_client_release(struct nx_v4l2_share_client *client,
+				 const struct nx_v4l2_frame *frame);
+
+struct nx_v4l2_stream *nx_v4l2_share_sim_create(uint32_t format,
+						uint32_t width,
+						uint32_t height, int count,
+						uint32_t fps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
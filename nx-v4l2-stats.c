@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include <linux/videodev2.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+#include "nx-v4l2-stats.h"
+
+#define MAX_CELLS	(NX_V4L2_STATS_MAX_GRID * NX_V4L2_STATS_MAX_GRID)
+
+/* where luma and chroma samples are found */
+struct stats_layout {
+	const uint8_t *luma;
+	uint32_t luma_stride;
+	int ystep;
+	const uint8_t *chroma[2];
+	uint32_t chroma_stride[2];
+	int cstep;
+	int vsub;
+};
+
+struct stats_acc {
+	uint32_t y[MAX_CELLS];
+	uint32_t u[MAX_CELLS];
+	uint32_t v[MAX_CELLS];
+	uint32_t ycount[MAX_CELLS];
+	uint32_t ccount[MAX_CELLS];
+	uint32_t x0[NX_V4L2_STATS_MAX_GRID + 1];
+	uint64_t focus;
+	uint64_t focus_count;
+};
+
+/****************************************************************
+ * row kernels, step is 1, 2 or 4 bytes between samples
+ */
+static uint32_t sum_bytes_c(const uint8_t *p, uint32_t n, int step)
+{
+	uint32_t sum = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		sum += p[i * step];
+
+	return sum;
+}
+
+static uint32_t sad_bytes_c(const uint8_t *a, const uint8_t *b, uint32_t n,
+			    int step)
+{
+	uint32_t sum = 0;
+	uint32_t i;
+	int d;
+
+	for (i = 0; i < n; i++) {
+		d = a[i * step] - b[i * step];
+		sum += d < 0 ? -d : d;
+	}
+
+	return sum;
+}
+
+/* number of bytes which can be loaded in 16 byte blocks */
+static uint32_t block_bytes(uint32_t n, int step)
+{
+	return n ? ((n - 1) * step + 1) & ~15 : 0;
+}
+
+#if defined(HAVE_SSE2)
+static __m128i step_mask(int step)
+{
+	if (step == 4)
+		return _mm_set1_epi32(0xff);
+	if (step == 2)
+		return _mm_set1_epi16(0xff);
+	return _mm_set1_epi8(-1);
+}
+
+static uint32_t sum_bytes(const uint8_t *p, uint32_t n, int step)
+{
+	const __m128i mask = step_mask(step);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero, v;
+	uint32_t len = block_bytes(n, step);
+	uint32_t i;
+
+	for (i = 0; i < len; i += 16) {
+		v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(p + i)),
+				  mask);
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+	}
+	acc = _mm_add_epi64(acc, _mm_srli_si128(acc, 8));
+
+	return _mm_cvtsi128_si32(acc) +
+	       sum_bytes_c(p + len, n - len / step, step);
+}
+
+static uint32_t sad_bytes(const uint8_t *a, const uint8_t *b, uint32_t n,
+			  int step)
+{
+	const __m128i mask = step_mask(step);
+	__m128i acc = _mm_setzero_si128(), va, vb;
+	uint32_t len = block_bytes(n, step);
+	uint32_t i;
+
+	for (i = 0; i < len; i += 16) {
+		va = _mm_and_si128(_mm_loadu_si128((const __m128i *)(a + i)),
+				   mask);
+		vb = _mm_and_si128(_mm_loadu_si128((const __m128i *)(b + i)),
+				   mask);
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+	}
+	acc = _mm_add_epi64(acc, _mm_srli_si128(acc, 8));
+
+	return _mm_cvtsi128_si32(acc) +
+	       sad_bytes_c(a + len, b + len, n - len / step, step);
+}
+#elif defined(HAVE_NEON)
+static uint8x16_t step_mask(int step)
+{
+	if (step == 4)
+		return vreinterpretq_u8_u32(vdupq_n_u32(0xff));
+	if (step == 2)
+		return vreinterpretq_u8_u16(vdupq_n_u16(0xff));
+	return vdupq_n_u8(0xff);
+}
+
+static uint32_t add_lanes(uint32x4_t acc)
+{
+	uint64x2_t s = vpaddlq_u32(acc);
+
+	return vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1);
+}
+
+static uint32_t sum_bytes(const uint8_t *p, uint32_t n, int step)
+{
+	const uint8x16_t mask = step_mask(step);
+	uint32x4_t acc = vdupq_n_u32(0);
+	uint32_t len = block_bytes(n, step);
+	uint32_t i;
+
+	for (i = 0; i < len; i += 16)
+		acc = vpadalq_u16(acc,
+				  vpaddlq_u8(vandq_u8(vld1q_u8(p + i), mask)));
+
+	return add_lanes(acc) + sum_bytes_c(p + len, n - len / step, step);
+}
+
+static uint32_t sad_bytes(const uint8_t *a, const uint8_t *b, uint32_t n,
+			  int step)
+{
+	const uint8x16_t mask = step_mask(step);
+	uint32x4_t acc = vdupq_n_u32(0);
+	uint32_t len = block_bytes(n, step);
+	uint32_t i;
+
+	for (i = 0; i < len; i += 16)
+		acc = vpadalq_u16(acc, vpaddlq_u8(
+			vandq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)),
+				 mask)));
+
+	return add_lanes(acc) +
+	       sad_bytes_c(a + len, b + len, n - len / step, step);
+}
+#else
+#define sum_bytes	sum_bytes_c
+#define sad_bytes	sad_bytes_c
+#endif
+
+/****************************************************************
+ * statistics
+ */
+void nx_v4l2_stats_default_config(struct nx_v4l2_stats_config *cfg)
+{
+	cfg->grid_cols = 8;
+	cfg->grid_rows = 8;
+	cfg->step_x = 4;
+	cfg->step_y = 4;
+	cfg->under = 16;
+	cfg->over = 235;
+}
+
+static int get_layout(const struct nx_v4l2_image *img,
+		      struct stats_layout *l)
+{
+	bzero(l, sizeof(*l));
+	l->luma = img->data[0];
+	l->luma_stride = img->strides[0];
+
+	switch (img->format) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV12M:
+		l->ystep = 1;
+		l->chroma[0] = img->data[1];
+		l->chroma[1] = img->data[1] + 1;
+		l->chroma_stride[0] = l->chroma_stride[1] = img->strides[1];
+		l->cstep = 2;
+		l->vsub = 2;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YUV420M:
+		l->ystep = 1;
+		l->chroma[0] = img->data[1];
+		l->chroma[1] = img->data[2];
+		l->chroma_stride[0] = img->strides[1];
+		l->chroma_stride[1] = img->strides[2];
+		l->cstep = 1;
+		l->vsub = 2;
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		l->ystep = 2;
+		l->chroma[0] = img->data[0] + 1;
+		l->chroma[1] = img->data[0] + 3;
+		l->chroma_stride[0] = l->chroma_stride[1] = img->strides[0];
+		l->cstep = 4;
+		l->vsub = 1;
+		break;
+	case V4L2_PIX_FMT_UYVY:
+		l->luma = img->data[0] + 1;
+		l->ystep = 2;
+		l->chroma[0] = img->data[0];
+		l->chroma[1] = img->data[0] + 2;
+		l->chroma_stride[0] = l->chroma_stride[1] = img->strides[0];
+		l->cstep = 4;
+		l->vsub = 1;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void luma_row(const struct stats_layout *l,
+		     const struct nx_v4l2_stats_config *cfg,
+		     const struct nx_v4l2_image *img, uint32_t y,
+		     uint32_t cy, struct stats_acc *acc,
+		     struct nx_v4l2_stats *stats)
+{
+	const uint8_t *row = l->luma + (size_t)y * l->luma_stride;
+	const int ys = l->ystep;
+	uint32_t *hist = stats->hist;
+	uint32_t c, x0, x1, cell;
+	uint32_t x;
+
+	for (x = 0; x < img->width; x += cfg->step_x)
+		hist[row[x * ys]]++;
+
+	for (c = 0; c < cfg->grid_cols; c++) {
+		x0 = acc->x0[c];
+		x1 = acc->x0[c + 1];
+		cell = cy * cfg->grid_cols + c;
+		acc->y[cell] += sum_bytes(row + x0 * ys, x1 - x0, ys);
+		acc->ycount[cell] += x1 - x0;
+	}
+
+	if (img->width > 1) {
+		acc->focus += sad_bytes(row, row + ys, img->width - 1, ys);
+		acc->focus_count += img->width - 1;
+	}
+	if (y + 1 < img->height) {
+		acc->focus += sad_bytes(row, row + l->luma_stride,
+					img->width, ys);
+		acc->focus_count += img->width;
+	}
+}
+
+static void chroma_row(const struct stats_layout *l,
+		       const struct nx_v4l2_stats_config *cfg, uint32_t y,
+		       uint32_t cy, struct stats_acc *acc)
+{
+	const uint8_t *u = l->chroma[0] + (size_t)y * l->chroma_stride[0];
+	const uint8_t *v = l->chroma[1] + (size_t)y * l->chroma_stride[1];
+	uint32_t c, cx0, n, cell;
+
+	for (c = 0; c < cfg->grid_cols; c++) {
+		cx0 = acc->x0[c] / 2;
+		n = (acc->x0[c + 1] + 1) / 2 - cx0;
+		cell = cy * cfg->grid_cols + c;
+		acc->u[cell] += sum_bytes(u + cx0 * l->cstep, n, l->cstep);
+		acc->v[cell] += sum_bytes(v + cx0 * l->cstep, n, l->cstep);
+		acc->ccount[cell] += n;
+	}
+}
+
+int nx_v4l2_stats_compute(const struct nx_v4l2_image *img,
+			  const struct nx_v4l2_stats_config *cfg,
+			  struct nx_v4l2_stats *stats)
+{
+	struct nx_v4l2_stats_config def;
+	struct stats_layout l;
+	struct stats_acc acc;
+	uint64_t total = 0;
+	uint32_t y, cy, next_row, i;
+	int ret;
+
+	if (!cfg) {
+		nx_v4l2_stats_default_config(&def);
+		cfg = &def;
+	}
+
+	if (!cfg->grid_cols || !cfg->grid_rows ||
+	    cfg->grid_cols > NX_V4L2_STATS_MAX_GRID ||
+	    cfg->grid_rows > NX_V4L2_STATS_MAX_GRID ||
+	    !cfg->step_x || !cfg->step_y ||
+	    img->width < 2 * cfg->grid_cols || img->height < cfg->grid_rows)
+		return -EINVAL;
+
+	ret = get_layout(img, &l);
+	if (ret)
+		return ret;
+
+	bzero(stats, sizeof(*stats));
+	bzero(&acc, sizeof(acc));
+	stats->grid_cols = cfg->grid_cols;
+	stats->grid_rows = cfg->grid_rows;
+
+	/* cell columns start on even pixels to keep chroma pairs */
+	for (i = 0; i < cfg->grid_cols; i++)
+		acc.x0[i] = (i * img->width / cfg->grid_cols) & ~1;
+	acc.x0[cfg->grid_cols] = img->width;
+
+	cy = 0;
+	next_row = img->height / cfg->grid_rows;
+	for (y = 0; y < img->height; y += cfg->step_y) {
+		while (cy + 1 < cfg->grid_rows && y >= next_row) {
+			cy++;
+			next_row = (cy + 1) * img->height / cfg->grid_rows;
+		}
+
+		luma_row(&l, cfg, img, y, cy, &acc, stats);
+		if (l.vsub == 1)
+			chroma_row(&l, cfg, y, cy, &acc);
+		else if (!(y & 1) || cfg->step_y & 1)
+			chroma_row(&l, cfg, y / 2, cy, &acc);
+	}
+
+	for (i = 0; i < 256; i++) {
+		stats->samples += stats->hist[i];
+		total += (uint64_t)stats->hist[i] * i;
+		if (i <= cfg->under)
+			stats->under += stats->hist[i];
+		if (i >= cfg->over)
+			stats->over += stats->hist[i];
+	}
+	if (stats->samples)
+		stats->mean = total / stats->samples;
+	if (acc.focus_count)
+		stats->focus = (acc.focus << 8) / acc.focus_count;
+
+	for (i = 0; i < cfg->grid_cols * cfg->grid_rows; i++) {
+		if (acc.ycount[i])
+			stats->y[i] = acc.y[i] / acc.ycount[i];
+		if (acc.ccount[i]) {
+			stats->u[i] = acc.u[i] / acc.ccount[i];
+			stats->v[i] = acc.v[i] / acc.ccount[i];
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_STATS_H
+#define _NX_V4L2_STATS_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-frame image statistics for NV12(M), YUV420(M), YUYV and UYVY.
+ *
+ * Every step_y'th luma row is visited once, the grid means and the focus
+ * score use all pixels of a visited row with SIMD sums, the histogram and
+ * exposure counters use every step_x'th pixel of it. The focus score is the
+ * mean absolute horizontal and vertical luma difference in Q8, larger is
+ * sharper. Grid cell i is at row i / grid_cols, column i % grid_cols.
+ */
+
+#define NX_V4L2_STATS_MAX_GRID	16
+
+struct nx_v4l2_stats_config {
+	uint32_t grid_cols;
+	uint32_t grid_rows;
+	uint32_t step_x;
+	uint32_t step_y;
+	uint8_t under;		/* luma <= under is under exposed */
+	uint8_t over;		/* luma >= over is over exposed */
+};
+
+struct nx_v4l2_stats {
+	uint32_t hist[256];
+	uint32_t samples;
+	uint32_t under;
+	uint32_t over;
+	uint32_t mean;
+	uint32_t focus;
+	uint32_t grid_cols;
+	uint32_t grid_rows;
+	uint8_t y[NX_V4L2_STATS_MAX_GRID * NX_V4L2_STATS_MAX_GRID];
+	uint8_t u[NX_V4L2_STATS_MAX_GRID * NX_V4L2_STATS_MAX_GRID];
+	uint8_t v[NX_V4L2_STATS_MAX_GRID * NX_V4L2_STATS_MAX_GRID];
+};
+
+void nx_v4l2_stats_default_config(struct nx_v4l2_stats_config *cfg);
+int nx_v4l2_stats_compute(const struct nx_v4l2_image *img,
+			  const struct nx_v4l2_stats_config *cfg,
+			  struct nx_v4l2_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
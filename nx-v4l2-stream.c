@@ -0,0 +1,747 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-metrics.h"
+
+struct nx_v4l2_stream *nx_v4l2_stream_alloc(
+				const struct nx_v4l2_stream_ops *ops,
+				size_t priv_size)
+{
+	struct nx_v4l2_stream *stream;
+
+	stream = calloc(1, sizeof(*stream) + priv_size);
+	if (!stream)
+		return NULL;
+
+	stream->ops = ops;
+	if (priv_size)
+		stream->priv = stream + 1;
+
+	return stream;
+}
+
+void nx_v4l2_stream_destroy(struct nx_v4l2_stream *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->ops->release)
+		stream->ops->release(stream);
+	free(stream);
+}
+
+void nx_v4l2_stream_set_metrics(struct nx_v4l2_stream *stream,
+				struct nx_v4l2_stream_metrics *sm)
+{
+	stream->metrics = sm;
+}
+
+int nx_v4l2_stream_start(struct nx_v4l2_stream *stream)
+{
+	struct nx_v4l2_stream_metrics *sm = stream->metrics;
+	int64_t pinned = 0;
+	int ret, i;
+
+	ret = stream->ops->start(stream);
+	if (!sm)
+		return ret;
+
+	if (ret) {
+		nx_v4l2_metric_add(sm->errors, 1);
+		return ret;
+	}
+
+	for (i = 0; i < stream->fmt.plane_num; i++)
+		pinned += stream->fmt.sizes[i];
+	nx_v4l2_metric_set(sm->pinned_bytes, pinned * stream->buf_count);
+	nx_v4l2_metric_set(sm->queued, stream->buf_count);
+
+	return 0;
+}
+
+int nx_v4l2_stream_stop(struct nx_v4l2_stream *stream)
+{
+	int ret;
+
+	ret = stream->ops->stop(stream);
+	if (stream->metrics) {
+		if (ret)
+			nx_v4l2_metric_add(stream->metrics->errors, 1);
+		nx_v4l2_metric_set(stream->metrics->queued, 0);
+	}
+
+	return ret;
+}
+
+int nx_v4l2_stream_dqbuf(struct nx_v4l2_stream *stream,
+			 struct nx_v4l2_frame *frame)
+{
+	struct nx_v4l2_stream_metrics *sm = stream->metrics;
+	int ret;
+
+	ret = stream->ops->dqbuf(stream, frame);
+	if (!sm)
+		return ret;
+
+	if (ret) {
+		if (ret != -EAGAIN)
+			nx_v4l2_metric_add(sm->errors, 1);
+		return ret;
+	}
+
+	nx_v4l2_metric_add(sm->queued, -1);
+	nx_v4l2_stream_metrics_frame(sm, frame);
+
+	return 0;
+}
+
+int nx_v4l2_stream_qbuf(struct nx_v4l2_stream *stream,
+			struct nx_v4l2_frame *frame)
+{
+	int ret;
+
+	ret = stream->ops->qbuf(stream, frame);
+	if (stream->metrics)
+		nx_v4l2_metric_add(ret ? stream->metrics->errors :
+				   stream->metrics->queued, 1);
+
+	return ret;
+}
+
+int nx_v4l2_stream_get_fd(struct nx_v4l2_stream *stream)
+{
+	if (!stream->ops->get_fd)
+		return -1;
+
+	return stream->ops->get_fd(stream);
+}
+
+/****************************************************************
+ * v4l2 video node source
+ */
+struct v4l2_source_buf {
+	bool queued;
+	bool suspended;		/* queued before nx_v4l2_stream_suspend() */
+	bool mapped;
+	int fds[NX_V4L2_MAX_PLANES];
+	void *virt[NX_V4L2_MAX_PLANES];
+	uint32_t sizes[NX_V4L2_MAX_PLANES];
+};
+
+struct v4l2_source {
+	int fd;
+	uint32_t memory;
+	bool streaming;
+	struct v4l2_source_buf bufs[VIDEO_MAX_FRAME];
+};
+
+static void v4l2_source_fill_frame(struct nx_v4l2_stream *stream, int index,
+				   struct nx_v4l2_frame *frame)
+{
+	struct v4l2_source *src = stream->priv;
+	struct v4l2_source_buf *buf = &src->bufs[index];
+	int i;
+
+	frame->index = index;
+	frame->memory = src->memory;
+	frame->plane_num = stream->fmt.plane_num;
+	for (i = 0; i < frame->plane_num; i++) {
+		frame->fds[i] = buf->fds[i];
+		frame->virt[i] = buf->virt[i];
+		frame->sizes[i] = buf->sizes[i];
+	}
+}
+
+static int v4l2_source_qbuf_index(struct nx_v4l2_stream *stream, int index)
+{
+	struct v4l2_source *src = stream->priv;
+	struct nx_v4l2_frame frame;
+	int ret;
+
+	if (src->memory == V4L2_MEMORY_DMABUF &&
+	    src->bufs[index].fds[0] < 0) {
+		fprintf(stderr, "%s: buffer %d is not set\n", __func__, index);
+		return -EINVAL;
+	}
+
+	bzero(&frame, sizeof(frame));
+	v4l2_source_fill_frame(stream, index, &frame);
+	ret = nx_v4l2_qbuf_frame(src->fd, stream->type, &frame);
+	if (ret)
+		return -errno;
+
+	src->bufs[index].queued = true;
+	return 0;
+}
+
+static int v4l2_source_start(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	int ret;
+	int i;
+
+	for (i = 0; i < stream->buf_count; i++) {
+		if (src->bufs[i].queued)
+			continue;
+		ret = v4l2_source_qbuf_index(stream, i);
+		if (ret)
+			return ret;
+	}
+
+	if (src->memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_streamon_mmap(src->fd, stream->type);
+	else
+		ret = nx_v4l2_streamon(src->fd, stream->type);
+	if (ret)
+		return ret;
+
+	src->streaming = true;
+	return 0;
+}
+
+static int v4l2_source_stop(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	int ret;
+	int i;
+
+	if (src->memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_streamoff_mmap(src->fd, stream->type);
+	else
+		ret = nx_v4l2_streamoff(src->fd, stream->type);
+
+	/* streamoff returns every buffer to userspace */
+	for (i = 0; i < stream->buf_count; i++)
+		src->bufs[i].queued = false;
+	src->streaming = false;
+
+	return ret;
+}
+
+static int v4l2_source_dqbuf(struct nx_v4l2_stream *stream,
+			     struct nx_v4l2_frame *frame)
+{
+	struct v4l2_source *src = stream->priv;
+	struct v4l2_source_buf *buf;
+	int ret;
+	int i;
+
+	if (src->memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_dqbuf_mmap_frame(src->fd, stream->type, frame);
+	else
+		ret = nx_v4l2_dqbuf_frame(src->fd, stream->type,
+					  stream->fmt.plane_num, frame);
+	if (ret)
+		return -errno;
+
+	if (frame->index < 0 || frame->index >= stream->buf_count)
+		return -EINVAL;
+
+	buf = &src->bufs[frame->index];
+	buf->queued = false;
+	for (i = 0; i < frame->plane_num; i++)
+		frame->virt[i] = buf->virt[i];
+
+	return 0;
+}
+
+static int v4l2_source_qbuf(struct nx_v4l2_stream *stream,
+			    struct nx_v4l2_frame *frame)
+{
+	struct v4l2_source *src = stream->priv;
+
+	if (frame->index < 0 || frame->index >= stream->buf_count)
+		return -EINVAL;
+
+	if (src->bufs[frame->index].queued)
+		return -EBUSY;
+
+	return v4l2_source_qbuf_index(stream, frame->index);
+}
+
+static int v4l2_source_get_fd(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+
+	return src->fd;
+}
+
+static void v4l2_source_unmap_buffers(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	struct v4l2_source_buf *buf;
+	int i;
+
+	for (i = 0; i < stream->buf_count; i++) {
+		buf = &src->bufs[i];
+		if (buf->mapped)
+			munmap(buf->virt[0], buf->sizes[0]);
+		buf->mapped = false;
+		buf->virt[0] = NULL;
+	}
+}
+
+static void v4l2_source_release(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+
+	if (src->streaming)
+		v4l2_source_stop(stream);
+
+	v4l2_source_unmap_buffers(stream);
+
+	if (src->memory == V4L2_MEMORY_MMAP)
+		nx_v4l2_reqbuf_mmap(src->fd, stream->type, 0);
+	else
+		nx_v4l2_reqbuf(src->fd, stream->type, 0);
+}
+
+static const struct nx_v4l2_stream_ops v4l2_source_ops = {
+	.start = v4l2_source_start,
+	.stop = v4l2_source_stop,
+	.dqbuf = v4l2_source_dqbuf,
+	.qbuf = v4l2_source_qbuf,
+	.get_fd = v4l2_source_get_fd,
+	.release = v4l2_source_release,
+};
+
+static int v4l2_source_get_format(int fd, uint32_t memory,
+				  struct nx_v4l2_format_info *fmt)
+{
+	struct v4l2_format v4l2_fmt;
+	int ret;
+	uint32_t i;
+
+	bzero(&v4l2_fmt, sizeof(v4l2_fmt));
+	if (memory == V4L2_MEMORY_MMAP) {
+		v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		ret = ioctl(fd, VIDIOC_G_FMT, &v4l2_fmt);
+		if (ret)
+			return ret;
+
+		fmt->format = v4l2_fmt.fmt.pix.pixelformat;
+		fmt->width = v4l2_fmt.fmt.pix.width;
+		fmt->height = v4l2_fmt.fmt.pix.height;
+		fmt->plane_num = 1;
+		fmt->strides[0] = v4l2_fmt.fmt.pix.bytesperline;
+		fmt->sizes[0] = v4l2_fmt.fmt.pix.sizeimage;
+		return 0;
+	}
+
+	v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	ret = ioctl(fd, VIDIOC_G_FMT, &v4l2_fmt);
+	if (ret)
+		return ret;
+
+	fmt->format = v4l2_fmt.fmt.pix_mp.pixelformat;
+	fmt->width = v4l2_fmt.fmt.pix_mp.width;
+	fmt->height = v4l2_fmt.fmt.pix_mp.height;
+	fmt->plane_num = v4l2_fmt.fmt.pix_mp.num_planes;
+	if (fmt->plane_num > NX_V4L2_MAX_PLANES)
+		return -EINVAL;
+	for (i = 0; i < v4l2_fmt.fmt.pix_mp.num_planes; i++) {
+		fmt->strides[i] = v4l2_fmt.fmt.pix_mp.plane_fmt[i].bytesperline;
+		fmt->sizes[i] = v4l2_fmt.fmt.pix_mp.plane_fmt[i].sizeimage;
+	}
+
+	return 0;
+}
+
+static int v4l2_source_map_buffers(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	struct v4l2_buffer v4l2_buf;
+	struct v4l2_source_buf *buf;
+	void *virt;
+	int ret;
+	int i;
+
+	for (i = 0; i < stream->buf_count; i++) {
+		buf = &src->bufs[i];
+		ret = nx_v4l2_query_buf_mmap(src->fd, stream->type, i,
+					     &v4l2_buf);
+		if (ret)
+			return ret;
+
+		virt = mmap(NULL, v4l2_buf.length, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, src->fd, v4l2_buf.m.offset);
+		if (virt == MAP_FAILED) {
+			fprintf(stderr, "%s: failed to mmap buffer %d\n",
+				__func__, i);
+			return -errno;
+		}
+
+		buf->mapped = true;
+		buf->virt[0] = virt;
+		buf->sizes[0] = v4l2_buf.length;
+	}
+
+	return 0;
+}
+
+struct nx_v4l2_stream *nx_v4l2_stream_create(int fd, int type,
+					     uint32_t memory, int count)
+{
+	struct nx_v4l2_stream *stream;
+	struct v4l2_source *src;
+	int ret;
+	int i, j;
+
+	if (type != nx_clipper_video && type != nx_decimator_video)
+		return NULL;
+
+	if (count <= 0 || count > VIDEO_MAX_FRAME)
+		return NULL;
+
+	if (memory != V4L2_MEMORY_DMABUF && memory != V4L2_MEMORY_MMAP)
+		return NULL;
+
+	stream = nx_v4l2_stream_alloc(&v4l2_source_ops, sizeof(*src));
+	if (!stream)
+		return NULL;
+
+	src = stream->priv;
+	src->fd = fd;
+	src->memory = memory;
+	stream->type = type;
+
+	ret = v4l2_source_get_format(fd, memory, &stream->fmt);
+	if (ret) {
+		fprintf(stderr, "%s: failed to get format\n", __func__);
+		free(stream);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < NX_V4L2_MAX_PLANES; j++) {
+			src->bufs[i].fds[j] = -1;
+			src->bufs[i].sizes[j] = stream->fmt.sizes[j];
+		}
+	}
+
+	if (memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_reqbuf_mmap(fd, type, count);
+	else
+		ret = nx_v4l2_reqbuf(fd, type, count);
+	if (ret) {
+		fprintf(stderr, "%s: failed to reqbuf %d\n", __func__, count);
+		free(stream);
+		return NULL;
+	}
+	stream->buf_count = count;
+
+	if (memory == V4L2_MEMORY_MMAP) {
+		ret = v4l2_source_map_buffers(stream);
+		if (ret) {
+			nx_v4l2_stream_destroy(stream);
+			return NULL;
+		}
+	}
+
+	return stream;
+}
+
+int nx_v4l2_stream_set_buffer(struct nx_v4l2_stream *stream, int index,
+			      const int *fds, void * const *virt)
+{
+	struct v4l2_source *src = stream->priv;
+	struct v4l2_source_buf *buf;
+	int i;
+
+	if (stream->ops != &v4l2_source_ops || src->memory != V4L2_MEMORY_DMABUF)
+		return -EINVAL;
+
+	if (index < 0 || index >= stream->buf_count)
+		return -EINVAL;
+
+	buf = &src->bufs[index];
+	if (buf->queued)
+		return -EBUSY;
+
+	for (i = 0; i < stream->fmt.plane_num; i++) {
+		buf->fds[i] = fds[i];
+		buf->virt[i] = virt ? virt[i] : NULL;
+	}
+
+	return 0;
+}
+
+int nx_v4l2_stream_requeue(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	int ret;
+	int i;
+
+	if (stream->ops != &v4l2_source_ops)
+		return -EINVAL;
+
+	for (i = 0; i < stream->buf_count; i++) {
+		if (src->bufs[i].queued)
+			continue;
+		ret = v4l2_source_qbuf_index(stream, i);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+bool nx_v4l2_stream_is_queued(struct nx_v4l2_stream *stream, int index)
+{
+	struct v4l2_source *src = stream->priv;
+
+	if (stream->ops != &v4l2_source_ops ||
+	    index < 0 || index >= stream->buf_count)
+		return false;
+
+	return src->bufs[index].queued;
+}
+
+bool nx_v4l2_stream_needs_buffers(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	int i;
+
+	if (stream->ops != &v4l2_source_ops || src->memory != V4L2_MEMORY_DMABUF)
+		return false;
+
+	for (i = 0; i < stream->buf_count; i++)
+		if (src->bufs[i].fds[0] < 0)
+			return true;
+
+	return false;
+}
+
+static int v4l2_source_set_format(struct nx_v4l2_stream *stream, uint32_t w,
+				  uint32_t h, uint32_t format)
+{
+	struct v4l2_source *src = stream->priv;
+
+	if (src->memory == V4L2_MEMORY_MMAP)
+		return nx_v4l2_set_format_mmap(src->fd, stream->type, w, h,
+					       format);
+	return nx_v4l2_set_format(src->fd, stream->type, w, h, format);
+}
+
+static bool v4l2_source_fits(struct nx_v4l2_stream *stream,
+			     const struct nx_v4l2_format_info *fmt)
+{
+	struct v4l2_source *src = stream->priv;
+	int i, j;
+
+	if (fmt->plane_num != stream->fmt.plane_num)
+		return false;
+
+	for (i = 0; i < stream->buf_count; i++)
+		for (j = 0; j < fmt->plane_num; j++)
+			if (fmt->sizes[j] > src->bufs[i].sizes[j])
+				return false;
+
+	return true;
+}
+
+/*
+ * Release the queue and request it again for the new format, the driver
+ * refuses S_FMT while buffers are allocated or the buffers are too small.
+ * Dmabuf descriptors are kept when the new planes fit into them, mmap
+ * buffers are always allocated again.
+ */
+static int v4l2_source_reformat_queue(struct nx_v4l2_stream *stream,
+				      uint32_t w, uint32_t h, uint32_t format,
+				      bool set_format, bool *reallocated)
+{
+	struct v4l2_source *src = stream->priv;
+	struct nx_v4l2_format_info fmt;
+	int count = stream->buf_count;
+	int ret;
+	int i, j;
+
+	v4l2_source_unmap_buffers(stream);
+	if (src->memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_reqbuf_mmap(src->fd, stream->type, 0);
+	else
+		ret = nx_v4l2_reqbuf(src->fd, stream->type, 0);
+	if (ret)
+		return ret;
+	stream->buf_count = 0;
+
+	if (set_format) {
+		ret = v4l2_source_set_format(stream, w, h, format);
+		if (ret) {
+			fprintf(stderr, "%s: failed to set format %ux%u\n",
+				__func__, w, h);
+			return ret;
+		}
+	}
+
+	ret = v4l2_source_get_format(src->fd, src->memory, &fmt);
+	if (ret)
+		return ret;
+
+	if (src->memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_reqbuf_mmap(src->fd, stream->type, count);
+	else
+		ret = nx_v4l2_reqbuf(src->fd, stream->type, count);
+	if (ret) {
+		fprintf(stderr, "%s: failed to reqbuf %d\n", __func__, count);
+		return ret;
+	}
+	stream->buf_count = count;
+
+	if (src->memory == V4L2_MEMORY_MMAP) {
+		stream->fmt = fmt;
+		*reallocated = true;
+		return v4l2_source_map_buffers(stream);
+	}
+
+	if (!v4l2_source_fits(stream, &fmt)) {
+		for (i = 0; i < count; i++) {
+			for (j = 0; j < NX_V4L2_MAX_PLANES; j++) {
+				src->bufs[i].fds[j] = -1;
+				src->bufs[i].virt[j] = NULL;
+				src->bufs[i].sizes[j] = fmt.sizes[j];
+			}
+		}
+		*reallocated = true;
+	}
+	stream->fmt = fmt;
+
+	return 0;
+}
+
+int nx_v4l2_stream_reformat(struct nx_v4l2_stream *stream, uint32_t w,
+			    uint32_t h, uint32_t format,
+			    const struct v4l2_rect *crop, bool *reallocated)
+{
+	struct v4l2_source *src = stream->priv;
+	struct nx_v4l2_format_info fmt;
+	int ret;
+
+	if (stream->ops != &v4l2_source_ops)
+		return -EINVAL;
+
+	if (src->streaming)
+		return -EBUSY;
+
+	*reallocated = false;
+
+	if (crop) {
+		if (src->memory == V4L2_MEMORY_MMAP)
+			ret = nx_v4l2_set_crop_mmap(src->fd, stream->type,
+						    crop->left, crop->top,
+						    crop->width, crop->height);
+		else
+			ret = nx_v4l2_set_crop(src->fd, stream->type,
+					       crop->left, crop->top,
+					       crop->width, crop->height);
+		if (ret) {
+			fprintf(stderr, "%s: failed to set crop\n", __func__);
+			return ret;
+		}
+	}
+
+	if (w == stream->fmt.width && h == stream->fmt.height &&
+	    format == stream->fmt.format)
+		return 0;
+
+	/* some drivers take a new format on an allocated queue */
+	ret = v4l2_source_set_format(stream, w, h, format);
+	if (ret) {
+		if (errno != EBUSY) {
+			fprintf(stderr, "%s: failed to set format %ux%u\n",
+				__func__, w, h);
+			return ret;
+		}
+		return v4l2_source_reformat_queue(stream, w, h, format, true,
+						  reallocated);
+	}
+
+	ret = v4l2_source_get_format(src->fd, src->memory, &fmt);
+	if (ret)
+		return ret;
+
+	if (v4l2_source_fits(stream, &fmt)) {
+		stream->fmt = fmt;
+		return 0;
+	}
+
+	return v4l2_source_reformat_queue(stream, w, h, format, false,
+					  reallocated);
+}
+
+int nx_v4l2_stream_suspend(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	int i;
+
+	if (stream->ops != &v4l2_source_ops)
+		return -EINVAL;
+
+	for (i = 0; i < stream->buf_count; i++)
+		src->bufs[i].suspended = src->bufs[i].queued;
+
+	return v4l2_source_stop(stream);
+}
+
+int nx_v4l2_stream_resume(struct nx_v4l2_stream *stream)
+{
+	struct v4l2_source *src = stream->priv;
+	int ret;
+	int i;
+
+	if (stream->ops != &v4l2_source_ops)
+		return -EINVAL;
+
+	for (i = 0; i < stream->buf_count; i++) {
+		if (!src->bufs[i].suspended)
+			continue;
+		src->bufs[i].suspended = false;
+		ret = v4l2_source_qbuf_index(stream, i);
+		if (ret)
+			return ret;
+	}
+
+	if (src->memory == V4L2_MEMORY_MMAP)
+		ret = nx_v4l2_streamon_mmap(src->fd, stream->type);
+	else
+		ret = nx_v4l2_streamon(src->fd, stream->type);
+	if (ret)
+		return ret;
+
+	src->streaming = true;
+	return 0;
+}
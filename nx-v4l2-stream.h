@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_STREAM_H
+#define _NX_V4L2_STREAM_H
+
+#include <stddef.h>
+
+#include "nx-v4l2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frame source with the dequeue/queue semantics of a v4l2 capture node.
+ *
+ * A stream created by nx_v4l2_stream_create() drives a real clipper or
+ * decimator video node, other sources(replay, software scaler, ...)
+ * implement the same ops so that consumers don't have to care where the
+ * frames come from.
+ */
+struct nx_v4l2_stream;
+struct nx_v4l2_stream_metrics;
+
+struct nx_v4l2_stream_ops {
+	int (*start)(struct nx_v4l2_stream *stream);
+	int (*stop)(struct nx_v4l2_stream *stream);
+	int (*dqbuf)(struct nx_v4l2_stream *stream,
+		     struct nx_v4l2_frame *frame);
+	int (*qbuf)(struct nx_v4l2_stream *stream,
+		    struct nx_v4l2_frame *frame);
+	/* pollable fd which becomes readable when a frame is ready */
+	int (*get_fd)(struct nx_v4l2_stream *stream);
+	void (*release)(struct nx_v4l2_stream *stream);
+};
+
+struct nx_v4l2_stream {
+	const struct nx_v4l2_stream_ops *ops;
+	int type;
+	int buf_count;
+	struct nx_v4l2_format_info fmt;
+	struct nx_v4l2_stream_metrics *metrics;
+	void *priv;
+};
+
+struct nx_v4l2_stream *nx_v4l2_stream_alloc(
+				const struct nx_v4l2_stream_ops *ops,
+				size_t priv_size);
+void nx_v4l2_stream_destroy(struct nx_v4l2_stream *stream);
+
+int nx_v4l2_stream_start(struct nx_v4l2_stream *stream);
+int nx_v4l2_stream_stop(struct nx_v4l2_stream *stream);
+int nx_v4l2_stream_dqbuf(struct nx_v4l2_stream *stream,
+			 struct nx_v4l2_frame *frame);
+int nx_v4l2_stream_qbuf(struct nx_v4l2_stream *stream,
+			struct nx_v4l2_frame *frame);
+int nx_v4l2_stream_get_fd(struct nx_v4l2_stream *stream);
+
+/*
+ * Publish frames, drops, fps, queue depth, dequeue latency, errors and
+ * pinned bytes of the stream to a metrics registry(nx-v4l2-metrics.h),
+ * updated from the start/stop/dqbuf/qbuf wrappers above. NULL detaches.
+ */
+void nx_v4l2_stream_set_metrics(struct nx_v4l2_stream *stream,
+				struct nx_v4l2_stream_metrics *sm);
+
+/* v4l2 video node source */
+struct nx_v4l2_stream *nx_v4l2_stream_create(int fd, int type,
+					     uint32_t memory, int count);
+int nx_v4l2_stream_set_buffer(struct nx_v4l2_stream *stream, int index,
+			      const int *fds, void * const *virt);
+int nx_v4l2_stream_requeue(struct nx_v4l2_stream *stream);
+/* true while the driver owns the buffer, false for other sources */
+bool nx_v4l2_stream_is_queued(struct nx_v4l2_stream *stream, int index);
+/* true when a dmabuf buffer has to be set before the queue can be filled */
+bool nx_v4l2_stream_needs_buffers(struct nx_v4l2_stream *stream);
+
+/*
+ * Stream off and on again without touching the buffers held by consumers,
+ * resume queues only the buffers which were queued when suspended.
+ */
+int nx_v4l2_stream_suspend(struct nx_v4l2_stream *stream);
+int nx_v4l2_stream_resume(struct nx_v4l2_stream *stream);
+
+/*
+ * Change format and crop of a stopped video node source without giving up
+ * its buffers when the new planes fit into them. reallocated is set when
+ * the queue had to be allocated again, mmap buffers are remapped then and
+ * dmabuf buffers must be set again with nx_v4l2_stream_set_buffer().
+ */
+int nx_v4l2_stream_reformat(struct nx_v4l2_stream *stream, uint32_t w,
+			    uint32_t h, uint32_t format,
+			    const struct v4l2_rect *crop, bool *reallocated);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
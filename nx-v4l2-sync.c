@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include <sys/epoll.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-sync.h"
+
+struct sync_queue {
+	int head;
+	int count;
+	struct nx_v4l2_frame frames[VIDEO_MAX_FRAME];
+};
+
+/* every buffer of every stream can be late at once */
+#define LATE_MAX	(NX_V4L2_SYNC_MAX_STREAMS * VIDEO_MAX_FRAME)
+
+struct late_queue {
+	int head;
+	int count;
+	int idx[LATE_MAX];		/* stream of the frame */
+	struct nx_v4l2_frame frames[LATE_MAX];
+};
+
+struct sync_offset {
+	int64_t sum;
+	uint32_t count;
+};
+
+struct nx_v4l2_sync {
+	int count;
+	struct nx_v4l2_sync_config cfg;
+	struct nx_v4l2_stream *streams[NX_V4L2_SYNC_MAX_STREAMS];
+	struct sync_queue pending[NX_V4L2_SYNC_MAX_STREAMS];
+	bool seen[NX_V4L2_SYNC_MAX_STREAMS];
+	uint32_t next_seq[NX_V4L2_SYNC_MAX_STREAMS];
+	/* late frames waiting to be emitted alone */
+	struct late_queue late;
+	uint64_t emitted_us;		/* newest frame of the last set */
+	int epoll_fd;
+	uint64_t skew_sum;
+	struct sync_offset offsets[NX_V4L2_SYNC_MAX_STREAMS];
+	struct nx_v4l2_sync_stats stats;
+};
+
+static uint64_t frame_us(const struct nx_v4l2_frame *frame)
+{
+	return (uint64_t)frame->timestamp.tv_sec * 1000000 +
+		frame->timestamp.tv_usec;
+}
+
+static struct nx_v4l2_frame *queue_head(struct sync_queue *q)
+{
+	return &q->frames[q->head];
+}
+
+static void queue_push(struct sync_queue *q, const struct nx_v4l2_frame *frame)
+{
+	q->frames[(q->head + q->count) % VIDEO_MAX_FRAME] = *frame;
+	q->count++;
+}
+
+static void queue_pop(struct sync_queue *q, struct nx_v4l2_frame *frame)
+{
+	*frame = q->frames[q->head];
+	q->head = (q->head + 1) % VIDEO_MAX_FRAME;
+	q->count--;
+}
+
+static void late_push(struct late_queue *q, int index,
+		      const struct nx_v4l2_frame *frame)
+{
+	int n = (q->head + q->count) % LATE_MAX;
+
+	q->idx[n] = index;
+	q->frames[n] = *frame;
+	q->count++;
+}
+
+/* returns the stream index of the frame */
+static int late_pop(struct late_queue *q, struct nx_v4l2_frame *frame)
+{
+	int index = q->idx[q->head];
+
+	*frame = q->frames[q->head];
+	q->head = (q->head + 1) % LATE_MAX;
+	q->count--;
+
+	return index;
+}
+
+void nx_v4l2_sync_default_config(struct nx_v4l2_sync_config *cfg)
+{
+	bzero(cfg, sizeof(*cfg));
+	cfg->tolerance_us = 5000;
+	cfg->max_pending = 2;
+}
+
+struct nx_v4l2_sync *nx_v4l2_sync_create(struct nx_v4l2_stream **streams,
+					 int count,
+					 const struct nx_v4l2_sync_config *cfg)
+{
+	struct nx_v4l2_sync *sync;
+	struct epoll_event ev;
+	int fd;
+	int i;
+
+	if (count < 2 || count > NX_V4L2_SYNC_MAX_STREAMS ||
+	    cfg->max_pending < 1 || cfg->max_pending > VIDEO_MAX_FRAME)
+		return NULL;
+
+	sync = calloc(1, sizeof(*sync));
+	if (!sync)
+		return NULL;
+
+	sync->count = count;
+	sync->cfg = *cfg;
+	sync->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (sync->epoll_fd < 0)
+		goto fail;
+
+	for (i = 0; i < count; i++) {
+		sync->streams[i] = streams[i];
+		sync->stats.streams[i].offset_min_us = INT32_MAX;
+		sync->stats.streams[i].offset_max_us = INT32_MIN;
+
+		fd = nx_v4l2_stream_get_fd(streams[i]);
+		if (fd < 0)
+			continue;
+		bzero(&ev, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(sync->epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+			goto fail;
+	}
+
+	return sync;
+
+fail:
+	nx_v4l2_sync_destroy(sync);
+	return NULL;
+}
+
+static void sync_drop(struct nx_v4l2_sync *sync, int index,
+		      struct nx_v4l2_frame *frame)
+{
+	if (nx_v4l2_stream_qbuf(sync->streams[index], frame))
+		fprintf(stderr, "%s: failed to queue buffer %d of stream %d\n",
+			__func__, frame->index, index);
+}
+
+void nx_v4l2_sync_destroy(struct nx_v4l2_sync *sync)
+{
+	struct nx_v4l2_frame frame;
+	int i;
+
+	if (!sync)
+		return;
+
+	for (i = 0; i < sync->count; i++) {
+		while (sync->pending[i].count) {
+			queue_pop(&sync->pending[i], &frame);
+			sync_drop(sync, i, &frame);
+		}
+	}
+	while (sync->late.count) {
+		i = late_pop(&sync->late, &frame);
+		sync_drop(sync, i, &frame);
+	}
+
+	if (sync->epoll_fd >= 0)
+		close(sync->epoll_fd);
+	free(sync);
+}
+
+int nx_v4l2_sync_get_fd(struct nx_v4l2_sync *sync)
+{
+	return sync->epoll_fd;
+}
+
+int nx_v4l2_sync_push(struct nx_v4l2_sync *sync, int index,
+		      const struct nx_v4l2_frame *frame)
+{
+	struct nx_v4l2_sync_stream_stats *s;
+	struct nx_v4l2_frame late;
+	int32_t gap;
+	int i;
+
+	if (index < 0 || index >= sync->count)
+		return -EINVAL;
+
+	if (sync->pending[index].count >= sync->cfg.max_pending)
+		return -ENOSPC;
+
+	s = &sync->stats.streams[index];
+	s->frames++;
+	gap = frame->sequence - sync->next_seq[index];
+	if (!sync->seen[index] || gap >= 0) {
+		if (sync->seen[index])
+			s->sequence_gaps += gap;
+		sync->seen[index] = true;
+		sync->next_seq[index] = frame->sequence + 1;
+	}
+
+	if (frame_us(frame) + sync->cfg.tolerance_us < sync->emitted_us) {
+		s->late++;
+		if (!sync->cfg.emit_late) {
+			late = *frame;
+			sync_drop(sync, index, &late);
+			return 0;
+		}
+		/* can't fill up with buffers from the streams, but stay safe */
+		if (sync->late.count == LATE_MAX) {
+			i = late_pop(&sync->late, &late);
+			sync_drop(sync, i, &late);
+		}
+		late_push(&sync->late, index, frame);
+		return 0;
+	}
+
+	queue_push(&sync->pending[index], frame);
+	return 0;
+}
+
+static void sync_unmatch(struct nx_v4l2_sync *sync, int index)
+{
+	struct nx_v4l2_frame frame;
+
+	queue_pop(&sync->pending[index], &frame);
+	sync->stats.streams[index].unmatched++;
+	sync_drop(sync, index, &frame);
+}
+
+static void sync_account(struct nx_v4l2_sync *sync,
+			 struct nx_v4l2_sync_set *set)
+{
+	struct nx_v4l2_sync_stream_stats *s;
+	struct sync_offset *o;
+	uint64_t min = UINT64_MAX, max = 0;
+	uint64_t ts;
+	int32_t off;
+	int i;
+
+	for (i = 0; i < set->count; i++) {
+		if (!set->valid[i])
+			continue;
+		ts = frame_us(&set->frames[i]);
+		if (ts < min)
+			min = ts;
+		if (ts > max)
+			max = ts;
+	}
+
+	set->timestamp_us = min;
+	set->skew_us = max - min;
+	if (max > sync->emitted_us)
+		sync->emitted_us = max;
+
+	sync->stats.sets++;
+	if (set->valid_num != set->count)
+		sync->stats.partial_sets++;
+	if (set->skew_us > sync->stats.skew_max_us)
+		sync->stats.skew_max_us = set->skew_us;
+	sync->skew_sum += set->skew_us;
+	sync->stats.skew_mean_us = sync->skew_sum / sync->stats.sets;
+
+	if (!set->valid[0])
+		return;
+
+	for (i = 1; i < set->count; i++) {
+		if (!set->valid[i])
+			continue;
+		s = &sync->stats.streams[i];
+		o = &sync->offsets[i];
+		off = (int64_t)frame_us(&set->frames[i]) -
+		      (int64_t)frame_us(&set->frames[0]);
+		if (off < s->offset_min_us)
+			s->offset_min_us = off;
+		if (off > s->offset_max_us)
+			s->offset_max_us = off;
+		o->sum += off;
+		o->count++;
+		s->offset_mean_us = o->sum / o->count;
+	}
+}
+
+/* emits the heads which aren't newer than ref by more than the tolerance */
+static void sync_emit(struct nx_v4l2_sync *sync, uint64_t ref,
+		      struct nx_v4l2_sync_set *set)
+{
+	struct sync_queue *q;
+	int i;
+
+	bzero(set, sizeof(*set));
+	set->count = sync->count;
+	for (i = 0; i < sync->count; i++) {
+		q = &sync->pending[i];
+		if (!q->count ||
+		    frame_us(queue_head(q)) > ref + sync->cfg.tolerance_us)
+			continue;
+		queue_pop(q, &set->frames[i]);
+		set->valid[i] = true;
+		set->valid_num++;
+	}
+
+	sync_account(sync, set);
+}
+
+static int sync_match(struct nx_v4l2_sync *sync, struct nx_v4l2_sync_set *set)
+{
+	struct sync_queue *q;
+	uint64_t newest, oldest, ts;
+	bool ready, full;
+	int old;
+	int i;
+
+	if (sync->late.count) {
+		bzero(set, sizeof(*set));
+		set->count = sync->count;
+		i = sync->late.idx[sync->late.head];
+		late_pop(&sync->late, &set->frames[i]);
+		set->valid[i] = true;
+		set->valid_num = 1;
+		set->timestamp_us = frame_us(&set->frames[i]);
+		sync->stats.sets++;
+		sync->stats.partial_sets++;
+		return 0;
+	}
+
+	for (;;) {
+		ready = true;
+		full = false;
+		newest = 0;
+		oldest = UINT64_MAX;
+		old = -1;
+		for (i = 0; i < sync->count; i++) {
+			q = &sync->pending[i];
+			if (!q->count) {
+				ready = false;
+				continue;
+			}
+			if (q->count >= sync->cfg.max_pending)
+				full = true;
+			ts = frame_us(queue_head(q));
+			if (ts > newest)
+				newest = ts;
+			if (ts < oldest) {
+				oldest = ts;
+				old = i;
+			}
+		}
+
+		if (!ready && !full)
+			return -EAGAIN;
+
+		if (ready && oldest + sync->cfg.tolerance_us >= newest) {
+			sync_emit(sync, newest, set);
+			return 0;
+		}
+
+		/*
+		 * The oldest head can't be matched anymore, either a newer
+		 * frame is there from every stream or a stream is full while
+		 * another one is missing frames.
+		 */
+		if (sync->cfg.emit_unmatched) {
+			sync_emit(sync, oldest, set);
+			for (i = 0; i < sync->count; i++)
+				if (set->valid[i])
+					sync->stats.streams[i].unmatched++;
+			return 0;
+		}
+		sync_unmatch(sync, old);
+	}
+}
+
+int nx_v4l2_sync_read(struct nx_v4l2_sync *sync, struct nx_v4l2_sync_set *set)
+{
+	struct epoll_event events[NX_V4L2_SYNC_MAX_STREAMS];
+	struct nx_v4l2_frame frame;
+	int index;
+	int ret;
+	int n;
+	int i;
+
+	ret = sync_match(sync, set);
+	if (ret != -EAGAIN)
+		return ret;
+
+	n = epoll_wait(sync->epoll_fd, events, NX_V4L2_SYNC_MAX_STREAMS, 0);
+	if (n < 0)
+		return -errno;
+
+	for (i = 0; i < n; i++) {
+		index = events[i].data.u32;
+		if (sync->pending[index].count >= sync->cfg.max_pending)
+			continue;
+
+		bzero(&frame, sizeof(frame));
+		ret = nx_v4l2_stream_dqbuf(sync->streams[index], &frame);
+		if (ret)
+			continue;
+		nx_v4l2_sync_push(sync, index, &frame);
+	}
+
+	return sync_match(sync, set);
+}
+
+int nx_v4l2_sync_release(struct nx_v4l2_sync *sync,
+			 struct nx_v4l2_sync_set *set)
+{
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < set->count; i++) {
+		if (!set->valid[i])
+			continue;
+		if (nx_v4l2_stream_qbuf(sync->streams[i], &set->frames[i]))
+			ret = -EIO;
+		set->valid[i] = false;
+	}
+	set->valid_num = 0;
+
+	return ret;
+}
+
+void nx_v4l2_sync_get_stats(struct nx_v4l2_sync *sync,
+			    struct nx_v4l2_sync_stats *stats)
+{
+	int i;
+
+	*stats = sync->stats;
+	for (i = 0; i < sync->count; i++) {
+		if (sync->offsets[i].count)
+			continue;
+		stats->streams[i].offset_min_us = 0;
+		stats->streams[i].offset_max_us = 0;
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_SYNC_H
+#define _NX_V4L2_SYNC_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Timestamp synchronizer for multi camera rigs.
+ *
+ * Frames dequeued from N streams are buffered per stream and matched by
+ * their timestamps, a set is emitted when the heads of all streams lie
+ * within tolerance_us. A head which is older than the newest head by more
+ * than the tolerance can't be matched anymore and is unmatched.
+ *
+ * Every stream buffers at most max_pending frames, when a stream is full
+ * while another one has no frame(stalled or dropping camera) the oldest
+ * frame of the full stream is unmatched. Unmatched frames are queued back
+ * to their streams, or emitted in partial sets if emit_unmatched is set.
+ * A frame arriving after a set newer than it has been emitted is late, it
+ * is queued back or emitted alone if emit_late is set.
+ *
+ * The sets given by nx_v4l2_sync_read() own their frames until
+ * nx_v4l2_sync_release(). Sequence gaps of every stream and the timestamp
+ * offset of every stream against stream 0 are collected in the stats.
+ */
+
+#define NX_V4L2_SYNC_MAX_STREAMS	4
+
+struct nx_v4l2_sync;
+
+struct nx_v4l2_sync_config {
+	uint32_t tolerance_us;
+	int max_pending;
+	bool emit_unmatched;
+	bool emit_late;
+};
+
+struct nx_v4l2_sync_set {
+	int count;			/* streams */
+	int valid_num;
+	bool valid[NX_V4L2_SYNC_MAX_STREAMS];
+	struct nx_v4l2_frame frames[NX_V4L2_SYNC_MAX_STREAMS];
+	uint64_t timestamp_us;		/* oldest frame */
+	uint32_t skew_us;		/* newest - oldest */
+};
+
+struct nx_v4l2_sync_stream_stats {
+	uint32_t frames;
+	uint32_t unmatched;
+	uint32_t late;
+	uint32_t sequence_gaps;		/* frames lost by the stream */
+	int32_t offset_min_us;		/* against stream 0 */
+	int32_t offset_max_us;
+	int32_t offset_mean_us;
+};
+
+struct nx_v4l2_sync_stats {
+	uint32_t sets;
+	uint32_t partial_sets;
+	uint32_t skew_max_us;
+	uint32_t skew_mean_us;
+	struct nx_v4l2_sync_stream_stats streams[NX_V4L2_SYNC_MAX_STREAMS];
+};
+
+void nx_v4l2_sync_default_config(struct nx_v4l2_sync_config *cfg);
+struct nx_v4l2_sync *nx_v4l2_sync_create(struct nx_v4l2_stream **streams,
+					 int count,
+					 const struct nx_v4l2_sync_config *cfg);
+void nx_v4l2_sync_destroy(struct nx_v4l2_sync *sync);
+int nx_v4l2_sync_get_fd(struct nx_v4l2_sync *sync);
+int nx_v4l2_sync_push(struct nx_v4l2_sync *sync, int index,
+		      const struct nx_v4l2_frame *frame);
+int nx_v4l2_sync_read(struct nx_v4l2_sync *sync,
+		      struct nx_v4l2_sync_set *set);
+int nx_v4l2_sync_release(struct nx_v4l2_sync *sync,
+			 struct nx_v4l2_sync_set *set);
+void nx_v4l2_sync_get_stats(struct nx_v4l2_sync *sync,
+			    struct nx_v4l2_sync_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
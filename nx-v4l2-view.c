@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+#include "nx-v4l2-layout.h"
+#include "nx-v4l2-view.h"
+
+static uint32_t div_up(uint32_t v, uint32_t d)
+{
+	return (v + d - 1) / d;
+}
+
+static int align_rect(const struct nx_v4l2_pixfmt *vf, uint32_t width,
+		      uint32_t height, struct v4l2_rect *rect)
+{
+	int64_t right = (int64_t)rect->left + rect->width;
+	int64_t bottom = (int64_t)rect->top + rect->height;
+	int64_t left = rect->left < 0 ? 0 : rect->left;
+	int64_t top = rect->top < 0 ? 0 : rect->top;
+
+	if (right > width)
+		right = width;
+	if (bottom > height)
+		bottom = height;
+	if (left >= right || top >= bottom)
+		return -EINVAL;
+
+	left -= left % vf->hsub;
+	top -= top % vf->vsub;
+	right = div_up(right, vf->hsub) * vf->hsub;
+	bottom = div_up(bottom, vf->vsub) * vf->vsub;
+	/* odd sized frames keep the last line/column */
+	if (right > width)
+		right = width;
+	if (bottom > height)
+		bottom = height;
+
+	rect->left = left;
+	rect->top = top;
+	rect->width = right - left;
+	rect->height = bottom - top;
+
+	return 0;
+}
+
+int nx_v4l2_view_align_rect(uint32_t format, uint32_t width, uint32_t height,
+			    struct v4l2_rect *rect)
+{
+	const struct nx_v4l2_pixfmt *vf = nx_v4l2_pixfmt_find(format);
+
+	if (!vf)
+		return -EINVAL;
+
+	return align_rect(vf, width, height, rect);
+}
+
+int nx_v4l2_view_init(struct nx_v4l2_view *view,
+		      const struct nx_v4l2_format_info *fmt,
+		      const struct nx_v4l2_frame *frame,
+		      const struct v4l2_rect *rect)
+{
+	const struct nx_v4l2_pixfmt *vf = nx_v4l2_pixfmt_find(fmt->format);
+	uint32_t base[NX_V4L2_MAX_PLANES];
+	uint32_t stride[NX_V4L2_MAX_PLANES];
+	uint32_t cw, ch, hs, vs, b, off;
+	bool contig;
+	int ret;
+	int p;
+
+	if (!vf) {
+		fprintf(stderr, "%s: unsupported format 0x%x\n", __func__,
+			fmt->format);
+		return -EINVAL;
+	}
+
+	bzero(view, sizeof(*view));
+	view->format = fmt->format;
+	view->plane_num = vf->planes;
+	view->index = frame->index;
+	view->sequence = frame->sequence;
+	view->timestamp = frame->timestamp;
+
+	if (rect) {
+		view->rect = *rect;
+	} else {
+		view->rect.width = fmt->width;
+		view->rect.height = fmt->height;
+	}
+
+	ret = align_rect(vf, fmt->width, fmt->height, &view->rect);
+	if (ret)
+		return ret;
+
+	/* plane layout, same rules as nx_v4l2_image_from_frame() */
+	contig = frame->plane_num < vf->planes;
+	cw = div_up(fmt->width, vf->hsub);
+	ch = div_up(fmt->height, vf->vsub);
+
+	stride[0] = fmt->strides[0] ? fmt->strides[0] :
+		    (vf->planes == 1 ? cw * vf->hsub : fmt->width) * vf->cpp[0];
+	base[0] = 0;
+	for (p = 1; p < vf->planes; p++) {
+		if (!contig && fmt->strides[p])
+			stride[p] = fmt->strides[p];
+		else if (vf->planes == 2)
+			stride[p] = stride[0];
+		else
+			stride[p] = fmt->strides[0] ? stride[0] / 2 : cw;
+
+		if (contig)
+			base[p] = p == 1 ? stride[0] * fmt->height :
+				  base[p - 1] + stride[p - 1] * ch;
+		else
+			base[p] = 0;
+	}
+
+	for (p = 0; p < vf->planes; p++) {
+		struct nx_v4l2_view_plane *vp = &view->planes[p];
+
+		hs = p ? vf->hsub : 1;
+		vs = p ? vf->vsub : 1;
+		b = contig ? 0 : p;
+
+		off = base[p] + (view->rect.top / vs) * stride[p];
+		off += (view->rect.left / hs) * vf->cpp[p];
+		vp->width = div_up(view->rect.width, hs) * vf->cpp[p];
+		vp->height = div_up(view->rect.height, vs);
+		vp->stride = stride[p];
+		vp->offset = off;
+		vp->fd = frame->fds[b];
+		vp->virt = frame->virt[b] ?
+			   (uint8_t *)frame->virt[b] + off : NULL;
+
+		if (frame->sizes[b] && off + (vp->height - 1) * vp->stride +
+		    vp->width > frame->sizes[b]) {
+			fprintf(stderr, "%s: plane %d exceeds buffer size\n",
+				__func__, p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+int nx_v4l2_view_init_multi(struct nx_v4l2_view *views,
+			    const struct nx_v4l2_format_info *fmt,
+			    const struct nx_v4l2_frame *frame,
+			    const struct v4l2_rect *rects, int count)
+{
+	int ret;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		ret = nx_v4l2_view_init(&views[i], fmt, frame, &rects[i]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int nx_v4l2_view_to_image(const struct nx_v4l2_view *view,
+			  struct nx_v4l2_image *img)
+{
+	int p;
+
+	bzero(img, sizeof(*img));
+	img->format = view->format;
+	img->width = view->rect.width;
+	img->height = view->rect.height;
+	img->plane_num = view->plane_num;
+
+	for (p = 0; p < view->plane_num; p++) {
+		if (!view->planes[p].virt)
+			return -EINVAL;
+		img->data[p] = view->planes[p].virt;
+		img->strides[p] = view->planes[p].stride;
+	}
+
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_VIEW_H
+#define _NX_V4L2_VIEW_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-convert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Zero-copy region of interest views.
+ *
+ * A view describes a sub-rectangle of a captured frame as the position of
+ * its first pixel in every plane, it is only valid while the frame is
+ * dequeued. The rectangle is aligned to the chroma subsampling of the
+ * format, so left/top are rounded down and right/bottom are rounded up to
+ * even for NV12/I420 and left/width are even for packed 4:2:2.
+ *
+ * offset is relative to the start of the dmabuf given by fd, so consumers
+ * which only have the fd(encoders, G2D) can use the view as well as CPU
+ * consumers which use virt.
+ */
+
+struct nx_v4l2_view_plane {
+	int fd;
+	void *virt;
+	uint32_t offset;
+	uint32_t stride;
+	uint32_t width;		/* bytes per line of the region */
+	uint32_t height;
+};
+
+struct nx_v4l2_view {
+	uint32_t format;
+	struct v4l2_rect rect;
+	int plane_num;
+	struct nx_v4l2_view_plane planes[NX_V4L2_MAX_PLANES];
+	int index;
+	uint32_t sequence;
+	struct timeval timestamp;
+};
+
+int nx_v4l2_view_align_rect(uint32_t format, uint32_t width, uint32_t height,
+			    struct v4l2_rect *rect);
+int nx_v4l2_view_init(struct nx_v4l2_view *view,
+		      const struct nx_v4l2_format_info *fmt,
+		      const struct nx_v4l2_frame *frame,
+		      const struct v4l2_rect *rect);
+int nx_v4l2_view_init_multi(struct nx_v4l2_view *views,
+			    const struct nx_v4l2_format_info *fmt,
+			    const struct nx_v4l2_frame *frame,
+			    const struct v4l2_rect *rects, int count);
+int nx_v4l2_view_to_image(const struct nx_v4l2_view *view,
+			  struct nx_v4l2_image *img);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
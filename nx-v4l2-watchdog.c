@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <poll.h>
+
+#include <sys/ioctl.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-mode.h"
+#include "nx-v4l2-bringup.h"
+#include "nx-v4l2-watchdog.h"
+
+struct nx_v4l2_watchdog {
+	struct nx_v4l2_stream *stream;
+	struct nx_v4l2_watchdog_config cfg;
+	int timeout_ms;
+	int stage;			/* last recovery stage without frame */
+	struct timespec last;		/* last frame or recovery */
+	bool held[VIDEO_MAX_FRAME];
+	struct nx_v4l2_watchdog_stats stats;
+};
+
+static uint32_t elapsed_us(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000 +
+		(now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/* frame interval of the node in us, 0 if unknown */
+static uint32_t query_interval_us(int fd)
+{
+	static const uint32_t buf_types[] = {
+		V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		V4L2_BUF_TYPE_VIDEO_CAPTURE,
+	};
+	struct v4l2_streamparm parm;
+	struct v4l2_fract *tpf;
+	uint32_t i;
+
+	for (i = 0; i < sizeof(buf_types) / sizeof(buf_types[0]); i++) {
+		bzero(&parm, sizeof(parm));
+		parm.type = buf_types[i];
+		if (ioctl(fd, VIDIOC_G_PARM, &parm))
+			continue;
+		tpf = &parm.parm.capture.timeperframe;
+		if (tpf->numerator && tpf->denominator)
+			return (uint64_t)tpf->numerator * 1000000 /
+				tpf->denominator;
+	}
+
+	return 0;
+}
+
+void nx_v4l2_watchdog_default_config(struct nx_v4l2_watchdog_config *cfg)
+{
+	bzero(cfg, sizeof(*cfg));
+	cfg->stall_pct = 150;
+}
+
+struct nx_v4l2_watchdog *nx_v4l2_watchdog_create(
+				struct nx_v4l2_stream *stream,
+				const struct nx_v4l2_watchdog_config *cfg)
+{
+	struct nx_v4l2_watchdog *wd;
+	uint32_t interval_us;
+
+	if (cfg->link_num > NX_V4L2_BRINGUP_MAX_LINKS)
+		return NULL;
+
+	wd = calloc(1, sizeof(*wd));
+	if (!wd)
+		return NULL;
+
+	wd->stream = stream;
+	wd->cfg = *cfg;
+	if (!wd->cfg.stall_pct)
+		wd->cfg.stall_pct = 150;
+
+	interval_us = query_interval_us(nx_v4l2_stream_get_fd(stream));
+	if (!interval_us)
+		interval_us = 1000000 / (cfg->fps ? cfg->fps : 30);
+	wd->timeout_ms = (interval_us * wd->cfg.stall_pct / 100 + 999) / 1000;
+	wd->stats.timeout_ms = wd->timeout_ms;
+
+	return wd;
+}
+
+void nx_v4l2_watchdog_destroy(struct nx_v4l2_watchdog *wd)
+{
+	free(wd);
+}
+
+/* queue the buffers which are neither queued nor held by the caller */
+static int watchdog_requeue(struct nx_v4l2_watchdog *wd)
+{
+	struct nx_v4l2_frame frame;
+	int ret;
+	int i;
+
+	for (i = 0; i < wd->stream->buf_count; i++) {
+		if (wd->held[i] || nx_v4l2_stream_is_queued(wd->stream, i))
+			continue;
+		bzero(&frame, sizeof(frame));
+		frame.index = i;
+		ret = nx_v4l2_stream_qbuf(wd->stream, &frame);
+		/* other sources don't report what they own */
+		if (ret && ret != -EBUSY)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int watchdog_reapply(struct nx_v4l2_watchdog *wd)
+{
+	const struct nx_v4l2_bringup_link *l;
+	const struct nx_v4l2_mode_node *node;
+	int stream_fd = nx_v4l2_stream_get_fd(wd->stream);
+	int ret;
+	int i;
+
+	for (i = 0; i < wd->cfg.link_num; i++) {
+		l = &wd->cfg.links[i];
+		ret = nx_v4l2_link(true, wd->cfg.module, l->src_type,
+				   l->src_pad, l->sink_type, l->sink_pad);
+		if (ret)
+			return ret;
+	}
+
+	if (!wd->cfg.mode)
+		return 0;
+
+	/* the video node keeps its format, its buffers depend on it */
+	for (i = 0; i < wd->cfg.mode->node_num; i++) {
+		node = &wd->cfg.mode->nodes[i];
+		if (node->fd == stream_fd)
+			continue;
+		if (node->crop_valid) {
+			ret = nx_v4l2_set_crop(node->fd, node->type,
+					       node->crop.left, node->crop.top,
+					       node->crop.width,
+					       node->crop.height);
+			if (ret)
+				return ret;
+		}
+		ret = nx_v4l2_set_format(node->fd, node->type, node->width,
+					 node->height, node->format);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int nx_v4l2_watchdog_recover(struct nx_v4l2_watchdog *wd, int stage)
+{
+	struct timespec start;
+	uint32_t us;
+	int ret;
+
+	if (stage < NX_V4L2_RECOVER_REQUEUE || stage >= NX_V4L2_RECOVER_MAX)
+		return -EINVAL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (stage == NX_V4L2_RECOVER_REQUEUE) {
+		ret = watchdog_requeue(wd);
+	} else {
+		nx_v4l2_stream_suspend(wd->stream);
+		ret = stage == NX_V4L2_RECOVER_REAPPLY ?
+			watchdog_reapply(wd) : 0;
+		if (!ret)
+			ret = nx_v4l2_stream_resume(wd->stream);
+		if (!ret)
+			ret = watchdog_requeue(wd);
+	}
+
+	us = elapsed_us(&start);
+	wd->stats.recoveries[stage]++;
+	wd->stats.recovery_us[stage] += us;
+	wd->stats.last_recovery_us = us;
+	if (ret)
+		fprintf(stderr, "%s: stage %d failed(%d)\n", __func__, stage,
+			ret);
+
+	return ret;
+}
+
+int nx_v4l2_watchdog_dqbuf(struct nx_v4l2_watchdog *wd,
+			   struct nx_v4l2_frame *frame)
+{
+	struct pollfd pfd;
+	int timeout;
+	int ret;
+
+	pfd.fd = nx_v4l2_stream_get_fd(wd->stream);
+	pfd.events = POLLIN;
+	if (!wd->last.tv_sec && !wd->last.tv_nsec)
+		clock_gettime(CLOCK_MONOTONIC, &wd->last);
+
+	for (;;) {
+		/* the stall is measured from the last frame, not from now */
+		timeout = wd->timeout_ms - (int)(elapsed_us(&wd->last) / 1000);
+		ret = poll(&pfd, 1, timeout > 0 ? timeout : 0);
+		if (ret < 0 && errno != EINTR)
+			return -errno;
+
+		if (ret > 0) {
+			ret = nx_v4l2_stream_dqbuf(wd->stream, frame);
+			if (!ret) {
+				if (frame->index >= 0 &&
+				    frame->index < VIDEO_MAX_FRAME)
+					wd->held[frame->index] = true;
+				wd->stage = 0;
+				wd->stats.frames++;
+				clock_gettime(CLOCK_MONOTONIC, &wd->last);
+				return 0;
+			}
+			if (ret == -EAGAIN)
+				continue;
+			wd->stats.errors++;
+		} else if (ret == 0) {
+			wd->stats.stalls++;
+		} else {
+			continue;
+		}
+
+		if (++wd->stage >= NX_V4L2_RECOVER_MAX) {
+			wd->stats.failures++;
+			wd->stage = 0;
+			clock_gettime(CLOCK_MONOTONIC, &wd->last);
+			return -EIO;
+		}
+		nx_v4l2_watchdog_recover(wd, wd->stage);
+		clock_gettime(CLOCK_MONOTONIC, &wd->last);
+	}
+}
+
+int nx_v4l2_watchdog_qbuf(struct nx_v4l2_watchdog *wd,
+			  struct nx_v4l2_frame *frame)
+{
+	if (frame->index >= 0 && frame->index < VIDEO_MAX_FRAME)
+		wd->held[frame->index] = false;
+
+	return nx_v4l2_stream_qbuf(wd->stream, frame);
+}
+
+void nx_v4l2_watchdog_get_stats(struct nx_v4l2_watchdog *wd,
+				struct nx_v4l2_watchdog_stats *stats)
+{
+	*stats = wd->stats;
+}
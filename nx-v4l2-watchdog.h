@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_WATCHDOG_H
+#define _NX_V4L2_WATCHDOG_H
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-mode.h"
+#include "nx-v4l2-bringup.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stream health watchdog.
+ *
+ * nx_v4l2_watchdog_dqbuf() replaces nx_v4l2_stream_dqbuf() of a v4l2 video
+ * node source. When no frame comes for stall_pct percent of the frame
+ * interval(VIDIOC_G_PARM, or fps of the config) or the dequeue fails, the
+ * stream is recovered in stages, a stage is escalated when the next
+ * interval has no frame either:
+ *
+ *  1. queue again every buffer which isn't held by the caller
+ *  2. stream off and on, the buffers are kept
+ *  3. program the links and the formats of the mode again, then 2
+ *
+ * When stage 3 doesn't help -EIO is returned and the pipeline must be
+ * built again. Frames given by the watchdog are returned with
+ * nx_v4l2_watchdog_qbuf() so that it knows which buffers the caller holds.
+ */
+
+enum {
+	NX_V4L2_RECOVER_REQUEUE = 1,
+	NX_V4L2_RECOVER_RESTART,
+	NX_V4L2_RECOVER_REAPPLY,
+	NX_V4L2_RECOVER_MAX,
+};
+
+struct nx_v4l2_watchdog;
+
+struct nx_v4l2_watchdog_config {
+	uint32_t fps;			/* 0 queries the node */
+	uint32_t stall_pct;
+	int module;
+	int link_num;
+	struct nx_v4l2_bringup_link links[NX_V4L2_BRINGUP_MAX_LINKS];
+	const struct nx_v4l2_mode *mode;	/* formats and crops, or NULL */
+};
+
+struct nx_v4l2_watchdog_stats {
+	uint32_t frames;
+	uint32_t stalls;
+	uint32_t errors;
+	uint32_t failures;		/* stage 3 didn't help */
+	uint32_t recoveries[NX_V4L2_RECOVER_MAX];
+	uint32_t recovery_us[NX_V4L2_RECOVER_MAX];	/* total */
+	uint32_t last_recovery_us;
+	uint32_t timeout_ms;
+};
+
+void nx_v4l2_watchdog_default_config(struct nx_v4l2_watchdog_config *cfg);
+struct nx_v4l2_watchdog *nx_v4l2_watchdog_create(
+				struct nx_v4l2_stream *stream,
+				const struct nx_v4l2_watchdog_config *cfg);
+void nx_v4l2_watchdog_destroy(struct nx_v4l2_watchdog *wd);
+int nx_v4l2_watchdog_dqbuf(struct nx_v4l2_watchdog *wd,
+			   struct nx_v4l2_frame *frame);
+int nx_v4l2_watchdog_qbuf(struct nx_v4l2_watchdog *wd,
+			  struct nx_v4l2_frame *frame);
+int nx_v4l2_watchdog_recover(struct nx_v4l2_watchdog *wd, int stage);
+void nx_v4l2_watchdog_get_stats(struct nx_v4l2_watchdog *wd,
+				struct nx_v4l2_watchdog_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,6 +32,7 @@
 #include <strings.h>
 #include <stdbool.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -43,16 +44,22 @@
 
 #include "nx-v4l2.h"
 
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
 #define DEVNAME_SIZE	64
 #define DEVNODE_SIZE	64
 struct nx_v4l2_entry {
 	bool exist;
 	bool is_mipi; /* used only in camera sensor */
+	int type;
+	int module;
+	int media_fd;	/* owning media controller */
 	int entity_id;
 	int pads;
 	int links;
 	char devname[DEVNAME_SIZE];
 	char devnode[DEVNODE_SIZE];
+	struct nx_v4l2_entry *hash_next;
 };
 
 enum {
@@ -62,22 +69,34 @@ enum {
 
 #define SYSFS_PATH_SIZE	128
 
-#define MAX_CAMERA_INSTANCE_NUM	3
-#define MAX_CSI_INSTANCE_NUM	1
+/*
+ * entries are kept per type in arrays indexed by module which grow on
+ * demand, and every entry is also hashed by its device name so that names
+ * found while enumerating resolve in constant time
+ */
+#define NAME_HASH_MIN	16
+
+struct nx_v4l2_entry_table {
+	int count;
+	struct nx_v4l2_entry **entries;
+};
+
 static struct nx_v4l2_entry_cache {
-	int media_fd;
+	int media_count;
+	int *media_fds;
 	bool cached;
-	struct nx_v4l2_entry nx_sensor_subdev[MAX_CAMERA_INSTANCE_NUM];
-	struct nx_v4l2_entry nx_clipper_subdev[MAX_CAMERA_INSTANCE_NUM];
-	struct nx_v4l2_entry nx_decimator_subdev[MAX_CAMERA_INSTANCE_NUM];
-	struct nx_v4l2_entry nx_csi_subdev[MAX_CSI_INSTANCE_NUM];
-	struct nx_v4l2_entry nx_clipper_video[MAX_CAMERA_INSTANCE_NUM];
-	struct nx_v4l2_entry nx_decimator_video[MAX_CAMERA_INSTANCE_NUM];
+	struct nx_v4l2_entry_table tables[nx_v4l2_max];
+	int hash_size;
+	int hash_count;
+	struct nx_v4l2_entry **hash;
 } _nx_v4l2_entry_cache = {
-	.media_fd = -1,
+	.media_count = 0,
 	.cached	= false,
 };
 
+/* the cache is built once, by the first caller */
+static pthread_mutex_t _nx_v4l2_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int get_type_category(uint32_t type)
 {
 	switch (type) {
@@ -116,66 +135,175 @@ static void print_nx_v4l2_entry(struct nx_v4l2_entry *e)
 
 static void print_all_nx_v4l2_entry(void)
 {
-	int i;
+	int i, type;
 	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
-	struct nx_v4l2_entry *entry;
+	struct nx_v4l2_entry_table *table;
 
 	if (!cache->cached) {
 		fprintf(stderr, "not cached\n");
 		return;
 	}
 
-	for (i = 0; i < MAX_CAMERA_INSTANCE_NUM; i++) {
-		entry = &cache->nx_sensor_subdev[i];
-		print_nx_v4l2_entry(entry);
+	for (type = 0; type < nx_v4l2_max; type++) {
+		table = &cache->tables[type];
+		for (i = 0; i < table->count; i++)
+			if (table->entries[i])
+				print_nx_v4l2_entry(table->entries[i]);
 	}
+}
 
-	for (i = 0; i < MAX_CAMERA_INSTANCE_NUM; i++) {
-		entry = &cache->nx_clipper_subdev[i];
-		print_nx_v4l2_entry(entry);
-	}
+/* FNV-1a */
+static uint32_t hash_name(const char *name)
+{
+	uint32_t h = 2166136261u;
 
-	for (i = 0; i < MAX_CAMERA_INSTANCE_NUM; i++) {
-		entry = &cache->nx_decimator_subdev[i];
-		print_nx_v4l2_entry(entry);
+	while (*name) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619u;
 	}
 
-	for (i = 0; i < MAX_CSI_INSTANCE_NUM; i++) {
-		entry = &cache->nx_csi_subdev[i];
-		print_nx_v4l2_entry(entry);
-	}
+	return h;
+}
 
-	for (i = 0; i < MAX_CAMERA_INSTANCE_NUM; i++) {
-		entry = &cache->nx_clipper_video[i];
-		print_nx_v4l2_entry(entry);
-	}
+/* names read from sysfs end with a newline */
+static void trim_name(char *name)
+{
+	int len = strlen(name);
 
-	for (i = 0; i < MAX_CAMERA_INSTANCE_NUM; i++) {
-		entry = &cache->nx_decimator_video[i];
-		print_nx_v4l2_entry(entry);
+	while (len > 0 && isspace((unsigned char)name[len - 1]))
+		name[--len] = '\0';
+}
+
+static int grow_name_hash(void)
+{
+	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	struct nx_v4l2_entry **hash, *e, *next;
+	int size = cache->hash_size ? cache->hash_size * 2 : NAME_HASH_MIN;
+	int i, b;
+
+	hash = calloc(size, sizeof(*hash));
+	if (!hash)
+		return -ENOMEM;
+
+	for (i = 0; i < cache->hash_size; i++) {
+		for (e = cache->hash[i]; e; e = next) {
+			next = e->hash_next;
+			b = hash_name(e->devname) & (size - 1);
+			e->hash_next = hash[b];
+			hash[b] = e;
+		}
 	}
+
+	free(cache->hash);
+	cache->hash = hash;
+	cache->hash_size = size;
+	return 0;
+}
+
+static void hash_entry(struct nx_v4l2_entry *e)
+{
+	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	int b;
+
+	if (cache->hash_count >= cache->hash_size && grow_name_hash())
+		return;
+
+	b = hash_name(e->devname) & (cache->hash_size - 1);
+	e->hash_next = cache->hash[b];
+	cache->hash[b] = e;
+	cache->hash_count++;
+}
+
+static struct nx_v4l2_entry *lookup_entry_name(const char *name)
+{
+	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	struct nx_v4l2_entry *e;
+
+	if (!cache->hash_size)
+		return NULL;
+
+	e = cache->hash[hash_name(name) & (cache->hash_size - 1)];
+	for (; e; e = e->hash_next)
+		if (!strcmp(e->devname, name))
+			return e;
+
+	return NULL;
 }
 
 static struct nx_v4l2_entry *find_v4l2_entry(int type, int module)
 {
 	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	struct nx_v4l2_entry_table *table;
 
-	switch (type) {
-	case nx_sensor_subdev:
-		return &cache->nx_sensor_subdev[module];
-	case nx_clipper_subdev:
-		return &cache->nx_clipper_subdev[module];
-	case nx_decimator_subdev:
-		return &cache->nx_decimator_subdev[module];
-	case nx_csi_subdev:
-		return &cache->nx_csi_subdev[0];
-	case nx_clipper_video:
-		return &cache->nx_clipper_video[module];
-	case nx_decimator_video:
-		return &cache->nx_decimator_video[module];
-	default:
+	if (type < 0 || type >= nx_v4l2_max || module < 0)
 		return NULL;
+
+	table = &cache->tables[type];
+	if (module < table->count && table->entries[module])
+		return table->entries[module];
+
+	/* boards with one csi share it between all modules */
+	if (type == nx_csi_subdev && module > 0)
+		return find_v4l2_entry(type, 0);
+
+	return NULL;
+}
+
+static struct nx_v4l2_entry *add_v4l2_entry(int type, int module,
+					    const char *name)
+{
+	struct nx_v4l2_entry_table *table = &_nx_v4l2_entry_cache.tables[type];
+	struct nx_v4l2_entry **entries;
+	struct nx_v4l2_entry *e;
+	int count;
+
+	if (module < table->count && table->entries[module])
+		return table->entries[module];
+
+	if (module >= table->count) {
+		count = module + 1;
+		entries = realloc(table->entries, count * sizeof(*entries));
+		if (!entries)
+			return NULL;
+		memset(entries + table->count, 0,
+		       (count - table->count) * sizeof(*entries));
+		table->entries = entries;
+		table->count = count;
 	}
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return NULL;
+
+	e->type = type;
+	e->module = module;
+	e->media_fd = -1;
+	strncpy(e->devname, name, DEVNAME_SIZE - 1);
+	table->entries[module] = e;
+	hash_entry(e);
+
+	return e;
+}
+
+static void free_v4l2_entries(void)
+{
+	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	struct nx_v4l2_entry_table *table;
+	int i, type;
+
+	for (type = 0; type < nx_v4l2_max; type++) {
+		table = &cache->tables[type];
+		for (i = 0; i < table->count; i++)
+			free(table->entries[i]);
+		free(table->entries);
+		table->entries = NULL;
+		table->count = 0;
+	}
+
+	free(cache->hash);
+	cache->hash = NULL;
+	cache->hash_size = 0;
+	cache->hash_count = 0;
 }
 
 #define NX_CLIPPER_SUBDEV_NAME		"nx-clipper"
@@ -184,109 +312,153 @@ static struct nx_v4l2_entry *find_v4l2_entry(int type, int module)
 #define NX_CLIPPER_VIDEO_NAME		"VIDEO CLIPPER"
 #define NX_DECIMATOR_VIDEO_NAME		"VIDEO DECIMATOR"
 
-static int get_type_by_name(char *type_name)
-{
-	if (!strncmp(type_name, NX_CLIPPER_SUBDEV_NAME,
-		     strlen(NX_CLIPPER_SUBDEV_NAME))) {
-		return nx_clipper_subdev;
-	} else if (!strncmp(type_name, NX_DECIMATOR_SUBDEV_NAME,
-			    strlen(NX_DECIMATOR_SUBDEV_NAME))) {
-		return nx_decimator_subdev;
-	} else if (!strncmp(type_name, NX_CSI_SUBDEV_NAME,
-			    strlen(NX_CSI_SUBDEV_NAME))) {
-		return nx_csi_subdev;
-	} else if (!strncmp(type_name, NX_CLIPPER_VIDEO_NAME,
-			    strlen(NX_CLIPPER_VIDEO_NAME))) {
-		return nx_clipper_video;
-	} else if (!strncmp(type_name, NX_DECIMATOR_VIDEO_NAME,
-			    strlen(NX_DECIMATOR_VIDEO_NAME))) {
-		return nx_decimator_video;
-	} else {
-		/* fprintf(stderr, "can't find type for name %s\n", type_name); */
-		return -EINVAL;
-	}
-}
+static const struct {
+	const char *name;
+	int type;
+} nx_type_names[] = {
+	{ NX_CLIPPER_SUBDEV_NAME, nx_clipper_subdev },
+	{ NX_DECIMATOR_SUBDEV_NAME, nx_decimator_subdev },
+	{ NX_CSI_SUBDEV_NAME, nx_csi_subdev },
+	{ NX_CLIPPER_VIDEO_NAME, nx_clipper_video },
+	{ NX_DECIMATOR_VIDEO_NAME, nx_decimator_video },
+};
 
-static int get_sensor_info(char *name, int *module)
-{
-	int i;
-	struct nx_v4l2_entry *e = &_nx_v4l2_entry_cache.nx_sensor_subdev[0];
+#define TYPE_HASH_SIZE	16
 
-	for (i = 0; i < MAX_CAMERA_INSTANCE_NUM; i++, e++) {
-		if (e->exist &&
-			!strncmp(name, e->devname, strlen(e->devname))) {
-			*module = i;
-			return nx_sensor_subdev;
+static int get_type_by_name(const char *type_name)
+{
+	static int8_t type_hash[TYPE_HASH_SIZE];
+	static bool type_hash_built;
+	uint32_t b;
+	size_t i;
+
+	/* open addressing over the type names, slot holds index + 1 */
+	if (!type_hash_built) {
+		for (i = 0; i < ARRAY_SIZE(nx_type_names); i++) {
+			b = hash_name(nx_type_names[i].name);
+			while (type_hash[b & (TYPE_HASH_SIZE - 1)])
+				b++;
+			type_hash[b & (TYPE_HASH_SIZE - 1)] = i + 1;
 		}
+		type_hash_built = true;
 	}
 
-	return -ENODEV;
+	for (b = hash_name(type_name); type_hash[b & (TYPE_HASH_SIZE - 1)];
+	     b++) {
+		i = type_hash[b & (TYPE_HASH_SIZE - 1)] - 1;
+		if (!strcmp(nx_type_names[i].name, type_name))
+			return nx_type_names[i].type;
+	}
+
+	/* fprintf(stderr, "can't find type for name %s\n", type_name); */
+	return -EINVAL;
 }
 
-static struct nx_v4l2_entry *find_v4l2_entry_by_name(char *name)
+/*
+ * resolve a device or entity name, names of the nexell blocks are a type
+ * name followed by the module number and get an entry on first sight,
+ * sensors are known by the names read from sysfs
+ */
+static struct nx_v4l2_entry *find_v4l2_entry_by_name(const char *devname)
 {
-	int type;
-	int module;
-	char type_name[DEVNAME_SIZE] = {0, };
-	char sensor_name[DEVNAME_SIZE] = {0, };
+	char name[DEVNAME_SIZE];
+	char type_name[DEVNAME_SIZE];
+	struct nx_v4l2_entry_table *table;
+	struct nx_v4l2_entry *e;
+	int type, module, len, i;
+
+	strncpy(name, devname, DEVNAME_SIZE - 1);
+	name[DEVNAME_SIZE - 1] = '\0';
+	trim_name(name);
 
-	memset(type_name, 0, DEVNAME_SIZE);
-	memset(sensor_name, 0, DEVNAME_SIZE);
+	e = lookup_entry_name(name);
+	if (e)
+		return e;
 
-	sscanf(name, "%[^0-9]%d", type_name, &module);
+	len = strlen(name);
+	while (len > 0 && isdigit((unsigned char)name[len - 1]))
+		len--;
+	module = name[len] ? atoi(&name[len]) : 0;
+	memcpy(type_name, name, len);
+	type_name[len] = '\0';
 
 	type = get_type_by_name(type_name);
-	if (type < 0) {
-		type = get_sensor_info(name, &module);
-		if (type < 0)
-			return NULL;
+	if (type >= 0)
+		return add_v4l2_entry(type, module, name);
+
+	/* sensor names which carry more than the sysfs name */
+	table = &_nx_v4l2_entry_cache.tables[nx_sensor_subdev];
+	for (i = 0; i < table->count; i++) {
+		e = table->entries[i];
+		if (e && e->devname[0] &&
+		    !strncmp(name, e->devname, strlen(e->devname)))
+			return e;
 	}
 
-	return find_v4l2_entry(type, module);
+	return NULL;
 }
 
 /* camera sensor sysfs entry
  * /sys/devices/platform/camerasensor[MODULE]/info
  * ex> /sys/devices/platform/camerasensor0/info
  */
+#define CAMERA_SENSOR_SYSFS	"/sys/devices/platform"
+#define CAMERA_SENSOR_NAME	"camerasensor"
 
 static void enum_camera_sensor(void)
 {
+	struct dirent **items;
+	struct nx_v4l2_entry *e;
+	int nitems;
 	int sys_fd;
-	int i;
-	char sysfs_path[64] = {0, };
-	struct nx_v4l2_entry *e = &_nx_v4l2_entry_cache.nx_sensor_subdev[0];
+	int i, module;
+	char sysfs_path[SYSFS_PATH_SIZE] = {0, };
+
+	nitems = scandir(CAMERA_SENSOR_SYSFS, &items, NULL, alphasort);
+	for (i = 0; i < nitems; i++) {
+		char buf[512] = {0, };
+		char *c;
+		int size;
+
+		if (sscanf(items[i]->d_name, CAMERA_SENSOR_NAME "%d",
+			   &module) != 1 || module < 0)
+			goto next;
 
-	for (i = 0; i < MAX_CAMERA_INSTANCE_NUM; i++, e++) {
-		sprintf(sysfs_path,
-			"/sys/devices/platform/camerasensor%d/info",i);
+		snprintf(sysfs_path, sizeof(sysfs_path),
+			 "%s/" CAMERA_SENSOR_NAME "%d/info",
+			 CAMERA_SENSOR_SYSFS, module);
 		sys_fd = open(sysfs_path, O_RDONLY);
-		if (sys_fd < 0) {
-			e->exist = false;
-		} else {
-			char buf[512] = {0, };
-			int size = read(sys_fd, buf, sizeof(buf));
-
-			close(sys_fd);
-			if (size < 0) {
-				fprintf(stderr, "failed to read %s\n",
-					sysfs_path);
-				e->exist = false;
-			} else {
-				if (!strcmp("no exist", buf)) {
-					e->exist = false;
-				} else {
-					char *c;
-
-					e->exist = true;
-					c = &buf[strlen("is_mipi:")];
-					e->is_mipi = *c - '0';
-					c += 7; /* ,name: */
-					strncpy(e->devname, c, DEVNAME_SIZE);
-				}
-			}
+		if (sys_fd < 0)
+			goto next;
+
+		size = read(sys_fd, buf, sizeof(buf) - 1);
+		close(sys_fd);
+		if (size < 0) {
+			fprintf(stderr, "failed to read %s\n", sysfs_path);
+			goto next;
+		}
+		if (!strcmp("no exist", buf))
+			goto next;
+
+		c = &buf[strlen("is_mipi:")];
+		e = NULL;
+		if (c + 7 < buf + size) {
+			bool is_mipi = *c - '0';
+
+			c += 7; /* ,name: */
+			trim_name(c);
+			e = add_v4l2_entry(nx_sensor_subdev, module, c);
+			if (e)
+				e->is_mipi = is_mipi;
 		}
+		if (e)
+			e->exist = true;
+next:
+		free(items[i]);
 	}
+
+	if (nitems >= 0)
+		free(items);
 }
 
 static int enum_all_v4l2_devices(void)
@@ -360,41 +532,151 @@ static int enum_all_v4l2_devices(void)
 	return 0;
 }
 
+/*
+ * every /dev/media* is enumerated by its own thread, the results are
+ * merged into the registry afterwards so that the registry needs no lock
+ */
+struct media_enum_job {
+	char path[DEVNODE_SIZE];
+	int fd;
+	int count;
+	struct media_entity_desc *entities;
+	pthread_t thread;
+};
+
+static void *enum_media_entities(void *arg)
+{
+	struct media_enum_job *job = arg;
+	struct media_entity_desc entity, *entities;
+	uint32_t id = 0;
+
+	job->fd = open(job->path, O_RDWR | O_CLOEXEC);
+	if (job->fd < 0)
+		return NULL;
+
+	for (;;) {
+		memset(&entity, 0, sizeof(entity));
+		entity.id = id | MEDIA_ENT_ID_FLAG_NEXT;
+		if (ioctl(job->fd, MEDIA_IOC_ENUM_ENTITIES, &entity))
+			break;
+
+		entities = realloc(job->entities,
+				   (job->count + 1) * sizeof(*entities));
+		if (!entities)
+			break;
+		job->entities = entities;
+		job->entities[job->count++] = entity;
+		id = entity.id;
+	}
+
+	return NULL;
+}
+
+static int media_filter(const struct dirent *d)
+{
+	return !strncmp(d->d_name, "media", 5) && isdigit(d->d_name[5]);
+}
+
+static int add_media_device(int fd)
+{
+	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	int *fds;
+
+	fds = realloc(cache->media_fds,
+		      (cache->media_count + 1) * sizeof(*fds));
+	if (!fds)
+		return -ENOMEM;
+
+	cache->media_fds = fds;
+	cache->media_fds[cache->media_count++] = fd;
+	return 0;
+}
+
 static int enum_all_media_entities(void)
 {
-	int ret;
-	int index;
-	struct media_entity_desc entity;
 	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	struct media_enum_job *jobs;
+	struct dirent **items;
 	struct nx_v4l2_entry *entry;
+	bool *started;
+	bool used;
+	int nitems;
+	int i, j;
 
 	if (cache->cached == false) {
 		fprintf(stderr, "%s: not cached\n", __func__);
 		return -EAGAIN;
 	}
 
-	if (cache->media_fd < 0) {
-		cache->media_fd = open("/dev/media0", O_RDWR);
-		if (cache->media_fd < 0) {
-			fprintf(stderr, "failed to open media device\n");
-			return -ENODEV;
-		}
+	nitems = scandir("/dev", &items, media_filter, alphasort);
+	if (nitems <= 0) {
+		fprintf(stderr, "failed to find media device\n");
+		return -ENODEV;
 	}
 
-	index = 0;
-	do {
-		entity.id = index | MEDIA_ENT_ID_FLAG_NEXT;
-		ret = ioctl(cache->media_fd, MEDIA_IOC_ENUM_ENTITIES, &entity);
-		if (ret == 0) {
-			entry = find_v4l2_entry_by_name(entity.name);
+	jobs = calloc(nitems, sizeof(*jobs));
+	started = calloc(nitems, sizeof(*started));
+	if (!jobs || !started) {
+		for (i = 0; i < nitems; i++)
+			free(items[i]);
+		free(items);
+		free(jobs);
+		free(started);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nitems; i++) {
+		snprintf(jobs[i].path, DEVNODE_SIZE, "/dev/%.*s",
+			 DEVNODE_SIZE - 6, items[i]->d_name);
+		jobs[i].fd = -1;
+		free(items[i]);
+		started[i] = !pthread_create(&jobs[i].thread, NULL,
+					     enum_media_entities, &jobs[i]);
+		if (!started[i])
+			enum_media_entities(&jobs[i]);
+	}
+	free(items);
+
+	for (i = 0; i < nitems; i++) {
+		if (started[i])
+			pthread_join(jobs[i].thread, NULL);
+		if (jobs[i].fd < 0)
+			continue;
+
+		used = false;
+		for (j = 0; j < jobs[i].count; j++) {
+			struct media_entity_desc *entity = &jobs[i].entities[j];
+
+			entry = find_v4l2_entry_by_name(entity->name);
 			if (entry) {
-				entry->entity_id = entity.id;
-				entry->pads = entity.pads;
-				entry->links = entity.links;
+				entry->entity_id = entity->id;
+				entry->pads = entity->pads;
+				entry->links = entity->links;
+				entry->media_fd = jobs[i].fd;
+				used = true;
 			}
 		}
-		index++;
-	} while (ret == 0);
+
+		/* keep only the controllers which own our entities */
+		if (!used || add_media_device(jobs[i].fd)) {
+			close(jobs[i].fd);
+			for (j = 0; used && j < jobs[i].count; j++) {
+				entry = find_v4l2_entry_by_name(
+						jobs[i].entities[j].name);
+				if (entry)
+					entry->media_fd = -1;
+			}
+		}
+		free(jobs[i].entities);
+	}
+
+	free(jobs);
+	free(started);
+
+	if (!cache->media_count) {
+		fprintf(stderr, "failed to open media device\n");
+		return -ENODEV;
+	}
 
 	return 0;
 }
@@ -402,17 +684,31 @@ static int enum_all_media_entities(void)
 /****************************************************************
  * public api
  */
-int nx_v4l2_open_device(int type, int module)
+static void enum_all_if_needed(void)
 {
-	struct nx_v4l2_entry *entry = NULL;
-
 	if (_nx_v4l2_entry_cache.cached == false) {
 		enum_all_v4l2_devices();
 		enum_all_media_entities();
 		/* print_all_nx_v4l2_entry(); */
 	}
+}
 
+/* fills the device cache once, later lookups only read it */
+void nx_v4l2_enumerate(void)
+{
+	pthread_mutex_lock(&_nx_v4l2_cache_lock);
+	enum_all_if_needed();
+	pthread_mutex_unlock(&_nx_v4l2_cache_lock);
+}
+
+int nx_v4l2_open_device(int type, int module)
+{
+	struct nx_v4l2_entry *entry = NULL;
+
+	pthread_mutex_lock(&_nx_v4l2_cache_lock);
+	enum_all_if_needed();
 	entry = find_v4l2_entry(type, module);
+	pthread_mutex_unlock(&_nx_v4l2_cache_lock);
 	if (entry) {
 		int fd = open(entry->devnode, O_RDWR);
 
@@ -429,12 +725,17 @@ int nx_v4l2_open_device(int type, int module)
 void nx_v4l2_cleanup(void)
 {
 	struct nx_v4l2_entry_cache *cache = &_nx_v4l2_entry_cache;
+	int i;
 
-	if (cache->media_fd >= 0) {
-		close(cache->media_fd);
-		cache->media_fd = -1;
-	}
+	pthread_mutex_lock(&_nx_v4l2_cache_lock);
+	for (i = 0; i < cache->media_count; i++)
+		close(cache->media_fds[i]);
+	free(cache->media_fds);
+	cache->media_fds = NULL;
+	cache->media_count = 0;
+	free_v4l2_entries();
 	cache->cached = false;
+	pthread_mutex_unlock(&_nx_v4l2_cache_lock);
 }
 
 bool nx_v4l2_is_mipi_camera(int module)
@@ -448,7 +749,23 @@ bool nx_v4l2_is_mipi_camera(int module)
 	return false;
 }
 
-int enum_link(int id, int pads, int links, struct media_links_enum *enumlink)
+/* media controller of the entity, owned by the library until cleanup */
+int nx_v4l2_get_media_fd(int type, int module)
+{
+	struct nx_v4l2_entry *e;
+
+	pthread_mutex_lock(&_nx_v4l2_cache_lock);
+	enum_all_if_needed();
+	e = find_v4l2_entry(type, module);
+	pthread_mutex_unlock(&_nx_v4l2_cache_lock);
+	if (!e || e->media_fd < 0)
+		return -ENODEV;
+
+	return e->media_fd;
+}
+
+int enum_link(int media_fd, int id, int pads, int links,
+	      struct media_links_enum *enumlink)
 {
 	int ret;
 	int i;
@@ -459,8 +776,7 @@ int enum_link(int id, int pads, int links, struct media_links_enum *enumlink)
 	enumlink->pads = malloc(sizeof(struct media_pad_desc) * pads);
 	enumlink->links = malloc(sizeof(struct media_link_desc) * links);
 
-	ret = ioctl(_nx_v4l2_entry_cache.media_fd,
-			MEDIA_IOC_ENUM_LINKS, enumlink);
+	ret = ioctl(media_fd, MEDIA_IOC_ENUM_LINKS, enumlink);
 	if (ret < 0) {
 		fprintf(stderr,
 			"failed to enum link foir %d\n", id);
@@ -535,14 +851,22 @@ int nx_v4l2_link(bool link, int module, int src_type, int src_pad,
 		return -EINVAL;
 	}
 
+	/* links never cross media controllers */
+	if (src_entry->media_fd < 0 ||
+	    src_entry->media_fd != sink_entry->media_fd) {
+		fprintf(stderr, "no media link between type %d and %d\n",
+			src_type, sink_type);
+		return -EXDEV;
+	}
+
 	/* This is for debugging */
 #if 0
 	{
 		struct media_links_enum link_enum;
-		enum_link(src_entry->entity_id, src_entry->pads,
-			  src_entry->links, &link_enum);
-		enum_link(sink_entry->entity_id, sink_entry->pads,
-			  sink_entry->links, &link_enum);
+		enum_link(src_entry->media_fd, src_entry->entity_id,
+			  src_entry->pads, src_entry->links, &link_enum);
+		enum_link(sink_entry->media_fd, sink_entry->entity_id,
+			  sink_entry->pads, sink_entry->links, &link_enum);
 	}
 #endif
 
@@ -561,15 +885,15 @@ int nx_v4l2_link(bool link, int module, int src_type, int src_pad,
 	desc.sink.index = sink_pad;
 	desc.sink.flags = MEDIA_PAD_FL_SINK;
 
-	return ioctl(_nx_v4l2_entry_cache.media_fd, MEDIA_IOC_SETUP_LINK,
-		     &desc);
+	return ioctl(src_entry->media_fd, MEDIA_IOC_SETUP_LINK, &desc);
 }
 
-static int subdev_set_format(int fd, uint32_t w, uint32_t h, uint32_t format)
+static int subdev_set_format(int fd, int pad, uint32_t w, uint32_t h,
+			     uint32_t format)
 {
 	struct v4l2_subdev_format fmt;
 	bzero(&fmt, sizeof(fmt));
-	fmt.pad = 0;
+	fmt.pad = pad;
 	fmt.which = V4L2_SUBDEV_FORMAT_ACTIVE;
 	fmt.format.code = format;
 	fmt.format.width = w;
@@ -610,7 +934,7 @@ int nx_v4l2_set_format(int fd, int type, uint32_t w, uint32_t h,
 	uint32_t format)
 {
 	if (get_type_category(type) == type_category_subdev)
-		return subdev_set_format(fd, w, h, format);
+		return subdev_set_format(fd, 0, w, h, format);
 	else
 		return video_set_format(fd, w, h, format, get_buf_type(type));
 }
@@ -619,18 +943,21 @@ int nx_v4l2_set_format_mmap(int fd, int type, uint32_t w, uint32_t h,
 			    uint32_t format)
 {
 	if (get_type_category(type) == type_category_subdev)
-		return subdev_set_format(fd, w, h, format);
+		return subdev_set_format(fd, 0, w, h, format);
 	else
 		return video_set_format_mmap(fd, w, h, format,
 					     V4L2_BUF_TYPE_VIDEO_CAPTURE);
 }
 
-static int subdev_get_format(int fd, uint32_t *w, uint32_t *h, uint32_t *format)
+static int subdev_get_format(int fd, int pad, uint32_t *w, uint32_t *h,
+			     uint32_t *format)
 {
 	int ret;
 	struct v4l2_subdev_format fmt;
 
 	bzero(&fmt, sizeof(fmt));
+	fmt.pad = pad;
+	fmt.which = V4L2_SUBDEV_FORMAT_ACTIVE;
 
 	ret = ioctl(fd, VIDIOC_SUBDEV_G_FMT, &fmt);
 	if (ret)
@@ -666,11 +993,136 @@ int nx_v4l2_get_format(int fd, int type, uint32_t *w, uint32_t *h,
 		       uint32_t *format)
 {
 	if (get_type_category(type) == type_category_subdev)
-		return subdev_get_format(fd, w, h, format);
+		return subdev_get_format(fd, 0, w, h, format);
 	else
 		return video_get_format(fd, w, h, format, get_buf_type(type));
 }
 
+/* pad is the subdev pad, video nodes have only pad 0 */
+int nx_v4l2_set_pad_format(int fd, int type, int pad, uint32_t w, uint32_t h,
+			   uint32_t format)
+{
+	if (get_type_category(type) == type_category_subdev)
+		return subdev_set_format(fd, pad, w, h, format);
+	if (pad)
+		return -EINVAL;
+	return video_set_format(fd, w, h, format, get_buf_type(type));
+}
+
+int nx_v4l2_get_pad_format(int fd, int type, int pad, uint32_t *w,
+			   uint32_t *h, uint32_t *format)
+{
+	if (get_type_category(type) == type_category_subdev)
+		return subdev_get_format(fd, pad, w, h, format);
+	if (pad)
+		return -EINVAL;
+	return video_get_format(fd, w, h, format, get_buf_type(type));
+}
+
+static int subdev_selection(int fd, unsigned long req, int pad,
+			    uint32_t target, uint32_t flags,
+			    struct v4l2_rect *rect)
+{
+	struct v4l2_subdev_selection sel;
+	struct v4l2_subdev_crop crop;
+	int ret;
+
+	bzero(&sel, sizeof(sel));
+	sel.which = V4L2_SUBDEV_FORMAT_ACTIVE;
+	sel.pad = pad;
+	sel.target = target;
+	sel.flags = flags;
+	sel.r = *rect;
+	ret = ioctl(fd, req, &sel);
+	if (!ret) {
+		*rect = sel.r;
+		return 0;
+	}
+
+	/* subdevs older than the selection api know only the crop */
+	if (errno != ENOTTY || target != V4L2_SEL_TGT_CROP)
+		return ret;
+
+	bzero(&crop, sizeof(crop));
+	crop.which = V4L2_SUBDEV_FORMAT_ACTIVE;
+	crop.pad = pad;
+	crop.rect = *rect;
+	ret = ioctl(fd, req == VIDIOC_SUBDEV_S_SELECTION ?
+		    VIDIOC_SUBDEV_S_CROP : VIDIOC_SUBDEV_G_CROP, &crop);
+	if (!ret)
+		*rect = crop.rect;
+	return ret;
+}
+
+static int video_selection(int fd, unsigned long req, uint32_t target,
+			   uint32_t flags, struct v4l2_rect *rect,
+			   uint32_t buf_type)
+{
+	struct v4l2_selection sel;
+	struct v4l2_crop crop;
+	int ret;
+
+	bzero(&sel, sizeof(sel));
+	sel.type = buf_type;
+	sel.target = target;
+	sel.flags = flags;
+	sel.r = *rect;
+	ret = ioctl(fd, req, &sel);
+	if (ret && errno == EINVAL) {
+		/* older kernels take only the single planar type */
+		sel.type = buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ?
+			V4L2_BUF_TYPE_VIDEO_CAPTURE : V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		sel.r = *rect;
+		ret = ioctl(fd, req, &sel);
+	}
+	if (!ret) {
+		*rect = sel.r;
+		return 0;
+	}
+
+	if (errno != ENOTTY || target != V4L2_SEL_TGT_CROP)
+		return ret;
+
+	bzero(&crop, sizeof(crop));
+	crop.type = buf_type;
+	crop.c = *rect;
+	ret = ioctl(fd, req == VIDIOC_S_SELECTION ?
+		    VIDIOC_S_CROP : VIDIOC_G_CROP, &crop);
+	if (!ret)
+		*rect = crop.c;
+	return ret;
+}
+
+/*
+ * target is one of V4L2_SEL_TGT_*, flags V4L2_SEL_FLAG_*. rect is updated
+ * with the rectangle the driver applied. Drivers without the selection api
+ * are served with the legacy crop ioctls for V4L2_SEL_TGT_CROP.
+ */
+int nx_v4l2_set_selection(int fd, int type, int pad, uint32_t target,
+			  uint32_t flags, struct v4l2_rect *rect)
+{
+	if (get_type_category(type) == type_category_subdev)
+		return subdev_selection(fd, VIDIOC_SUBDEV_S_SELECTION, pad,
+					target, flags, rect);
+	if (pad)
+		return -EINVAL;
+	return video_selection(fd, VIDIOC_S_SELECTION, target, flags, rect,
+			       get_buf_type(type));
+}
+
+int nx_v4l2_get_selection(int fd, int type, int pad, uint32_t target,
+			  struct v4l2_rect *rect)
+{
+	bzero(rect, sizeof(*rect));
+	if (get_type_category(type) == type_category_subdev)
+		return subdev_selection(fd, VIDIOC_SUBDEV_G_SELECTION, pad,
+					target, 0, rect);
+	if (pad)
+		return -EINVAL;
+	return video_selection(fd, VIDIOC_G_SELECTION, target, 0, rect,
+			       get_buf_type(type));
+}
+
 static int subdev_set_crop(int fd, uint32_t x, uint32_t y, uint32_t w,
 			   uint32_t h)
 {
@@ -787,6 +1239,32 @@ int nx_v4l2_get_ctrl(int fd, int type, uint32_t ctrl_id, int *value)
 	return 0;
 }
 
+/*
+ * write the controls in one VIDIOC_S_EXT_CTRLS, drivers which only support
+ * VIDIOC_S_CTRL get them one by one
+ */
+int nx_v4l2_set_ext_ctrls(int fd, int type, struct v4l2_ext_control *ctrls,
+			  int count)
+{
+	struct v4l2_ext_controls ext;
+	int ret;
+	int i;
+
+	bzero(&ext, sizeof(ext));
+	ext.count = count;
+	ext.controls = ctrls;
+	ret = ioctl(fd, VIDIOC_S_EXT_CTRLS, &ext);
+	if (!ret || (errno != ENOTTY && errno != EINVAL))
+		return ret;
+
+	for (i = 0; i < count; i++) {
+		ret = nx_v4l2_set_ctrl(fd, type, ctrls[i].id, ctrls[i].value);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
 int nx_v4l2_reqbuf(int fd, int type, int count)
 {
 	struct v4l2_requestbuffers req;
@@ -815,7 +1293,41 @@ int nx_v4l2_reqbuf_mmap(int fd, int type, int count)
 	return ioctl(fd, VIDIOC_REQBUFS, &req);
 }
 
-#define MAX_PLANES	3
+/*
+ * V4L2_BUF_CAP_* of the queue without touching its buffers, 0 on kernels
+ * which don't report capabilities and -ENOTSUP when built against headers
+ * older than the field
+ */
+int nx_v4l2_query_buf_caps(int fd, int type, uint32_t memory, uint32_t *caps)
+{
+#ifdef V4L2_BUF_CAP_SUPPORTS_REQUESTS
+	struct v4l2_create_buffers create;
+	int ret;
+
+	if (get_type_category(type) == type_category_subdev)
+		return -EINVAL;
+
+	bzero(&create, sizeof(create));
+	create.memory = memory;
+	create.format.type = memory == V4L2_MEMORY_MMAP ?
+		V4L2_BUF_TYPE_VIDEO_CAPTURE : get_buf_type(type);
+	ret = ioctl(fd, VIDIOC_G_FMT, &create.format);
+	if (ret)
+		return -errno;
+
+	/* count 0 only reports the queue */
+	ret = ioctl(fd, VIDIOC_CREATE_BUFS, &create);
+	if (ret)
+		return -errno;
+
+	*caps = create.capabilities;
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+#define MAX_PLANES	NX_V4L2_MAX_PLANES
 int nx_v4l2_qbuf(int fd, int type, int plane_num, int index, int *fds,
 		 int *sizes)
 {
@@ -1028,9 +1540,167 @@ int nx_v4l2_query_buf_mmap(int fd, int type, int index,
 	return ioctl(fd, VIDIOC_QUERYBUF, v4l2_buf);
 }
 
+/* export a mmap buffer as dmabuf, the caller closes dmabuf_fd */
+int nx_v4l2_expbuf_mmap(int fd, int type, int index, int *dmabuf_fd)
+{
+	struct v4l2_exportbuffer expbuf;
+	int ret;
+
+	if (get_type_category(type) == type_category_subdev)
+		return -EINVAL;
+
+	bzero(&expbuf, sizeof(expbuf));
+	expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	expbuf.index = index;
+	expbuf.plane = 0;
+	expbuf.flags = O_RDWR | O_CLOEXEC;
+	ret = ioctl(fd, VIDIOC_EXPBUF, &expbuf);
+	if (ret)
+		return ret;
+	*dmabuf_fd = expbuf.fd;
+	return 0;
+}
+
+/*
+ * queue a frame as part of a media request, see nx-v4l2-request.h
+ * -ENOTSUP when built against headers without the request api
+ */
+int nx_v4l2_qbuf_frame_request(int fd, int type, struct nx_v4l2_frame *frame,
+			       int request_fd)
+{
+#ifdef V4L2_BUF_FLAG_REQUEST_FD
+	struct v4l2_buffer v4l2_buf;
+	struct v4l2_plane planes[MAX_PLANES];
+	int i;
+
+	if (get_type_category(type) == type_category_subdev)
+		return -EINVAL;
+
+	if (frame->plane_num > MAX_PLANES) {
+		fprintf(stderr, "plane_num(%d) is over MAX_PLANES\n",
+			frame->plane_num);
+		return -EINVAL;
+	}
+
+	bzero(&v4l2_buf, sizeof(v4l2_buf));
+	v4l2_buf.memory = frame->memory;
+	v4l2_buf.index = frame->index;
+	v4l2_buf.flags = V4L2_BUF_FLAG_REQUEST_FD;
+	v4l2_buf.request_fd = request_fd;
+	if (frame->memory == V4L2_MEMORY_MMAP) {
+		v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	} else {
+		bzero(planes, sizeof(planes));
+		v4l2_buf.type = get_buf_type(type);
+		v4l2_buf.m.planes = planes;
+		v4l2_buf.length = frame->plane_num;
+		for (i = 0; i < frame->plane_num; i++) {
+			planes[i].m.fd = frame->fds[i];
+			planes[i].length = frame->sizes[i];
+		}
+	}
+
+	return ioctl(fd, VIDIOC_QBUF, &v4l2_buf);
+#else
+	return -ENOTSUP;
+#endif
+}
+
 int nx_v4l2_set_parm(int fd, int type, struct v4l2_streamparm *parm)
 {
 	uint32_t buf_type;
 	parm->type = get_buf_type(type);
 	return ioctl(fd, VIDIOC_S_PARM, parm);
 }
+
+int nx_v4l2_dqbuf_frame(int fd, int type, int plane_num,
+			struct nx_v4l2_frame *frame)
+{
+	int ret;
+	int i;
+	struct v4l2_buffer v4l2_buf;
+	struct v4l2_plane planes[MAX_PLANES];
+
+	if (get_type_category(type) == type_category_subdev)
+		return -EINVAL;
+
+	if (plane_num > MAX_PLANES) {
+		fprintf(stderr, "plane_num(%d) is over MAX_PLANES\n",
+			plane_num);
+		return -EINVAL;
+	}
+
+	bzero(&v4l2_buf, sizeof(v4l2_buf));
+	bzero(planes, sizeof(planes));
+	v4l2_buf.m.planes = planes;
+	v4l2_buf.type = get_buf_type(type);
+	v4l2_buf.memory = V4L2_MEMORY_DMABUF;
+	v4l2_buf.length = plane_num;
+
+	ret = ioctl(fd, VIDIOC_DQBUF, &v4l2_buf);
+	if (ret)
+		return ret;
+
+	bzero(frame, sizeof(*frame));
+	frame->index = v4l2_buf.index;
+	frame->memory = V4L2_MEMORY_DMABUF;
+	frame->plane_num = plane_num;
+	for (i = 0; i < plane_num; i++) {
+		frame->fds[i] = planes[i].m.fd;
+		frame->sizes[i] = planes[i].length;
+		frame->bytesused[i] = planes[i].bytesused;
+	}
+	frame->sequence = v4l2_buf.sequence;
+	memcpy(&frame->timestamp, &v4l2_buf.timestamp,
+	       sizeof(frame->timestamp));
+
+	return 0;
+}
+
+int nx_v4l2_dqbuf_mmap_frame(int fd, int type, struct nx_v4l2_frame *frame)
+{
+	int ret;
+	struct v4l2_buffer v4l2_buf;
+
+	if (get_type_category(type) == type_category_subdev)
+		return -EINVAL;
+
+	bzero(&v4l2_buf, sizeof(v4l2_buf));
+	v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	v4l2_buf.memory = V4L2_MEMORY_MMAP;
+
+	ret = ioctl(fd, VIDIOC_DQBUF, &v4l2_buf);
+	if (ret)
+		return ret;
+
+	bzero(frame, sizeof(*frame));
+	frame->index = v4l2_buf.index;
+	frame->memory = V4L2_MEMORY_MMAP;
+	frame->plane_num = 1;
+	frame->fds[0] = -1;
+	frame->sizes[0] = v4l2_buf.length;
+	frame->bytesused[0] = v4l2_buf.bytesused;
+	frame->sequence = v4l2_buf.sequence;
+	memcpy(&frame->timestamp, &v4l2_buf.timestamp,
+	       sizeof(frame->timestamp));
+
+	return 0;
+}
+
+int nx_v4l2_qbuf_frame(int fd, int type, struct nx_v4l2_frame *frame)
+{
+	int fds[MAX_PLANES];
+	int sizes[MAX_PLANES];
+	int i;
+
+	if (frame->memory == V4L2_MEMORY_MMAP)
+		return nx_v4l2_qbuf_mmap(fd, type, frame->index);
+
+	for (i = 0; i < frame->plane_num && i < MAX_PLANES; i++) {
+		fds[i] = frame->fds[i];
+		sizes[i] = frame->sizes[i];
+	}
+
+	return nx_v4l2_qbuf(fd, type, frame->plane_num, frame->index, fds,
+			    sizes);
+}
@@ -23,6 +23,11 @@
 #ifndef _NX_V4L2_H
 #define _NX_V4L2_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include <linux/videodev2.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,9 +42,41 @@ enum {
 	nx_v4l2_max
 };
 
+#define NX_V4L2_MAX_PLANES	3
+
+/* negotiated image format and its plane layout */
+struct nx_v4l2_format_info {
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	int plane_num;
+	uint32_t strides[NX_V4L2_MAX_PLANES];
+	uint32_t sizes[NX_V4L2_MAX_PLANES];
+};
+
+/*
+ * Descriptor of a dequeued buffer.
+ * fds are valid for V4L2_MEMORY_DMABUF and -1 for V4L2_MEMORY_MMAP.
+ * virt is never filled by the library, the caller who mapped the buffer
+ * sets it after dequeue if the consumer needs cpu access.
+ */
+struct nx_v4l2_frame {
+	int index;
+	uint32_t memory;
+	int plane_num;
+	int fds[NX_V4L2_MAX_PLANES];
+	void *virt[NX_V4L2_MAX_PLANES];
+	uint32_t sizes[NX_V4L2_MAX_PLANES];
+	uint32_t bytesused[NX_V4L2_MAX_PLANES];
+	uint32_t sequence;
+	struct timeval timestamp;
+};
+
+void nx_v4l2_enumerate(void);
 int nx_v4l2_open_device(int type, int module);
 void nx_v4l2_cleanup(void);
 bool nx_v4l2_is_mipi_camera(int module);
+int nx_v4l2_get_media_fd(int type, int module);
 int nx_v4l2_link(bool link, int module, int src_type, int src_pad,
 		 int sink_type, int sink_pad);
 int nx_v4l2_set_format(int fd, int type, uint32_t w, uint32_t h,
@@ -50,9 +87,20 @@ int nx_v4l2_set_crop(int fd, int type, uint32_t x, uint32_t y, uint32_t w,
 		     uint32_t h);
 int nx_v4l2_get_crop(int fd, int type, uint32_t *x, uint32_t *y, uint32_t *w,
 		     uint32_t *h);
+int nx_v4l2_set_pad_format(int fd, int type, int pad, uint32_t w, uint32_t h,
+			   uint32_t format);
+int nx_v4l2_get_pad_format(int fd, int type, int pad, uint32_t *w,
+			   uint32_t *h, uint32_t *format);
+int nx_v4l2_set_selection(int fd, int type, int pad, uint32_t target,
+			  uint32_t flags, struct v4l2_rect *rect);
+int nx_v4l2_get_selection(int fd, int type, int pad, uint32_t target,
+			  struct v4l2_rect *rect);
 int nx_v4l2_set_ctrl(int fd, int type, uint32_t ctrl_id, int value);
 int nx_v4l2_get_ctrl(int fd, int type, uint32_t ctrl_id, int *value);
+int nx_v4l2_set_ext_ctrls(int fd, int type, struct v4l2_ext_control *ctrls,
+			  int count);
 int nx_v4l2_reqbuf(int fd, int type, int count);
+int nx_v4l2_query_buf_caps(int fd, int type, uint32_t memory, uint32_t *caps);
 int nx_v4l2_qbuf(int fd, int type, int plane_num, int index, int *fds,
 		 int *sizes);
 int nx_v4l2_dqbuf(int fd, int type, int plane_num, int *index);
@@ -62,6 +110,14 @@ int nx_v4l2_streamon(int fd, int type);
 int nx_v4l2_streamoff(int fd, int type);
 int nx_v4l2_set_parm(int fd, int type, struct v4l2_streamparm *parm);
 
+/* API for frame descriptor */
+int nx_v4l2_dqbuf_frame(int fd, int type, int plane_num,
+			struct nx_v4l2_frame *frame);
+int nx_v4l2_dqbuf_mmap_frame(int fd, int type, struct nx_v4l2_frame *frame);
+int nx_v4l2_qbuf_frame(int fd, int type, struct nx_v4l2_frame *frame);
+int nx_v4l2_qbuf_frame_request(int fd, int type, struct nx_v4l2_frame *frame,
+			       int request_fd);
+
 /* API for mmap type */
 int nx_v4l2_set_format_mmap(int fd, int type, uint32_t w, uint32_t h,
 			    uint32_t format);
@@ -76,6 +132,7 @@ int nx_v4l2_streamon_mmap(int fd, int type);
 int nx_v4l2_streamoff_mmap(int fd, int type);
 int nx_v4l2_query_buf_mmap(int fd, int type, int index,
 			   struct v4l2_buffer *v4l2_buf);
+int nx_v4l2_expbuf_mmap(int fd, int type, int index, int *dmabuf_fd);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,674 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _NX_V4L2_HPP
+#define _NX_V4L2_HPP
+
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <utility>
+#include <vector>
+
+#include "nx-v4l2.h"
+
+/*
+ * Header only C++ wrapper of the video node api.
+ *
+ * Device owns a file descriptor, Stream owns the device and the buffer queue
+ * of it and Frame owns a dequeued buffer. All of them are move only and give
+ * their resource back when destroyed: the fd is closed, the queue is stopped
+ * and freed, a capture frame is queued again.
+ *
+ * Memory type, direction and plane count of a stream are template
+ * parameters, the v4l2_buffer of every index is prepared once so queue and
+ * dequeue are a copy and an ioctl without looking at the node type.
+ * Like nx_v4l2_*_mmap(), mmap streams use the single planar api and have
+ * one plane, dmabuf and userptr streams use the multi planar api.
+ *
+ * Errors are returned as negative errno, nothing throws.
+ */
+
+namespace nx_v4l2 {
+
+enum class Memory : uint32_t {
+	DMABUF = V4L2_MEMORY_DMABUF,
+	MMAP = V4L2_MEMORY_MMAP,
+	USERPTR = V4L2_MEMORY_USERPTR,
+};
+
+enum class Direction {
+	Capture,
+	Output,
+};
+
+namespace detail {
+
+template <Memory M, Direction D>
+struct queue_traits {
+	static constexpr bool mplane = true;
+	static constexpr uint32_t buf_type = D == Direction::Capture ?
+		V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE :
+		V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+};
+
+template <Direction D>
+struct queue_traits<Memory::MMAP, D> {
+	static constexpr bool mplane = false;
+	static constexpr uint32_t buf_type = D == Direction::Capture ?
+		V4L2_BUF_TYPE_VIDEO_CAPTURE : V4L2_BUF_TYPE_VIDEO_OUTPUT;
+};
+
+inline int xioctl(int fd, unsigned long req, void *arg)
+{
+	int ret;
+
+	do {
+		ret = ioctl(fd, req, arg);
+	} while (ret && errno == EINTR);
+
+	return ret ? -errno : 0;
+}
+
+} /* namespace detail */
+
+class Device {
+public:
+	Device() noexcept : fd_(-1) {}
+	/* takes over an opened fd */
+	explicit Device(int fd) noexcept : fd_(fd) {}
+	/* nx_v4l2_open_device(), check valid() */
+	Device(int type, int module) noexcept
+		: fd_(nx_v4l2_open_device(type, module)) {}
+	~Device() { reset(); }
+
+	Device(Device &&other) noexcept : fd_(other.release()) {}
+	Device &operator=(Device &&other) noexcept
+	{
+		if (this != &other)
+			reset(other.release());
+		return *this;
+	}
+	Device(const Device &) = delete;
+	Device &operator=(const Device &) = delete;
+
+	int fd() const noexcept { return fd_; }
+	bool valid() const noexcept { return fd_ >= 0; }
+	explicit operator bool() const noexcept { return valid(); }
+
+	int release() noexcept
+	{
+		int fd = fd_;
+
+		fd_ = -1;
+		return fd;
+	}
+
+	void reset(int fd = -1) noexcept
+	{
+		if (fd_ >= 0)
+			close(fd_);
+		fd_ = fd;
+	}
+
+	/* type is the nx_v4l2 node type as in nx-v4l2.h */
+	int set_format(int type, uint32_t w, uint32_t h, uint32_t format)
+	{
+		return nx_v4l2_set_format(fd_, type, w, h, format);
+	}
+
+	int set_crop(int type, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+	{
+		return nx_v4l2_set_crop(fd_, type, x, y, w, h);
+	}
+
+	int set_ctrl(int type, uint32_t id, int value)
+	{
+		return nx_v4l2_set_ctrl(fd_, type, id, value);
+	}
+
+	int get_ctrl(int type, uint32_t id, int *value)
+	{
+		return nx_v4l2_get_ctrl(fd_, type, id, value);
+	}
+
+private:
+	int fd_;
+};
+
+template <class S>
+class Frame {
+public:
+	Frame() noexcept : stream_(nullptr), index_(-1) {}
+	~Frame() { reset(); }
+
+	Frame(Frame &&other) noexcept { take(other); }
+	Frame &operator=(Frame &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			take(other);
+		}
+		return *this;
+	}
+	Frame(const Frame &) = delete;
+	Frame &operator=(const Frame &) = delete;
+
+	bool valid() const noexcept { return stream_ != nullptr; }
+	explicit operator bool() const noexcept { return valid(); }
+
+	int index() const noexcept { return index_; }
+	uint32_t sequence() const noexcept { return sequence_; }
+	const struct timeval &timestamp() const noexcept { return timestamp_; }
+	static constexpr int planes() noexcept { return S::plane_num; }
+
+	int fd(int plane) const noexcept
+	{
+		return stream_->buffer_fd(index_, plane);
+	}
+
+	void *data(int plane) const noexcept
+	{
+		return stream_->buffer_data(index_, plane);
+	}
+
+	uint32_t length(int plane) const noexcept
+	{
+		return stream_->buffer_length(index_, plane);
+	}
+
+	uint32_t bytesused(int plane) const noexcept
+	{
+		return bytesused_[plane];
+	}
+
+	/* descriptor for the C modules, the frame keeps the buffer */
+	void fill(struct nx_v4l2_frame *frame) const noexcept
+	{
+		int i;
+
+		memset(frame, 0, sizeof(*frame));
+		frame->index = index_;
+		frame->memory = S::memory;
+		frame->plane_num = S::plane_num;
+		for (i = 0; i < S::plane_num; i++) {
+			frame->fds[i] = fd(i);
+			frame->virt[i] = data(i);
+			frame->sizes[i] = length(i);
+			frame->bytesused[i] = bytesused_[i];
+		}
+		frame->sequence = sequence_;
+		frame->timestamp = timestamp_;
+	}
+
+	/*
+	 * Give the buffer back now instead of on destruction. A capture
+	 * frame is queued to be filled again, an output frame is queued
+	 * with bytesused by submit() or returned unused to the stream.
+	 */
+	int requeue() noexcept
+	{
+		S *stream = stream_;
+
+		if (!stream)
+			return 0;
+		stream_ = nullptr;
+		return stream->put(index_);
+	}
+
+	int submit(const uint32_t (&bytesused)[S::plane_num]) noexcept
+	{
+		S *stream = stream_;
+
+		static_assert(S::direction == Direction::Output,
+			      "capture frames are requeued, not submitted");
+		if (!stream)
+			return -EINVAL;
+		stream_ = nullptr;
+		return stream->queue(index_, bytesused);
+	}
+
+	void reset() noexcept { requeue(); }
+
+private:
+	friend S;
+
+	Frame(S *stream, const struct v4l2_buffer &buf) noexcept
+		: stream_(stream), index_(buf.index),
+		  sequence_(buf.sequence), timestamp_(buf.timestamp)
+	{
+		int i;
+
+		for (i = 0; i < S::plane_num; i++)
+			bytesused_[i] = S::mplane ? buf.m.planes[i].bytesused :
+				buf.bytesused;
+	}
+
+	void take(Frame &other) noexcept
+	{
+		stream_ = other.stream_;
+		index_ = other.index_;
+		sequence_ = other.sequence_;
+		timestamp_ = other.timestamp_;
+		memcpy(bytesused_, other.bytesused_, sizeof(bytesused_));
+		other.stream_ = nullptr;
+	}
+
+	S *stream_;
+	int index_;
+	uint32_t sequence_;
+	struct timeval timestamp_;
+	uint32_t bytesused_[S::plane_num];
+};
+
+/*
+ * Buffer queue of a video node.
+ *
+ * request() allocates the queue and maps mmap buffers, dmabuf and userptr
+ * buffers are given with set_buffer() before they are queued. A capture
+ * stream is filled with queue_all() and start(), frames from dequeue()
+ * are queued again when destroyed. An output stream hands out free buffers
+ * with acquire(), they are sent with Frame::submit().
+ *
+ * Frames point to their stream, it must not be moved or destroyed while
+ * frames are held.
+ */
+template <Memory M, Direction D = Direction::Capture, int Planes = 1>
+class Stream {
+	typedef detail::queue_traits<M, D> traits;
+
+public:
+	typedef Frame<Stream> frame_type;
+
+	static constexpr uint32_t memory = static_cast<uint32_t>(M);
+	static constexpr uint32_t buf_type = traits::buf_type;
+	static constexpr bool mplane = traits::mplane;
+	static constexpr Direction direction = D;
+	static constexpr int plane_num = Planes;
+
+	static_assert(Planes >= 1 && Planes <= NX_V4L2_MAX_PLANES,
+		      "invalid plane count");
+	static_assert(M != Memory::MMAP || Planes == 1,
+		      "mmap streams have a single plane");
+
+	Stream() noexcept : streaming_(false) {}
+	explicit Stream(Device &&dev) noexcept
+		: dev_(std::move(dev)), streaming_(false) {}
+	~Stream() { reset(); }
+
+	Stream(Stream &&other) noexcept { take(other); }
+	Stream &operator=(Stream &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			take(other);
+		}
+		return *this;
+	}
+	Stream(const Stream &) = delete;
+	Stream &operator=(const Stream &) = delete;
+
+	Device &device() noexcept { return dev_; }
+	int get_fd() const noexcept { return dev_.fd(); }
+	int count() const noexcept { return (int)bufs_.size(); }
+	bool streaming() const noexcept { return streaming_; }
+
+	int request(unsigned count)
+	{
+		struct v4l2_requestbuffers req;
+		unsigned i;
+		int ret;
+
+		free_buffers();
+
+		memset(&req, 0, sizeof(req));
+		req.count = count;
+		req.type = buf_type;
+		req.memory = memory;
+		ret = detail::xioctl(dev_.fd(), VIDIOC_REQBUFS, &req);
+		if (ret)
+			return ret;
+
+		bufs_.resize(req.count);
+		for (i = 0; i < req.count; i++) {
+			Buffer &b = bufs_[i];
+
+			b.buf.index = i;
+			b.buf.type = buf_type;
+			b.buf.memory = memory;
+			if (mplane)
+				b.buf.length = Planes;
+		}
+		free_.reserve(req.count);
+		for (i = 0; i < req.count; i++)
+			free_.push_back(i);
+
+		if (M == Memory::MMAP) {
+			ret = map_buffers();
+			if (ret)
+				free_buffers();
+		}
+
+		return ret;
+	}
+
+	int set_buffer(unsigned index, const int (&fds)[Planes],
+		       const uint32_t (&lengths)[Planes])
+	{
+		int i;
+
+		static_assert(M == Memory::DMABUF, "not a dmabuf stream");
+		if (index >= bufs_.size())
+			return -EINVAL;
+
+		for (i = 0; i < Planes; i++) {
+			bufs_[index].planes[i].m.fd = fds[i];
+			bufs_[index].planes[i].length = lengths[i];
+		}
+
+		return 0;
+	}
+
+	int set_buffer(unsigned index, void * const (&ptrs)[Planes],
+		       const uint32_t (&lengths)[Planes])
+	{
+		int i;
+
+		static_assert(M == Memory::USERPTR, "not a userptr stream");
+		if (index >= bufs_.size())
+			return -EINVAL;
+
+		for (i = 0; i < Planes; i++) {
+			bufs_[index].planes[i].m.userptr =
+				(unsigned long)ptrs[i];
+			bufs_[index].planes[i].length = lengths[i];
+		}
+
+		return 0;
+	}
+
+	/* capture, queue every buffer not held by a frame */
+	int queue_all()
+	{
+		int ret;
+
+		static_assert(D == Direction::Capture,
+			      "output buffers are queued by submit");
+		while (!free_.empty()) {
+			ret = queue(free_.back());
+			if (ret)
+				return ret;
+			free_.pop_back();
+		}
+
+		return 0;
+	}
+
+	int start()
+	{
+		uint32_t type = buf_type;
+		int ret;
+
+		ret = detail::xioctl(dev_.fd(), VIDIOC_STREAMON, &type);
+		if (!ret)
+			streaming_ = true;
+
+		return ret;
+	}
+
+	/* the queued buffers are free again, held frames stay valid */
+	int stop()
+	{
+		uint32_t type = buf_type;
+		unsigned i;
+		int ret;
+
+		if (!streaming_)
+			return 0;
+
+		ret = detail::xioctl(dev_.fd(), VIDIOC_STREAMOFF, &type);
+		streaming_ = false;
+		for (i = 0; i < bufs_.size(); i++) {
+			if (bufs_[i].queued) {
+				bufs_[i].queued = false;
+				free_.push_back(i);
+			}
+		}
+
+		return ret;
+	}
+
+	/* -EAGAIN when the node is non blocking and nothing is ready */
+	int dequeue(frame_type &frame)
+	{
+		struct v4l2_buffer buf;
+		struct v4l2_plane planes[Planes];
+		int ret;
+
+		memset(&buf, 0, sizeof(buf));
+		buf.type = buf_type;
+		buf.memory = memory;
+		if (mplane) {
+			memset(planes, 0, sizeof(planes));
+			buf.m.planes = planes;
+			buf.length = Planes;
+		}
+
+		ret = detail::xioctl(dev_.fd(), VIDIOC_DQBUF, &buf);
+		if (ret)
+			return ret;
+		if (buf.index >= bufs_.size())
+			return -EINVAL;
+
+		bufs_[buf.index].queued = false;
+		frame = frame_type(this, buf);
+
+		return 0;
+	}
+
+	/* output, a buffer which was never queued or came back */
+	int acquire(frame_type &frame)
+	{
+		struct v4l2_buffer buf;
+		struct v4l2_plane planes[Planes];
+
+		static_assert(D == Direction::Output,
+			      "capture frames come from dequeue");
+		if (free_.empty())
+			return dequeue(frame);
+
+		/* a free buffer has nothing in it yet */
+		memset(&buf, 0, sizeof(buf));
+		memset(planes, 0, sizeof(planes));
+		buf.index = free_.back();
+		if (mplane) {
+			buf.m.planes = planes;
+			buf.length = Planes;
+		}
+		free_.pop_back();
+		frame = frame_type(this, buf);
+
+		return 0;
+	}
+
+private:
+	friend frame_type;
+
+	struct Buffer {
+		Buffer() : queued(false), virt(nullptr)
+		{
+			memset(&buf, 0, sizeof(buf));
+			memset(planes, 0, sizeof(planes));
+		}
+
+		struct v4l2_buffer buf;
+		struct v4l2_plane planes[Planes];
+		bool queued;
+		void *virt;
+	};
+
+	int queue(unsigned index)
+	{
+		Buffer &b = bufs_[index];
+		struct v4l2_buffer buf = b.buf;
+		struct v4l2_plane planes[Planes];
+		int ret;
+
+		if (mplane) {
+			memcpy(planes, b.planes, sizeof(planes));
+			buf.m.planes = planes;
+		}
+
+		ret = detail::xioctl(dev_.fd(), VIDIOC_QBUF, &buf);
+		if (!ret)
+			b.queued = true;
+
+		return ret;
+	}
+
+	int queue(unsigned index, const uint32_t (&bytesused)[Planes])
+	{
+		Buffer &b = bufs_[index];
+		int i;
+
+		if (mplane)
+			for (i = 0; i < Planes; i++)
+				b.planes[i].bytesused = bytesused[i];
+		else
+			b.buf.bytesused = bytesused[0];
+
+		return queue(index);
+	}
+
+	/* called by frames, capture buffers go back to the driver */
+	int put(unsigned index)
+	{
+		if (D == Direction::Capture)
+			return queue(index);
+
+		free_.push_back(index);
+		return 0;
+	}
+
+	int buffer_fd(int index, int plane) const noexcept
+	{
+		return M == Memory::DMABUF ?
+			bufs_[index].planes[plane].m.fd : -1;
+	}
+
+	void *buffer_data(int index, int plane) const noexcept
+	{
+		if (M == Memory::MMAP)
+			return bufs_[index].virt;
+		if (M == Memory::USERPTR)
+			return (void *)bufs_[index].planes[plane].m.userptr;
+		return nullptr;
+	}
+
+	uint32_t buffer_length(int index, int plane) const noexcept
+	{
+		return mplane ? bufs_[index].planes[plane].length :
+			bufs_[index].buf.length;
+	}
+
+	int map_buffers()
+	{
+		unsigned i;
+		void *virt;
+		int ret;
+
+		for (i = 0; i < bufs_.size(); i++) {
+			Buffer &b = bufs_[i];
+
+			ret = detail::xioctl(dev_.fd(), VIDIOC_QUERYBUF,
+					     &b.buf);
+			if (ret)
+				return ret;
+
+			virt = mmap(nullptr, b.buf.length,
+				    PROT_READ | PROT_WRITE, MAP_SHARED,
+				    dev_.fd(), b.buf.m.offset);
+			if (virt == MAP_FAILED)
+				return -errno;
+			b.virt = virt;
+		}
+
+		return 0;
+	}
+
+	void free_buffers()
+	{
+		struct v4l2_requestbuffers req;
+		unsigned i;
+
+		if (bufs_.empty())
+			return;
+
+		stop();
+		for (i = 0; i < bufs_.size(); i++)
+			if (bufs_[i].virt)
+				munmap(bufs_[i].virt, bufs_[i].buf.length);
+		bufs_.clear();
+		free_.clear();
+
+		memset(&req, 0, sizeof(req));
+		req.type = buf_type;
+		req.memory = memory;
+		detail::xioctl(dev_.fd(), VIDIOC_REQBUFS, &req);
+	}
+
+	void reset()
+	{
+		if (dev_.valid())
+			free_buffers();
+		dev_.reset();
+	}
+
+	void take(Stream &other) noexcept
+	{
+		dev_ = std::move(other.dev_);
+		bufs_ = std::move(other.bufs_);
+		free_ = std::move(other.free_);
+		streaming_ = other.streaming_;
+		other.bufs_.clear();
+		other.free_.clear();
+		other.streaming_ = false;
+	}
+
+	Device dev_;
+	std::vector<Buffer> bufs_;
+	std::vector<unsigned> free_;
+	bool streaming_;
+};
+
+template <int Planes = 1>
+using DmabufCapture = Stream<Memory::DMABUF, Direction::Capture, Planes>;
+template <int Planes = 1>
+using UserptrCapture = Stream<Memory::USERPTR, Direction::Capture, Planes>;
+using MmapCapture = Stream<Memory::MMAP, Direction::Capture, 1>;
+
+} /* namespace nx_v4l2 */
+
+#endif
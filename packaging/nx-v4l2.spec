@@ -43,14 +43,41 @@ find %{buildroot} -type f -name "*.la" -delete
 mkdir -p %{buildroot}/usr/include
 cp %{_builddir}/%{name}-%{version}/media-bus-format.h %{buildroot}/usr/include
 cp %{_builddir}/%{name}-%{version}/nx-v4l2.h %{buildroot}/usr/include
+cp %{_builddir}/%{name}-%{version}/nx-v4l2.hpp %{buildroot}/usr/include
 
 %files
 %{_libdir}/libnx_v4l2.so
 %{_libdir}/libnx_v4l2.so.*
+%{_bindir}/nx-v4l2-shared
+%{_bindir}/nx-v4l2-share-cat
+%{_bindir}/nx-v4l2-metrics
 %license LICENSE.LGPLv2+
 
 %files devel
 %{_includedir}/media-bus-format.h
 %{_includedir}/nx-v4l2.h
+%{_includedir}/nx-v4l2.hpp
+%{_includedir}/nx-v4l2-recorder.h
+%{_includedir}/nx-v4l2-stream.h
+%{_includedir}/nx-v4l2-raw.h
+%{_includedir}/nx-v4l2-convert.h
+%{_includedir}/nx-v4l2-scaler.h
+%{_includedir}/nx-v4l2-view.h
+%{_includedir}/nx-v4l2-stats.h
+%{_includedir}/nx-v4l2-3a.h
+%{_includedir}/nx-v4l2-caps.h
+%{_includedir}/nx-v4l2-layout.h
+%{_includedir}/nx-v4l2-mm.h
+%{_includedir}/nx-v4l2-mode.h
+%{_includedir}/nx-v4l2-fanout.h
+%{_includedir}/nx-v4l2-share.h
+%{_includedir}/nx-v4l2-sync.h
+%{_includedir}/nx-v4l2-pair.h
+%{_includedir}/nx-v4l2-bringup.h
+%{_includedir}/nx-v4l2-watchdog.h
+%{_includedir}/nx-v4l2-metrics.h
+%{_includedir}/nx-v4l2-request.h
+%{_includedir}/nx-v4l2-m2m.h
+%{_includedir}/nx-v4l2-chain.h
 %{_includedir}/mm_types.h
 %license LICENSE.LGPLv2+
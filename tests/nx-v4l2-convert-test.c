@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Conversions into buffers sized by nx_v4l2_image_setup() at odd sizes, with
+ * a guard after every buffer, on every kernel set the cpu supports.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nx-v4l2-convert.h"
+
+#define GUARD_SIZE	64
+#define GUARD_BYTE	0xa5
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s\n", __FILE__,	\
+				__LINE__, #cond);			\
+			return 1;					\
+		}							\
+	} while (0)
+
+static const struct {
+	uint32_t src;
+	uint32_t dst;
+} conversions[] = {
+	{ V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12 },
+	{ V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12 },
+	{ V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_NV12 },
+	{ V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB24 },
+	{ V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGBA32 },
+};
+
+static const uint32_t sizes[][2] = {
+	{ 1, 1 }, { 3, 1 }, { 17, 3 }, { 33, 5 }, { 65, 7 },
+};
+
+static uint8_t *alloc_image(struct nx_v4l2_image *img, uint32_t format,
+			    uint32_t w, uint32_t h, size_t *size)
+{
+	uint8_t *buf;
+	size_t i;
+
+	*size = nx_v4l2_image_setup(NULL, format, w, h, NULL);
+	if (!*size)
+		return NULL;
+
+	buf = malloc(*size + GUARD_SIZE);
+	if (!buf)
+		return NULL;
+
+	for (i = 0; i < *size; i++)
+		buf[i] = (uint8_t)(i * 7 + 3);
+	memset(buf + *size, GUARD_BYTE, GUARD_SIZE);
+	nx_v4l2_image_setup(img, format, w, h, buf);
+	return buf;
+}
+
+static int guard_intact(const uint8_t *buf, size_t size)
+{
+	int i;
+
+	for (i = 0; i < GUARD_SIZE; i++)
+		if (buf[size + i] != GUARD_BYTE)
+			return 0;
+	return 1;
+}
+
+static int run(uint32_t w, uint32_t h)
+{
+	struct nx_v4l2_image src, dst;
+	uint8_t *sbuf, *dbuf;
+	size_t ssize, dsize;
+	size_t i;
+
+	for (i = 0; i < sizeof(conversions) / sizeof(conversions[0]); i++) {
+		sbuf = alloc_image(&src, conversions[i].src, w, h, &ssize);
+		dbuf = alloc_image(&dst, conversions[i].dst, w, h, &dsize);
+		CHECK(sbuf && dbuf);
+
+		CHECK(nx_v4l2_convert(&src, &dst, NX_V4L2_COLOR_BT601) == 0);
+		CHECK(guard_intact(sbuf, ssize));
+		CHECK(guard_intact(dbuf, dsize));
+
+		free(sbuf);
+		free(dbuf);
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	struct nx_v4l2_image img;
+	int simd;
+	size_t i;
+
+	/* a UV row of an odd width still carries a pair for the last pixel */
+	CHECK(nx_v4l2_image_setup(&img, V4L2_PIX_FMT_NV12, 17, 3, NULL) ==
+	      17 * 3 + 18 * 2);
+	CHECK(img.strides[1] == 18);
+
+	for (simd = NX_V4L2_SIMD_SCALAR; simd <= NX_V4L2_SIMD_NEON; simd++) {
+		if (nx_v4l2_convert_set_simd(simd))
+			continue;
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+			CHECK(run(sizes[i][0], sizes[i][1]) == 0);
+	}
+
+	return 0;
+}
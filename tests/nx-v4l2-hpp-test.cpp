@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Output path of nx-v4l2.hpp against an ioctl shim: buffers handed out by
+ * acquire() before and after they went through the queue.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <fcntl.h>
+
+#include <deque>
+
+#include "nx-v4l2.hpp"
+
+struct queued_buf {
+	uint32_t index;
+	uint32_t bytesused[VIDEO_MAX_PLANES];
+};
+
+static std::deque<queued_buf> queued;
+
+/* the header only wrapper calls ioctl(), this one takes its place */
+extern "C" int ioctl(int fd, unsigned long req, ...)
+{
+	struct v4l2_requestbuffers *reqbufs;
+	struct v4l2_buffer *buf;
+	struct queued_buf q;
+	va_list ap;
+	void *arg;
+	uint32_t i;
+
+	(void)fd;
+	va_start(ap, req);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	switch (req) {
+	case VIDIOC_REQBUFS:
+		reqbufs = (struct v4l2_requestbuffers *)arg;
+		if (reqbufs->count > 4)
+			reqbufs->count = 4;
+		return 0;
+	case VIDIOC_STREAMON:
+	case VIDIOC_STREAMOFF:
+		return 0;
+	case VIDIOC_QBUF:
+		buf = (struct v4l2_buffer *)arg;
+		q.index = buf->index;
+		for (i = 0; i < buf->length; i++)
+			q.bytesused[i] = buf->m.planes[i].bytesused;
+		queued.push_back(q);
+		return 0;
+	case VIDIOC_DQBUF:
+		buf = (struct v4l2_buffer *)arg;
+		if (queued.empty()) {
+			errno = EAGAIN;
+			return -1;
+		}
+		q = queued.front();
+		queued.pop_front();
+		buf->index = q.index;
+		for (i = 0; i < buf->length; i++)
+			buf->m.planes[i].bytesused = q.bytesused[i];
+		return 0;
+	default:
+		errno = ENOTTY;
+		return -1;
+	}
+}
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s\n", __FILE__,	\
+				__LINE__, #cond);			\
+			return 1;					\
+		}							\
+	} while (0)
+
+int main(void)
+{
+	typedef nx_v4l2::Stream<nx_v4l2::Memory::DMABUF,
+				nx_v4l2::Direction::Output, 2> stream_type;
+	stream_type stream(nx_v4l2::Device(open("/dev/null", O_RDWR)));
+	stream_type::frame_type frame;
+	const uint32_t lengths[2] = { 4096, 2048 };
+	const uint32_t used[2] = { 1000, 500 };
+	int i;
+
+	CHECK(stream.request(4) == 0);
+	CHECK(stream.count() == 4);
+	for (i = 0; i < stream.count(); i++) {
+		const int fds[2] = { 100 + i, 200 + i };
+
+		CHECK(stream.set_buffer(i, fds, lengths) == 0);
+	}
+	CHECK(stream.start() == 0);
+
+	/* never queued buffers */
+	for (i = 0; i < stream.count(); i++) {
+		CHECK(stream.acquire(frame) == 0);
+		CHECK(frame.valid());
+		CHECK(frame.bytesused(0) == 0 && frame.bytesused(1) == 0);
+		CHECK(frame.fd(1) == 200 + frame.index());
+		CHECK(frame.length(0) == 4096);
+		CHECK(frame.submit(used) == 0);
+		CHECK(!frame.valid());
+	}
+	CHECK(queued.size() == 4);
+
+	/* buffers coming back from the driver */
+	CHECK(stream.acquire(frame) == 0);
+	CHECK(frame.bytesused(0) == 1000 && frame.bytesused(1) == 500);
+
+	/* returned unused, handed out again without a dequeue */
+	frame.reset();
+	CHECK(queued.size() == 3);
+	CHECK(stream.acquire(frame) == 0);
+	CHECK(frame.bytesused(0) == 0);
+	CHECK(queued.size() == 3);
+
+	return 0;
+}
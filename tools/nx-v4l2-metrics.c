@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Prints the metrics registries(nx-v4l2-metrics.h) found in /dev/shm as a
+ * table or in the Prometheus text exposition format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-metrics.h"
+
+#define METRICS_DIR	"/dev/shm"
+
+static void print_value(const struct nx_v4l2_metric *m)
+{
+	if (m->scale > 1)
+		printf("%.3f", (double)m->value / m->scale);
+	else
+		printf("%lld", (long long)m->value);
+}
+
+static void print_table(const char *name,
+			const struct nx_v4l2_metrics_header *h,
+			const struct nx_v4l2_metric *entries, int count)
+{
+	int i;
+
+	printf("%s (pid %u)\n", name, h->pid);
+	for (i = 0; i < count; i++) {
+		printf("  %-32s %-24s ", entries[i].name, entries[i].labels);
+		print_value(&entries[i]);
+		printf("\n");
+	}
+}
+
+struct sample {
+	const char *registry;
+	struct nx_v4l2_metric m;
+};
+
+/* samples of every registry, prometheus wants each family in one block */
+struct samples {
+	struct sample *s;
+	int num;
+	int cap;
+};
+
+static const struct {
+	const char *name;
+	const char *help;
+} helps[] = {
+	{ "nx_v4l2_frames_total", "Frames dequeued." },
+	{ "nx_v4l2_dropped_frames_total", "Frames lost in sequence gaps." },
+	{ "nx_v4l2_fps", "Smoothed frame rate." },
+	{ "nx_v4l2_queued_buffers", "Buffers queued to the driver." },
+	{ "nx_v4l2_dequeue_latency_us",
+	  "Frame timestamp to dequeue of the last frame." },
+	{ "nx_v4l2_dequeue_latency_us_sum",
+	  "Frame timestamp to dequeue summed over all frames." },
+	{ "nx_v4l2_ioctl_errors_total", "Failed stream operations." },
+	{ "nx_v4l2_pinned_bytes", "Bytes of the allocated buffers." },
+};
+
+static const char *get_help(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(helps) / sizeof(helps[0]); i++)
+		if (!strcmp(helps[i].name, name))
+			return helps[i].help;
+
+	return "nx-v4l2 metric.";
+}
+
+static int add_samples(struct samples *all, const char *registry,
+		       const struct nx_v4l2_metric *entries, int count)
+{
+	struct sample *s;
+	int i;
+
+	if (all->num + count > all->cap) {
+		s = realloc(all->s, sizeof(*s) * (all->num + count));
+		if (!s)
+			return -ENOMEM;
+		all->s = s;
+		all->cap = all->num + count;
+	}
+
+	for (i = 0; i < count; i++) {
+		s = &all->s[all->num++];
+		s->registry = registry;
+		s->m = entries[i];
+	}
+
+	return 0;
+}
+
+static void print_prometheus(const struct samples *all)
+{
+	const struct nx_v4l2_metric *m;
+	bool *done;
+	int i, j;
+
+	done = calloc(all->num ? all->num : 1, sizeof(*done));
+	if (!done)
+		return;
+
+	for (i = 0; i < all->num; i++) {
+		if (done[i])
+			continue;
+
+		m = &all->s[i].m;
+		printf("# HELP %s %s\n", m->name, get_help(m->name));
+		printf("# TYPE %s %s\n", m->name,
+		       m->kind == NX_V4L2_METRIC_COUNTER ? "counter" : "gauge");
+
+		for (j = i; j < all->num; j++) {
+			m = &all->s[j].m;
+			if (done[j] || strcmp(m->name, all->s[i].m.name))
+				continue;
+			done[j] = true;
+			printf("%s{registry=\"%s\"%s%s} ", m->name,
+			       all->s[j].registry, m->labels[0] ? "," : "",
+			       m->labels);
+			print_value(m);
+			printf("\n");
+		}
+	}
+
+	free(done);
+}
+
+/* prints the table of a registry or adds its samples to all */
+static int dump(const char *name, struct samples *all)
+{
+	const struct nx_v4l2_metrics_header *h;
+	struct nx_v4l2_metric *entries;
+	char path[512];
+	struct stat st;
+	void *base;
+	int count;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s%s", METRICS_DIR,
+		 NX_V4L2_METRICS_PREFIX, name);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "failed to open %s\n", path);
+		return -errno;
+	}
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*h)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -errno;
+
+	h = base;
+	if (h->header_size + (uint64_t)h->entry_size * h->capacity >
+	    (uint64_t)st.st_size) {
+		fprintf(stderr, "%s: truncated\n", path);
+		munmap(base, st.st_size);
+		return -EINVAL;
+	}
+
+	entries = calloc(h->capacity ? h->capacity : 1, sizeof(*entries));
+	if (!entries) {
+		munmap(base, st.st_size);
+		return -ENOMEM;
+	}
+
+	count = nx_v4l2_metrics_read(h, entries, h->capacity);
+	if (count == -EAGAIN)
+		fprintf(stderr, "%s: busy, skipped\n", path);
+	else if (count < 0)
+		fprintf(stderr, "%s: bad header\n", path);
+	else if (all)
+		count = add_samples(all, name, entries, count);
+	else
+		print_table(name, h, entries, count);
+
+	free(entries);
+	munmap(base, st.st_size);
+
+	return count < 0 ? count : 0;
+}
+
+static int dump_all(struct samples *all, char ***names, int *name_num)
+{
+	size_t len = strlen(NX_V4L2_METRICS_PREFIX);
+	struct dirent *ent;
+	char **n;
+	DIR *dir;
+	int ret = 0;
+
+	dir = opendir(METRICS_DIR);
+	if (!dir)
+		return -errno;
+
+	while ((ent = readdir(dir))) {
+		if (strncmp(ent->d_name, NX_V4L2_METRICS_PREFIX, len))
+			continue;
+		/* samples point at the registry name until printed */
+		n = realloc(*names, sizeof(*n) * (*name_num + 1));
+		if (!n) {
+			ret = -ENOMEM;
+			break;
+		}
+		*names = n;
+		n[*name_num] = strdup(ent->d_name + len);
+		if (!n[*name_num]) {
+			ret = -ENOMEM;
+			break;
+		}
+		if (dump(n[(*name_num)++], all))
+			ret = -EINVAL;
+	}
+	closedir(dir);
+
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] [registry...]\n"
+		"  -p        prometheus text format\n"
+		"  -i sec    repeat every sec seconds\n"
+		"all registries in %s are printed when none is given\n",
+		name, METRICS_DIR);
+}
+
+int main(int argc, char *argv[])
+{
+	bool prometheus = false;
+	struct samples all;
+	char **names;
+	int name_num;
+	int interval = 0;
+	int ret;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "pi:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			prometheus = true;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	do {
+		bzero(&all, sizeof(all));
+		names = NULL;
+		name_num = 0;
+
+		ret = 0;
+		if (optind == argc)
+			ret = dump_all(prometheus ? &all : NULL, &names,
+				       &name_num);
+		for (i = optind; i < argc; i++)
+			if (dump(argv[i], prometheus ? &all : NULL))
+				ret = -EINVAL;
+		if (prometheus)
+			print_prometheus(&all);
+		fflush(stdout);
+
+		free(all.s);
+		for (i = 0; i < name_num; i++)
+			free(names[i]);
+		free(names);
+
+		if (interval)
+			sleep(interval);
+	} while (interval);
+
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Prints the frames received from nx-v4l2-shared, the first byte of the
+ * first plane and the delivery latency.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <getopt.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-share.h"
+
+#define DEFAULT_SOCKET	"/tmp/nx-v4l2-share"
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -s path   socket path(default %s)\n"
+		"  -i id     stream id(default 0)\n"
+		"  -d depth  frames held at most(default 2)\n"
+		"  -n count  frames to receive(default 100)\n"
+		"  -w ms     time a frame is held before release(default 0)\n",
+		name, DEFAULT_SOCKET);
+}
+
+int main(int argc, char *argv[])
+{
+	struct nx_v4l2_share_client *client;
+	const struct nx_v4l2_format_info *fmt;
+	struct nx_v4l2_frame frame;
+	const char *path = DEFAULT_SOCKET;
+	struct pollfd pfd;
+	uint64_t ts;
+	int depth = 2;
+	int count = 100;
+	int hold_ms = 0;
+	int id = 0;
+	int ret = 0;
+	int opt;
+	int n;
+
+	while ((opt = getopt(argc, argv, "s:i:d:n:w:h")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+		case 'i':
+			id = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'w':
+			hold_ms = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	client = nx_v4l2_share_client_connect(path, id, depth);
+	if (!client)
+		return 1;
+
+	fmt = nx_v4l2_share_client_get_format(client);
+	printf("stream %d: %ux%u %.4s, %d planes\n", id, fmt->width,
+	       fmt->height, (const char *)&fmt->format, fmt->plane_num);
+
+	pfd.fd = nx_v4l2_share_client_get_fd(client);
+	pfd.events = POLLIN;
+	for (n = 0; n < count; ) {
+		ret = nx_v4l2_share_client_acquire(client, &frame);
+		if (ret == -EAGAIN) {
+			if (poll(&pfd, 1, 1000) <= 0) {
+				fprintf(stderr, "no frame for 1s\n");
+				ret = -ETIMEDOUT;
+				break;
+			}
+			continue;
+		}
+		if (ret) {
+			fprintf(stderr, "failed to acquire(%d)\n", ret);
+			break;
+		}
+
+		ts = (uint64_t)frame.timestamp.tv_sec * 1000000 +
+		     frame.timestamp.tv_usec;
+		printf("seq %u index %d byte %d latency %lluus\n",
+		       frame.sequence, frame.index,
+		       frame.virt[0] ? *(uint8_t *)frame.virt[0] : -1,
+		       (unsigned long long)(now_us() - ts));
+
+		if (hold_ms)
+			usleep(hold_ms * 1000);
+		ret = nx_v4l2_share_client_release(client, &frame);
+		if (ret)
+			break;
+		n++;
+	}
+
+	nx_v4l2_share_client_close(client);
+
+	return ret ? 1 : 0;
+}
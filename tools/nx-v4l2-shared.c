@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2016 Nexell Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Shares the frames of a clipper/decimator video node or of a simulated
+ * source with other processes, see nx-v4l2-share.h.
+ *
+ * The media pipeline(links, formats) must be configured before, the node
+ * is streamed with mmap buffers which are exported to the clients.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+
+#include <linux/videodev2.h>
+
+#include "nx-v4l2.h"
+#include "nx-v4l2-stream.h"
+#include "nx-v4l2-share.h"
+
+#define DEFAULT_SOCKET	"/tmp/nx-v4l2-share"
+
+static volatile sig_atomic_t quit;
+
+/* quit holds the signal which stopped the server */
+static void on_signal(int sig)
+{
+	quit = sig;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -s path    socket path(default %s)\n"
+		"  -m module  clipper module(default 0)\n"
+		"  -d         use decimator instead of clipper\n"
+		"  -c count   buffer count(default 4)\n"
+		"  -S WxH     simulated source instead of a device\n"
+		"  -f fps     frame rate of the simulated source(default 30)\n",
+		name, DEFAULT_SOCKET);
+}
+
+int main(int argc, char *argv[])
+{
+	struct nx_v4l2_share_server *server;
+	struct nx_v4l2_stream *stream;
+	const char *path = DEFAULT_SOCKET;
+	int type = nx_clipper_video;
+	uint32_t width = 0, height = 0;
+	uint32_t fps = 30;
+	int module = 0;
+	int count = 4;
+	int fd = -1;
+	int ret;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:m:dc:S:f:h")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+		case 'm':
+			module = atoi(optarg);
+			break;
+		case 'd':
+			type = nx_decimator_video;
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'S':
+			if (sscanf(optarg, "%ux%u", &width, &height) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'f':
+			fps = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (width) {
+		stream = nx_v4l2_share_sim_create(V4L2_PIX_FMT_YUV420, width,
+						  height, count, fps);
+	} else {
+		fd = nx_v4l2_open_device(type, module);
+		if (fd < 0) {
+			fprintf(stderr, "failed to open video node of module %d\n",
+				module);
+			return 1;
+		}
+		stream = nx_v4l2_stream_create(fd, type, V4L2_MEMORY_MMAP,
+					       count);
+	}
+	if (!stream)
+		return 1;
+
+	server = nx_v4l2_share_server_create(path);
+	if (!server) {
+		nx_v4l2_stream_destroy(stream);
+		return 1;
+	}
+
+	ret = nx_v4l2_share_server_add_stream(server, 0, stream);
+	if (!ret)
+		ret = nx_v4l2_stream_start(stream);
+	if (ret) {
+		fprintf(stderr, "failed to start stream(%d)\n", ret);
+		goto done;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("sharing %ux%u on %s\n", stream->fmt.width, stream->fmt.height,
+	       path);
+	while (!quit) {
+		ret = nx_v4l2_share_server_process(server, 100);
+		if (ret < 0) {
+			fprintf(stderr, "failed to process(%d)\n", ret);
+			break;
+		}
+	}
+	if (quit)
+		printf("stopped by signal %d\n", (int)quit);
+
+	nx_v4l2_stream_stop(stream);
+
+done:
+	nx_v4l2_share_server_destroy(server);
+	nx_v4l2_stream_destroy(stream);
+	if (fd >= 0)
+		close(fd);
+
+	return ret < 0 ? 1 : 0;
+}